@@ -15,7 +15,21 @@ SOURCES += \
     fieldencode.c \
     floatspecial.c \
     OrionComm.c \
+    OrionCommConfig.c \
+    OrionCommDispatch.c \
+    OrionCommDiscovery.c \
+    OrionCommEventLoop.c \
     OrionCommLinux.c \
+    OrionCommLog.c \
+    OrionCommPipe.c \
+    OrionCommQueue.c \
+    OrionCommRequest.c \
+    OrionCommSched.c \
+    OrionCommShm.c \
+    OrionCommStats.c \
+    OrionCommSupervise.c \
+    OrionCommUdp.c \
+    OrionCommUring.c \
     OrionCommWindows.c \
     OrionPublicPacket.c \
     scaleddecode.c \
@@ -26,6 +40,21 @@ HEADERS += \
     fieldencode.h \
     floatspecial.h \
     OrionComm.h \
+    OrionCommConfig.h \
+    OrionCommDispatch.h \
+    OrionCommDiscovery.h \
+    OrionCommEventLoop.h \
+    OrionCommLog.h \
+    OrionCommPipe.h \
+    OrionCommPrivate.h \
+    OrionCommQueue.h \
+    OrionCommRequest.h \
+    OrionCommSched.h \
+    OrionCommShm.h \
+    OrionCommStats.h \
+    OrionCommSupervise.h \
+    OrionCommUdp.h \
+    OrionCommUring.h \
     OrionPublicPacket.h \
     scaleddecode.h \
     scaledencode.h
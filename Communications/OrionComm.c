@@ -1,7 +1,26 @@
 #include "OrionComm.h"
+#include "OrionCommLog.h"
 
+#include <stdlib.h>
+
+static BOOL OpenFromArgs(int *pArgc, char ***pArgv);
 
 BOOL OrionCommOpen(int *pArgc, char ***pArgv)
+{
+    // Connect to the gimbal (or recording) the user asked for
+    BOOL Result = OpenFromArgs(pArgc, pArgv);
+
+#if defined(__linux__) || defined(__APPLE__)
+    // If ORION_RECORD names a file, record everything we receive from here on into it
+    if (Result && (getenv("ORION_RECORD") != NULL))
+        OrionCommStartRecording(getenv("ORION_RECORD"));
+#endif // __linux__ || __APPLE__
+
+    return Result;
+
+}// OrionCommOpen
+
+static BOOL OpenFromArgs(int *pArgc, char ***pArgv)
 {
     // If there are at least two arguments, and the first looks like a serial port or IP
     if (*pArgc >= 2)
@@ -26,9 +45,24 @@ BOOL OrionCommOpen(int *pArgc, char ***pArgv)
             // Try connecting to a gimbal at this IP
             return OrionCommOpenNetworkIp((*pArgv)[0]);
         }
+#if defined(__linux__) || defined(__APPLE__)
+        // Recording...?
+        else if (OrionLogPathValid((*pArgv)[1]))
+        {
+            // Play back in real time unless ORION_REPLAY_SPEED says otherwise (0 for as fast as possible)
+            const char *pSpeed = getenv("ORION_REPLAY_SPEED");
+
+            // Decrement the number of arguments and push the pointer up one arg
+            (*pArgc)--;
+            (*pArgv) = &(*pArgv)[1];
+
+            // Try opening the recording
+            return OrionCommOpenReplay((*pArgv)[0], (pSpeed != NULL) ? atof(pSpeed) : 1.0);
+        }
+#endif // __linux__ || __APPLE__
     }
 
     // If we haven't connected any other way, try using network broadcast
     return OrionCommOpenNetwork();
 
-}// OrionCommOpen
+}// OpenFromArgs
@@ -14,12 +14,24 @@
 #define UDP_OUT_PORT        8745
 #define UDP_IN_PORT         8746
 #define TCP_PORT            8747
+#define UDP_TELEMETRY_PORT  8748
+
+// Size of the buffer that OrionCommReceive reads incoming data into
+#define ORION_COMM_RX_BUFFER_SIZE   65536
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+// Receive path counters, used to measure how many syscalls each packet costs
+typedef struct
+{
+    UInt32 ReadCalls;   // Number of read calls made by OrionCommReceive
+    UInt32 Bytes;       // Total number of bytes returned by those calls
+    UInt32 Packets;     // Total number of packets returned by OrionCommReceive
+} OrionCommRxStats_t;
+
 // Macro to maintain backwards compatibility
 #define OrionCommOpenNetwork(void) OrionCommOpenNetworkIp("255.255.255.255")
 
@@ -31,7 +43,68 @@ BOOL OrionCommSerialPathValid(const char *pPath);
 void OrionCommClose(void);
 BOOL OrionCommSend(const OrionPkt_t *pPkt);
 BOOL OrionCommReceive(OrionPkt_t *pPkt);
+BOOL OrionCommReceiveTimeout(OrionPkt_t *pPkt, UInt32 TimeoutUs);
+BOOL OrionCommWaitFor(OrionPkt_t *pPkt, UInt8 ID, UInt32 TimeoutUs);
 BOOL OrionCommIsOpen(void);
+void OrionCommGetRxStats(OrionCommRxStats_t *pStats, BOOL Reset);
+
+#if defined(__linux__) || defined(__APPLE__)
+
+// A single link to a single gimbal. Each connection has its own file descriptor, receive buffer
+//  and parser state, so any number of gimbals can be serviced at once, each from its own thread
+//  if need be. The OrionComm functions above all operate on a default connection.
+typedef struct OrionConn_s OrionConn_t;
+
+// A received packet left in place in the connection's receive buffer rather than copied out. The
+//  packet pointer can be handed straight to the generated decode functions, but only its header,
+//  data and checksum bytes are valid, and only until the next receive call on that connection.
+//  Use OrionPktViewCopy to hold on to a packet for longer.
+typedef struct
+{
+    const OrionPkt_t *pPkt;     // The packet, as it appeared on the wire
+    UInt32 Size;                // Number of bytes the packet occupies on the wire
+    UInt64 TimeUs;              // When the packet's first byte arrived, on the OrionCommGetTimeUs clock
+} OrionPktView_t;
+
+// Send path counters, used to tune outbound batching
+typedef struct
+{
+    UInt32 WriteCalls;  // Number of write calls made to the link
+    UInt32 Bytes;       // Total number of bytes written by those calls
+    UInt32 Packets;     // Total number of packets sent
+    UInt32 Flushes;     // Number of batches of packets flushed to the link
+    UInt32 Segments;    // Number of TCP segments carrying data, or 0 if the link isn't a TCP socket
+} OrionCommTxStats_t;
+
+OrionConn_t *OrionConnOpenSerial(const char *pPath);
+OrionConn_t *OrionConnOpenNetworkIp(const char *pAddress);
+OrionConn_t *OrionConnOpenHandle(int Handle);
+void OrionConnClose(OrionConn_t *pConn);
+BOOL OrionConnSend(OrionConn_t *pConn, const OrionPkt_t *pPkt);
+BOOL OrionConnReceive(OrionConn_t *pConn, OrionPkt_t *pPkt);
+BOOL OrionConnReceiveTimeout(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt32 TimeoutUs);
+BOOL OrionConnWaitFor(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt8 ID, UInt32 TimeoutUs);
+BOOL OrionConnReceiveView(OrionConn_t *pConn, OrionPktView_t *pView);
+BOOL OrionConnReceiveViewTimeout(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs);
+BOOL OrionConnReceiveTimed(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt64 *pTimeUs, UInt32 TimeoutUs);
+UInt64 OrionConnGetRxTimeUs(const OrionConn_t *pConn);
+void OrionPktViewCopy(const OrionPktView_t *pView, OrionPkt_t *pPkt);
+BOOL OrionConnIsOpen(const OrionConn_t *pConn);
+int  OrionConnGetHandle(const OrionConn_t *pConn);
+void OrionConnGetRxStats(OrionConn_t *pConn, OrionCommRxStats_t *pStats, BOOL Reset);
+BOOL OrionConnSetBatching(OrionConn_t *pConn, UInt32 MaxBytes, UInt32 MaxDelayUs);
+BOOL OrionConnFlush(OrionConn_t *pConn);
+void OrionConnGetTxStats(OrionConn_t *pConn, OrionCommTxStats_t *pStats, BOOL Reset);
+BOOL OrionCommReceiveView(OrionPktView_t *pView);
+BOOL OrionCommReceiveTimed(OrionPkt_t *pPkt, UInt64 *pTimeUs, UInt32 TimeoutUs);
+UInt64 OrionCommGetTimeUs(void);
+OrionConn_t *OrionCommGetDefaultConn(void);
+BOOL OrionCommSetDefaultConn(OrionConn_t *pConn);
+BOOL OrionCommSetBatching(UInt32 MaxBytes, UInt32 MaxDelayUs);
+BOOL OrionCommFlush(void);
+void OrionCommGetTxStats(OrionCommTxStats_t *pStats, BOOL Reset);
+
+#endif // __linux__ || __APPLE__
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,567 @@
+#include "OrionCommConfig.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif // _WIN32
+
+// Marks the end of a chain of in-flight entries
+#define NO_ENTRY    -1
+
+// Chunk size used when reading configuration files
+#define FILE_CHUNK  4096
+
+// Where a packet is in the transfer
+typedef enum
+{
+    XFER_QUEUED,
+    XFER_IN_FLIGHT,
+    XFER_ACKED,
+    XFER_FAILED
+} OrionXferState_t;
+
+// One packet to be uploaded, along with its transfer state
+typedef struct
+{
+    OrionPkt_t Pkt;
+
+    // Barrier packets are only sent once everything queued before them has finished
+    BOOL Barrier;
+
+    // Current state, number of times sent so far and when to give up waiting for a response
+    OrionXferState_t State;
+    UInt32 Attempts;
+    UInt64 Deadline;
+
+    // Next in-flight entry with the same packet ID, and this entry's slot in the in-flight list
+    int NextSameId;
+    int Slot;
+} OrionXferEntry_t;
+
+// Function pointers used to move packets, so the same engine can run over any connection
+typedef BOOL (*XferSend_t)(void *pLink, const OrionPkt_t *pPkt);
+typedef BOOL (*XferReceive_t)(void *pLink, OrionPkt_t *pPkt, UInt32 TimeoutUs);
+
+struct OrionConfigXfer_s
+{
+    OrionConfigXferOptions_t Options;
+
+    // Every packet in the transfer, in the order they were added
+    OrionXferEntry_t *pEntries;
+    UInt32 Count;
+    UInt32 Capacity;
+
+    // Index of the next packet to send for the first time, and number of packets acked or failed
+    UInt32 Next;
+    UInt32 Finished;
+
+    // Indices of the packets awaiting a response, in no particular order
+    int *pInFlight;
+    UInt32 InFlightCount;
+
+    // Heads of the in-flight chains for each packet ID, used to match responses
+    int Heads[256];
+
+    // Indices of the failed packets, in the order they failed
+    int *pFailed;
+
+    // Progress callback and context
+    OrionConfigXferProgress_t pProgress;
+    void *pContext;
+
+    OrionConfigXferStats_t Stats;
+};
+
+// Context for loading a configuration file
+typedef struct
+{
+    OrionConfigXfer_t *pXfer;
+    BOOL Barriers;
+    int Count;
+} XferLoad_t;
+
+static BOOL RunTransfer(OrionConfigXfer_t *pXfer, XferSend_t pSend, XferReceive_t pReceive, void *pLink);
+static BOOL SendEntry(OrionConfigXfer_t *pXfer, int Index, XferSend_t pSend, void *pLink, UInt64 Now);
+static void FinishEntry(OrionConfigXfer_t *pXfer, int Index, OrionXferState_t State);
+static void HandleResponse(OrionConfigXfer_t *pXfer, const OrionPkt_t *pPkt);
+static BOOL LoadPacket(const OrionPkt_t *pPkt, void *pContext);
+static BOOL DefaultSend(void *pLink, const OrionPkt_t *pPkt);
+static BOOL DefaultReceive(void *pLink, OrionPkt_t *pPkt, UInt32 TimeoutUs);
+#if defined(__linux__) || defined(__APPLE__)
+static BOOL ConnSend(void *pLink, const OrionPkt_t *pPkt);
+static BOOL ConnReceive(void *pLink, OrionPkt_t *pPkt, UInt32 TimeoutUs);
+#endif // __linux__ || __APPLE__
+static UInt64 GetTimeUs(void);
+
+/*!
+ * Fill out a set of transfer options with sensible defaults
+ * \param pOptions receives the default options
+ */
+void OrionConfigXferDefaultOptions(OrionConfigXferOptions_t *pOptions)
+{
+    // Eight packets in flight, 100ms to respond and five attempts per packet
+    pOptions->Window = 8;
+    pOptions->TimeoutUs = 100000;
+    pOptions->MaxAttempts = 5;
+
+}// OrionConfigXferDefaultOptions
+
+/*!
+ * Create a new, empty configuration transfer
+ * \param pOptions are the transfer options, or NULL to use the defaults
+ * \return a pointer to the transfer, or NULL on failure
+ */
+OrionConfigXfer_t *OrionConfigXferCreate(const OrionConfigXferOptions_t *pOptions)
+{
+    OrionConfigXfer_t *pXfer = (OrionConfigXfer_t *)calloc(1, sizeof(OrionConfigXfer_t));
+    int i;
+
+    // Out of memory
+    if (pXfer == NULL)
+        return NULL;
+
+    // Copy the options over, making sure at least one packet can be in flight and gets sent
+    if (pOptions != NULL)
+        pXfer->Options = *pOptions;
+    else
+        OrionConfigXferDefaultOptions(&pXfer->Options);
+    if (pXfer->Options.Window == 0)
+        pXfer->Options.Window = 1;
+    if (pXfer->Options.MaxAttempts == 0)
+        pXfer->Options.MaxAttempts = 1;
+
+    // Allocate the in-flight list
+    pXfer->pInFlight = (int *)malloc(pXfer->Options.Window * sizeof(int));
+    if (pXfer->pInFlight == NULL)
+    {
+        free(pXfer);
+        return NULL;
+    }
+
+    // No packets are in flight yet
+    for (i = 0; i < 256; i++)
+        pXfer->Heads[i] = NO_ENTRY;
+
+    return pXfer;
+
+}// OrionConfigXferCreate
+
+/*!
+ * Free a transfer and everything in it
+ * \param pXfer is the transfer to destroy
+ */
+void OrionConfigXferDestroy(OrionConfigXfer_t *pXfer)
+{
+    if (pXfer != NULL)
+    {
+        free(pXfer->pEntries);
+        free(pXfer->pInFlight);
+        free(pXfer->pFailed);
+        free(pXfer);
+    }
+
+}// OrionConfigXferDestroy
+
+/*!
+ * Add a packet to the end of a transfer
+ * \param pXfer is the transfer to add to
+ * \param pPkt is the packet to add, which is copied
+ * \param Barrier is TRUE if the packet must not be sent until every packet before it has
+ *        been acked or failed, and nothing after it may be sent until it has too
+ * \return TRUE if the packet was added, FALSE if out of memory
+ */
+BOOL OrionConfigXferAdd(OrionConfigXfer_t *pXfer, const OrionPkt_t *pPkt, BOOL Barrier)
+{
+    OrionXferEntry_t *pEntry;
+
+    // Grow the entry list if need be, doubling its size each time
+    if (pXfer->Count == pXfer->Capacity)
+    {
+        UInt32 Capacity = (pXfer->Capacity != 0) ? (pXfer->Capacity * 2) : 64;
+        OrionXferEntry_t *pEntries = (OrionXferEntry_t *)realloc(pXfer->pEntries, Capacity * sizeof(OrionXferEntry_t));
+        int *pFailed = (int *)realloc(pXfer->pFailed, Capacity * sizeof(int));
+
+        // Keep whichever allocations succeeded so nothing leaks
+        if (pEntries != NULL)
+            pXfer->pEntries = pEntries;
+        if (pFailed != NULL)
+            pXfer->pFailed = pFailed;
+
+        // Out of memory
+        if ((pEntries == NULL) || (pFailed == NULL))
+            return FALSE;
+
+        pXfer->Capacity = Capacity;
+    }
+
+    // Fill out the new entry, copying only the bytes that are actually part of the packet
+    pEntry = &pXfer->pEntries[pXfer->Count++];
+    memset(pEntry, 0, sizeof(*pEntry));
+    memcpy(&pEntry->Pkt, pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+    pEntry->Barrier = Barrier;
+    pEntry->State = XFER_QUEUED;
+    pEntry->NextSameId = NO_ENTRY;
+    pEntry->Slot = NO_ENTRY;
+
+    pXfer->Stats.Packets = pXfer->Count;
+    return TRUE;
+
+}// OrionConfigXferAdd
+
+/*!
+ * Add every packet in an OrionUi configuration file to a transfer. Any ORION_PKT_PRIVATE_20
+ * packets must reach the gimbal after everything else, so they are moved to the end as barriers.
+ * \param pXfer is the transfer to add to
+ * \param pPath is the path to the .orionconfig file
+ * \return the number of packets added, or -1 if the file couldn't be read
+ */
+int OrionConfigXferLoadFile(OrionConfigXfer_t *pXfer, const char *pPath)
+{
+    XferLoad_t Load = { pXfer, FALSE, 0 };
+    FILE *pFile = fopen(pPath, "rb");
+    int Pass;
+
+    // Can't do much without a file
+    if (pFile == NULL)
+        return -1;
+
+    // Add the regular packets on the first pass and the barriers on the second
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        OrionPkt_t Pkt;
+        UInt8 Buffer[FILE_CHUNK];
+        size_t Length;
+
+        // Start over at the top of the file with a clean parser
+        memset(&Pkt, 0, sizeof(Pkt));
+        rewind(pFile);
+        Load.Barriers = (Pass == 1);
+
+        // Frame packets out of the file a chunk at a time
+        while ((Length = fread(Buffer, 1, sizeof(Buffer), pFile)) > 0)
+        {
+            // The loader only stops early if it runs out of memory
+            if (LookForOrionPacketsInBuffer(&Pkt, Buffer, (UInt32)Length, LoadPacket, &Load) < Length)
+            {
+                fclose(pFile);
+                return -1;
+            }
+        }
+    }
+
+    fclose(pFile);
+    return Load.Count;
+
+}// OrionConfigXferLoadFile
+
+/*!
+ * Set the function to call each time a packet is acked or fails
+ * \param pXfer is the transfer
+ * \param pProgress is the progress callback, or NULL for none
+ * \param pContext is passed to the callback
+ */
+void OrionConfigXferSetProgress(OrionConfigXfer_t *pXfer, OrionConfigXferProgress_t pProgress, void *pContext)
+{
+    pXfer->pProgress = pProgress;
+    pXfer->pContext = pContext;
+
+}// OrionConfigXferSetProgress
+
+/*!
+ * Run a transfer over the default OrionComm connection until every packet has been acked or failed
+ * \param pXfer is the transfer to run
+ * \return TRUE if the transfer ran to completion, FALSE if a packet could not be sent
+ */
+BOOL OrionConfigXferRun(OrionConfigXfer_t *pXfer)
+{
+    return RunTransfer(pXfer, DefaultSend, DefaultReceive, NULL);
+
+}// OrionConfigXferRun
+
+/*!
+ * Get a copy of a transfer's progress and throughput counters
+ * \param pXfer is the transfer
+ * \param pStats receives the counters
+ */
+void OrionConfigXferGetStats(const OrionConfigXfer_t *pXfer, OrionConfigXferStats_t *pStats)
+{
+    *pStats = pXfer->Stats;
+
+}// OrionConfigXferGetStats
+
+/*!
+ * Get one of the packets that ran out of attempts
+ * \param pXfer is the transfer
+ * \param Index is the index of the failed packet, from 0 to Stats.Failed - 1
+ * \return a pointer to the failed packet, or NULL if Index is out of range
+ */
+const OrionPkt_t *OrionConfigXferGetFailed(const OrionConfigXfer_t *pXfer, UInt32 Index)
+{
+    if (Index >= pXfer->Stats.Failed)
+        return NULL;
+
+    return &pXfer->pEntries[pXfer->pFailed[Index]].Pkt;
+
+}// OrionConfigXferGetFailed
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*!
+ * Run a transfer over a specific connection until every packet has been acked or failed
+ * \param pXfer is the transfer to run
+ * \param pConn is the connection to the gimbal
+ * \return TRUE if the transfer ran to completion, FALSE if a packet could not be sent
+ */
+BOOL OrionConfigXferRunConn(OrionConfigXfer_t *pXfer, OrionConn_t *pConn)
+{
+    return RunTransfer(pXfer, ConnSend, ConnReceive, pConn);
+
+}// OrionConfigXferRunConn
+
+#endif // __linux__ || __APPLE__
+
+/*!
+ * Keep the window full, match responses and resend packets that time out until the transfer is done
+ * \param pXfer is the transfer to run
+ * \param pSend sends a packet over the link
+ * \param pReceive receives a packet from the link, waiting up to a timeout
+ * \param pLink is passed to pSend and pReceive
+ * \return TRUE if the transfer ran to completion, FALSE if a packet could not be sent
+ */
+static BOOL RunTransfer(OrionConfigXfer_t *pXfer, XferSend_t pSend, XferReceive_t pReceive, void *pLink)
+{
+    UInt64 Start = GetTimeUs(), Now = Start;
+    OrionPkt_t Pkt;
+
+    while (pXfer->Finished < pXfer->Count)
+    {
+        UInt64 Deadline = Now + pXfer->Options.TimeoutUs;
+        UInt32 i;
+
+        // Send new packets until the window is full or we hit a barrier that has to wait
+        while ((pXfer->InFlightCount < pXfer->Options.Window) && (pXfer->Next < pXfer->Count))
+        {
+            const OrionXferEntry_t *pEntry = &pXfer->pEntries[pXfer->Next];
+
+            // Barriers wait for everything before them, and everything after them waits for the barrier
+            if ((pEntry->Barrier || ((pXfer->Next > 0) && pEntry[-1].Barrier)) && (pXfer->Finished < pXfer->Next))
+                break;
+
+            if (SendEntry(pXfer, pXfer->Next++, pSend, pLink, Now) == FALSE)
+                return FALSE;
+        }
+
+        // Find the earliest deadline of anything in flight
+        for (i = 0; i < pXfer->InFlightCount; i++)
+        {
+            if (pXfer->pEntries[pXfer->pInFlight[i]].Deadline < Deadline)
+                Deadline = pXfer->pEntries[pXfer->pInFlight[i]].Deadline;
+        }
+
+        // Sleep until a response arrives or the earliest deadline passes, then handle everything queued up
+        if (pReceive(pLink, &Pkt, (Deadline > Now) ? (UInt32)(Deadline - Now) : 0))
+        {
+            do
+            {
+                HandleResponse(pXfer, &Pkt);
+            }
+            while (pReceive(pLink, &Pkt, 0));
+        }
+
+        Now = GetTimeUs();
+        pXfer->Stats.ElapsedUs = (UInt32)(Now - Start);
+
+        // Resend anything whose deadline has passed, or give up on it if it's out of attempts
+        for (i = 0; i < pXfer->InFlightCount; )
+        {
+            int Index = pXfer->pInFlight[i];
+            OrionXferEntry_t *pEntry = &pXfer->pEntries[Index];
+
+            // Still waiting on this one
+            if (pEntry->Deadline > Now)
+                i++;
+            // Out of attempts; this swaps the last in-flight entry into slot i, so don't move on
+            else if (pEntry->Attempts >= pXfer->Options.MaxAttempts)
+                FinishEntry(pXfer, Index, XFER_FAILED);
+            // Try again
+            else
+            {
+                pXfer->Stats.Retries++;
+                if (SendEntry(pXfer, Index, pSend, pLink, Now) == FALSE)
+                    return FALSE;
+                i++;
+            }
+        }
+    }
+
+    return TRUE;
+
+}// RunTransfer
+
+/*!
+ * Send a packet and start (or restart) waiting for its response
+ * \param pXfer is the transfer
+ * \param Index is the index of the entry to send
+ * \param pSend sends a packet over the link
+ * \param pLink is passed to pSend
+ * \param Now is the current time in microseconds
+ * \return TRUE if the packet was sent
+ */
+static BOOL SendEntry(OrionConfigXfer_t *pXfer, int Index, XferSend_t pSend, void *pLink, UInt64 Now)
+{
+    OrionXferEntry_t *pEntry = &pXfer->pEntries[Index];
+
+    // Bail out if the link is gone
+    if (pSend(pLink, &pEntry->Pkt) == FALSE)
+        return FALSE;
+
+    // If this is the first send, add the entry to the in-flight list and its ID's chain
+    if (pEntry->State == XFER_QUEUED)
+    {
+        int *pChain = &pXfer->Heads[pEntry->Pkt.ID];
+
+        // Append to the end of the chain so the oldest duplicate gets matched first
+        while (*pChain != NO_ENTRY)
+            pChain = &pXfer->pEntries[*pChain].NextSameId;
+        *pChain = Index;
+
+        pEntry->Slot = pXfer->InFlightCount;
+        pXfer->pInFlight[pXfer->InFlightCount++] = Index;
+        pEntry->State = XFER_IN_FLIGHT;
+    }
+
+    // Count the attempt and set the new deadline
+    pEntry->Attempts++;
+    pEntry->Deadline = Now + pXfer->Options.TimeoutUs;
+    pXfer->Stats.Sent++;
+    pXfer->Stats.Bytes += pEntry->Pkt.Length + ORION_PKT_OVERHEAD;
+    return TRUE;
+
+}// SendEntry
+
+/*!
+ * Take an in-flight entry out of the transfer, marking it as acked or failed
+ * \param pXfer is the transfer
+ * \param Index is the index of the in-flight entry
+ * \param State is XFER_ACKED or XFER_FAILED
+ */
+static void FinishEntry(OrionConfigXfer_t *pXfer, int Index, OrionXferState_t State)
+{
+    OrionXferEntry_t *pEntry = &pXfer->pEntries[Index];
+    int *pChain = &pXfer->Heads[pEntry->Pkt.ID], Last;
+
+    // Unlink the entry from its ID's chain
+    while (*pChain != Index)
+        pChain = &pXfer->pEntries[*pChain].NextSameId;
+    *pChain = pEntry->NextSameId;
+
+    // Fill its slot in the in-flight list with the last entry in the list
+    Last = pXfer->pInFlight[--pXfer->InFlightCount];
+    pXfer->pInFlight[pEntry->Slot] = Last;
+    pXfer->pEntries[Last].Slot = pEntry->Slot;
+
+    // Record the outcome
+    pEntry->State = State;
+    pEntry->Slot = NO_ENTRY;
+    if (State == XFER_FAILED)
+        pXfer->pFailed[pXfer->Stats.Failed++] = Index;
+    else
+        pXfer->Stats.Acked++;
+    pXfer->Finished++;
+
+    // Let the caller know how things are going
+    if (pXfer->pProgress != NULL)
+        pXfer->pProgress(&pXfer->Stats, pXfer->pContext);
+
+}// FinishEntry
+
+/*!
+ * Match an incoming packet to the oldest in-flight entry with the same ID and first data byte
+ * \param pXfer is the transfer
+ * \param pPkt is the incoming packet, which is ignored if it isn't a response
+ */
+static void HandleResponse(OrionConfigXfer_t *pXfer, const OrionPkt_t *pPkt)
+{
+    int Index;
+
+    // Walk the in-flight entries with this packet ID, which is usually just one
+    for (Index = pXfer->Heads[pPkt->ID]; Index != NO_ENTRY; Index = pXfer->pEntries[Index].NextSameId)
+    {
+        // The first data byte is often an index byte, so it has to match too
+        if (pXfer->pEntries[Index].Pkt.Data[0] == pPkt->Data[0])
+        {
+            FinishEntry(pXfer, Index, XFER_ACKED);
+            return;
+        }
+    }
+
+}// HandleResponse
+
+/*!
+ * Packet callback for OrionConfigXferLoadFile
+ * \param pPkt is a packet framed from the file
+ * \param pContext points to the XferLoad_t for this file
+ * \return FALSE to stop loading if out of memory
+ */
+static BOOL LoadPacket(const OrionPkt_t *pPkt, void *pContext)
+{
+    XferLoad_t *pLoad = (XferLoad_t *)pContext;
+
+    // Only take the packets that belong to this pass
+    if ((pPkt->ID == ORION_PKT_PRIVATE_20) != pLoad->Barriers)
+        return TRUE;
+
+    // Add the packet, bailing out if we run out of memory
+    if (OrionConfigXferAdd(pLoad->pXfer, pPkt, pLoad->Barriers) == FALSE)
+        return FALSE;
+
+    pLoad->Count++;
+    return TRUE;
+
+}// LoadPacket
+
+static BOOL DefaultSend(void *pLink, const OrionPkt_t *pPkt)
+{
+    return OrionCommSend(pPkt);
+
+}// DefaultSend
+
+static BOOL DefaultReceive(void *pLink, OrionPkt_t *pPkt, UInt32 TimeoutUs)
+{
+    return OrionCommReceiveTimeout(pPkt, TimeoutUs);
+
+}// DefaultReceive
+
+#if defined(__linux__) || defined(__APPLE__)
+
+static BOOL ConnSend(void *pLink, const OrionPkt_t *pPkt)
+{
+    return OrionConnSend((OrionConn_t *)pLink, pPkt);
+
+}// ConnSend
+
+static BOOL ConnReceive(void *pLink, OrionPkt_t *pPkt, UInt32 TimeoutUs)
+{
+    return OrionConnReceiveTimeout((OrionConn_t *)pLink, pPkt, TimeoutUs);
+
+}// ConnReceive
+
+#endif // __linux__ || __APPLE__
+
+static UInt64 GetTimeUs(void)
+{
+#ifdef _WIN32
+    // Millisecond resolution is plenty for response timeouts
+    return (UInt64)GetTickCount64() * 1000;
+#else
+    struct timespec Time;
+
+    // Use the monotonic clock so wall clock changes don't trip the deadlines
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (UInt64)Time.tv_sec * 1000000 + Time.tv_nsec / 1000;
+#endif // _WIN32
+
+}// GetTimeUs
@@ -0,0 +1,57 @@
+#ifndef ORIONCOMMCONFIG_H
+#define ORIONCOMMCONFIG_H
+
+#include "OrionComm.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Uploads a list of configuration packets to a gimbal, keeping several packets in flight at once.
+//  The gimbal echoes each configuration packet back once it has been applied; echoes are matched
+//  to outstanding packets by packet ID and first data byte.
+typedef struct OrionConfigXfer_s OrionConfigXfer_t;
+
+// Transfer tuning parameters
+typedef struct
+{
+    UInt32 Window;          // Maximum number of packets awaiting a response at once
+    UInt32 TimeoutUs;       // Time to wait for a response before resending a packet
+    UInt32 MaxAttempts;     // Number of times to send each packet before giving up on it
+} OrionConfigXferOptions_t;
+
+// Transfer progress and throughput counters
+typedef struct
+{
+    UInt32 Packets;         // Number of packets in the transfer
+    UInt32 Acked;           // Number of packets the gimbal responded to
+    UInt32 Failed;          // Number of packets that ran out of attempts
+    UInt32 Sent;            // Number of packets sent, including retries
+    UInt32 Retries;         // Number of packets resent after timing out
+    UInt32 Bytes;           // Number of bytes sent, including retries
+    UInt32 ElapsedUs;       // Time spent in OrionConfigXferRun so far
+} OrionConfigXferStats_t;
+
+// Called each time a packet is acked or fails
+typedef void (*OrionConfigXferProgress_t)(const OrionConfigXferStats_t *pStats, void *pContext);
+
+void OrionConfigXferDefaultOptions(OrionConfigXferOptions_t *pOptions);
+OrionConfigXfer_t *OrionConfigXferCreate(const OrionConfigXferOptions_t *pOptions);
+void OrionConfigXferDestroy(OrionConfigXfer_t *pXfer);
+BOOL OrionConfigXferAdd(OrionConfigXfer_t *pXfer, const OrionPkt_t *pPkt, BOOL Barrier);
+int  OrionConfigXferLoadFile(OrionConfigXfer_t *pXfer, const char *pPath);
+void OrionConfigXferSetProgress(OrionConfigXfer_t *pXfer, OrionConfigXferProgress_t pProgress, void *pContext);
+BOOL OrionConfigXferRun(OrionConfigXfer_t *pXfer);
+void OrionConfigXferGetStats(const OrionConfigXfer_t *pXfer, OrionConfigXferStats_t *pStats);
+const OrionPkt_t *OrionConfigXferGetFailed(const OrionConfigXfer_t *pXfer, UInt32 Index);
+
+#if defined(__linux__) || defined(__APPLE__)
+BOOL OrionConfigXferRunConn(OrionConfigXfer_t *pXfer, OrionConn_t *pConn);
+#endif // __linux__ || __APPLE__
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ORIONCOMMCONFIG_H
@@ -0,0 +1,464 @@
+#include "OrionCommDiscovery.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Most broadcast addresses to send discovery requests to at once
+#define MAX_TARGETS         32
+
+// How often to resend discovery requests, in microseconds
+#define RESEND_PERIOD_US    100000
+
+// Discovery state
+struct OrionDiscovery_s
+{
+    int Handle;
+
+    // Addresses (in network byte order) that discovery requests are sent to
+    UInt32 Targets[MAX_TARGETS];
+    int TargetCount;
+
+    // When discovery started, and when to send the next round of requests
+    UInt64 StartUs;
+    UInt64 NextSendUs;
+
+    // Every gimbal found so far
+    OrionGimbalInfo_t *pGimbals;
+    int Count;
+    int Capacity;
+};
+
+static void AddTarget(OrionDiscovery_t *pDisc, UInt32 Address);
+static void AddInterfaceTargets(OrionDiscovery_t *pDisc);
+static void SendRequests(OrionDiscovery_t *pDisc);
+static void ReadReplies(OrionDiscovery_t *pDisc);
+static void AddGimbal(OrionDiscovery_t *pDisc, UInt32 Address, const UInt8 *pData, UInt32 Length);
+static BOOL DecodeVersion(const OrionPkt_t *pPkt, void *pContext);
+
+/*!
+ * Start looking for gimbals. This sends out the first round of requests and returns immediately;
+ * replies are collected by OrionDiscoveryPoll.
+ * \param pAddress is a broadcast or gimbal IP address to send requests to, or NULL to broadcast
+ *        on every network interface at once
+ * \return a pointer to the discovery state, or NULL if the request socket couldn't be opened
+ */
+OrionDiscovery_t *OrionDiscoveryStart(const char *pAddress)
+{
+    OrionDiscovery_t *pDisc = (OrionDiscovery_t *)calloc(1, sizeof(OrionDiscovery_t));
+    struct sockaddr_in Local;
+    int Enable = 1;
+
+    // Out of memory
+    if (pDisc == NULL)
+        return NULL;
+
+    // Open a non-blocking UDP socket that can broadcast
+    pDisc->Handle = socket(AF_INET, SOCK_DGRAM, 0);
+    if (pDisc->Handle < 0)
+    {
+        free(pDisc);
+        return NULL;
+    }
+    fcntl(pDisc->Handle, F_SETFL, O_NONBLOCK);
+    setsockopt(pDisc->Handle, SOL_SOCKET, SO_BROADCAST, &Enable, sizeof(Enable));
+    setsockopt(pDisc->Handle, SOL_SOCKET, SO_REUSEADDR, &Enable, sizeof(Enable));
+
+    // Gimbals reply to the discovery port, so listen there; if something else already has it,
+    //  carry on anyway and catch whatever replies come back to our own port
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family = AF_INET;
+    Local.sin_addr.s_addr = htonl(INADDR_ANY);
+    Local.sin_port = htons(UDP_IN_PORT);
+    bind(pDisc->Handle, (struct sockaddr *)&Local, sizeof(Local));
+
+    // Work out where to send requests: the given address, or every interface's broadcast address
+    if (pAddress != NULL)
+    {
+        UInt32 Address;
+
+        if (inet_pton(AF_INET, pAddress, &Address) == 1)
+            AddTarget(pDisc, Address);
+    }
+    else
+    {
+        AddTarget(pDisc, htonl(INADDR_BROADCAST));
+        AddInterfaceTargets(pDisc);
+    }
+
+    // Send the first round of requests right away
+    pDisc->StartUs = OrionCommGetTimeUs();
+    SendRequests(pDisc);
+
+    return pDisc;
+
+}// OrionDiscoveryStart
+
+/*!
+ * Get the socket that discovery replies arrive on, for use with poll() or an event loop
+ * \param pDisc is the discovery state
+ * \return the socket's file descriptor
+ */
+int OrionDiscoveryGetHandle(const OrionDiscovery_t *pDisc)
+{
+    return pDisc->Handle;
+
+}// OrionDiscoveryGetHandle
+
+/*!
+ * Collect discovery replies, resending requests as needed
+ * \param pDisc is the discovery state
+ * \param TimeoutUs is the longest to wait for a reply, or 0 to only pick up replies that have
+ *        already arrived
+ * \return the number of gimbals found so far
+ */
+int OrionDiscoveryPoll(OrionDiscovery_t *pDisc, UInt32 TimeoutUs)
+{
+    UInt64 Deadline = OrionCommGetTimeUs() + TimeoutUs, Now;
+    int Count = pDisc->Count;
+
+    do
+    {
+        struct pollfd Poll = { pDisc->Handle, POLLIN, 0 };
+        UInt64 WaitUs;
+
+        // Pick up any replies that are waiting
+        ReadReplies(pDisc);
+
+        // Resend requests periodically in case some got lost along the way
+        Now = OrionCommGetTimeUs();
+        if (Now >= pDisc->NextSendUs)
+            SendRequests(pDisc);
+
+        // Stop once something new turns up or we run out of time
+        if ((pDisc->Count > Count) || (Now >= Deadline))
+            break;
+
+        // Otherwise sleep until a reply arrives, it's time to resend, or the deadline passes
+        WaitUs = ((Deadline < pDisc->NextSendUs) ? Deadline : pDisc->NextSendUs) - Now;
+        poll(&Poll, 1, (int)((WaitUs + 999) / 1000));
+    }
+    while (1);
+
+    return pDisc->Count;
+
+}// OrionDiscoveryPoll
+
+/*!
+ * Get the number of gimbals found so far
+ * \param pDisc is the discovery state
+ * \return the number of gimbals found
+ */
+int OrionDiscoveryGetCount(const OrionDiscovery_t *pDisc)
+{
+    return pDisc->Count;
+
+}// OrionDiscoveryGetCount
+
+/*!
+ * Get information about a gimbal that has been found, in the order they replied
+ * \param pDisc is the discovery state
+ * \param Index is the index of the gimbal
+ * \return a pointer to the gimbal's information, valid until the next poll, or NULL if Index is
+ *         out of range
+ */
+const OrionGimbalInfo_t *OrionDiscoveryGetGimbal(const OrionDiscovery_t *pDisc, int Index)
+{
+    return ((Index >= 0) && (Index < pDisc->Count)) ? &pDisc->pGimbals[Index] : NULL;
+
+}// OrionDiscoveryGetGimbal
+
+/*!
+ * Stop discovery and free everything associated with it
+ * \param pDisc is the discovery state, which may be NULL
+ */
+void OrionDiscoveryStop(OrionDiscovery_t *pDisc)
+{
+    if (pDisc == NULL)
+        return;
+
+    close(pDisc->Handle);
+    free(pDisc->pGimbals);
+    free(pDisc);
+
+}// OrionDiscoveryStop
+
+/*!
+ * Find every gimbal that replies to discovery within a deadline
+ * \param pAddress is a broadcast or gimbal IP address, or NULL to broadcast on every interface
+ * \param pGimbals receives information on the gimbals found, in the order they replied
+ * \param MaxGimbals is the number of entries pGimbals has room for
+ * \param TimeoutUs is how long to keep listening for replies
+ * \return the number of gimbals found, which may be more than MaxGimbals, or -1 on failure
+ */
+int OrionCommDiscover(const char *pAddress, OrionGimbalInfo_t *pGimbals, int MaxGimbals, UInt32 TimeoutUs)
+{
+    OrionDiscovery_t *pDisc = OrionDiscoveryStart(pAddress);
+    UInt64 Deadline = OrionCommGetTimeUs() + TimeoutUs, Now;
+    int Count;
+
+    if (pDisc == NULL)
+        return -1;
+
+    // Keep collecting replies until the deadline
+    while ((Now = OrionCommGetTimeUs()) < Deadline)
+        OrionDiscoveryPoll(pDisc, (UInt32)(Deadline - Now));
+
+    // Hand back as many as the caller has room for
+    Count = pDisc->Count;
+    memcpy(pGimbals, pDisc->pGimbals, ((Count < MaxGimbals) ? Count : MaxGimbals) * sizeof(OrionGimbalInfo_t));
+    OrionDiscoveryStop(pDisc);
+
+    return Count;
+
+}// OrionCommDiscover
+
+/*!
+ * Connect to several gimbals at once. All connections are started together and completed in
+ * parallel, so this takes no longer than the slowest gimbal to accept.
+ * \param pGimbals lists the gimbals to connect to
+ * \param Count is the number of gimbals in the list
+ * \param ppConns receives a connection for each gimbal, or NULL for those that couldn't be reached
+ * \param TimeoutUs is how long to wait for the gimbals to accept
+ * \return the number of gimbals connected
+ */
+int OrionConnOpenMany(const OrionGimbalInfo_t *pGimbals, int Count, OrionConn_t **ppConns, UInt32 TimeoutUs)
+{
+    struct pollfd *pPolls = (struct pollfd *)calloc(Count, sizeof(struct pollfd));
+    UInt64 Deadline = OrionCommGetTimeUs() + TimeoutUs, Now;
+    int i, Pending = 0, Connected = 0;
+
+    // Out of memory
+    if ((pPolls == NULL) && (Count > 0))
+        return 0;
+
+    // Kick off a non-blocking connect to every gimbal
+    for (i = 0; i < Count; i++)
+    {
+        struct sockaddr_in Server;
+
+        ppConns[i] = NULL;
+        pPolls[i].fd = -1;
+
+        memset(&Server, 0, sizeof(Server));
+        Server.sin_family = AF_INET;
+        Server.sin_port = htons(TCP_PORT);
+        if (inet_pton(AF_INET, pGimbals[i].Address, &Server.sin_addr) != 1)
+            continue;
+
+        pPolls[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+        pPolls[i].events = POLLOUT;
+        if (pPolls[i].fd < 0)
+            continue;
+        fcntl(pPolls[i].fd, F_SETFL, O_NONBLOCK);
+
+        // A connect that finishes right away (or fails right away) is handled just like one that doesn't
+        if ((connect(pPolls[i].fd, (struct sockaddr *)&Server, sizeof(Server)) == 0) || (errno == EINPROGRESS))
+            Pending++;
+        else
+        {
+            close(pPolls[i].fd);
+            pPolls[i].fd = -1;
+        }
+    }
+
+    // Wait for connections to complete until they all have, or we run out of time
+    while ((Pending > 0) && ((Now = OrionCommGetTimeUs()) < Deadline))
+    {
+        // Note that poll skips entries with negative descriptors, i.e. the ones already finished
+        int Ready = poll(pPolls, Count, (int)((Deadline - Now + 999) / 1000));
+
+        // A timeout or a signal just means going round again, but any other error would only
+        //  happen again, so give up on whatever's left
+        if ((Ready == 0) || ((Ready < 0) && (errno == EINTR)))
+            continue;
+        else if (Ready < 0)
+            break;
+
+        for (i = 0; i < Count; i++)
+        {
+            int Error = 0;
+            socklen_t Size = sizeof(Error);
+
+            if ((pPolls[i].fd < 0) || (pPolls[i].revents == 0))
+                continue;
+
+            // The connect is done one way or the other; find out which
+            getsockopt(pPolls[i].fd, SOL_SOCKET, SO_ERROR, &Error, &Size);
+            if (Error == 0)
+            {
+                ppConns[i] = OrionConnOpenHandle(pPolls[i].fd);
+                printf("Connected to %s\n", pGimbals[i].Address);
+                Connected++;
+            }
+            else
+                close(pPolls[i].fd);
+
+            pPolls[i].fd = -1;
+            Pending--;
+        }
+    }
+
+    // Give up on anything still outstanding
+    for (i = 0; i < Count; i++)
+    {
+        if (pPolls[i].fd >= 0)
+            close(pPolls[i].fd);
+
+        if (ppConns[i] == NULL)
+            printf("Failed to connect to %s\n", pGimbals[i].Address);
+    }
+
+    free(pPolls);
+    return Connected;
+
+}// OrionConnOpenMany
+
+// Add an address to the list of places to send requests, ignoring duplicates
+static void AddTarget(OrionDiscovery_t *pDisc, UInt32 Address)
+{
+    int i;
+
+    for (i = 0; i < pDisc->TargetCount; i++)
+    {
+        if (pDisc->Targets[i] == Address)
+            return;
+    }
+
+    if (pDisc->TargetCount < MAX_TARGETS)
+        pDisc->Targets[pDisc->TargetCount++] = Address;
+
+}// AddTarget
+
+// Add the broadcast address of every IPv4 interface that's up. Sending only to 255.255.255.255
+//  would reach just the interface the default route goes out of.
+static void AddInterfaceTargets(OrionDiscovery_t *pDisc)
+{
+    struct ifaddrs *pList, *pIf;
+
+    if (getifaddrs(&pList) != 0)
+        return;
+
+    for (pIf = pList; pIf != NULL; pIf = pIf->ifa_next)
+    {
+        if ((pIf->ifa_addr == NULL) || (pIf->ifa_addr->sa_family != AF_INET) || (pIf->ifa_broadaddr == NULL))
+            continue;
+
+        if ((pIf->ifa_flags & IFF_UP) && (pIf->ifa_flags & IFF_BROADCAST))
+            AddTarget(pDisc, ((struct sockaddr_in *)pIf->ifa_broadaddr)->sin_addr.s_addr);
+    }
+
+    freeifaddrs(pList);
+
+}// AddInterfaceTargets
+
+// Send a version request to every target
+static void SendRequests(OrionDiscovery_t *pDisc)
+{
+    struct sockaddr_in Remote;
+    OrionPkt_t Pkt;
+    int i;
+
+    // Build a version request packet (any packet will do, but this one gets us version info)
+    MakeOrionPacket(&Pkt, ORION_PKT_CROWN_VERSION, 0);
+
+    memset(&Remote, 0, sizeof(Remote));
+    Remote.sin_family = AF_INET;
+    Remote.sin_port = htons(UDP_OUT_PORT);
+
+    for (i = 0; i < pDisc->TargetCount; i++)
+    {
+        Remote.sin_addr.s_addr = pDisc->Targets[i];
+        sendto(pDisc->Handle, (char *)&Pkt, Pkt.Length + ORION_PKT_OVERHEAD, 0, (struct sockaddr *)&Remote, sizeof(Remote));
+    }
+
+    pDisc->NextSendUs = OrionCommGetTimeUs() + RESEND_PERIOD_US;
+
+}// SendRequests
+
+// Read every reply waiting on the socket
+static void ReadReplies(OrionDiscovery_t *pDisc)
+{
+    UInt8 Buffer[ORION_PKT_OVERHEAD + 255];
+    struct sockaddr_in From;
+    socklen_t Size = sizeof(From);
+    ssize_t Length;
+
+    while ((Length = recvfrom(pDisc->Handle, Buffer, sizeof(Buffer), 0, (struct sockaddr *)&From, &Size)) >= 0)
+    {
+        AddGimbal(pDisc, From.sin_addr.s_addr, Buffer, (UInt32)Length);
+        Size = sizeof(From);
+    }
+
+}// ReadReplies
+
+// Record a gimbal that replied, unless it's already in the list
+static void AddGimbal(OrionDiscovery_t *pDisc, UInt32 Address, const UInt8 *pData, UInt32 Length)
+{
+    OrionGimbalInfo_t Gimbal;
+    OrionPkt_t Pkt;
+    int i;
+
+    memset(&Gimbal, 0, sizeof(Gimbal));
+    inet_ntop(AF_INET, &Address, Gimbal.Address, sizeof(Gimbal.Address));
+
+    // Gimbals answer on every interface and every resend, so we'll hear from most of them more than once
+    for (i = 0; i < pDisc->Count; i++)
+    {
+        if (strcmp(pDisc->pGimbals[i].Address, Gimbal.Address) == 0)
+            return;
+    }
+
+    // Pull the version out of the reply if that's what it is; any reply at all is good enough, though
+    memset(&Pkt, 0, sizeof(Pkt));
+    LookForOrionPacketsInBuffer(&Pkt, pData, Length, DecodeVersion, &Gimbal);
+    Gimbal.ResponseUs = (UInt32)(OrionCommGetTimeUs() - pDisc->StartUs);
+
+    // Make room in the list if need be
+    if (pDisc->Count == pDisc->Capacity)
+    {
+        int Capacity = (pDisc->Capacity == 0) ? 8 : pDisc->Capacity * 2;
+        OrionGimbalInfo_t *pGimbals = (OrionGimbalInfo_t *)realloc(pDisc->pGimbals, Capacity * sizeof(OrionGimbalInfo_t));
+
+        if (pGimbals == NULL)
+            return;
+
+        pDisc->pGimbals = pGimbals;
+        pDisc->Capacity = Capacity;
+    }
+
+    pDisc->pGimbals[pDisc->Count++] = Gimbal;
+
+}// AddGimbal
+
+// Packet callback: copy version info out of a crown version packet
+static BOOL DecodeVersion(const OrionPkt_t *pPkt, void *pContext)
+{
+    OrionGimbalInfo_t *pGimbal = (OrionGimbalInfo_t *)pContext;
+    OrionCrownVersion_t Version;
+
+    if (decodeOrionCrownVersionPacketStructure(pPkt, &Version))
+    {
+        memcpy(pGimbal->Version, Version.Version, sizeof(pGimbal->Version) - 1);
+        memcpy(pGimbal->PartNumber, Version.PartNumber, sizeof(pGimbal->PartNumber) - 1);
+        return FALSE;
+    }
+
+    return TRUE;
+
+}// DecodeVersion
+
+#endif // __linux__ || __APPLE__
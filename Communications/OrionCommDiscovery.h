@@ -0,0 +1,43 @@
+#ifndef ORIONCOMMDISCOVERY_H
+#define ORIONCOMMDISCOVERY_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Finds every gimbal that answers a discovery request on any network interface. Requests are
+//  broadcast on all interfaces at once and resent periodically; each gimbal is listed once, with
+//  whatever version information came back in its reply.
+typedef struct OrionDiscovery_s OrionDiscovery_t;
+
+// A gimbal found by discovery
+typedef struct
+{
+    char Address[16];       // Dotted-quad IP address of the gimbal
+    char Version[16];       // Crown board software version, or empty if the reply didn't say
+    char PartNumber[16];    // Crown board hardware details, or empty if the reply didn't say
+    UInt32 ResponseUs;      // Time from the start of discovery to the gimbal's first reply
+} OrionGimbalInfo_t;
+
+OrionDiscovery_t *OrionDiscoveryStart(const char *pAddress);
+int  OrionDiscoveryGetHandle(const OrionDiscovery_t *pDisc);
+int  OrionDiscoveryPoll(OrionDiscovery_t *pDisc, UInt32 TimeoutUs);
+int  OrionDiscoveryGetCount(const OrionDiscovery_t *pDisc);
+const OrionGimbalInfo_t *OrionDiscoveryGetGimbal(const OrionDiscovery_t *pDisc, int Index);
+void OrionDiscoveryStop(OrionDiscovery_t *pDisc);
+
+int  OrionCommDiscover(const char *pAddress, OrionGimbalInfo_t *pGimbals, int MaxGimbals, UInt32 TimeoutUs);
+int  OrionConnOpenMany(const OrionGimbalInfo_t *pGimbals, int Count, OrionConn_t **ppConns, UInt32 TimeoutUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMDISCOVERY_H
@@ -0,0 +1,286 @@
+#include "OrionCommDispatch.h"
+#include "OrionPublicPacket.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Number of possible packet IDs, and therefore entries in the handler table
+#define NUM_PACKET_IDS      256
+
+// One slot in the handler table, indexed directly by packet ID
+typedef struct
+{
+    OrionDecodeFunc_t pDecode;          // Decoder for this ID, or NULL to hand over the raw packet
+    OrionDispatchHandler_t pHandler;    // Handler for this ID, or NULL if nothing is registered
+    void *pDecoded;                     // Structure the decoder writes into
+    void *pContext;                     // User context passed to the handler
+} OrionDispatchEntry_t;
+
+struct OrionDispatcher_s
+{
+    OrionDispatchEntry_t Entries[NUM_PACKET_IDS];   // Handler table
+    OrionDispatchStats_t Stats;                     // Counters since the last reset
+    UInt32 Unhandled[NUM_PACKET_IDS];               // Per-ID count of packets with no handler
+};
+
+// A decoder known to the dispatcher, along with the ID and structure size it applies to
+typedef struct
+{
+    UInt8 ID;                   // Packet ID this decoder accepts
+    UInt32 Size;                // Size of the structure this decoder writes
+    OrionDecodeFunc_t pDecode;  // Wrapper around the generated decode function
+} OrionDecoderInfo_t;
+
+// Wrap a generated decodeXPacketStructure function in the dispatcher's decoder signature
+#define DECODER(Name) \
+    static BOOL Decode##Name(const OrionPkt_t *pPkt, void *pDecoded) \
+    { \
+        return decode##Name##PacketStructure(pPkt, (Name##_t *)pDecoded) ? TRUE : FALSE; \
+    }
+
+DECODER(GeolocateTelemetryCore)
+DECODER(GpsData)
+DECODER(DebugString)
+DECODER(InsOptions)
+DECODER(InsQuality)
+DECODER(NetworkDiagnostics)
+DECODER(OrionAptinaSettings)
+DECODER(OrionAutopilotData)
+DECODER(OrionBoard)
+DECODER(OrionCameras)
+DECODER(OrionClevisVersion)
+DECODER(OrionCrownVersion)
+DECODER(OrionDiagnostics)
+DECODER(OrionFlirSettings)
+DECODER(OrionHitachiSettings)
+DECODER(OrionKtncSettings)
+DECODER(OrionLaserCommand)
+DECODER(OrionLaserStates)
+DECODER(OrionLensCtlVersion)
+DECODER(OrionLimitsData)
+DECODER(OrionNetworkByteSettings)
+DECODER(OrionNetworkByteVideo)
+DECODER(OrionNetworkSettings)
+DECODER(OrionNetworkVideo)
+DECODER(OrionPath)
+DECODER(OrionPayloadVersion)
+DECODER(OrionPerformance)
+DECODER(OrionPositions)
+DECODER(OrionRetractVersion)
+DECODER(OrionSoftwareDiagnostics)
+DECODER(OrionSonySettings)
+DECODER(OrionStartupCmd)
+DECODER(OrionTrackerVersion)
+DECODER(OrionUartConfig)
+DECODER(OrionUserData)
+DECODER(OrionVibration)
+DECODER(OrionZafiroSettings)
+DECODER(StareStart)
+
+// The command packet's decoder doesn't follow the generated naming
+static BOOL DecodeOrionCmd(const OrionPkt_t *pPkt, void *pDecoded)
+{
+    return decodeOrionCmdPacket(pPkt, (OrionCmd_t *)pDecoded) ? TRUE : FALSE;
+}
+
+// Build a decoder table entry from a structure name
+#define DECODER_INFO(Name) { get##Name##PacketID(), sizeof(Name##_t), Decode##Name }
+
+// Every decoder in the public protocol. Two IDs have two structures each, told apart by size.
+static const OrionDecoderInfo_t Decoders[] =
+{
+    DECODER_INFO(GeolocateTelemetryCore),
+    DECODER_INFO(GpsData),
+    DECODER_INFO(DebugString),
+    DECODER_INFO(InsOptions),
+    DECODER_INFO(InsQuality),
+    DECODER_INFO(NetworkDiagnostics),
+    DECODER_INFO(OrionAptinaSettings),
+    DECODER_INFO(OrionAutopilotData),
+    DECODER_INFO(OrionBoard),
+    DECODER_INFO(OrionCameras),
+    DECODER_INFO(OrionClevisVersion),
+    DECODER_INFO(OrionCmd),
+    DECODER_INFO(OrionCrownVersion),
+    DECODER_INFO(OrionDiagnostics),
+    DECODER_INFO(OrionFlirSettings),
+    DECODER_INFO(OrionHitachiSettings),
+    DECODER_INFO(OrionKtncSettings),
+    DECODER_INFO(OrionLaserCommand),
+    DECODER_INFO(OrionLaserStates),
+    DECODER_INFO(OrionLensCtlVersion),
+    DECODER_INFO(OrionLimitsData),
+    DECODER_INFO(OrionNetworkByteSettings),
+    DECODER_INFO(OrionNetworkByteVideo),
+    DECODER_INFO(OrionNetworkSettings),
+    DECODER_INFO(OrionNetworkVideo),
+    DECODER_INFO(OrionPath),
+    DECODER_INFO(OrionPayloadVersion),
+    DECODER_INFO(OrionPerformance),
+    DECODER_INFO(OrionPositions),
+    DECODER_INFO(OrionRetractVersion),
+    DECODER_INFO(OrionSoftwareDiagnostics),
+    DECODER_INFO(OrionSonySettings),
+    DECODER_INFO(OrionStartupCmd),
+    DECODER_INFO(OrionTrackerVersion),
+    DECODER_INFO(OrionUartConfig),
+    DECODER_INFO(OrionUserData),
+    DECODER_INFO(OrionVibration),
+    DECODER_INFO(OrionZafiroSettings),
+    DECODER_INFO(StareStart)
+};
+
+/*!
+ * Create a dispatcher with no handlers registered.
+ * \return A pointer to the new dispatcher, or NULL on failure
+ */
+OrionDispatcher_t *OrionDispatcherCreate(void)
+{
+    // Zeroed memory means every table entry starts out empty
+    return (OrionDispatcher_t *)calloc(1, sizeof(OrionDispatcher_t));
+
+}// OrionDispatcherCreate
+
+/*!
+ * Free a dispatcher. Handler contexts and decode structures belong to the caller.
+ * \param pDisp is the dispatcher to free, which may be NULL
+ */
+void OrionDispatcherDestroy(OrionDispatcher_t *pDisp)
+{
+    free(pDisp);
+
+}// OrionDispatcherDestroy
+
+/*!
+ * Register a handler for a packet ID using the protocol's own decoder for that ID.
+ * \param pDisp is the dispatcher to register with
+ * \param ID is the packet ID to handle
+ * \param pDecoded is the structure to decode into, or NULL to hand the handler raw packets
+ * \param Size is the size of *pDecoded, which picks between structures that share an ID
+ * \param pHandler is called with each packet of this ID once it's decoded
+ * \param pContext is passed through to the handler
+ * \return TRUE on success, or FALSE if no decoder for this ID writes a structure of this size
+ */
+BOOL OrionDispatcherSet(OrionDispatcher_t *pDisp, UInt8 ID, void *pDecoded, UInt32 Size, OrionDispatchHandler_t pHandler, void *pContext)
+{
+    UInt32 i;
+
+    // Raw handlers don't need a decoder at all
+    if (pDecoded == NULL)
+    {
+        OrionDispatcherSetDecoder(pDisp, ID, NULL, NULL, pHandler, pContext);
+        return TRUE;
+    }
+
+    // Look for the decoder that matches both the ID and the structure
+    for (i = 0; i < sizeof(Decoders) / sizeof(Decoders[0]); i++)
+    {
+        // If this is the one, register it and we're done
+        if ((Decoders[i].ID == ID) && (Decoders[i].Size == Size))
+        {
+            OrionDispatcherSetDecoder(pDisp, ID, Decoders[i].pDecode, pDecoded, pHandler, pContext);
+            return TRUE;
+        }
+    }
+
+    // Nothing in the protocol decodes this ID into this structure
+    return FALSE;
+
+}// OrionDispatcherSet
+
+/*!
+ * Register a handler for a packet ID with a caller-supplied decoder, replacing any handler
+ * already registered for that ID.
+ * \param pDisp is the dispatcher to register with
+ * \param ID is the packet ID to handle
+ * \param pDecode decodes packets of this ID into *pDecoded, or NULL to hand the handler raw packets
+ * \param pDecoded is the structure passed to pDecode and then to the handler
+ * \param pHandler is called with each packet of this ID once it's decoded
+ * \param pContext is passed through to the handler
+ */
+void OrionDispatcherSetDecoder(OrionDispatcher_t *pDisp, UInt8 ID, OrionDecodeFunc_t pDecode, void *pDecoded, OrionDispatchHandler_t pHandler, void *pContext)
+{
+    OrionDispatchEntry_t *pEntry = &pDisp->Entries[ID];
+
+    // Fill in the table entry for this ID
+    pEntry->pDecode  = pDecode;
+    pEntry->pDecoded = (pDecode == NULL) ? NULL : pDecoded;
+    pEntry->pHandler = pHandler;
+    pEntry->pContext = pContext;
+
+}// OrionDispatcherSetDecoder
+
+/*!
+ * Remove the handler for a packet ID, so that packets with that ID are counted as unhandled.
+ * \param pDisp is the dispatcher to modify
+ * \param ID is the packet ID to stop handling
+ */
+void OrionDispatcherClear(OrionDispatcher_t *pDisp, UInt8 ID)
+{
+    memset(&pDisp->Entries[ID], 0, sizeof(pDisp->Entries[ID]));
+
+}// OrionDispatcherClear
+
+/*!
+ * Decode a packet and hand it to the handler registered for its ID. This is a single table
+ * lookup regardless of how many handlers are registered.
+ * \param pDisp is the dispatcher to use
+ * \param pPkt is the packet to dispatch
+ * \return TRUE if a handler was called, FALSE if the packet was unhandled or failed to decode
+ */
+BOOL OrionDispatch(OrionDispatcher_t *pDisp, const OrionPkt_t *pPkt)
+{
+    const OrionDispatchEntry_t *pEntry = &pDisp->Entries[pPkt->ID];
+
+    // With no handler, just count the packet and don't bother decoding it
+    if (pEntry->pHandler == NULL)
+    {
+        pDisp->Stats.Unhandled++;
+        pDisp->Unhandled[pPkt->ID]++;
+        return FALSE;
+    }
+
+    // Decode it, unless the handler wants the raw packet
+    if ((pEntry->pDecode != NULL) && (pEntry->pDecode(pPkt, pEntry->pDecoded) == FALSE))
+    {
+        pDisp->Stats.Failed++;
+        return FALSE;
+    }
+
+    // Count it, then hand it over
+    pDisp->Stats.Handled++;
+    pEntry->pHandler(pPkt, pEntry->pDecoded, pEntry->pContext);
+    return TRUE;
+
+}// OrionDispatch
+
+/*!
+ * Get a dispatcher's counters, optionally resetting them.
+ * \param pDisp is the dispatcher to query
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters, including the per-ID unhandled counts
+ */
+void OrionDispatcherGetStats(OrionDispatcher_t *pDisp, OrionDispatchStats_t *pStats, BOOL Reset)
+{
+    // Hand back a copy of the counters
+    *pStats = pDisp->Stats;
+
+    // Reset them if asked to
+    if (Reset)
+    {
+        memset(&pDisp->Stats, 0, sizeof(pDisp->Stats));
+        memset(pDisp->Unhandled, 0, sizeof(pDisp->Unhandled));
+    }
+
+}// OrionDispatcherGetStats
+
+/*!
+ * Get the number of unhandled packets seen with a given ID since the counters were last reset.
+ * \param pDisp is the dispatcher to query
+ * \param ID is the packet ID of interest
+ * \return The number of packets with that ID that had no handler
+ */
+UInt32 OrionDispatcherGetUnhandled(const OrionDispatcher_t *pDisp, UInt8 ID)
+{
+    return pDisp->Unhandled[ID];
+
+}// OrionDispatcherGetUnhandled
@@ -0,0 +1,49 @@
+#ifndef ORIONCOMMDISPATCH_H
+#define ORIONCOMMDISPATCH_H
+
+#include "OrionComm.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Hands each packet to the handler registered for its ID in a 256-entry table, decoding it into
+//  the handler's structure first. The ID and length are checked once, by the decoder; packets
+//  with no handler are only counted.
+typedef struct OrionDispatcher_s OrionDispatcher_t;
+
+// Decodes a packet into a structure, returning TRUE on success
+typedef BOOL (*OrionDecodeFunc_t)(const OrionPkt_t *pPkt, void *pDecoded);
+
+// Called with each packet and the structure it was decoded into (NULL if the handler asked for raw packets)
+typedef void (*OrionDispatchHandler_t)(const OrionPkt_t *pPkt, void *pDecoded, void *pContext);
+
+// Dispatch counters
+typedef struct
+{
+    UInt32 Handled;     // Packets decoded and handed to a handler
+    UInt32 Unhandled;   // Packets with no handler registered for their ID
+    UInt32 Failed;      // Packets whose decoder rejected them, e.g. for being too short
+} OrionDispatchStats_t;
+
+OrionDispatcher_t *OrionDispatcherCreate(void);
+void OrionDispatcherDestroy(OrionDispatcher_t *pDisp);
+BOOL OrionDispatcherSet(OrionDispatcher_t *pDisp, UInt8 ID, void *pDecoded, UInt32 Size, OrionDispatchHandler_t pHandler, void *pContext);
+void OrionDispatcherSetDecoder(OrionDispatcher_t *pDisp, UInt8 ID, OrionDecodeFunc_t pDecode, void *pDecoded, OrionDispatchHandler_t pHandler, void *pContext);
+void OrionDispatcherClear(OrionDispatcher_t *pDisp, UInt8 ID);
+BOOL OrionDispatch(OrionDispatcher_t *pDisp, const OrionPkt_t *pPkt);
+void OrionDispatcherGetStats(OrionDispatcher_t *pDisp, OrionDispatchStats_t *pStats, BOOL Reset);
+UInt32 OrionDispatcherGetUnhandled(const OrionDispatcher_t *pDisp, UInt8 ID);
+
+// Register a handler for a packet ID that decodes into *pStruct, e.g. a GeolocateTelemetryCore_t
+//  for ORION_PKT_GEOLOCATE_TELEMETRY. The structure's size picks the decoder, so this fails if the
+//  structure doesn't belong to that ID.
+#define OrionDispatcherSetStruct(pDisp, ID, pStruct, pHandler, pContext) \
+    OrionDispatcherSet(pDisp, ID, pStruct, sizeof(*(pStruct)), pHandler, pContext)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ORIONCOMMDISPATCH_H
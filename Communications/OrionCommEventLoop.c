@@ -0,0 +1,477 @@
+#include "OrionCommEventLoop.h"
+#include "OrionCommPrivate.h"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Maximum number of epoll events handled per wakeup
+#define MAX_EVENTS 64
+
+// One file descriptor registered with the loop: either a connection or a timer
+typedef struct OrionLoopEntry_s
+{
+    // Connection to service, or NULL if this is a timer
+    OrionConn_t *pConn;
+
+    // Timer file descriptor, handler and context (timers only)
+    int TimerHandle;
+    OrionTimerHandler_t pTimer;
+    void *pContext;
+
+    // Set when the entry is removed, so it can be freed once the current batch of events is done
+    BOOL Removed;
+
+    struct OrionLoopEntry_s *pNext;
+} OrionLoopEntry_t;
+
+// A handler and the context pointer to pass it
+typedef struct
+{
+    OrionPktHandler_t pHandler;
+    void *pContext;
+} OrionLoopHandler_t;
+
+struct OrionEventLoop_s
+{
+    // epoll instance, plus an eventfd used to wake the loop up from other threads
+    int EpollHandle;
+    int WakeHandle;
+
+    // Everything registered with the loop
+    OrionLoopEntry_t *pEntries;
+
+    // Per packet ID handlers, and the handler for everything else
+    OrionLoopHandler_t Handlers[256];
+    OrionLoopHandler_t DefaultHandler;
+
+    // Hangup handler and context
+    OrionConnHandler_t pClose;
+    void *pCloseContext;
+
+    // Set by OrionEventLoopStop to break out of OrionEventLoopRun
+    volatile BOOL Stop;
+};
+
+static OrionLoopEntry_t *AddEntry(OrionEventLoop_t *pLoop, int Handle);
+static void RemoveEntry(OrionEventLoop_t *pLoop, OrionLoopEntry_t *pEntry, int Handle);
+static void FreeRemovedEntries(OrionEventLoop_t *pLoop);
+static int ServiceConn(OrionEventLoop_t *pLoop, OrionLoopEntry_t *pEntry);
+static int FlushBatches(OrionEventLoop_t *pLoop, int TimeoutMs);
+
+/*!
+ * Create a new, empty event loop
+ * \return a pointer to the loop, or NULL on failure
+ */
+OrionEventLoop_t *OrionEventLoopCreate(void)
+{
+    OrionEventLoop_t *pLoop = (OrionEventLoop_t *)calloc(1, sizeof(OrionEventLoop_t));
+    struct epoll_event Event;
+
+    // Out of memory
+    if (pLoop == NULL)
+        return NULL;
+
+    // Create the epoll instance and the wakeup event
+    pLoop->EpollHandle = epoll_create1(EPOLL_CLOEXEC);
+    pLoop->WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Register the wakeup event with a NULL pointer to tell it apart from real entries
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    Event.data.ptr = NULL;
+
+    // If any of that failed, clean up and give up
+    if ((pLoop->EpollHandle < 0) || (pLoop->WakeHandle < 0) ||
+        (epoll_ctl(pLoop->EpollHandle, EPOLL_CTL_ADD, pLoop->WakeHandle, &Event) != 0))
+    {
+        OrionEventLoopDestroy(pLoop);
+        return NULL;
+    }
+
+    return pLoop;
+
+}// OrionEventLoopCreate
+
+/*!
+ * Destroy an event loop and all of its timers. Connections are left open.
+ * \param pLoop is the loop to destroy
+ */
+void OrionEventLoopDestroy(OrionEventLoop_t *pLoop)
+{
+    // Nothing to do for a NULL loop
+    if (pLoop == NULL)
+        return;
+
+    // Free every entry, closing timer file descriptors as we go
+    while (pLoop->pEntries != NULL)
+    {
+        OrionLoopEntry_t *pEntry = pLoop->pEntries;
+
+        pLoop->pEntries = pEntry->pNext;
+        if ((pEntry->pConn == NULL) && !pEntry->Removed)
+            close(pEntry->TimerHandle);
+
+        free(pEntry);
+    }
+
+    // Close down the epoll instance and wakeup event
+    if (pLoop->EpollHandle >= 0)
+        close(pLoop->EpollHandle);
+
+    if (pLoop->WakeHandle >= 0)
+        close(pLoop->WakeHandle);
+
+    free(pLoop);
+
+}// OrionEventLoopDestroy
+
+/*!
+ * Start servicing a connection
+ * \param pLoop is the event loop
+ * \param pConn is the connection to add, which must stay open until it is removed
+ * \return TRUE if the connection was added
+ */
+BOOL OrionEventLoopAddConn(OrionEventLoop_t *pLoop, OrionConn_t *pConn)
+{
+    OrionLoopEntry_t *pEntry;
+
+    // Register the connection's file descriptor with epoll
+    if ((pConn == NULL) || ((pEntry = AddEntry(pLoop, OrionConnGetHandle(pConn))) == NULL))
+        return FALSE;
+
+    pEntry->pConn = pConn;
+    return TRUE;
+
+}// OrionEventLoopAddConn
+
+/*!
+ * Stop servicing a connection. The connection itself is not closed.
+ * \param pLoop is the event loop
+ * \param pConn is the connection to remove
+ */
+void OrionEventLoopRemoveConn(OrionEventLoop_t *pLoop, OrionConn_t *pConn)
+{
+    OrionLoopEntry_t *pEntry;
+
+    // Find the matching entry and remove it
+    for (pEntry = pLoop->pEntries; pEntry != NULL; pEntry = pEntry->pNext)
+    {
+        if ((pEntry->pConn == pConn) && !pEntry->Removed)
+            RemoveEntry(pLoop, pEntry, OrionConnGetHandle(pConn));
+    }
+
+}// OrionEventLoopRemoveConn
+
+/*!
+ * Register a handler for all incoming packets with a given ID
+ * \param pLoop is the event loop
+ * \param ID is the packet ID
+ * \param pHandler is the handler, or NULL to stop handling this ID
+ * \param pContext is passed through to pHandler
+ */
+void OrionEventLoopSetHandler(OrionEventLoop_t *pLoop, UInt8 ID, OrionPktHandler_t pHandler, void *pContext)
+{
+    pLoop->Handlers[ID].pHandler = pHandler;
+    pLoop->Handlers[ID].pContext = pContext;
+
+}// OrionEventLoopSetHandler
+
+/*!
+ * Register a handler for incoming packets whose ID has no handler of its own
+ * \param pLoop is the event loop
+ * \param pHandler is the handler, or NULL to drop unhandled packets
+ * \param pContext is passed through to pHandler
+ */
+void OrionEventLoopSetDefaultHandler(OrionEventLoop_t *pLoop, OrionPktHandler_t pHandler, void *pContext)
+{
+    pLoop->DefaultHandler.pHandler = pHandler;
+    pLoop->DefaultHandler.pContext = pContext;
+
+}// OrionEventLoopSetDefaultHandler
+
+/*!
+ * Register a handler to be called when a connection hangs up
+ * \param pLoop is the event loop
+ * \param pHandler is the handler, which may close the connection
+ * \param pContext is passed through to pHandler
+ */
+void OrionEventLoopSetCloseHandler(OrionEventLoop_t *pLoop, OrionConnHandler_t pHandler, void *pContext)
+{
+    pLoop->pClose = pHandler;
+    pLoop->pCloseContext = pContext;
+
+}// OrionEventLoopSetCloseHandler
+
+/*!
+ * Add a periodic timer to the loop
+ * \param pLoop is the event loop
+ * \param PeriodUs is the timer period in microseconds
+ * \param pHandler is called each time the timer expires
+ * \param pContext is passed through to pHandler
+ * \return an identifier for use with OrionEventLoopRemoveTimer, or -1 on failure
+ */
+int OrionEventLoopAddTimer(OrionEventLoop_t *pLoop, UInt32 PeriodUs, OrionTimerHandler_t pHandler, void *pContext)
+{
+    int Handle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec Spec;
+    OrionLoopEntry_t *pEntry;
+
+    // Make sure we got a timer
+    if (Handle < 0)
+        return -1;
+
+    // Fire after one period, then every period after that
+    Spec.it_interval.tv_sec = PeriodUs / 1000000;
+    Spec.it_interval.tv_nsec = (PeriodUs % 1000000) * 1000;
+    Spec.it_value = Spec.it_interval;
+
+    // Arm the timer and register it with epoll
+    if ((PeriodUs == 0) || (timerfd_settime(Handle, 0, &Spec, NULL) != 0) || ((pEntry = AddEntry(pLoop, Handle)) == NULL))
+    {
+        close(Handle);
+        return -1;
+    }
+
+    pEntry->TimerHandle = Handle;
+    pEntry->pTimer = pHandler;
+    pEntry->pContext = pContext;
+
+    return Handle;
+
+}// OrionEventLoopAddTimer
+
+/*!
+ * Remove a timer from the loop
+ * \param pLoop is the event loop
+ * \param Timer is the identifier returned by OrionEventLoopAddTimer
+ */
+void OrionEventLoopRemoveTimer(OrionEventLoop_t *pLoop, int Timer)
+{
+    OrionLoopEntry_t *pEntry;
+
+    // Find the matching entry, remove it, and close the timer
+    for (pEntry = pLoop->pEntries; pEntry != NULL; pEntry = pEntry->pNext)
+    {
+        if ((pEntry->pConn == NULL) && (pEntry->TimerHandle == Timer) && !pEntry->Removed)
+        {
+            RemoveEntry(pLoop, pEntry, Timer);
+            close(Timer);
+        }
+    }
+
+}// OrionEventLoopRemoveTimer
+
+/*!
+ * Wait for activity on any connection or timer and dispatch it
+ * \param pLoop is the event loop
+ * \param TimeoutMs is the longest time to wait in milliseconds, or -1 to wait forever
+ * \return the number of packets dispatched, or -1 on error
+ */
+int OrionEventLoopRunOnce(OrionEventLoop_t *pLoop, int TimeoutMs)
+{
+    struct epoll_event Events[MAX_EVENTS];
+    int Count, i, Packets = 0;
+
+    // Send any overdue outgoing batches, and wake up in time for the next one to come due
+    TimeoutMs = FlushBatches(pLoop, TimeoutMs);
+
+    // Wait for something to happen
+    Count = epoll_wait(pLoop->EpollHandle, Events, MAX_EVENTS, TimeoutMs);
+
+    // A signal isn't an error, it just means there's nothing to do
+    if (Count < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    for (i = 0; i < Count; i++)
+    {
+        OrionLoopEntry_t *pEntry = (OrionLoopEntry_t *)Events[i].data.ptr;
+        uint64_t Value;
+
+        // The wakeup event just needs to be cleared
+        if (pEntry == NULL)
+            read(pLoop->WakeHandle, &Value, sizeof(Value));
+        // Skip anything that an earlier handler in this batch removed
+        else if (pEntry->Removed)
+            continue;
+        // Connections get drained and dispatched
+        else if (pEntry->pConn != NULL)
+            Packets += ServiceConn(pLoop, pEntry);
+        // Timers get acknowledged, then run
+        else if (read(pEntry->TimerHandle, &Value, sizeof(Value)) == sizeof(Value))
+            pEntry->pTimer(pEntry->pContext);
+    }
+
+    // Send any batches that came due while we were waiting or dispatching
+    FlushBatches(pLoop, TimeoutMs);
+
+    // Now that we're done with this batch it's safe to free removed entries
+    FreeRemovedEntries(pLoop);
+
+    return Packets;
+
+}// OrionEventLoopRunOnce
+
+/*!
+ * Run the loop until OrionEventLoopStop is called
+ * \param pLoop is the event loop
+ */
+void OrionEventLoopRun(OrionEventLoop_t *pLoop)
+{
+    // Keep dispatching until we're told to stop or something breaks
+    pLoop->Stop = FALSE;
+    while (!pLoop->Stop && (OrionEventLoopRunOnce(pLoop, -1) >= 0));
+
+}// OrionEventLoopRun
+
+/*!
+ * Make OrionEventLoopRun return. This may be called from a handler or any other thread.
+ * \param pLoop is the event loop
+ */
+void OrionEventLoopStop(OrionEventLoop_t *pLoop)
+{
+    uint64_t Value = 1;
+
+    // Set the flag, then kick the loop in case it's waiting
+    pLoop->Stop = TRUE;
+    write(pLoop->WakeHandle, &Value, sizeof(Value));
+
+}// OrionEventLoopStop
+
+// Allocate a new entry and register its file descriptor with epoll
+static OrionLoopEntry_t *AddEntry(OrionEventLoop_t *pLoop, int Handle)
+{
+    OrionLoopEntry_t *pEntry = (OrionLoopEntry_t *)calloc(1, sizeof(OrionLoopEntry_t));
+    struct epoll_event Event;
+
+    // Out of memory
+    if (pEntry == NULL)
+        return NULL;
+
+    // Level triggered input, with a pointer back to the entry
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    Event.data.ptr = pEntry;
+
+    // Register the file descriptor
+    if ((Handle < 0) || (epoll_ctl(pLoop->EpollHandle, EPOLL_CTL_ADD, Handle, &Event) != 0))
+    {
+        free(pEntry);
+        return NULL;
+    }
+
+    // Add it to the front of the list
+    pEntry->pNext = pLoop->pEntries;
+    pLoop->pEntries = pEntry;
+
+    return pEntry;
+
+}// AddEntry
+
+// Unregister an entry's file descriptor and flag it for freeing
+static void RemoveEntry(OrionEventLoop_t *pLoop, OrionLoopEntry_t *pEntry, int Handle)
+{
+    epoll_ctl(pLoop->EpollHandle, EPOLL_CTL_DEL, Handle, NULL);
+    pEntry->Removed = TRUE;
+
+}// RemoveEntry
+
+// Free every entry that was removed since the last time this was called
+static void FreeRemovedEntries(OrionEventLoop_t *pLoop)
+{
+    OrionLoopEntry_t **ppEntry = &pLoop->pEntries;
+
+    // Walk the list, unlinking and freeing the removed entries
+    while (*ppEntry != NULL)
+    {
+        OrionLoopEntry_t *pEntry = *ppEntry;
+
+        if (pEntry->Removed)
+        {
+            *ppEntry = pEntry->pNext;
+            free(pEntry);
+        }
+        else
+            ppEntry = &pEntry->pNext;
+    }
+
+}// FreeRemovedEntries
+
+// Drain all buffered packets from a connection and hand each to its handler
+static int ServiceConn(OrionEventLoop_t *pLoop, OrionLoopEntry_t *pEntry)
+{
+    OrionConn_t *pConn = pEntry->pConn;
+    OrionPktView_t View;
+    int Packets = 0;
+
+    // Pull packets out until the connection runs dry, or a handler removes it. Handlers get the
+    //  packet where it was framed, so packets nobody handles are never copied at all.
+    while (!pEntry->Removed && OrionConnReceiveView(pConn, &View))
+    {
+        OrionLoopHandler_t *pHandler = &pLoop->Handlers[View.pPkt->ID];
+
+        // Fall back on the default handler if this ID doesn't have one
+        if (pHandler->pHandler == NULL)
+            pHandler = &pLoop->DefaultHandler;
+
+        if (pHandler->pHandler != NULL)
+            pHandler->pHandler(pConn, View.pPkt, pHandler->pContext);
+
+        Packets++;
+    }
+
+    // If the far end hung up, drop the connection and let the user know
+    if (!pEntry->Removed && !OrionConnIsOpen(pConn))
+    {
+        RemoveEntry(pLoop, pEntry, OrionConnGetHandle(pConn));
+        if (pLoop->pClose != NULL)
+            pLoop->pClose(pConn, pLoop->pCloseContext);
+    }
+
+    return Packets;
+
+}// ServiceConn
+
+// Flush every connection whose outgoing batch is overdue, returning the timeout shortened to the next deadline
+static int FlushBatches(OrionEventLoop_t *pLoop, int TimeoutMs)
+{
+    OrionLoopEntry_t *pEntry;
+    UInt64 NowUs = 0;
+
+    for (pEntry = pLoop->pEntries; pEntry != NULL; pEntry = pEntry->pNext)
+    {
+        OrionConn_t *pConn = pEntry->pConn;
+        int WaitMs;
+
+        // Only connections with packets waiting on a deadline matter here
+        if ((pConn == NULL) || pEntry->Removed || (pConn->TxDeadlineUs == 0))
+            continue;
+
+        // Only look at the clock if there's a deadline to compare it to
+        if (NowUs == 0)
+            NowUs = OrionCommGetTimeUs();
+
+        // Send it if it's due; if the link didn't take all of it, the flush sets a new deadline
+        if (NowUs >= pConn->TxDeadlineUs)
+            OrionConnFlush(pConn);
+
+        // Don't sleep past the deadline, rounding up so we don't wake up just short of it
+        if (pConn->TxDeadlineUs != 0)
+        {
+            WaitMs = (pConn->TxDeadlineUs > NowUs) ? (int)((pConn->TxDeadlineUs - NowUs + 999) / 1000) : 0;
+            if ((TimeoutMs < 0) || (WaitMs < TimeoutMs))
+                TimeoutMs = WaitMs;
+        }
+    }
+
+    return TimeoutMs;
+
+}// FlushBatches
+
+#endif // __linux__
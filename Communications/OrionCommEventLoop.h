@@ -0,0 +1,46 @@
+#ifndef ORIONCOMMEVENTLOOP_H
+#define ORIONCOMMEVENTLOOP_H
+
+#include "OrionComm.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// An epoll-based event loop which services any number of connections and timers from one
+//  thread. Incoming packets are dispatched to per-ID handlers as soon as their bytes arrive.
+typedef struct OrionEventLoop_s OrionEventLoop_t;
+
+// Called for each packet received on any connection in the loop. The packet is a view into the
+//  connection's receive buffer (see OrionPktView_t), so it must be copied to be kept past the call.
+typedef void (*OrionPktHandler_t)(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+
+// Called when a connection in the loop hangs up; the connection is removed from the loop first
+typedef void (*OrionConnHandler_t)(OrionConn_t *pConn, void *pContext);
+
+// Called each time a timer expires
+typedef void (*OrionTimerHandler_t)(void *pContext);
+
+OrionEventLoop_t *OrionEventLoopCreate(void);
+void OrionEventLoopDestroy(OrionEventLoop_t *pLoop);
+BOOL OrionEventLoopAddConn(OrionEventLoop_t *pLoop, OrionConn_t *pConn);
+void OrionEventLoopRemoveConn(OrionEventLoop_t *pLoop, OrionConn_t *pConn);
+void OrionEventLoopSetHandler(OrionEventLoop_t *pLoop, UInt8 ID, OrionPktHandler_t pHandler, void *pContext);
+void OrionEventLoopSetDefaultHandler(OrionEventLoop_t *pLoop, OrionPktHandler_t pHandler, void *pContext);
+void OrionEventLoopSetCloseHandler(OrionEventLoop_t *pLoop, OrionConnHandler_t pHandler, void *pContext);
+int  OrionEventLoopAddTimer(OrionEventLoop_t *pLoop, UInt32 PeriodUs, OrionTimerHandler_t pHandler, void *pContext);
+void OrionEventLoopRemoveTimer(OrionEventLoop_t *pLoop, int Timer);
+int  OrionEventLoopRunOnce(OrionEventLoop_t *pLoop, int TimeoutMs);
+void OrionEventLoopRun(OrionEventLoop_t *pLoop);
+void OrionEventLoopStop(OrionEventLoop_t *pLoop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__
+
+#endif // ORIONCOMMEVENTLOOP_H
@@ -1,10 +1,20 @@
+// Needed for ppoll()
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
 #include "OrionComm.h"
+#include "OrionCommPrivate.h"
+#include "OrionCommLog.h"
+#include "OrionCommStats.h"
 
 #if defined(__linux__) || defined(__APPLE__)
 
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,15 +24,35 @@
 #include <unistd.h>
 #include <signal.h>
 #include <arpa/inet.h>
-
-static struct sockaddr *GetSockAddr(uint32_t Address, unsigned short port);
-
-static int Handle = -1;
-
-BOOL OrionCommOpenSerial(const char *pPath)
+#include <stddef.h>
+
+#ifdef __linux__
+# include <linux/tcp.h>
+#else
+# include <netinet/tcp.h>
+#endif
+
+static OrionConn_t *NewConn(int Handle);
+static struct sockaddr_in MakeSockAddr(uint32_t Address, unsigned short Port);
+static BOOL ViewPacket(const OrionPkt_t *pPkt, void *pContext);
+static ssize_t WriteLink(OrionConn_t *pConn, const void *pData, size_t Size);
+static UInt32 GetSegmentsOut(const OrionConn_t *pConn);
+static UInt32 GetByteNs(int Handle);
+static ssize_t FdRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t FdWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void FdWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void FdClose(OrionConn_t *pConn);
+
+// Transport operations for serial ports and sockets
+static const OrionConnOps_t FdOps = { FdRead, FdWrite, FdWait, FdClose };
+
+// The connection used by the original single-gimbal OrionComm API
+static OrionConn_t *pDefaultConn = NULL;
+
+OrionConn_t *OrionConnOpenSerial(const char *pPath)
 {
     // Open a file descriptor for the serial port
-    Handle = open(pPath, O_RDWR | O_NOCTTY | O_NDELAY);
+    int Handle = open(pPath, O_RDWR | O_NOCTTY | O_NDELAY);
 
     // If we actually managed to open something
     if (Handle >= 0)
@@ -35,7 +65,7 @@ BOOL OrionCommOpenSerial(const char *pPath)
             // If we can't, close and invalidate the file descriptor
             close(Handle);
             Handle = -1;
-        } 
+        }
         else
         {
             // Otherwise, clear out the port attributes structure
@@ -60,14 +90,14 @@ BOOL OrionCommOpenSerial(const char *pPath)
     else
         printf("Looking for gimbal on %s...\n", pPath);
 
-    // Return the file descriptor
-    return Handle != -1;
+    // Wrap the file descriptor in a new connection
+    return NewConn(Handle);
 
-}// OrionCommOpenSerial
+}// OrionConnOpenSerial
 
 BOOL OrionCommIpStringValid(const char *pAddress)
 {
-    uint32_t Address; 
+    uint32_t Address;
 
     // Return TRUE if this is a valid IP address
     return inet_pton(AF_INET, pAddress, &Address) == 1;
@@ -81,10 +111,20 @@ BOOL OrionCommSerialPathValid(const char *pPath)
 
 }//  OrionCommSerialPathValid
 
-BOOL OrionCommOpenNetworkIp(const char *pAddress)
+OrionConn_t *OrionConnOpenHandle(int Handle)
+{
+    // Make sure reads won't block, then wrap the file descriptor in a new connection
+    if (Handle >= 0)
+        fcntl(Handle, F_SETFL, fcntl(Handle, F_GETFL) | O_NONBLOCK);
+
+    return NewConn(Handle);
+
+}// OrionConnOpenHandle
+
+OrionConn_t *OrionConnOpenNetworkIp(const char *pAddress)
 {
     // Open a new UDP socket for auto-discovery
-    int UdpHandle = socket(AF_INET, SOCK_DGRAM, 0);
+    int UdpHandle = socket(AF_INET, SOCK_DGRAM, 0), Handle = -1;
     uint32_t BroadcastAddr = INADDR_BROADCAST;
     char IpString[INET_ADDRSTRLEN];
 
@@ -97,26 +137,28 @@ BOOL OrionCommOpenNetworkIp(const char *pAddress)
         // Now print out the broadcast address we're pinging
         printf("Looking for gimbal on %s...\n", inet_ntop(AF_INET, &BroadcastAddr, IpString, INET_ADDRSTRLEN));
 
-        // Roll the bytes for our GetSockAddr function
+        // Roll the bytes for our MakeSockAddr function
         BroadcastAddr = ntohl(BroadcastAddr);
     }
     else
     {
         // Close the discovery handle and return a failure
         close(UdpHandle);
-        return FALSE;
+        return NULL;
     }
 
     // If the socket looks good
     if (UdpHandle >= 0)
     {
+        struct sockaddr_in Local = MakeSockAddr(INADDR_ANY, UDP_IN_PORT);
+        struct sockaddr_in Remote = MakeSockAddr(BroadcastAddr, UDP_OUT_PORT);
         BOOL Broadcast = TRUE;
         int WaitCount = 0;
         char Buffer[64];
         OrionPkt_t Pkt;
 
         // Bind to the proper port to get responses from the gimbal
-        bind(UdpHandle, GetSockAddr(INADDR_ANY, UDP_IN_PORT), sizeof(struct sockaddr_in));
+        bind(UdpHandle, (struct sockaddr *)&Local, sizeof(Local));
 
         // Make this socket non blocking
         fcntl(UdpHandle, F_SETFL, O_NONBLOCK);
@@ -130,25 +172,28 @@ BOOL OrionCommOpenNetworkIp(const char *pAddress)
         // Wait for up to 20 iterations
         while (WaitCount++ < 20)
         {
-            socklen_t Size = sizeof(struct sockaddr_in);
+            struct sockaddr_in From;
+            socklen_t Size = sizeof(From);
 
             // Send a version request packet
-            sendto(UdpHandle, (char *)&Pkt, Pkt.Length + ORION_PKT_OVERHEAD, 0, GetSockAddr(BroadcastAddr, UDP_OUT_PORT), sizeof(struct sockaddr_in));
+            sendto(UdpHandle, (char *)&Pkt, Pkt.Length + ORION_PKT_OVERHEAD, 0, (struct sockaddr *)&Remote, sizeof(Remote));
 
             // If we get data back forom the gimbal
-            if (recvfrom(UdpHandle, Buffer, 64, 0, GetSockAddr(INADDR_ANY, UDP_IN_PORT), &Size) > 0)
+            if (recvfrom(UdpHandle, Buffer, 64, 0, (struct sockaddr *)&From, &Size) > 0)
             {
                 // Pull the gimbal's IP address from the datagram header
-                UInt32 Address = ntohl(((struct sockaddr_in *)GetSockAddr(0, 0))->sin_addr.s_addr);
+                UInt32 Address = ntohl(From.sin_addr.s_addr);
+                struct sockaddr_in Server = MakeSockAddr(Address, TCP_PORT);
 
                 // Open a file descriptor for the TCP comm socket
                 Handle = socket(AF_INET, SOCK_STREAM, 0);
 
                 // Bind to the right incoming port
-                bind(Handle, GetSockAddr(INADDR_ANY, TCP_PORT), sizeof(struct sockaddr_in));
+                Local = MakeSockAddr(INADDR_ANY, TCP_PORT);
+                bind(Handle, (struct sockaddr *)&Local, sizeof(Local));
 
                 // Connect to the gimbal's server socket (note this is a blocking call)
-                connect(Handle, GetSockAddr(Address, TCP_PORT), sizeof(struct sockaddr_in));
+                connect(Handle, (struct sockaddr *)&Server, sizeof(Server));
 
                 // Now make the socket non-blocking for future reads/writes
                 fcntl(Handle, F_SETFL, O_NONBLOCK);
@@ -179,74 +224,796 @@ BOOL OrionCommOpenNetworkIp(const char *pAddress)
         close(UdpHandle);
     }
 
-    // Return a possibly valid handle to this socket
-    return Handle != -1;
+    // Wrap a possibly valid handle to this socket in a new connection
+    return NewConn(Handle);
+
+}// OrionConnOpenNetworkIp
+
+void OrionConnClose(OrionConn_t *pConn)
+{
+    // Nothing to do for a connection that never opened
+    if (pConn == NULL)
+        return;
+
+    // Send anything still waiting in the batch while we still can
+    OrionConnFlush(pConn);
+
+    // Stop the receive thread, finish off any recording, then shut down the transport and free the connection
+    if (pConn->pQueueOps != NULL)
+        pConn->pQueueOps->pStop(pConn);
+    OrionConnStopRecording(pConn);
+    OrionConnEnableStats(pConn, FALSE);
+    pConn->pOps->pClose(pConn);
+    free(pConn->pTxBuffer);
+    free(pConn);
+
+}// OrionConnClose
+
+BOOL OrionConnSend(OrionConn_t *pConn, const OrionPkt_t *pPkt)
+{
+    UInt32 Size;
+
+    // No connection, no sending
+    if (pConn == NULL)
+        return FALSE;
+
+    // Total size of the packet on the wire, including header data
+    Size = pPkt->Length + ORION_PKT_OVERHEAD;
+
+    // Without batching, every packet gets its own write to the link
+    if (pConn->pTxBuffer == NULL)
+    {
+        if (WriteLink(pConn, pPkt, Size) <= 0)
+            return FALSE;
+
+        pConn->TxStats.Packets++;
+        pConn->TxStats.Flushes++;
+        if (pConn->pStats != NULL)
+            OrionConnStatsTx(pConn, pPkt);
+        return TRUE;
+    }
+
+    // If the waiting packets are overdue, or this one won't fit behind them, flush them first
+    if ((pConn->TxUsed + Size > pConn->TxSize) || ((pConn->TxDeadlineUs != 0) && (OrionCommGetTimeUs() >= pConn->TxDeadlineUs)))
+        OrionConnFlush(pConn);
+
+    // If the link wouldn't take them, there's nowhere to put this one
+    if (pConn->TxUsed + Size > pConn->TxSize)
+        return FALSE;
+
+    // The first packet in a batch starts the clock on the latency bound
+    if ((pConn->TxUsed == 0) && (pConn->TxDelayUs > 0))
+        pConn->TxDeadlineUs = OrionCommGetTimeUs() + pConn->TxDelayUs;
+
+    // Pack it in behind the others
+    memcpy(&pConn->pTxBuffer[pConn->TxUsed], pPkt, Size);
+    pConn->TxUsed += Size;
+    pConn->TxStats.Packets++;
+    if (pConn->pStats != NULL)
+        OrionConnStatsTx(pConn, pPkt);
+    return TRUE;
+
+}// OrionConnSend
+
+BOOL OrionConnSetBatching(OrionConn_t *pConn, UInt32 MaxBytes, UInt32 MaxDelayUs)
+{
+    // Push out anything batched up under the old settings, and don't lose what the link won't take
+    if ((pConn == NULL) || (OrionConnFlush(pConn) == FALSE))
+        return FALSE;
+
+    // Zero bytes turns batching off, going back to one write per packet
+    if (MaxBytes == 0)
+    {
+        free(pConn->pTxBuffer);
+        pConn->pTxBuffer = NULL;
+        pConn->TxSize = 0;
+    }
+    else
+    {
+        UInt8 *pBuffer;
+
+        // The batch has to hold at least one packet of any size
+        if (MaxBytes < sizeof(OrionPkt_t))
+            MaxBytes = sizeof(OrionPkt_t);
+
+        // Resize the batch buffer, leaving the old one alone if that fails
+        if ((pBuffer = (UInt8 *)realloc(pConn->pTxBuffer, MaxBytes)) == NULL)
+            return FALSE;
+
+        pConn->pTxBuffer = pBuffer;
+        pConn->TxSize = MaxBytes;
+    }
+
+    // Zero delay means batches only go out when they fill up or are flushed explicitly
+    pConn->TxDelayUs = MaxDelayUs;
+    return TRUE;
+
+}// OrionConnSetBatching
+
+BOOL OrionConnFlush(OrionConn_t *pConn)
+{
+    ssize_t Count;
+
+    // Nothing to send means nothing to do
+    if ((pConn == NULL) || (pConn->TxUsed == 0))
+        return pConn != NULL;
+
+    // Hand the whole batch to the link in one go
+    Count = WriteLink(pConn, pConn->pTxBuffer, pConn->TxUsed);
+    if (Count > 0)
+    {
+        // Keep hold of whatever the link didn't take, which may end partway through a packet
+        pConn->TxUsed -= (UInt32)Count;
+        memmove(pConn->pTxBuffer, &pConn->pTxBuffer[Count], pConn->TxUsed);
+        pConn->TxStats.Flushes++;
+    }
+
+    // Once it's all gone there's no deadline; otherwise give the link a little while to drain
+    if (pConn->TxUsed == 0)
+        pConn->TxDeadlineUs = 0;
+    else if (pConn->TxDelayUs > 0)
+        pConn->TxDeadlineUs = OrionCommGetTimeUs() + pConn->TxDelayUs;
+
+    return pConn->TxUsed == 0;
+
+}// OrionConnFlush
+
+BOOL OrionConnReceive(OrionConn_t *pConn, OrionPkt_t *pPkt)
+{
+    OrionPktView_t View;
+
+    // Frame the packet in place, then copy it out
+    if (OrionConnReceiveView(pConn, &View) == FALSE)
+        return FALSE;
+
+    OrionPktViewCopy(&View, pPkt);
+    return TRUE;
+
+}// OrionConnReceive
+
+BOOL OrionConnReceiveView(OrionConn_t *pConn, OrionPktView_t *pView)
+{
+    // No connection, no packets
+    if (pConn == NULL)
+        return FALSE;
+
+    // Keep outgoing batches to their latency bound while the application is busy receiving
+    if ((pConn->TxDeadlineUs != 0) && (OrionCommGetTimeUs() >= pConn->TxDeadlineUs))
+        OrionConnFlush(pConn);
+
+    // If a receive thread owns the link, just take whatever it has queued up
+    if (pConn->pQueueOps != NULL)
+    {
+        if (pConn->pQueueOps->pReceive(pConn, pView, 0) == FALSE)
+            return FALSE;
+    }
+    else if (OrionConnReceiveLink(pConn, pView) == FALSE)
+        return FALSE;
+
+    // Remember when it arrived, for anyone handed just the packet
+    pConn->RxTimeUs = pView->TimeUs;
+    return TRUE;
+
+}// OrionConnReceiveView
+
+void OrionPktViewCopy(const OrionPktView_t *pView, OrionPkt_t *pPkt)
+{
+    // Only copy the bytes actually on the wire; the view may point into the receive buffer
+    memcpy(pPkt, pView->pPkt, pView->Size);
+
+}// OrionPktViewCopy
+
+// Read and frame the next packet straight from the link, leaving it where it was framed
+BOOL OrionConnReceiveLink(OrionConn_t *pConn, OrionPktView_t *pView)
+{
+    while (1)
+    {
+        ssize_t Count;
+
+        // If there's unparsed data in the buffer, pick up where we left off
+        if (pConn->RxTail < pConn->RxHead)
+        {
+            pView->pPkt = NULL;
+
+            // Frame packets straight out of the buffer, stopping at the first one. The buffer isn't
+            //  refilled until it's all been scanned, so the packet stays put until the next call.
+            //  Anything the parser throws away along the way is counted against the link.
+            pConn->RxTail += LookForOrionPacketsInBufferEx(&pConn->RxPkt, &pConn->pRxData[pConn->RxTail], pConn->RxHead - pConn->RxTail, ViewPacket, pView, &pConn->RxParseStats);
+
+            // If we found one, we're done for now
+            if (pView->pPkt != NULL)
+            {
+                // Its first byte arrived in an earlier read if it straddled reads, and otherwise
+                //  in this one, ahead of the rest of the read by however long the rest took to send
+                if (pView->pPkt == &pConn->RxPkt)
+                    pView->TimeUs = pConn->RxPartialUs;
+                else
+                    pView->TimeUs = pConn->RxReadUs - (UInt64)(pConn->RxHead - (UInt32)((const UInt8 *)pView->pPkt - pConn->pRxData)) * pConn->RxByteNs / 1000;
+
+                pConn->RxStats.Packets++;
+                if (pConn->pStats != NULL)
+                    OrionConnStatsRx(pConn, pView->pPkt, pView->TimeUs);
+                return TRUE;
+            }
+        }
+
+        // If a packet runs off the end of this read and started in it (rather than in an earlier
+        //  one), note when its first byte arrived
+        if ((pConn->RxPkt.Info.State != 0) && (pConn->RxPkt.Info.State <= pConn->RxHead))
+            pConn->RxPartialUs = pConn->RxReadUs - (UInt64)pConn->RxPkt.Info.State * pConn->RxByteNs / 1000;
+
+        // The buffer's empty now (partial packets live in RxPkt), so refill it from the top, or
+        //  let the transport point us at data it already has
+        pConn->RxHead = pConn->RxTail = 0;
+        pConn->RxReadUs = 0;
+        pConn->pRxData = pConn->RxBuffer;
+        if (pConn->pOps->pReadInPlace != NULL)
+            Count = pConn->pOps->pReadInPlace(pConn, &pConn->pRxData);
+        else
+            Count = pConn->pOps->pRead(pConn, pConn->RxBuffer, sizeof(pConn->RxBuffer));
+        pConn->RxStats.ReadCalls++;
+
+        // If there's nothing to read (or something went wrong), we're done
+        if (Count <= 0)
+        {
+            // End of file or a hard error means the link is gone, as opposed to just quiet
+            if ((Count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+                pConn->LinkDown = TRUE;
+
+            return FALSE;
+        }
+
+        // Otherwise note how much data we have to work with, and when it arrived if the
+        //  transport couldn't tell us
+        pConn->RxHead = (UInt32)Count;
+        pConn->RxStats.Bytes += (UInt32)Count;
+        if (pConn->RxReadUs == 0)
+            pConn->RxReadUs = OrionCommGetTimeUs();
+        if (pConn->pStats != NULL)
+            OrionConnStatsRead(pConn, (UInt32)Count);
+
+        // Keep a timestamped copy of the raw bytes if we're recording
+        if (pConn->pRecord != NULL)
+            OrionLogWrite(pConn->pRecord, pConn->RxReadUs, pConn->pRxData, (UInt32)Count);
+    }
+
+}// OrionConnReceiveLink
+
+BOOL OrionConnReceiveTimeout(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt32 TimeoutUs)
+{
+    OrionPktView_t View;
+
+    // Wait for the packet to be framed in place, then copy it out
+    if (OrionConnReceiveViewTimeout(pConn, &View, TimeoutUs) == FALSE)
+        return FALSE;
+
+    OrionPktViewCopy(&View, pPkt);
+    return TRUE;
+
+}// OrionConnReceiveTimeout
+
+BOOL OrionConnReceiveViewTimeout(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs)
+{
+    UInt64 Deadline = OrionCommGetTimeUs() + TimeoutUs;
+
+    // The receive thread's queue does its own waiting, but no longer than the outgoing batch can
+    //  wait, so the batch still goes out on time
+    if ((pConn != NULL) && (pConn->pQueueOps != NULL))
+    {
+        while (1)
+        {
+            UInt64 Now = OrionCommGetTimeUs(), Until = Deadline;
+
+            if ((pConn->TxDeadlineUs != 0) && (Now >= pConn->TxDeadlineUs))
+                OrionConnFlush(pConn);
+            if ((pConn->TxDeadlineUs != 0) && (pConn->TxDeadlineUs < Until))
+                Until = pConn->TxDeadlineUs;
+
+            if (pConn->pQueueOps->pReceive(pConn, pView, (Until > Now) ? (UInt32)(Until - Now) : 0))
+            {
+                pConn->RxTimeUs = pView->TimeUs;
+                return TRUE;
+            }
+
+            // Only give up once the caller's deadline has passed, not just the batch's
+            if (OrionCommGetTimeUs() >= Deadline)
+                return FALSE;
+        }
+    }
+
+    while (1)
+    {
+        UInt64 Now, Until = Deadline;
+
+        // If a packet is buffered or already waiting in the kernel, we're done
+        if (OrionConnReceiveView(pConn, pView))
+            return TRUE;
+
+        // Don't bother waiting on a dead link, or past the deadline
+        if (!OrionConnIsOpen(pConn) || ((Now = OrionCommGetTimeUs()) >= Deadline))
+            return FALSE;
+
+        // Sleep until more data arrives or we run out of time, waking up in time to send any
+        //  outgoing batch before it's overdue
+        if ((pConn->TxDeadlineUs != 0) && (pConn->TxDeadlineUs > Now) && (pConn->TxDeadlineUs < Until))
+            Until = pConn->TxDeadlineUs;
+        pConn->pOps->pWait(pConn, (UInt32)(Until - Now));
+    }
+
+}// OrionConnReceiveViewTimeout
+
+BOOL OrionConnReceiveTimed(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt64 *pTimeUs, UInt32 TimeoutUs)
+{
+    OrionPktView_t View;
+
+    // Wait for the packet to be framed in place, then copy it out along with when it arrived
+    if (OrionConnReceiveViewTimeout(pConn, &View, TimeoutUs) == FALSE)
+        return FALSE;
+
+    OrionPktViewCopy(&View, pPkt);
+    *pTimeUs = View.TimeUs;
+    return TRUE;
+
+}// OrionConnReceiveTimed
+
+UInt64 OrionConnGetRxTimeUs(const OrionConn_t *pConn)
+{
+    // Arrival time of the last packet handed over, or 0 if there hasn't been one
+    return (pConn != NULL) ? pConn->RxTimeUs : 0;
+
+}// OrionConnGetRxTimeUs
+
+BOOL OrionConnWaitFor(OrionConn_t *pConn, OrionPkt_t *pPkt, UInt8 ID, UInt32 TimeoutUs)
+{
+    UInt64 Deadline = OrionCommGetTimeUs() + TimeoutUs, Now;
+    OrionPktView_t View;
+
+    // Keep receiving packets until we get the right one or run out of time
+    while ((Now = OrionCommGetTimeUs()) <= Deadline)
+    {
+        // If the next packet is the one we want, copy it out and we're done; anything else gets dropped
+        if (OrionConnReceiveViewTimeout(pConn, &View, (UInt32)(Deadline - Now)))
+        {
+            if (View.pPkt->ID == ID)
+            {
+                OrionPktViewCopy(&View, pPkt);
+                return TRUE;
+            }
+        }
+        // Nothing came in before the deadline
+        else
+            break;
+    }
+
+    return FALSE;
+
+}// OrionConnWaitFor
+
+BOOL OrionConnIsOpen(const OrionConn_t *pConn)
+{
+    // Return TRUE if the connection exists and hasn't been hung up on, or still has packets queued from before it was
+    return (pConn != NULL) && ((pConn->LinkDown == FALSE) || ((pConn->pQueueOps != NULL) && pConn->pQueueOps->pPending(pConn)));
+
+}// OrionConnIsOpen
+
+int OrionConnGetHandle(const OrionConn_t *pConn)
+{
+    // Hand back the file descriptor, e.g. for use with poll()
+    return (pConn != NULL) ? pConn->Handle : -1;
+
+}// OrionConnGetHandle
+
+void OrionConnGetRxStats(OrionConn_t *pConn, OrionCommRxStats_t *pStats, BOOL Reset)
+{
+    // No connection means no traffic
+    if (pConn == NULL)
+    {
+        memset(pStats, 0, sizeof(*pStats));
+        return;
+    }
+
+    // Hand over a copy of the receive counters, clearing them if asked to
+    *pStats = pConn->RxStats;
+    if (Reset)
+        memset(&pConn->RxStats, 0, sizeof(pConn->RxStats));
+
+}// OrionConnGetRxStats
+
+void OrionConnGetTxStats(OrionConn_t *pConn, OrionCommTxStats_t *pStats, BOOL Reset)
+{
+    UInt32 Segments;
+
+    // No connection means no traffic
+    if (pConn == NULL)
+    {
+        memset(pStats, 0, sizeof(*pStats));
+        return;
+    }
+
+    // The kernel keeps its own running segment count, so note where it was at the last reset
+    Segments = GetSegmentsOut(pConn);
+
+    // Hand over a copy of the send counters, clearing them if asked to
+    *pStats = pConn->TxStats;
+    pStats->Segments = Segments - pConn->TxSegmentBase;
+    if (Reset)
+    {
+        memset(&pConn->TxStats, 0, sizeof(pConn->TxStats));
+        pConn->TxSegmentBase = Segments;
+    }
+
+}// OrionConnGetTxStats
+
+BOOL OrionCommOpenSerial(const char *pPath)
+{
+    // Replace the default connection with one on this serial port
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenSerial(pPath));
+
+}// OrionCommOpenSerial
+
+BOOL OrionCommOpenNetworkIp(const char *pAddress)
+{
+    // Replace the default connection with one to this address
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenNetworkIp(pAddress));
 
 }// OrionCommOpenNetworkIp
 
 void OrionCommClose(void)
 {
-    // Easy enough, just close the file descriptor and invalidate it
-    close(Handle);
-    Handle = -1;
+    // Close and forget the default connection
+    OrionCommSetDefaultConn(NULL);
 
 }// OrionCommClose
 
 BOOL OrionCommSend(const OrionPkt_t *pPkt)
 {
-    // Write the packet, including header data, to the file descriptor
-    return write(Handle, (char *)pPkt, pPkt->Length + ORION_PKT_OVERHEAD) > 0;
+    return OrionConnSend(pDefaultConn, pPkt);
 
 }// OrionCommSend
 
 BOOL OrionCommReceive(OrionPkt_t *pPkt)
 {
-    static OrionPkt_t Pkt = { 0 };
-    UInt8 Buffer;
+    return OrionConnReceive(pDefaultConn, pPkt);
 
-    // As long as we keep getting bytes, keep reading them in one by one
-    while (read(Handle, (char *)&Buffer, 1) == 1)
+}// OrionCommReceive
+
+BOOL OrionCommReceiveTimeout(OrionPkt_t *pPkt, UInt32 TimeoutUs)
+{
+    return OrionConnReceiveTimeout(pDefaultConn, pPkt, TimeoutUs);
+
+}// OrionCommReceiveTimeout
+
+BOOL OrionCommWaitFor(OrionPkt_t *pPkt, UInt8 ID, UInt32 TimeoutUs)
+{
+    return OrionConnWaitFor(pDefaultConn, pPkt, ID, TimeoutUs);
+
+}// OrionCommWaitFor
+
+BOOL OrionCommReceiveView(OrionPktView_t *pView)
+{
+    return OrionConnReceiveView(pDefaultConn, pView);
+
+}// OrionCommReceiveView
+
+BOOL OrionCommReceiveTimed(OrionPkt_t *pPkt, UInt64 *pTimeUs, UInt32 TimeoutUs)
+{
+    return OrionConnReceiveTimed(pDefaultConn, pPkt, pTimeUs, TimeoutUs);
+
+}// OrionCommReceiveTimed
+
+BOOL OrionCommIsOpen(void)
+{
+    // Return TRUE if the default connection is valid
+    return OrionConnIsOpen(pDefaultConn);
+
+}// OrionCommIsOpen
+
+void OrionCommGetRxStats(OrionCommRxStats_t *pStats, BOOL Reset)
+{
+    OrionConnGetRxStats(pDefaultConn, pStats, Reset);
+
+}// OrionCommGetRxStats
+
+BOOL OrionCommSetBatching(UInt32 MaxBytes, UInt32 MaxDelayUs)
+{
+    return OrionConnSetBatching(pDefaultConn, MaxBytes, MaxDelayUs);
+
+}// OrionCommSetBatching
+
+BOOL OrionCommFlush(void)
+{
+    return OrionConnFlush(pDefaultConn);
+
+}// OrionCommFlush
+
+void OrionCommGetTxStats(OrionCommTxStats_t *pStats, BOOL Reset)
+{
+    OrionConnGetTxStats(pDefaultConn, pStats, Reset);
+
+}// OrionCommGetTxStats
+
+OrionConn_t *OrionCommGetDefaultConn(void)
+{
+    return pDefaultConn;
+
+}// OrionCommGetDefaultConn
+
+BOOL OrionCommSetDefaultConn(OrionConn_t *pConn)
+{
+    // Close the old default connection (unless it's being set again) and take ownership of the new one
+    if (pConn != pDefaultConn)
+        OrionConnClose(pDefaultConn);
+
+    pDefaultConn = pConn;
+    return pConn != NULL;
+
+}// OrionCommSetDefaultConn
+
+OrionConn_t *OrionConnCreate(int Handle, const OrionConnOps_t *pOps, void *pTransport)
+{
+    // Allocate a zeroed out connection, which also resets the receive buffer and parser
+    OrionConn_t *pConn = (OrionConn_t *)calloc(1, sizeof(OrionConn_t));
+
+    // Hook up the transport, unless we're out of memory
+    if (pConn != NULL)
     {
-        // If this byte is the end of a valid packet
-        if (LookForOrionPacketInByte(&Pkt, Buffer))
+        pConn->Handle = Handle;
+        pConn->pRxData = pConn->RxBuffer;
+        pConn->pOps = pOps;
+        pConn->pTransport = pTransport;
+    }
+
+    return pConn;
+
+}// OrionConnCreate
+
+// Monotonic time in microseconds, for timeouts and timestamps
+UInt64 OrionCommGetTimeUs(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (UInt64)Now.tv_sec * 1000000 + Now.tv_nsec / 1000;
+
+}// OrionCommGetTimeUs
+
+// Turn on kernel receive timestamps, returning FALSE if the handle isn't a socket that has them
+BOOL OrionCommEnableRxTimestamps(int Handle)
+{
+    int On = 1;
+
+#ifdef SO_TIMESTAMPNS
+    return setsockopt(Handle, SOL_SOCKET, SO_TIMESTAMPNS, &On, sizeof(On)) == 0;
+#else
+    return setsockopt(Handle, SOL_SOCKET, SO_TIMESTAMP, &On, sizeof(On)) == 0;
+#endif
+
+}// OrionCommEnableRxTimestamps
+
+// Read from a socket with kernel receive timestamps turned on, noting when the data arrived (or
+//  leaving *pTimeUs alone if the kernel didn't say)
+ssize_t OrionCommReadTimestamped(int Handle, void *pBuffer, size_t Size, UInt64 *pTimeUs)
+{
+    union
+    {
+        struct cmsghdr Header;
+        UInt8 Space[CMSG_SPACE(sizeof(struct timespec))];
+    } Control;
+    struct iovec Iov = { pBuffer, Size };
+    struct msghdr Msg;
+    ssize_t Count;
+    UInt64 TimeUs;
+
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = &Iov;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = &Control;
+    Msg.msg_controllen = sizeof(Control);
+
+    if (((Count = recvmsg(Handle, &Msg, 0)) > 0) && ((TimeUs = OrionCommGetMsgTimeUs(&Msg, OrionCommGetClockOffsetUs())) != 0))
+        *pTimeUs = TimeUs;
+
+    return Count;
+
+}// OrionCommReadTimestamped
+
+// Difference between the wall clock the kernel stamps packets with and our monotonic clock
+SInt64 OrionCommGetClockOffsetUs(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_REALTIME, &Now);
+    return ((SInt64)Now.tv_sec * 1000000 + Now.tv_nsec / 1000) - (SInt64)OrionCommGetTimeUs();
+
+}// OrionCommGetClockOffsetUs
+
+// Pull the kernel receive timestamp out of a received message and convert it to our monotonic
+//  clock using a clock offset from OrionCommGetClockOffsetUs, or return 0 if there isn't one
+UInt64 OrionCommGetMsgTimeUs(const struct msghdr *pMsg, SInt64 OffsetUs)
+{
+    struct cmsghdr *pCmsg;
+
+    for (pCmsg = CMSG_FIRSTHDR(pMsg); pCmsg != NULL; pCmsg = CMSG_NXTHDR((struct msghdr *)pMsg, pCmsg))
+    {
+        if (pCmsg->cmsg_level != SOL_SOCKET)
+            continue;
+
+#ifdef SO_TIMESTAMPNS
+        if (pCmsg->cmsg_type == SCM_TIMESTAMPNS)
         {
-            // Copy the packet into the passed-in location and return a success
-            *pPkt = Pkt;
-            return TRUE;
+            struct timespec Time;
+
+            memcpy(&Time, CMSG_DATA(pCmsg), sizeof(Time));
+            return (UInt64)((SInt64)Time.tv_sec * 1000000 + Time.tv_nsec / 1000 - OffsetUs);
+        }
+#endif
+        if (pCmsg->cmsg_type == SCM_TIMESTAMP)
+        {
+            struct timeval Time;
+
+            memcpy(&Time, CMSG_DATA(pCmsg), sizeof(Time));
+            return (UInt64)((SInt64)Time.tv_sec * 1000000 + Time.tv_usec - OffsetUs);
         }
     }
 
-    // Nope, no packets yet
+    return 0;
+
+}// OrionCommGetMsgTimeUs
+
+// Wrap a freshly opened file descriptor in a new connection, or close it on failure
+static OrionConn_t *NewConn(int Handle)
+{
+    OrionConn_t *pConn;
+    int NoDelay = 1;
+
+    // If the handle's no good, neither is the connection
+    if (Handle < 0)
+        return NULL;
+
+    // Packets go out as soon as they're sent (or flushed, if batching), rather than being held
+    //  back by Nagle's algorithm until the last segment is acknowledged. This fails harmlessly if
+    //  the handle isn't a TCP socket.
+    setsockopt(Handle, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+
+    // Wrap the handle up with the file descriptor transport
+    pConn = OrionConnCreate(Handle, &FdOps, NULL);
+
+    // Out of memory: don't leak the file descriptor
+    if (pConn == NULL)
+        close(Handle);
+    else
+    {
+        // Sockets can have the kernel stamp data as it arrives, which is far more accurate than
+        //  anything we can do after the fact; for serial ports, we work back from the baud rate
+        pConn->RxKernelTime = OrionCommEnableRxTimestamps(Handle);
+        pConn->RxByteNs = GetByteNs(Handle);
+    }
+
+    return pConn;
+
+}// NewConn
+
+// Quickly and easily constructs a sockaddr_in structure from a host byte order address and port
+static struct sockaddr_in MakeSockAddr(uint32_t Address, unsigned short Port)
+{
+    struct sockaddr_in SockAddr;
+
+    // Populate it with the requested IP address and port
+    memset(&SockAddr, 0, sizeof(SockAddr));
+    SockAddr.sin_family = AF_INET;
+    SockAddr.sin_addr.s_addr = htonl(Address);
+    SockAddr.sin_port = htons(Port);
+
+    return SockAddr;
+
+}// MakeSockAddr
+
+// Buffer scanner callback: points a view at the first packet found and stops the scan
+static BOOL ViewPacket(const OrionPkt_t *pPkt, void *pContext)
+{
+    OrionPktView_t *pView = (OrionPktView_t *)pContext;
+
+    // pPkt points into the receive buffer, or at the parser packet if it straddled two reads
+    pView->pPkt = pPkt;
+    pView->Size = pPkt->Length + ORION_PKT_OVERHEAD;
+
+    // Don't look any further
     return FALSE;
 
-}// OrionCommReceive
+}// ViewPacket
 
-BOOL OrionCommIsOpen(void)
+// Write to the link, counting the call and the bytes it took
+static ssize_t WriteLink(OrionConn_t *pConn, const void *pData, size_t Size)
 {
-    // Return TRUE if the file descriptor is valid
-    return (Handle >= 0);
+    ssize_t Count = pConn->pOps->pWrite(pConn, pData, Size);
 
-}// OrionCommIsOpen
+    pConn->TxStats.WriteCalls++;
+    if (Count > 0)
+        pConn->TxStats.Bytes += (UInt32)Count;
+
+    return Count;
 
-// Quickly and easily constructs a sockaddr pointer for a bunch of different functions.
-//   Call this function with Address == Port == 0 to access the pointer, or pass in
-//   actual values to construct a new sockaddr.
-static struct sockaddr *GetSockAddr(uint32_t Address, unsigned short Port)
+}// WriteLink
+
+// Ask the kernel how many data segments a TCP link has sent, or return 0 for any other link
+static UInt32 GetSegmentsOut(const OrionConn_t *pConn)
 {
-    static struct sockaddr_in SockAddr;
+#ifdef __linux__
+    struct tcp_info Info;
+    socklen_t Size = sizeof(Info);
+
+    // Older kernels return a shorter structure without the segment counters
+    if ((pConn->Handle >= 0) && (getsockopt(pConn->Handle, IPPROTO_TCP, TCP_INFO, &Info, &Size) == 0) &&
+        (Size >= offsetof(struct tcp_info, tcpi_data_segs_out) + sizeof(Info.tcpi_data_segs_out)))
+        return Info.tcpi_data_segs_out;
+#endif
 
-    // If address and port are both zero, don't modify the structure
-    if (Address || Port)
+    return 0;
+
+}// GetSegmentsOut
+
+// Time each byte takes on the wire for a serial port, at 10 bits per byte, or 0 for anything else
+static UInt32 GetByteNs(int Handle)
+{
+    static const struct
     {
-        // Otherwise, populate it with the requested IP address and port
-        memset(&SockAddr, 0, sizeof(SockAddr));
-        SockAddr.sin_family = AF_INET;
-        SockAddr.sin_addr.s_addr = htonl(Address);
-        SockAddr.sin_port = htons(Port);
+        speed_t Speed;
+        UInt32 Baud;
+    } Rates[] = {
+        { B9600, 9600 }, { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 }, { B115200, 115200 }, { B230400, 230400 },
+    };
+    struct termios Port;
+    int i;
+
+    if (!isatty(Handle) || (tcgetattr(Handle, &Port) != 0))
+        return 0;
+
+    for (i = 0; i < (int)(sizeof(Rates) / sizeof(Rates[0])); i++)
+    {
+        if (cfgetispeed(&Port) == Rates[i].Speed)
+            return 10000000000ull / Rates[i].Baud;
     }
 
-    // Return a casted pointer to the sockaddr_in structure
-    return (struct sockaddr *)&SockAddr;
+    return 0;
+
+}// GetByteNs
+
+static ssize_t FdRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    // Sockets tell us when their data arrived
+    if (pConn->RxKernelTime)
+        return OrionCommReadTimestamped(pConn->Handle, pBuffer, Size, &pConn->RxReadUs);
+
+    return read(pConn->Handle, pBuffer, Size);
+
+}// FdRead
+
+static ssize_t FdWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    return write(pConn->Handle, pData, Size);
+
+}// FdWrite
+
+static void FdWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    struct pollfd Poll = { pConn->Handle, POLLIN, 0 };
+
+#ifdef __linux__
+    // Sleep until more data arrives or we run out of time
+    struct timespec Timeout = { (time_t)(TimeoutUs / 1000000), (long)(TimeoutUs % 1000000) * 1000 };
+    ppoll(&Poll, 1, &Timeout, NULL);
+#else
+    // Sleep until more data arrives or we run out of time, rounding up to whole milliseconds
+    poll(&Poll, 1, (int)((TimeoutUs + 999) / 1000));
+#endif
+
+}// FdWait
+
+static void FdClose(OrionConn_t *pConn)
+{
+    close(pConn->Handle);
 
-}// GetSockAddr
+}// FdClose
 #endif // __linux__
@@ -0,0 +1,421 @@
+#include "OrionCommLog.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Log files start with this header, followed by records of a 64-bit timestamp in microseconds, a
+//  32-bit length and that many bytes of data. Everything is in host byte order.
+#define LOG_MAGIC           "ORIONLOG"
+#define LOG_VERSION         1
+#define LOG_HEADER_SIZE     16
+#define RECORD_HEADER_SIZE  12
+
+// Log files grow (and get remapped) this much at a time
+#define LOG_GROW_SIZE       (4 * 1024 * 1024)
+
+// A log file being written
+struct OrionLog_s
+{
+    int Handle;
+
+    // Current mapping of the file, and how much of it holds records so far
+    UInt8 *pMap;
+    size_t Size;
+    size_t Used;
+};
+
+// Replay transport state
+typedef struct
+{
+    // Read-only mapping of the whole log
+    const UInt8 *pMap;
+    size_t Size;
+
+    // Offset of the next record, and how much of it has already been handed out
+    size_t Offset;
+    UInt32 ChunkOffset;
+
+    // Playback speed, when playback started and the timestamp of the first record
+    double Speed;
+    UInt64 StartUs;
+    UInt64 FirstUs;
+} OrionReplay_t;
+
+static BOOL GrowLog(OrionLog_t *pLog, size_t Needed);
+static BOOL NextRecord(const OrionReplay_t *pReplay, UInt64 *pTimeUs, UInt32 *pLength);
+static UInt64 RecordDueUs(const OrionReplay_t *pReplay, UInt64 TimeUs);
+static ssize_t ReplayRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t ReplayWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void ReplayWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void ReplayClose(OrionConn_t *pConn);
+
+// Transport operations for log replay
+static const OrionConnOps_t ReplayOps = { ReplayRead, ReplayWrite, ReplayWait, ReplayClose };
+
+/*!
+ * Create a new, empty log file, replacing any existing file
+ * \param pPath is the path of the log file
+ * \return a pointer to the log, or NULL on failure
+ */
+OrionLog_t *OrionLogCreate(const char *pPath)
+{
+    OrionLog_t *pLog = (OrionLog_t *)calloc(1, sizeof(OrionLog_t));
+    UInt32 Version = LOG_VERSION;
+
+    // Out of memory
+    if (pLog == NULL)
+        return NULL;
+
+    // Create the file and map enough of it for the header
+    pLog->Handle = open(pPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ((pLog->Handle < 0) || (GrowLog(pLog, LOG_HEADER_SIZE) == FALSE))
+    {
+        printf("Failed to create %s\n", pPath);
+        OrionLogClose(pLog);
+        return NULL;
+    }
+
+    // Write the header out, leaving the reserved word zeroed
+    memcpy(pLog->pMap, LOG_MAGIC, 8);
+    memcpy(&pLog->pMap[8], &Version, sizeof(Version));
+    pLog->Used = LOG_HEADER_SIZE;
+
+    return pLog;
+
+}// OrionLogCreate
+
+/*!
+ * Append a chunk of raw data to a log
+ * \param pLog is the log to write to
+ * \param TimeUs is the monotonic time the data was read, in microseconds
+ * \param pData points to the data
+ * \param Length is the number of bytes of data, which must be non-zero
+ * \return TRUE if the data was written
+ */
+BOOL OrionLogWrite(OrionLog_t *pLog, UInt64 TimeUs, const void *pData, UInt32 Length)
+{
+    UInt8 *pRecord;
+
+    // Zero length records mark the end of the log, so never write one
+    if ((Length == 0) || (GrowLog(pLog, RECORD_HEADER_SIZE + Length) == FALSE))
+        return FALSE;
+
+    // Copy the record straight into the mapping
+    pRecord = &pLog->pMap[pLog->Used];
+    memcpy(pRecord, &TimeUs, sizeof(TimeUs));
+    memcpy(&pRecord[8], &Length, sizeof(Length));
+    memcpy(&pRecord[RECORD_HEADER_SIZE], pData, Length);
+    pLog->Used += RECORD_HEADER_SIZE + Length;
+
+    return TRUE;
+
+}// OrionLogWrite
+
+/*!
+ * Close a log file, trimming off any space that was reserved but never written
+ * \param pLog is the log to close
+ */
+void OrionLogClose(OrionLog_t *pLog)
+{
+    if (pLog == NULL)
+        return;
+
+    // Unmap the file, then cut it down to the data actually written
+    if (pLog->pMap != NULL)
+        munmap(pLog->pMap, pLog->Size);
+    if (pLog->Handle >= 0)
+    {
+        if (ftruncate(pLog->Handle, (off_t)pLog->Used) != 0)
+            perror("ftruncate");
+        close(pLog->Handle);
+    }
+
+    free(pLog);
+
+}// OrionLogClose
+
+/*!
+ * Check whether a path looks like a raw stream log
+ * \param pPath is the path to check
+ * \return TRUE if the path ends in .orionlog
+ */
+BOOL OrionLogPathValid(const char *pPath)
+{
+    size_t Length = strlen(pPath);
+
+    return (Length > 9) && (strcmp(&pPath[Length - 9], ".orionlog") == 0);
+
+}// OrionLogPathValid
+
+/*!
+ * Start logging everything read from a connection, replacing any log already in progress
+ * \param pConn is the connection to record
+ * \param pPath is the path of the log file
+ * \return TRUE if recording started
+ */
+BOOL OrionConnStartRecording(OrionConn_t *pConn, const char *pPath)
+{
+    if (pConn == NULL)
+        return FALSE;
+
+    OrionConnStopRecording(pConn);
+    pConn->pRecord = OrionLogCreate(pPath);
+    return pConn->pRecord != NULL;
+
+}// OrionConnStartRecording
+
+/*!
+ * Stop recording a connection and close its log
+ * \param pConn is the connection being recorded
+ */
+void OrionConnStopRecording(OrionConn_t *pConn)
+{
+    if (pConn != NULL)
+    {
+        OrionLogClose(pConn->pRecord);
+        pConn->pRecord = NULL;
+    }
+
+}// OrionConnStopRecording
+
+/*!
+ * Open a connection that replays a log instead of talking to a gimbal. Data is handed to the
+ * parser in the same chunks it was originally read in, at the original pace scaled by Speed.
+ * Anything sent to the connection is discarded, and the link goes down at the end of the log.
+ * \param pPath is the path of the log file
+ * \param Speed is the playback speed (1.0 for real time), or ORION_REPLAY_AFAP
+ * \return a pointer to the connection, or NULL on failure
+ */
+OrionConn_t *OrionConnOpenReplay(const char *pPath, double Speed)
+{
+    OrionReplay_t *pReplay = (OrionReplay_t *)calloc(1, sizeof(OrionReplay_t));
+    int Handle = open(pPath, O_RDONLY);
+    OrionConn_t *pConn = NULL;
+    struct stat Stat;
+    UInt32 Length, Version = 0;
+
+    // Map the whole file; the mapping stays valid after the file descriptor is closed
+    if ((pReplay != NULL) && (Handle >= 0) && (fstat(Handle, &Stat) == 0) && (Stat.st_size >= LOG_HEADER_SIZE))
+    {
+        void *pMap = mmap(NULL, (size_t)Stat.st_size, PROT_READ, MAP_PRIVATE, Handle, 0);
+
+        if (pMap != MAP_FAILED)
+        {
+            pReplay->pMap = (const UInt8 *)pMap;
+            pReplay->Size = (size_t)Stat.st_size;
+
+            // We'll be reading straight through, so let the kernel read ahead
+            madvise(pMap, pReplay->Size, MADV_SEQUENTIAL);
+        }
+    }
+
+    if (Handle >= 0)
+        close(Handle);
+
+    // Make sure this is actually a log we can read
+    if ((pReplay != NULL) && (pReplay->pMap != NULL))
+        memcpy(&Version, &pReplay->pMap[8], sizeof(Version));
+    if ((Version == LOG_VERSION) && (memcmp(pReplay->pMap, LOG_MAGIC, 8) == 0))
+    {
+        // Start the clock now, relative to the first record
+        pReplay->Offset = LOG_HEADER_SIZE;
+        pReplay->Speed = Speed;
+        pReplay->StartUs = OrionCommGetTimeUs();
+        NextRecord(pReplay, &pReplay->FirstUs, &Length);
+
+        pConn = OrionConnCreate(-1, &ReplayOps, pReplay);
+    }
+
+    // Let the user know what happened
+    if (pConn == NULL)
+    {
+        printf("Failed to open %s\n", pPath);
+        if ((pReplay != NULL) && (pReplay->pMap != NULL))
+            munmap((void *)pReplay->pMap, pReplay->Size);
+        free(pReplay);
+    }
+    else
+        printf("Replaying %s...\n", pPath);
+
+    return pConn;
+
+}// OrionConnOpenReplay
+
+/*!
+ * Start logging everything read from the default connection
+ * \param pPath is the path of the log file
+ * \return TRUE if recording started
+ */
+BOOL OrionCommStartRecording(const char *pPath)
+{
+    return OrionConnStartRecording(OrionCommGetDefaultConn(), pPath);
+
+}// OrionCommStartRecording
+
+/*!
+ * Stop recording the default connection
+ */
+void OrionCommStopRecording(void)
+{
+    OrionConnStopRecording(OrionCommGetDefaultConn());
+
+}// OrionCommStopRecording
+
+/*!
+ * Replace the default connection with one that replays a log
+ * \param pPath is the path of the log file
+ * \param Speed is the playback speed (1.0 for real time), or ORION_REPLAY_AFAP
+ * \return TRUE if the log was opened
+ */
+BOOL OrionCommOpenReplay(const char *pPath, double Speed)
+{
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenReplay(pPath, Speed));
+
+}// OrionCommOpenReplay
+
+// Make sure the mapping has room for another Needed bytes, growing the file if need be
+static BOOL GrowLog(OrionLog_t *pLog, size_t Needed)
+{
+    size_t Size;
+    void *pMap;
+
+    // Already room
+    if (pLog->Used + Needed <= pLog->Size)
+        return TRUE;
+
+    // Round the new size up to the growth increment
+    Size = ((pLog->Used + Needed + LOG_GROW_SIZE - 1) / LOG_GROW_SIZE) * LOG_GROW_SIZE;
+
+    // Extend the file, then map the whole thing again
+    if (ftruncate(pLog->Handle, (off_t)Size) != 0)
+        return FALSE;
+
+    pMap = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, pLog->Handle, 0);
+    if (pMap == MAP_FAILED)
+        return FALSE;
+
+    // Swap the new mapping in for the old one
+    if (pLog->pMap != NULL)
+        munmap(pLog->pMap, pLog->Size);
+    pLog->pMap = (UInt8 *)pMap;
+    pLog->Size = Size;
+
+    return TRUE;
+
+}// GrowLog
+
+// Look at the record at the current replay offset, returning FALSE at the end of the log
+static BOOL NextRecord(const OrionReplay_t *pReplay, UInt64 *pTimeUs, UInt32 *pLength)
+{
+    const UInt8 *pRecord = &pReplay->pMap[pReplay->Offset];
+    size_t Remaining = pReplay->Size - pReplay->Offset;
+
+    // Not enough left for a record header
+    if (Remaining < RECORD_HEADER_SIZE)
+        return FALSE;
+
+    memcpy(pTimeUs, pRecord, sizeof(*pTimeUs));
+    memcpy(pLength, &pRecord[8], sizeof(*pLength));
+
+    // A zero length marks the unwritten tail of a log that was never closed
+    return (*pLength != 0) && (*pLength <= Remaining - RECORD_HEADER_SIZE);
+
+}// NextRecord
+
+// Time at which a record should be handed out, given the playback speed
+static UInt64 RecordDueUs(const OrionReplay_t *pReplay, UInt64 TimeUs)
+{
+    if (pReplay->Speed <= 0.0)
+        return 0;
+
+    return pReplay->StartUs + (UInt64)((TimeUs - pReplay->FirstUs) / pReplay->Speed);
+
+}// RecordDueUs
+
+static ssize_t ReplayRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    OrionReplay_t *pReplay = (OrionReplay_t *)pConn->pTransport;
+    UInt64 TimeUs;
+    UInt32 Length, Count;
+
+    // End of the log is end of file
+    if (NextRecord(pReplay, &TimeUs, &Length) == FALSE)
+        return 0;
+
+    // Nothing to read until this record is due
+    if (OrionCommGetTimeUs() < RecordDueUs(pReplay, TimeUs))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Hand out as much of the record as will fit, as having arrived when it came due. That keeps
+    //  the recorded spacing while staying on the OrionCommGetTimeUs clock, which the recording
+    //  session's stamps aren't; replaying flat out leaves the stamp to the time of the read.
+    pConn->RxReadUs = RecordDueUs(pReplay, TimeUs);
+    Count = Length - pReplay->ChunkOffset;
+    if (Count > Size)
+        Count = (UInt32)Size;
+    memcpy(pBuffer, &pReplay->pMap[pReplay->Offset + RECORD_HEADER_SIZE + pReplay->ChunkOffset], Count);
+
+    // Move on to the next record once this one's been used up
+    pReplay->ChunkOffset += Count;
+    if (pReplay->ChunkOffset == Length)
+    {
+        pReplay->Offset += RECORD_HEADER_SIZE + Length;
+        pReplay->ChunkOffset = 0;
+    }
+
+    return (ssize_t)Count;
+
+}// ReplayRead
+
+static ssize_t ReplayWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    // There's nobody on the other end, so just pretend it went out
+    return (ssize_t)Size;
+
+}// ReplayWrite
+
+static void ReplayWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    OrionReplay_t *pReplay = (OrionReplay_t *)pConn->pTransport;
+    UInt64 TimeUs, Now = OrionCommGetTimeUs(), Due;
+    UInt32 Length;
+
+    // At the end of the log, the next read will report it straight away
+    if (NextRecord(pReplay, &TimeUs, &Length) == FALSE)
+        return;
+
+    // Sleep until the next record is due or we run out of time
+    Due = RecordDueUs(pReplay, TimeUs);
+    if (Due > Now)
+    {
+        UInt64 Sleep = ((Due - Now) < TimeoutUs) ? (Due - Now) : TimeoutUs;
+        struct timespec Time = { (time_t)(Sleep / 1000000), (long)(Sleep % 1000000) * 1000 };
+        nanosleep(&Time, NULL);
+    }
+
+}// ReplayWait
+
+static void ReplayClose(OrionConn_t *pConn)
+{
+    OrionReplay_t *pReplay = (OrionReplay_t *)pConn->pTransport;
+
+    munmap((void *)pReplay->pMap, pReplay->Size);
+    free(pReplay);
+
+}// ReplayClose
+
+#endif // __linux__ || __APPLE__
@@ -0,0 +1,40 @@
+#ifndef ORIONCOMMLOG_H
+#define ORIONCOMMLOG_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Raw stream logs hold every chunk of bytes read from a link, each with the monotonic time in
+//  microseconds at which it was read. Logs are written through a memory mapping and only ever
+//  appended to, and can be replayed through a connection as if a gimbal were attached.
+typedef struct OrionLog_s OrionLog_t;
+
+// Replay speed that delivers every chunk as soon as it's asked for
+#define ORION_REPLAY_AFAP   0.0
+
+OrionLog_t *OrionLogCreate(const char *pPath);
+BOOL OrionLogWrite(OrionLog_t *pLog, UInt64 TimeUs, const void *pData, UInt32 Length);
+void OrionLogClose(OrionLog_t *pLog);
+BOOL OrionLogPathValid(const char *pPath);
+
+BOOL OrionConnStartRecording(OrionConn_t *pConn, const char *pPath);
+void OrionConnStopRecording(OrionConn_t *pConn);
+OrionConn_t *OrionConnOpenReplay(const char *pPath, double Speed);
+
+BOOL OrionCommStartRecording(const char *pPath);
+void OrionCommStopRecording(void);
+BOOL OrionCommOpenReplay(const char *pPath, double Speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMLOG_H
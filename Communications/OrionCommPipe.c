@@ -0,0 +1,616 @@
+#include "OrionCommPipe.h"
+#include "OrionCommPrivate.h"
+#include "OrionPublicPacket.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include "fieldencode.h"
+#include "fielddecode.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Data carried by each packet: a full user data payload
+#define FRAGMENT_SIZE       sizeof(((OrionUserData_t *)0)->data)
+
+// The top bit of a packet's id marks it as an acknowledgement; the rest is a sequence number
+#define ACK_FLAG            0x80000000UL
+#define SEQ_MASK            0x7FFFFFFFUL
+
+// Largest window in packets, which keeps sequence numbers far from wrapping into each other
+#define MAX_WINDOW          4096
+
+// Retransmission timeout until there's a round trip to go on, and the range it's kept within
+#define INITIAL_RTO_US      200000
+#define MIN_RTO_US          10000
+#define MAX_RTO_US          2000000
+
+// Acknowledgements carry the room left at the far end, then a bitmap of packets that have arrived
+//  out of order, which is as long as the window or the rest of the packet allows
+#define ACK_HEADER_SIZE     4
+#define MAX_SACK_BITS       ((FRAGMENT_SIZE - ACK_HEADER_SIZE) * 8)
+
+// One packet's worth of data in the send or receive window
+typedef struct
+{
+    UInt32 Size;                // Bytes of data, or 0 if the slot is empty
+    UInt32 Sends;               // Number of times it's been sent
+    BOOL Sacked;                // TRUE if the far end has it, but not everything before it
+    UInt64 SentUs;              // When it was last sent
+    UInt8 Data[FRAGMENT_SIZE];  // The data itself
+} OrionPipeFragment_t;
+
+struct OrionPipe_s
+{
+    // Connection and user data port the pipe runs over, and the scheduler to send through (or NULL)
+    OrionConn_t *pConn;
+    OrionSched_t *pSched;
+    UInt8 Port;
+
+    // Window size in packets, which is a power of two, and the mask that turns sequence numbers
+    //  into slots
+    UInt32 Window;
+    UInt32 Mask;
+
+    // Outgoing data. [TxBase, TxNext) has been sent but not acknowledged and [TxNext, TxEnd) is
+    //  still to go; the far end has room for everything before TxLimit, as of the last
+    //  acknowledgement at LastAckUs.
+    OrionPipeFragment_t *pTx;
+    UInt32 TxBase, TxNext, TxEnd, TxLimit;
+    UInt64 LastAckUs;
+
+    // Smoothed round trip time and its variation, and the retransmission timeout they give
+    UInt32 SrttUs, RttVarUs, RtoUs;
+
+    // Incoming data. [RxRead, RxNext) has arrived in order and is waiting to be read, starting
+    //  RxOffset bytes into RxRead; anything later arrived out of order. RxEdge is the end of the
+    //  room last advertised to the far end.
+    OrionPipeFragment_t *pRx;
+    UInt32 RxRead, RxOffset, RxNext, RxEdge;
+    BOOL AckDue;
+
+    // Counters since the last reset
+    OrionPipeStats_t Stats;
+};
+
+static BOOL ReadyToSend(const OrionPipe_t *pPipe, UInt64 NowUs);
+static BOOL SendData(OrionPipe_t *pPipe, UInt32 Seq, UInt64 NowUs);
+static BOOL SendAck(OrionPipe_t *pPipe);
+static BOOL SendUserData(OrionPipe_t *pPipe, const OrionUserData_t *pUser);
+static void HandleAck(OrionPipe_t *pPipe, const OrionUserData_t *pUser);
+static void HandleData(OrionPipe_t *pPipe, const OrionUserData_t *pUser);
+static void UpdateRtt(OrionPipe_t *pPipe, UInt32 SampleUs);
+static void ResetRto(OrionPipe_t *pPipe);
+
+/*!
+ * Create a byte pipe over a connection. The far end must run a pipe on the same port.
+ * \param pConn is the connection to run over, which must outlive the pipe
+ * \param Port is the user data port (a UserDataPort_t) to send on and accept packets from
+ * \param Window is the number of packets that can be in flight at once, rounded up to a power of
+ *        two. The same number of 128 byte packets is buffered at each end.
+ * \return a pointer to the new pipe, or NULL on failure
+ */
+OrionPipe_t *OrionPipeCreate(OrionConn_t *pConn, UInt8 Port, UInt32 Window)
+{
+    OrionPipe_t *pPipe;
+    UInt32 Size = 1;
+
+    // Nothing to run over without a connection
+    if ((pConn == NULL) || ((pPipe = (OrionPipe_t *)calloc(1, sizeof(OrionPipe_t))) == NULL))
+        return NULL;
+
+    // Round the window up to a power of two, within reason
+    while ((Size < Window) && (Size < MAX_WINDOW))
+        Size <<= 1;
+
+    // Out of memory: free whatever we got
+    if (((pPipe->pTx = (OrionPipeFragment_t *)calloc(Size, sizeof(OrionPipeFragment_t))) == NULL) ||
+        ((pPipe->pRx = (OrionPipeFragment_t *)calloc(Size, sizeof(OrionPipeFragment_t))) == NULL))
+    {
+        OrionPipeDestroy(pPipe);
+        return NULL;
+    }
+
+    pPipe->pConn = pConn;
+    pPipe->Port = Port;
+    pPipe->Window = Size;
+    pPipe->Mask = Size - 1;
+
+    // Until the far end says otherwise, assume it has room for a whole window
+    pPipe->TxLimit = pPipe->RxEdge = Size;
+    pPipe->LastAckUs = OrionCommGetTimeUs();
+    pPipe->RtoUs = INITIAL_RTO_US;
+
+    return pPipe;
+
+}// OrionPipeCreate
+
+/*!
+ * Free a pipe, dropping any data that hasn't been sent or read
+ * \param pPipe is the pipe to free, which may be NULL
+ */
+void OrionPipeDestroy(OrionPipe_t *pPipe)
+{
+    if (pPipe == NULL)
+        return;
+
+    free(pPipe->pTx);
+    free(pPipe->pRx);
+    free(pPipe);
+
+}// OrionPipeDestroy
+
+/*!
+ * Send the pipe's packets through a transmit scheduler rather than straight to the connection,
+ * so that they share a slow link fairly with everything else. User data is bulk traffic by default.
+ * \param pPipe is the pipe
+ * \param pSched is a scheduler on the pipe's connection, or NULL to send straight to it
+ */
+void OrionPipeSetScheduler(OrionPipe_t *pPipe, OrionSched_t *pSched)
+{
+    pPipe->pSched = pSched;
+
+}// OrionPipeSetScheduler
+
+/*!
+ * Write bytes into a pipe, and send as much as the window allows right away. This never blocks;
+ * bytes that don't fit in the window are left for the caller to write again later.
+ * \param pPipe is the pipe
+ * \param pData points to the bytes to write
+ * \param Size is the number of bytes to write
+ * \return the number of bytes accepted, which may be anything from 0 to Size
+ */
+UInt32 OrionPipeWrite(OrionPipe_t *pPipe, const void *pData, UInt32 Size)
+{
+    const UInt8 *pBytes = (const UInt8 *)pData;
+    UInt32 Written = 0;
+
+    while (Written < Size)
+    {
+        OrionPipeFragment_t *pFrag = &pPipe->pTx[(pPipe->TxEnd - 1) & pPipe->Mask];
+        UInt32 Count;
+
+        // Top up the last fragment if it hasn't gone out yet, otherwise start a new one if the
+        //  window has a free slot
+        if ((pPipe->TxEnd == pPipe->TxNext) || (pFrag->Size == FRAGMENT_SIZE))
+        {
+            if (pPipe->TxEnd - pPipe->TxBase >= pPipe->Window)
+                break;
+
+            pFrag = &pPipe->pTx[pPipe->TxEnd++ & pPipe->Mask];
+            pFrag->Size = pFrag->Sends = 0;
+            pFrag->Sacked = FALSE;
+        }
+
+        // Copy in as much as fits
+        Count = FRAGMENT_SIZE - pFrag->Size;
+        if (Count > Size - Written)
+            Count = Size - Written;
+
+        memcpy(&pFrag->Data[pFrag->Size], &pBytes[Written], Count);
+        pFrag->Size += Count;
+        Written += Count;
+    }
+
+    // Get it moving
+    pPipe->Stats.BytesWritten += Written;
+    if (Written > 0)
+        OrionPipeService(pPipe);
+
+    return Written;
+
+}// OrionPipeWrite
+
+/*!
+ * Read bytes that have arrived in order from a pipe. This never blocks.
+ * \param pPipe is the pipe
+ * \param pData receives the bytes
+ * \param Size is the most bytes to read
+ * \return the number of bytes read, which is 0 if there's nothing to read yet
+ */
+UInt32 OrionPipeRead(OrionPipe_t *pPipe, void *pData, UInt32 Size)
+{
+    UInt8 *pBytes = (UInt8 *)pData;
+    UInt32 Count = 0;
+
+    // Copy out of the in-order fragments, freeing each one as it's finished with
+    while ((Count < Size) && (pPipe->RxRead != pPipe->RxNext))
+    {
+        OrionPipeFragment_t *pFrag = &pPipe->pRx[pPipe->RxRead & pPipe->Mask];
+        UInt32 Chunk = pFrag->Size - pPipe->RxOffset;
+
+        if (Chunk > Size - Count)
+            Chunk = Size - Count;
+
+        memcpy(&pBytes[Count], &pFrag->Data[pPipe->RxOffset], Chunk);
+        pPipe->RxOffset += Chunk;
+        Count += Chunk;
+
+        // On to the next fragment if that's all of this one
+        if (pPipe->RxOffset == pFrag->Size)
+        {
+            pFrag->Size = 0;
+            pPipe->RxOffset = 0;
+            pPipe->RxRead++;
+        }
+    }
+
+    // Let the far end know once half the window has opened up since it last heard
+    if (pPipe->RxRead + pPipe->Window - pPipe->RxEdge > (pPipe->Window - 1) / 2)
+        pPipe->AckDue = TRUE;
+
+    pPipe->Stats.BytesRead += Count;
+    return Count;
+
+}// OrionPipeRead
+
+/*!
+ * Hand a received packet to a pipe. Call this for every packet received on the pipe's connection,
+ * then call OrionPipeService to acknowledge whatever arrived.
+ * \param pPipe is the pipe
+ * \param pPkt is the received packet
+ * \return TRUE if the packet belonged to the pipe, or FALSE if it's for someone else
+ */
+BOOL OrionPipeProcess(OrionPipe_t *pPipe, const OrionPkt_t *pPkt)
+{
+    OrionUserData_t User;
+
+    // Only user data on our port is any of our business
+    if ((pPkt->ID != ORION_PKT_USER_DATA) || (decodeOrionUserDataPacketStructure(pPkt, &User) == 0) || (User.port != pPipe->Port))
+        return FALSE;
+
+    // The decoder takes the size on trust, so make sure the data really is all there
+    if ((User.size > FRAGMENT_SIZE) || (pPkt->Length < getOrionUserDataMinDataLength() + User.size))
+        return TRUE;
+
+    if (User.id & ACK_FLAG)
+        HandleAck(pPipe, &User);
+    else
+        HandleData(pPipe, &User);
+
+    return TRUE;
+
+}// OrionPipeProcess
+
+/*!
+ * Send whatever's due: packets that weren't acknowledged in time, new data the window has room
+ * for, and an acknowledgement of what's arrived. Call this whenever OrionPipeGetWaitUs says it's
+ * time, and after handing received packets to OrionPipeProcess.
+ * \param pPipe is the pipe
+ * \return the number of packets sent
+ */
+int OrionPipeService(OrionPipe_t *pPipe)
+{
+    UInt64 NowUs = OrionCommGetTimeUs();
+    int Sent = 0;
+    UInt32 Seq;
+
+    // Anything the far end hasn't got that's been in flight longer than the timeout has probably
+    //  been lost, so send it again, backing the timeout off each time the oldest has to go again
+    for (Seq = pPipe->TxBase; Seq != pPipe->TxNext; Seq++)
+    {
+        const OrionPipeFragment_t *pFrag = &pPipe->pTx[Seq & pPipe->Mask];
+
+        if (pFrag->Sacked || (NowUs - pFrag->SentUs < pPipe->RtoUs))
+            continue;
+        if (SendData(pPipe, Seq, NowUs) == FALSE)
+            break;
+        if ((Seq == pPipe->TxBase) && ((pPipe->RtoUs *= 2) > MAX_RTO_US))
+            pPipe->RtoUs = MAX_RTO_US;
+
+        pPipe->Stats.Retransmits++;
+        Sent++;
+    }
+
+    // Then new data, as long as it's allowed and the connection will take it
+    while (ReadyToSend(pPipe, NowUs) && SendData(pPipe, pPipe->TxNext, NowUs))
+    {
+        pPipe->TxNext++;
+        Sent++;
+    }
+
+    // Tell the far end where we're up to
+    if (pPipe->AckDue && SendAck(pPipe))
+        Sent++;
+
+    // If the connection batches packets, these ones have already waited their turn
+    if ((Sent > 0) && (pPipe->pSched == NULL))
+        OrionConnFlush(pPipe->pConn);
+
+    return Sent;
+
+}// OrionPipeService
+
+/*!
+ * Find out how long until a pipe next needs servicing
+ * \param pPipe is the pipe
+ * \return the wait in microseconds (0 to call OrionPipeService right away), or ORION_PIPE_IDLE if
+ *         there's nothing to send and nothing in flight
+ */
+UInt32 OrionPipeGetWaitUs(OrionPipe_t *pPipe)
+{
+    UInt64 NowUs = OrionCommGetTimeUs(), DueUs;
+    UInt32 Seq;
+
+    // An acknowledgement or new data can go right away
+    if (pPipe->AckDue || ReadyToSend(pPipe, NowUs))
+        return 0;
+
+    // With nothing in flight, the only thing to wait for is a chance to probe a far end that
+    //  had no room, if there's anything to send it
+    if (pPipe->TxBase == pPipe->TxNext)
+    {
+        if (pPipe->TxNext == pPipe->TxEnd)
+            return ORION_PIPE_IDLE;
+
+        DueUs = pPipe->LastAckUs + pPipe->RtoUs;
+    }
+    // Otherwise it's whichever packet in flight times out first. The oldest is never one the far
+    //  end already has, or it would have been acknowledged.
+    else
+    {
+        DueUs = pPipe->pTx[pPipe->TxBase & pPipe->Mask].SentUs + pPipe->RtoUs;
+        for (Seq = pPipe->TxBase + 1; Seq != pPipe->TxNext; Seq++)
+        {
+            const OrionPipeFragment_t *pFrag = &pPipe->pTx[Seq & pPipe->Mask];
+
+            if (!pFrag->Sacked && (pFrag->SentUs + pPipe->RtoUs < DueUs))
+                DueUs = pFrag->SentUs + pPipe->RtoUs;
+        }
+    }
+
+    return (DueUs <= NowUs) ? 0 : (UInt32)(DueUs - NowUs);
+
+}// OrionPipeGetWaitUs
+
+/*!
+ * Find out how many bytes written to a pipe haven't been acknowledged by the far end yet
+ * \param pPipe is the pipe
+ * \return the number of bytes still to be delivered, which is 0 once everything has arrived
+ */
+UInt32 OrionPipeGetPending(const OrionPipe_t *pPipe)
+{
+    UInt32 Seq, Pending = 0;
+
+    for (Seq = pPipe->TxBase; Seq != pPipe->TxEnd; Seq++)
+        Pending += pPipe->pTx[Seq & pPipe->Mask].Size;
+
+    return Pending;
+
+}// OrionPipeGetPending
+
+/*!
+ * Get a pipe's counters, optionally resetting them
+ * \param pPipe is the pipe
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ */
+void OrionPipeGetStats(OrionPipe_t *pPipe, OrionPipeStats_t *pStats, BOOL Reset)
+{
+    // Hand back a copy of the counters, along with the current round trip estimate
+    *pStats = pPipe->Stats;
+    pStats->RttUs = pPipe->SrttUs;
+
+    if (Reset)
+        memset(&pPipe->Stats, 0, sizeof(pPipe->Stats));
+
+}// OrionPipeGetStats
+
+// Decide whether the next unsent fragment can go now. A partly filled one waits until nothing
+//  else is in flight, so that small writes made in the meantime go out together. Nothing goes
+//  beyond the far end's room, except for a single probe once it's been quiet for a timeout.
+static BOOL ReadyToSend(const OrionPipe_t *pPipe, UInt64 NowUs)
+{
+    BOOL Idle = (pPipe->TxNext == pPipe->TxBase);
+
+    if (pPipe->TxNext == pPipe->TxEnd)
+        return FALSE;
+    if ((pPipe->pTx[pPipe->TxNext & pPipe->Mask].Size < FRAGMENT_SIZE) && !Idle)
+        return FALSE;
+
+    return ((SInt32)(pPipe->TxNext - pPipe->TxLimit) < 0) || (Idle && (NowUs - pPipe->LastAckUs >= pPipe->RtoUs));
+
+}// ReadyToSend
+
+// Send (or resend) the fragment with a given sequence number
+static BOOL SendData(OrionPipe_t *pPipe, UInt32 Seq, UInt64 NowUs)
+{
+    OrionPipeFragment_t *pFrag = &pPipe->pTx[Seq & pPipe->Mask];
+    OrionUserData_t User;
+
+    User.port = (UserDataPort_t)pPipe->Port;
+    User.size = (uint8_t)pFrag->Size;
+    User.id = Seq & SEQ_MASK;
+    memcpy(User.data, pFrag->Data, pFrag->Size);
+
+    if (SendUserData(pPipe, &User) == FALSE)
+        return FALSE;
+
+    // Note when it went, for timing it out and for measuring the round trip
+    pFrag->SentUs = NowUs;
+    pFrag->Sends++;
+    pPipe->Stats.Sent++;
+    return TRUE;
+
+}// SendData
+
+// Acknowledge everything that's arrived in order, say how much more there's room for, and list
+//  what's arrived beyond the first gap
+static BOOL SendAck(OrionPipe_t *pPipe)
+{
+    UInt32 Room = pPipe->Window - (pPipe->RxNext - pPipe->RxRead), Bits = 0, i;
+    OrionUserData_t User;
+    int Index = 0;
+
+    User.port = (UserDataPort_t)pPipe->Port;
+    User.id = ACK_FLAG | (pPipe->RxNext & SEQ_MASK);
+    uint32ToBeBytes(Room, User.data, &Index);
+    memset(&User.data[Index], 0, FRAGMENT_SIZE - Index);
+
+    // Bit i is set if packet RxNext + 1 + i is here, and the bitmap stops at the last one that is
+    for (i = 0; (i < MAX_SACK_BITS) && (i + 1 < Room); i++)
+    {
+        if (pPipe->pRx[(pPipe->RxNext + 1 + i) & pPipe->Mask].Size != 0)
+        {
+            User.data[Index + i / 8] |= (UInt8)(1 << (i % 8));
+            Bits = i + 1;
+        }
+    }
+    User.size = (uint8_t)(Index + (Bits + 7) / 8);
+
+    if (SendUserData(pPipe, &User) == FALSE)
+        return FALSE;
+
+    pPipe->RxEdge = pPipe->RxNext + Room;
+    pPipe->AckDue = FALSE;
+    pPipe->Stats.AcksSent++;
+    return TRUE;
+
+}// SendAck
+
+// Encode a user data packet and send it, through the scheduler if there is one
+static BOOL SendUserData(OrionPipe_t *pPipe, const OrionUserData_t *pUser)
+{
+    OrionPkt_t Pkt;
+
+    encodeOrionUserDataPacketStructure(&Pkt, pUser);
+    if (pPipe->pSched != NULL)
+        return OrionSchedSend(pPipe->pSched, &Pkt);
+    else
+        return OrionConnSend(pPipe->pConn, &Pkt);
+
+}// SendUserData
+
+// Take in an acknowledgement from the far end
+static void HandleAck(OrionPipe_t *pPipe, const OrionUserData_t *pUser)
+{
+    UInt32 Acked = (pUser->id - pPipe->TxBase) & SEQ_MASK, Bits, Last = 0, Seq, i;
+    UInt64 NowUs = OrionCommGetTimeUs();
+    int Index = 0;
+
+    // Ignore anything too short to be an acknowledgement, or that acknowledges data we never sent
+    //  (which includes stale acknowledgements from before TxBase)
+    if ((pUser->size < ACK_HEADER_SIZE) || (Acked > pPipe->TxNext - pPipe->TxBase))
+        return;
+
+    pPipe->TxLimit = pPipe->TxBase + Acked + uint32FromBeBytes(pUser->data, &Index);
+    pPipe->Stats.AcksReceived++;
+    pPipe->LastAckUs = NowUs;
+
+    if (Acked > 0)
+    {
+        BOOL Clean = TRUE;
+
+        // Time the round trip off the newest packet acknowledged, but only if every packet it
+        //  covers went through first time. After a resend there's no telling which copy got
+        //  through, and after a gap the acknowledgement was held up waiting for it to fill.
+        for (Seq = pPipe->TxBase; Seq != pPipe->TxBase + Acked; Seq++)
+        {
+            if ((pPipe->pTx[Seq & pPipe->Mask].Sends != 1) || pPipe->pTx[Seq & pPipe->Mask].Sacked)
+                Clean = FALSE;
+        }
+
+        if (Clean)
+            UpdateRtt(pPipe, (UInt32)(NowUs - pPipe->pTx[(Seq - 1) & pPipe->Mask].SentUs));
+
+        // Things are moving again, so there's no call to keep backing off
+        pPipe->TxBase += Acked;
+        ResetRto(pPipe);
+    }
+
+    // Note everything the far end has beyond the first gap
+    Bits = (pUser->size - ACK_HEADER_SIZE) * 8;
+    for (i = 0; (i < Bits) && (i + 1 < pPipe->TxNext - pPipe->TxBase); i++)
+    {
+        if (pUser->data[Index + i / 8] & (1 << (i % 8)))
+        {
+            pPipe->pTx[(pPipe->TxBase + 1 + i) & pPipe->Mask].Sacked = TRUE;
+            Last = i + 2;
+        }
+    }
+
+    // Anything missing from before the last packet that arrived was most likely lost, so resend
+    //  it now rather than waiting for it to time out; but only once per round trip, as a resent
+    //  packet could still be on its way
+    for (Seq = pPipe->TxBase; Seq != pPipe->TxBase + Last; Seq++)
+    {
+        const OrionPipeFragment_t *pFrag = &pPipe->pTx[Seq & pPipe->Mask];
+
+        if (pFrag->Sacked || (NowUs - pFrag->SentUs < pPipe->SrttUs))
+            continue;
+        if (SendData(pPipe, Seq, NowUs) == FALSE)
+            break;
+
+        pPipe->Stats.Retransmits++;
+    }
+
+}// HandleAck
+
+// Take in a fragment of data from the far end
+static void HandleData(OrionPipe_t *pPipe, const OrionUserData_t *pUser)
+{
+    UInt32 Seq = pPipe->RxNext + ((pUser->id - pPipe->RxNext) & SEQ_MASK);
+    OrionPipeFragment_t *pFrag = &pPipe->pRx[Seq & pPipe->Mask];
+
+    // Whatever it turns out to be, the far end will need to hear where we're up to
+    pPipe->Stats.Received++;
+    pPipe->AckDue = TRUE;
+
+    // Keep it if there's room for it and we haven't already got it
+    if ((pUser->size == 0) || (Seq - pPipe->RxRead >= pPipe->Window) || (pFrag->Size != 0))
+    {
+        pPipe->Stats.Duplicates++;
+        return;
+    }
+
+    memcpy(pFrag->Data, pUser->data, pUser->size);
+    pFrag->Size = pUser->size;
+
+    // Move past everything that's now arrived in order
+    while ((pPipe->RxNext - pPipe->RxRead < pPipe->Window) && (pPipe->pRx[pPipe->RxNext & pPipe->Mask].Size != 0))
+        pPipe->RxNext++;
+
+}// HandleData
+
+// Fold a round trip measurement into the smoothed estimates, and work out a new timeout from them
+static void UpdateRtt(OrionPipe_t *pPipe, UInt32 SampleUs)
+{
+    UInt32 ErrorUs;
+
+    // A zero round trip would read as no measurement at all
+    if (SampleUs == 0)
+        SampleUs = 1;
+
+    // The first measurement stands on its own; after that, the usual 1/8 and 1/4 gains
+    if (pPipe->SrttUs == 0)
+    {
+        pPipe->SrttUs = SampleUs;
+        pPipe->RttVarUs = SampleUs / 2;
+    }
+    else
+    {
+        ErrorUs = (SampleUs > pPipe->SrttUs) ? SampleUs - pPipe->SrttUs : pPipe->SrttUs - SampleUs;
+        pPipe->RttVarUs = (3 * pPipe->RttVarUs + ErrorUs) / 4;
+        pPipe->SrttUs = (7 * pPipe->SrttUs + SampleUs) / 8;
+    }
+
+    ResetRto(pPipe);
+
+}// UpdateRtt
+
+// Work out the retransmission timeout from the round trip estimates, undoing any backoff
+static void ResetRto(OrionPipe_t *pPipe)
+{
+    // Nothing to go on until there's been a measurement
+    if (pPipe->SrttUs == 0)
+        return;
+
+    // Allow for four times the variation, within limits
+    pPipe->RtoUs = pPipe->SrttUs + 4 * pPipe->RttVarUs;
+    if (pPipe->RtoUs < MIN_RTO_US)
+        pPipe->RtoUs = MIN_RTO_US;
+    else if (pPipe->RtoUs > MAX_RTO_US)
+        pPipe->RtoUs = MAX_RTO_US;
+
+}// ResetRto
+
+#endif // __linux__ || __APPLE__
@@ -0,0 +1,55 @@
+#ifndef ORIONCOMMPIPE_H
+#define ORIONCOMMPIPE_H
+
+#include "OrionComm.h"
+#include "OrionCommSched.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A reliable, ordered byte stream carried in ORION_PKT_USER_DATA packets on one user data port.
+//  Written bytes are cut into full-size packets whose id is a sequence number, and a window of
+//  them is kept in flight at once. The far end puts them back in order, acknowledges them and
+//  says how much room it has left, and anything that isn't acknowledged in time is sent again.
+//  Both ends of the link have to be running a pipe on the same port.
+typedef struct OrionPipe_s OrionPipe_t;
+
+// Returned by OrionPipeGetWaitUs when there's nothing to send and nothing to wait for
+#define ORION_PIPE_IDLE     0xFFFFFFFF
+
+// Pipe counters
+typedef struct
+{
+    UInt32 BytesWritten;    // Bytes accepted by OrionPipeWrite
+    UInt32 BytesRead;       // Bytes handed out by OrionPipeRead
+    UInt32 Sent;            // Data packets sent, including retransmissions
+    UInt32 Retransmits;     // Data packets sent again because they weren't acknowledged in time
+    UInt32 Received;        // Data packets received
+    UInt32 Duplicates;      // Data packets received that were already held, or had no room
+    UInt32 AcksSent;        // Acknowledgements sent
+    UInt32 AcksReceived;    // Acknowledgements received
+    UInt32 RttUs;           // Smoothed round trip time, from packet sent to acknowledgement
+} OrionPipeStats_t;
+
+OrionPipe_t *OrionPipeCreate(OrionConn_t *pConn, UInt8 Port, UInt32 Window);
+void OrionPipeDestroy(OrionPipe_t *pPipe);
+void OrionPipeSetScheduler(OrionPipe_t *pPipe, OrionSched_t *pSched);
+UInt32 OrionPipeWrite(OrionPipe_t *pPipe, const void *pData, UInt32 Size);
+UInt32 OrionPipeRead(OrionPipe_t *pPipe, void *pData, UInt32 Size);
+BOOL OrionPipeProcess(OrionPipe_t *pPipe, const OrionPkt_t *pPkt);
+int  OrionPipeService(OrionPipe_t *pPipe);
+UInt32 OrionPipeGetWaitUs(OrionPipe_t *pPipe);
+UInt32 OrionPipeGetPending(const OrionPipe_t *pPipe);
+void OrionPipeGetStats(OrionPipe_t *pPipe, OrionPipeStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMPIPE_H
@@ -0,0 +1,129 @@
+#ifndef ORIONCOMMPRIVATE_H
+#define ORIONCOMMPRIVATE_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <sys/types.h>
+
+// Internal to the Communications library: lets other transports plug in underneath OrionConn_t
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct OrionLog_s OrionLog_t;
+typedef struct OrionConnStats_s OrionConnStats_t;
+struct msghdr;
+
+// Transport operations, which follow the read()/write() conventions (-1 and errno EAGAIN when
+//  there's nothing to read yet, 0 at end of stream)
+typedef struct
+{
+    ssize_t (*pRead)(OrionConn_t *pConn, void *pBuffer, size_t Size);
+    ssize_t (*pWrite)(OrionConn_t *pConn, const void *pData, size_t Size);
+
+    // Sleep until there's something to read or the timeout expires
+    void (*pWait)(OrionConn_t *pConn, UInt32 TimeoutUs);
+
+    // Release the transport's resources
+    void (*pClose)(OrionConn_t *pConn);
+
+    // Optional: hand over the next chunk of received data where it already sits instead of
+    //  copying it with pRead, following the same return conventions. The data must stay put until
+    //  the next call, and must be no bigger than the receive buffer.
+    ssize_t (*pReadInPlace)(OrionConn_t *pConn, const UInt8 **ppData);
+} OrionConnOps_t;
+
+// Operations for a receive queue that has taken over reading from a connection's link, so that
+//  the connection's receive functions pull packets from the queue instead
+typedef struct
+{
+    // View the next queued packet, waiting up to TimeoutUs for one to arrive. The view stays
+    //  valid until the next call.
+    BOOL (*pReceive)(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs);
+
+    // Return TRUE if there are packets waiting in the queue
+    BOOL (*pPending)(const OrionConn_t *pConn);
+
+    // Stop reading from the link and free the queue
+    void (*pStop)(OrionConn_t *pConn);
+} OrionConnQueueOps_t;
+
+// Everything needed to talk to one gimbal over one link
+struct OrionConn_s
+{
+    // File descriptor for the serial port or TCP socket, or -1 if the transport has none
+    int Handle;
+
+    // Transport operations, and any state the transport needs
+    const OrionConnOps_t *pOps;
+    void *pTransport;
+
+    // Set once the far end hangs up or the link fails
+    BOOL LinkDown;
+
+    // Incoming data buffer and the parser state that persists between reads. pRxData points at
+    //  the data being framed: the buffer, or wherever the transport read it in place.
+    UInt8 RxBuffer[ORION_COMM_RX_BUFFER_SIZE];
+    const UInt8 *pRxData;
+    UInt32 RxHead, RxTail;
+    OrionPkt_t RxPkt;
+    OrionCommRxStats_t RxStats;
+    TrilliumParseStats_t RxParseStats;
+
+    // When the data in the receive buffer arrived, as stamped by the transport (or by us, if it
+    //  doesn't), and when the first byte of a packet that straddled reads arrived. On a serial
+    //  port each byte takes RxByteNs on the wire, so bytes early in a read arrived before it.
+    UInt64 RxReadUs;
+    UInt64 RxPartialUs;
+    UInt32 RxByteNs;
+
+    // Set if the handle is a socket with kernel receive timestamps turned on
+    BOOL RxKernelTime;
+
+    // When the packet most recently handed to the application arrived
+    UInt64 RxTimeUs;
+
+    // Outgoing packets waiting to be flushed to the link as one write, if batching is on, along
+    //  with the time by which they must go out (0 for no deadline)
+    UInt8 *pTxBuffer;
+    UInt32 TxUsed, TxSize, TxDelayUs;
+    UInt64 TxDeadlineUs;
+    OrionCommTxStats_t TxStats;
+    UInt32 TxSegmentBase;
+
+    // Log that receives a copy of everything read from the link, if recording
+    OrionLog_t *pRecord;
+
+    // Receive queue operations and state, if a receive thread is running
+    const OrionConnQueueOps_t *pQueueOps;
+    void *pQueue;
+
+    // Link statistics, if they've been turned on
+    OrionConnStats_t *pStats;
+};
+
+OrionConn_t *OrionConnCreate(int Handle, const OrionConnOps_t *pOps, void *pTransport);
+BOOL OrionConnReceiveLink(OrionConn_t *pConn, OrionPktView_t *pView);
+
+// Kernel receive timestamps for sockets, converted to the OrionCommGetTimeUs clock
+BOOL OrionCommEnableRxTimestamps(int Handle);
+ssize_t OrionCommReadTimestamped(int Handle, void *pBuffer, size_t Size, UInt64 *pTimeUs);
+SInt64 OrionCommGetClockOffsetUs(void);
+UInt64 OrionCommGetMsgTimeUs(const struct msghdr *pMsg, SInt64 OffsetUs);
+
+// Link statistics hooks, only called when pConn->pStats is set
+void OrionConnStatsRead(OrionConn_t *pConn, UInt32 Bytes);
+void OrionConnStatsRx(OrionConn_t *pConn, const OrionPkt_t *pPkt, UInt64 TimeUs);
+void OrionConnStatsTx(OrionConn_t *pConn, const OrionPkt_t *pPkt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMPRIVATE_H
@@ -0,0 +1,530 @@
+#include "OrionCommQueue.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Size of a cache line, used to keep the producer's and consumer's indices from sharing one
+#define CACHE_LINE_SIZE     64
+
+// Longest the receive thread waits on the link before checking whether it's been told to stop
+#define STOP_POLL_US        50000
+
+// Index loads and stores; an acquire load pairs with the other thread's release store
+#define LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+struct OrionPktQueue_s
+{
+    // Producer's side: the next slot to fill (which also counts every packet queued), the last
+    //  consumer index it saw and the number of packets dropped
+    UInt32 Head;
+    UInt32 TailCache;
+    UInt32 Dropped;
+    UInt8 ProducerPad[CACHE_LINE_SIZE - 3 * sizeof(UInt32)];
+
+    // Consumer's side: the next slot to empty, the last producer index it saw, the high water
+    //  mark and the counter values as of the last reset
+    UInt32 Tail;
+    UInt32 HeadCache;
+    UInt32 MaxDepth;
+    UInt32 QueuedBase;
+    UInt32 DroppedBase;
+    UInt8 ConsumerPad[CACHE_LINE_SIZE - 5 * sizeof(UInt32)];
+
+    // Slot storage; the slot count is a power of two so indices can just be masked
+    OrionPkt_t *pSlots;
+    UInt32 Mask;
+
+    // Set once the producer won't be adding any more packets
+    int Closed;
+
+    // Used only when the consumer sleeps on an empty queue
+    int Waiting;
+    pthread_mutex_t Lock;
+    pthread_cond_t Ready;
+};
+
+// Receive thread state
+typedef struct
+{
+    OrionPktQueue_t *pQueue;
+    pthread_t Thread;
+    int Stop;
+
+    // When the packet in each queue slot arrived
+    UInt64 *pTimes;
+
+    // Set while the consumer has a view of the slot at the front of the queue
+    BOOL Holding;
+} OrionRxThread_t;
+
+static void Wake(OrionPktQueue_t *pQueue);
+static void *RxThread(void *pArg);
+static BOOL QueueReceive(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs);
+static BOOL QueuePending(const OrionConn_t *pConn);
+static void QueueStop(OrionConn_t *pConn);
+
+// Receive queue operations for connections with a receive thread
+static const OrionConnQueueOps_t RxThreadOps = { QueueReceive, QueuePending, QueueStop };
+
+/*!
+ * Create a packet queue
+ * \param Slots is the number of packets the queue can hold, rounded up to a power of two
+ * \return a pointer to the new queue, or NULL if out of memory
+ */
+OrionPktQueue_t *OrionPktQueueCreate(UInt32 Slots)
+{
+    OrionPktQueue_t *pQueue = (OrionPktQueue_t *)calloc(1, sizeof(OrionPktQueue_t));
+    pthread_condattr_t Attr;
+    UInt32 Size = 1;
+
+    // Out of memory
+    if (pQueue == NULL)
+        return NULL;
+
+    // Round the slot count up to a power of two
+    while ((Size < Slots) && (Size < 0x80000000))
+        Size <<= 1;
+
+    pQueue->pSlots = (OrionPkt_t *)malloc(Size * sizeof(OrionPkt_t));
+    pQueue->Mask = Size - 1;
+    if (pQueue->pSlots == NULL)
+    {
+        free(pQueue);
+        return NULL;
+    }
+
+    // Sleeping consumers time out against the monotonic clock where that's possible
+    pthread_condattr_init(&Attr);
+#ifdef __linux__
+    pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&pQueue->Ready, &Attr);
+    pthread_condattr_destroy(&Attr);
+    pthread_mutex_init(&pQueue->Lock, NULL);
+
+    return pQueue;
+
+}// OrionPktQueueCreate
+
+/*!
+ * Free a packet queue. Neither thread may be using it.
+ * \param pQueue is the queue to free, which may be NULL
+ */
+void OrionPktQueueDestroy(OrionPktQueue_t *pQueue)
+{
+    if (pQueue == NULL)
+        return;
+
+    pthread_cond_destroy(&pQueue->Ready);
+    pthread_mutex_destroy(&pQueue->Lock);
+    free(pQueue->pSlots);
+    free(pQueue);
+
+}// OrionPktQueueDestroy
+
+/*!
+ * Get the next free slot so that the producer can fill it in place. Nothing is added to the
+ * queue until OrionPktQueuePush is called.
+ * \param pQueue is the queue, which must only be used by one producer thread
+ * \return a pointer to the next slot, or NULL if the queue is full
+ */
+OrionPkt_t *OrionPktQueueBack(OrionPktQueue_t *pQueue)
+{
+    UInt32 Head = pQueue->Head;
+
+    // Only go back to the consumer's cache line when the queue looks full
+    if (Head - pQueue->TailCache > pQueue->Mask)
+    {
+        pQueue->TailCache = LOAD_ACQUIRE(&pQueue->Tail);
+        if (Head - pQueue->TailCache > pQueue->Mask)
+            return NULL;
+    }
+
+    return &pQueue->pSlots[Head & pQueue->Mask];
+
+}// OrionPktQueueBack
+
+/*!
+ * Add the slot returned by OrionPktQueueBack to the queue
+ * \param pQueue is the queue, which must only be used by one producer thread
+ */
+void OrionPktQueuePush(OrionPktQueue_t *pQueue)
+{
+    // Publish the slot's contents along with the new head. This has to be ordered before the
+    //  check of Waiting below, or a consumer just going to sleep could miss the packet.
+    __atomic_store_n(&pQueue->Head, pQueue->Head + 1, __ATOMIC_SEQ_CST);
+
+    // Only touch the lock if the consumer is actually asleep
+    if (__atomic_load_n(&pQueue->Waiting, __ATOMIC_SEQ_CST))
+        Wake(pQueue);
+
+}// OrionPktQueuePush
+
+/*!
+ * Count a packet that the producer had to throw away because the queue was full
+ * \param pQueue is the queue, which must only be used by one producer thread
+ */
+void OrionPktQueueDrop(OrionPktQueue_t *pQueue)
+{
+    STORE_RELEASE(&pQueue->Dropped, pQueue->Dropped + 1);
+
+}// OrionPktQueueDrop
+
+/*!
+ * Mark the queue as finished, waking the consumer if it's waiting. Packets already in the queue
+ * can still be popped.
+ * \param pQueue is the queue, which must only be used by one producer thread
+ */
+void OrionPktQueueClose(OrionPktQueue_t *pQueue)
+{
+    __atomic_store_n(&pQueue->Closed, 1, __ATOMIC_SEQ_CST);
+    Wake(pQueue);
+
+}// OrionPktQueueClose
+
+/*!
+ * Take the oldest packet off the queue
+ * \param pQueue is the queue, which must only be used by one consumer thread
+ * \param pPkt receives a copy of the packet
+ * \return TRUE if there was a packet, FALSE if the queue was empty
+ */
+BOOL OrionPktQueuePop(OrionPktQueue_t *pQueue, OrionPkt_t *pPkt)
+{
+    const OrionPkt_t *pSlot = OrionPktQueueFront(pQueue);
+
+    if (pSlot == NULL)
+        return FALSE;
+
+    // Copy out only the bytes that were on the wire, then hand the slot back to the producer
+    memcpy(pPkt, pSlot, pSlot->Length + ORION_PKT_OVERHEAD);
+    OrionPktQueueRelease(pQueue);
+
+    return TRUE;
+
+}// OrionPktQueuePop
+
+/*!
+ * Look at the oldest packet in the queue without taking it off. The slot belongs to the consumer
+ * until OrionPktQueueRelease is called.
+ * \param pQueue is the queue, which must only be used by one consumer thread
+ * \return a pointer to the packet, or NULL if the queue is empty
+ */
+const OrionPkt_t *OrionPktQueueFront(OrionPktQueue_t *pQueue)
+{
+    UInt32 Tail = pQueue->Tail, Depth;
+
+    // Only go back to the producer's cache line when the queue looks empty
+    if (Tail == pQueue->HeadCache)
+    {
+        pQueue->HeadCache = LOAD_ACQUIRE(&pQueue->Head);
+        if (Tail == pQueue->HeadCache)
+            return NULL;
+    }
+
+    // Keep track of the deepest the queue has been, as seen from this end
+    Depth = pQueue->HeadCache - Tail;
+    if (Depth > pQueue->MaxDepth)
+        pQueue->MaxDepth = Depth;
+
+    return &pQueue->pSlots[Tail & pQueue->Mask];
+
+}// OrionPktQueueFront
+
+/*!
+ * Take the packet returned by OrionPktQueueFront off the queue, handing its slot back to the producer
+ * \param pQueue is the queue, which must only be used by one consumer thread
+ */
+void OrionPktQueueRelease(OrionPktQueue_t *pQueue)
+{
+    STORE_RELEASE(&pQueue->Tail, pQueue->Tail + 1);
+
+}// OrionPktQueueRelease
+
+/*!
+ * Sleep until the queue has something in it
+ * \param pQueue is the queue, which must only be used by one consumer thread
+ * \param TimeoutUs is the longest to wait
+ * \return TRUE if the queue has packets waiting, FALSE if it timed out or the queue was closed
+ *         while empty
+ */
+BOOL OrionPktQueueWait(OrionPktQueue_t *pQueue, UInt32 TimeoutUs)
+{
+    UInt64 Deadline;
+    struct timespec Until;
+    BOOL Ready;
+
+    // Don't bother with the lock if there's already something waiting
+    if (pQueue->Tail != LOAD_ACQUIRE(&pQueue->Head))
+        return TRUE;
+
+    // Work out when to give up, on the same clock the condition variable uses
+#ifdef __linux__
+    clock_gettime(CLOCK_MONOTONIC, &Until);
+#else
+    clock_gettime(CLOCK_REALTIME, &Until);
+#endif
+    Deadline = (UInt64)Until.tv_sec * 1000000 + Until.tv_nsec / 1000 + TimeoutUs;
+    Until.tv_sec = (time_t)(Deadline / 1000000);
+    Until.tv_nsec = (long)(Deadline % 1000000) * 1000;
+
+    pthread_mutex_lock(&pQueue->Lock);
+
+    // Tell the producer we're going to sleep, then check once more that it hasn't pushed
+    //  something in the meantime; it checks Waiting after pushing, so one of us will notice
+    __atomic_store_n(&pQueue->Waiting, 1, __ATOMIC_SEQ_CST);
+    while (((Ready = (pQueue->Tail != __atomic_load_n(&pQueue->Head, __ATOMIC_SEQ_CST))) == FALSE) &&
+           (__atomic_load_n(&pQueue->Closed, __ATOMIC_SEQ_CST) == 0))
+    {
+        if (pthread_cond_timedwait(&pQueue->Ready, &pQueue->Lock, &Until) == ETIMEDOUT)
+        {
+            Ready = (pQueue->Tail != LOAD_ACQUIRE(&pQueue->Head));
+            break;
+        }
+    }
+    __atomic_store_n(&pQueue->Waiting, 0, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&pQueue->Lock);
+
+    return Ready;
+
+}// OrionPktQueueWait
+
+/*!
+ * Get the queue counters. This may be called from the consumer thread only.
+ * \param pQueue is the queue
+ * \param pStats receives the counters
+ * \param Reset is TRUE to start the counters and high water mark over from zero
+ */
+void OrionPktQueueGetStats(OrionPktQueue_t *pQueue, OrionPktQueueStats_t *pStats, BOOL Reset)
+{
+    UInt32 Queued = LOAD_ACQUIRE(&pQueue->Head), Dropped = LOAD_ACQUIRE(&pQueue->Dropped);
+
+    pStats->Depth = Queued - pQueue->Tail;
+    pStats->MaxDepth = pQueue->MaxDepth;
+    pStats->Queued = Queued - pQueue->QueuedBase;
+    pStats->Dropped = Dropped - pQueue->DroppedBase;
+
+    // The producer owns its counters, so resetting just moves our baseline
+    if (Reset)
+    {
+        pQueue->MaxDepth = 0;
+        pQueue->QueuedBase = Queued;
+        pQueue->DroppedBase = Dropped;
+    }
+
+}// OrionPktQueueGetStats
+
+/*!
+ * Start a thread that reads the connection's link in the background. From then on the
+ * connection's receive functions pull packets from the thread's queue without making system
+ * calls. If the queue fills up, the thread keeps reading and drops the newest packets.
+ * \param pConn is the connection, which must not be serviced by an event loop
+ * \param Slots is the number of packets to queue, rounded up to a power of two
+ * \return TRUE if the thread started, or was already running
+ */
+BOOL OrionConnStartRxThread(OrionConn_t *pConn, UInt32 Slots)
+{
+    OrionRxThread_t *pThread;
+
+    // Nothing to read from, or already reading from it
+    if (pConn == NULL)
+        return FALSE;
+    else if (pConn->pQueueOps != NULL)
+        return TRUE;
+
+    pThread = (OrionRxThread_t *)calloc(1, sizeof(OrionRxThread_t));
+    if (pThread == NULL)
+        return FALSE;
+
+    // Hook the queue up before the thread starts so its very first packet has somewhere to go
+    pThread->pQueue = OrionPktQueueCreate(Slots);
+    if (pThread->pQueue != NULL)
+        pThread->pTimes = (UInt64 *)malloc((pThread->pQueue->Mask + 1) * sizeof(UInt64));
+
+    pConn->pQueue = pThread;
+    if ((pThread->pTimes == NULL) || (pthread_create(&pThread->Thread, NULL, RxThread, pConn) != 0))
+    {
+        OrionPktQueueDestroy(pThread->pQueue);
+        free(pThread->pTimes);
+        free(pThread);
+        pConn->pQueue = NULL;
+        return FALSE;
+    }
+
+    pConn->pQueueOps = &RxThreadOps;
+    return TRUE;
+
+}// OrionConnStartRxThread
+
+/*!
+ * Stop a connection's receive thread. Any packets still in its queue are lost, but data the
+ * thread hadn't framed yet stays in the connection's receive buffer.
+ * \param pConn is the connection
+ */
+void OrionConnStopRxThread(OrionConn_t *pConn)
+{
+    if ((pConn != NULL) && (pConn->pQueueOps != NULL))
+        pConn->pQueueOps->pStop(pConn);
+
+}// OrionConnStopRxThread
+
+/*!
+ * Get the counters for a connection's receive queue
+ * \param pConn is the connection
+ * \param pStats receives the counters
+ * \param Reset is TRUE to start the counters over from zero
+ * \return TRUE if the connection has a receive thread, otherwise pStats is zeroed
+ */
+BOOL OrionConnGetQueueStats(OrionConn_t *pConn, OrionPktQueueStats_t *pStats, BOOL Reset)
+{
+    if ((pConn == NULL) || (pConn->pQueueOps != &RxThreadOps))
+    {
+        memset(pStats, 0, sizeof(*pStats));
+        return FALSE;
+    }
+
+    OrionPktQueueGetStats(((OrionRxThread_t *)pConn->pQueue)->pQueue, pStats, Reset);
+    return TRUE;
+
+}// OrionConnGetQueueStats
+
+/*!
+ * Start a receive thread on the default connection
+ * \param Slots is the number of packets to queue
+ * \return TRUE if the thread started, or was already running
+ */
+BOOL OrionCommStartRxThread(UInt32 Slots)
+{
+    return OrionConnStartRxThread(OrionCommGetDefaultConn(), Slots);
+
+}// OrionCommStartRxThread
+
+/*!
+ * Stop the default connection's receive thread
+ */
+void OrionCommStopRxThread(void)
+{
+    OrionConnStopRxThread(OrionCommGetDefaultConn());
+
+}// OrionCommStopRxThread
+
+/*!
+ * Get the counters for the default connection's receive queue
+ * \param pStats receives the counters
+ * \param Reset is TRUE to start the counters over from zero
+ * \return TRUE if the default connection has a receive thread
+ */
+BOOL OrionCommGetQueueStats(OrionPktQueueStats_t *pStats, BOOL Reset)
+{
+    return OrionConnGetQueueStats(OrionCommGetDefaultConn(), pStats, Reset);
+
+}// OrionCommGetQueueStats
+
+// Wake the consumer if it's asleep in OrionPktQueueWait
+static void Wake(OrionPktQueue_t *pQueue)
+{
+    pthread_mutex_lock(&pQueue->Lock);
+    pthread_cond_signal(&pQueue->Ready);
+    pthread_mutex_unlock(&pQueue->Lock);
+
+}// Wake
+
+// Receive thread: frame packets straight into queue slots until the link drops or we're stopped
+static void *RxThread(void *pArg)
+{
+    OrionConn_t *pConn = (OrionConn_t *)pArg;
+    OrionRxThread_t *pThread = (OrionRxThread_t *)pConn->pQueue;
+    OrionPktQueue_t *pQueue = pThread->pQueue;
+    OrionPktView_t View;
+
+    while (__atomic_load_n(&pThread->Stop, __ATOMIC_ACQUIRE) == 0)
+    {
+        if (OrionConnReceiveLink(pConn, &View))
+        {
+            OrionPkt_t *pSlot = OrionPktQueueBack(pQueue);
+
+            // If the queue is full, drop the packet; the link still gets drained so data doesn't back up in the kernel
+            if (pSlot != NULL)
+            {
+                OrionPktViewCopy(&View, pSlot);
+                pThread->pTimes[pSlot - pQueue->pSlots] = View.TimeUs;
+                OrionPktQueuePush(pQueue);
+            }
+            else
+                OrionPktQueueDrop(pQueue);
+        }
+        else if (pConn->LinkDown)
+            break;
+        else
+            pConn->pOps->pWait(pConn, STOP_POLL_US);
+    }
+
+    // Let a waiting consumer know there's nothing more coming
+    OrionPktQueueClose(pQueue);
+    return NULL;
+
+}// RxThread
+
+// Queue operation: view the next packet in its slot, sleeping for up to TimeoutUs if the queue is empty
+static BOOL QueueReceive(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs)
+{
+    OrionRxThread_t *pThread = (OrionRxThread_t *)pConn->pQueue;
+    OrionPktQueue_t *pQueue = pThread->pQueue;
+
+    // The caller is done with the last packet we showed it, so its slot can be reused
+    if (pThread->Holding)
+    {
+        OrionPktQueueRelease(pQueue);
+        pThread->Holding = FALSE;
+    }
+
+    // Look at the front of the queue, waiting for something to show up if need be
+    pView->pPkt = OrionPktQueueFront(pQueue);
+    if ((pView->pPkt == NULL) && (TimeoutUs > 0) && OrionPktQueueWait(pQueue, TimeoutUs))
+        pView->pPkt = OrionPktQueueFront(pQueue);
+
+    if (pView->pPkt == NULL)
+        return FALSE;
+
+    // Leave the packet in its slot until the next call
+    pView->Size = pView->pPkt->Length + ORION_PKT_OVERHEAD;
+    pView->TimeUs = pThread->pTimes[pView->pPkt - pQueue->pSlots];
+    pThread->Holding = TRUE;
+    return TRUE;
+
+}// QueueReceive
+
+// Queue operation: report whether any packets are waiting
+static BOOL QueuePending(const OrionConn_t *pConn)
+{
+    const OrionRxThread_t *pThread = (const OrionRxThread_t *)pConn->pQueue;
+
+    // The packet the caller is looking at has already been received
+    return LOAD_ACQUIRE(&pThread->pQueue->Head) - pThread->pQueue->Tail > (UInt32)pThread->Holding;
+
+}// QueuePending
+
+// Queue operation: stop the thread and go back to reading the link directly
+static void QueueStop(OrionConn_t *pConn)
+{
+    OrionRxThread_t *pThread = (OrionRxThread_t *)pConn->pQueue;
+
+    __atomic_store_n(&pThread->Stop, 1, __ATOMIC_RELEASE);
+    pthread_join(pThread->Thread, NULL);
+
+    pConn->pQueueOps = NULL;
+    pConn->pQueue = NULL;
+    OrionPktQueueDestroy(pThread->pQueue);
+    free(pThread->pTimes);
+    free(pThread);
+
+}// QueueStop
+
+#endif // __linux__ || __APPLE__
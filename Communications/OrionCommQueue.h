@@ -0,0 +1,55 @@
+#ifndef ORIONCOMMQUEUE_H
+#define ORIONCOMMQUEUE_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A fixed-size ring of packet slots passed from exactly one producer thread to exactly one
+//  consumer thread without locks. Neither side makes a system call unless the consumer chooses
+//  to sleep while the queue is empty.
+typedef struct OrionPktQueue_s OrionPktQueue_t;
+
+// Queue counters
+typedef struct
+{
+    UInt32 Depth;       // Number of packets waiting in the queue right now
+    UInt32 MaxDepth;    // Most packets the consumer has found waiting at once
+    UInt32 Queued;      // Number of packets added to the queue
+    UInt32 Dropped;     // Number of packets thrown away because the queue was full
+} OrionPktQueueStats_t;
+
+OrionPktQueue_t *OrionPktQueueCreate(UInt32 Slots);
+void OrionPktQueueDestroy(OrionPktQueue_t *pQueue);
+OrionPkt_t *OrionPktQueueBack(OrionPktQueue_t *pQueue);
+void OrionPktQueuePush(OrionPktQueue_t *pQueue);
+void OrionPktQueueDrop(OrionPktQueue_t *pQueue);
+void OrionPktQueueClose(OrionPktQueue_t *pQueue);
+BOOL OrionPktQueuePop(OrionPktQueue_t *pQueue, OrionPkt_t *pPkt);
+const OrionPkt_t *OrionPktQueueFront(OrionPktQueue_t *pQueue);
+void OrionPktQueueRelease(OrionPktQueue_t *pQueue);
+BOOL OrionPktQueueWait(OrionPktQueue_t *pQueue, UInt32 TimeoutUs);
+void OrionPktQueueGetStats(OrionPktQueue_t *pQueue, OrionPktQueueStats_t *pStats, BOOL Reset);
+
+// Receive threads read and frame packets from a connection's link in the background, queueing
+//  them for the connection's receive functions. Only one thread may call those functions.
+BOOL OrionConnStartRxThread(OrionConn_t *pConn, UInt32 Slots);
+void OrionConnStopRxThread(OrionConn_t *pConn);
+BOOL OrionConnGetQueueStats(OrionConn_t *pConn, OrionPktQueueStats_t *pStats, BOOL Reset);
+
+BOOL OrionCommStartRxThread(UInt32 Slots);
+void OrionCommStopRxThread(void);
+BOOL OrionCommGetQueueStats(OrionPktQueueStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMQUEUE_H
@@ -0,0 +1,532 @@
+#include "OrionCommRequest.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Timer wheel resolution, and the number of slots it has; timeouts longer than one turn of the
+//  wheel just stay in their slot for more than one pass
+#define TICK_US             1000
+#define WHEEL_SLOTS         1024
+
+struct OrionRequest_s
+{
+    // Requester this belongs to, and the connection the request went out on
+    OrionRequester_t *pOwner;
+    OrionConn_t *pConn;
+
+    // Where the request is up to, and what a reply has to look like: its packet ID, and the number
+    //  of leading payload bytes it has to share with the request
+    OrionRequestState_t State;
+    UInt8 ReplyID;
+    UInt32 MatchSize;
+
+    // The request packet while it's pending, then the reply once it's answered
+    OrionPkt_t Pkt;
+
+    // What to call when it's finished, or NULL to hold on to it until it's released
+    OrionRequestHandler_t pHandler;
+    void *pContext;
+
+    // When it was sent, when it finished, and the wheel tick at which it times out
+    UInt64 SentUs;
+    UInt64 DoneUs;
+    UInt64 ExpiryTick;
+
+    // Neighbours in its hash bucket (or the free list) and its timer wheel slot
+    OrionRequest_t *pNext, *pPrev;
+    OrionRequest_t *pWheelNext, *pWheelPrev;
+};
+
+// Pending requests that share a hash, oldest first
+typedef struct
+{
+    OrionRequest_t *pHead;
+    OrionRequest_t *pTail;
+} OrionRequestBucket_t;
+
+struct OrionRequester_s
+{
+    // Every request there can be, and the ones not in use
+    OrionRequest_t *pPool;
+    UInt32 PoolSize;
+    OrionRequest_t *pFree;
+
+    // Pending requests by connection and reply ID, in a table whose size is a power of two
+    OrionRequestBucket_t *pBuckets;
+    UInt32 Mask;
+
+    // Pending requests by timeout, and the last tick the wheel was turned to
+    OrionRequest_t *pWheel[WHEEL_SLOTS];
+    UInt64 Tick;
+
+    // Counters since the last reset
+    OrionRequesterStats_t Stats;
+};
+
+static OrionRequestBucket_t *GetBucket(OrionRequester_t *pReq, const OrionConn_t *pConn, UInt8 ID);
+static BOOL Unlink(OrionRequest_t *pRequest, OrionRequestState_t State);
+static void Finish(OrionRequest_t *pRequest, OrionRequestState_t State);
+
+/*!
+ * Create a requester
+ * \param MaxRequests is the most requests that can be outstanding at once, counting finished
+ *        requests that haven't been released yet
+ * \return a pointer to the new requester, or NULL on failure
+ */
+OrionRequester_t *OrionRequesterCreate(UInt32 MaxRequests)
+{
+    OrionRequester_t *pReq;
+    UInt32 Size = 1, i;
+
+    // Need room for at least one request
+    if ((MaxRequests == 0) || ((pReq = (OrionRequester_t *)calloc(1, sizeof(OrionRequester_t))) == NULL))
+        return NULL;
+
+    // Size the hash table to the number of requests, so chains stay short
+    while ((Size < MaxRequests) && (Size < 0x80000000))
+        Size <<= 1;
+
+    // Out of memory: free whatever we got
+    if (((pReq->pPool = (OrionRequest_t *)calloc(MaxRequests, sizeof(OrionRequest_t))) == NULL) ||
+        ((pReq->pBuckets = (OrionRequestBucket_t *)calloc(Size, sizeof(OrionRequestBucket_t))) == NULL))
+    {
+        OrionRequesterDestroy(pReq);
+        return NULL;
+    }
+
+    // Every request starts out on the free list, and not pending on anything
+    for (i = 0; i < MaxRequests; i++)
+    {
+        pReq->pPool[i].pOwner = pReq;
+        pReq->pPool[i].State = ORION_REQUEST_CANCELLED;
+        pReq->pPool[i].pNext = (i + 1 < MaxRequests) ? &pReq->pPool[i + 1] : NULL;
+    }
+
+    pReq->pFree = pReq->pPool;
+    pReq->PoolSize = MaxRequests;
+    pReq->Mask = Size - 1;
+    pReq->Tick = OrionCommGetTimeUs() / TICK_US;
+
+    return pReq;
+
+}// OrionRequesterCreate
+
+/*!
+ * Free a requester. Pending requests are dropped without calling their handlers, and any
+ * requests not yet released become invalid.
+ * \param pReq is the requester to free, which may be NULL
+ */
+void OrionRequesterDestroy(OrionRequester_t *pReq)
+{
+    if (pReq == NULL)
+        return;
+
+    free(pReq->pPool);
+    free(pReq->pBuckets);
+    free(pReq);
+
+}// OrionRequesterDestroy
+
+/*!
+ * Send a request and start waiting for its reply
+ * \param pReq is the requester to track the request with
+ * \param pConn is the connection to send on
+ * \param pPkt is the request packet, which is copied
+ * \param ReplyID is the packet ID of the reply, which is usually the request's own ID
+ * \param MatchSize is the number of leading payload bytes the reply must share with the request
+ *        for it to count as the answer, or 0 to accept any packet with the reply ID
+ * \param TimeoutUs is how long to wait for the reply
+ * \param pHandler is called when the request finishes, after which the request is freed. If it's
+ *        NULL, the request is a future instead: poll it with OrionRequestGetState, and free it
+ *        with OrionRequestRelease.
+ * \param pContext is passed through to the handler
+ * \return the request, or NULL if too many are outstanding or the packet couldn't be sent
+ */
+OrionRequest_t *OrionRequestSend(OrionRequester_t *pReq, OrionConn_t *pConn, const OrionPkt_t *pPkt, UInt8 ReplyID, UInt32 MatchSize,
+                                 UInt32 TimeoutUs, OrionRequestHandler_t pHandler, void *pContext)
+{
+    OrionRequest_t *pRequest = pReq->pFree;
+    OrionRequestBucket_t *pBucket;
+    UInt64 NowUs = OrionCommGetTimeUs();
+    UInt32 Slot;
+
+    // Make sure there's room to keep track of it before sending it
+    if ((pRequest == NULL) || (OrionConnSend(pConn, pPkt) == FALSE))
+    {
+        pReq->Stats.Rejected++;
+        return NULL;
+    }
+
+    pReq->pFree = pRequest->pNext;
+
+    // Fill it out, keeping a copy of the request to match replies against
+    memcpy(&pRequest->Pkt, pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+    pRequest->pConn = pConn;
+    pRequest->State = ORION_REQUEST_PENDING;
+    pRequest->ReplyID = ReplyID;
+    pRequest->MatchSize = (MatchSize > pPkt->Length) ? pPkt->Length : MatchSize;
+    pRequest->pHandler = pHandler;
+    pRequest->pContext = pContext;
+    pRequest->SentUs = NowUs;
+    pRequest->DoneUs = 0;
+
+    // Put it on the back of its bucket, so replies go to the oldest matching request first
+    pBucket = GetBucket(pReq, pConn, ReplyID);
+    pRequest->pNext = NULL;
+    pRequest->pPrev = pBucket->pTail;
+    if (pBucket->pTail != NULL)
+        pBucket->pTail->pNext = pRequest;
+    else
+        pBucket->pHead = pRequest;
+    pBucket->pTail = pRequest;
+
+    // Then into the timer wheel slot for the tick it expires on, rounding up and never landing on
+    //  a tick the wheel has already passed
+    pRequest->ExpiryTick = (NowUs + TimeoutUs + TICK_US - 1) / TICK_US;
+    if (pRequest->ExpiryTick <= pReq->Tick)
+        pRequest->ExpiryTick = pReq->Tick + 1;
+
+    Slot = (UInt32)(pRequest->ExpiryTick % WHEEL_SLOTS);
+    pRequest->pWheelPrev = NULL;
+    pRequest->pWheelNext = pReq->pWheel[Slot];
+    if (pReq->pWheel[Slot] != NULL)
+        pReq->pWheel[Slot]->pWheelPrev = pRequest;
+    pReq->pWheel[Slot] = pRequest;
+
+    // Keep count
+    pReq->Stats.Sent++;
+    if (++pReq->Stats.InFlight > pReq->Stats.MaxInFlight)
+        pReq->Stats.MaxInFlight = pReq->Stats.InFlight;
+
+    return pRequest;
+
+}// OrionRequestSend
+
+/*!
+ * Find out where a request is up to
+ * \param pRequest is the request
+ * \return the request's state
+ */
+OrionRequestState_t OrionRequestGetState(const OrionRequest_t *pRequest)
+{
+    return pRequest->State;
+
+}// OrionRequestGetState
+
+/*!
+ * Get the reply to a request
+ * \param pRequest is the request
+ * \return the reply, which is valid until the request is released, or NULL if it hasn't been
+ *         answered
+ */
+const OrionPkt_t *OrionRequestGetReply(const OrionRequest_t *pRequest)
+{
+    return (pRequest->State == ORION_REQUEST_DONE) ? &pRequest->Pkt : NULL;
+
+}// OrionRequestGetReply
+
+/*!
+ * Get the connection a request was sent on
+ * \param pRequest is the request
+ * \return the request's connection
+ */
+OrionConn_t *OrionRequestGetConn(const OrionRequest_t *pRequest)
+{
+    return pRequest->pConn;
+
+}// OrionRequestGetConn
+
+/*!
+ * Get the time between sending a request and its reply arriving
+ * \param pRequest is the request
+ * \return the round trip in microseconds, or 0 if the request hasn't been answered
+ */
+UInt32 OrionRequestGetLatencyUs(const OrionRequest_t *pRequest)
+{
+    return (pRequest->State == ORION_REQUEST_DONE) ? (UInt32)(pRequest->DoneUs - pRequest->SentUs) : 0;
+
+}// OrionRequestGetLatencyUs
+
+/*!
+ * Free a request. A pending request is cancelled first, without calling its handler. Requests
+ * with a handler are freed as soon as the handler returns, so only release those to cancel them
+ * before then, and never from within the handler.
+ * \param pRequest is the request to free, which may be NULL
+ */
+void OrionRequestRelease(OrionRequest_t *pRequest)
+{
+    OrionRequester_t *pReq;
+
+    if (pRequest == NULL)
+        return;
+
+    // Stop waiting on it, leaving it marked as cancelled so nothing can find it pending once it's
+    //  back on the free list
+    pReq = pRequest->pOwner;
+    if (Unlink(pRequest, ORION_REQUEST_CANCELLED))
+        pReq->Stats.Cancelled++;
+
+    // Back on the free list
+    pRequest->pNext = pReq->pFree;
+    pReq->pFree = pRequest;
+
+}// OrionRequestRelease
+
+/*!
+ * Hand a received packet to a requester, completing the oldest pending request it answers. Call
+ * this for every packet received on any connection requests were sent on.
+ * \param pReq is the requester
+ * \param pConn is the connection the packet arrived on
+ * \param pPkt is the received packet, which is copied if it completes a request
+ * \return TRUE if the packet completed a request, or FALSE if it didn't answer anything
+ */
+BOOL OrionRequesterProcess(OrionRequester_t *pReq, OrionConn_t *pConn, const OrionPkt_t *pPkt)
+{
+    OrionRequest_t *pRequest;
+
+    // Look through the requests waiting on this connection and ID, oldest first
+    for (pRequest = GetBucket(pReq, pConn, pPkt->ID)->pHead; pRequest != NULL; pRequest = pRequest->pNext)
+    {
+        // Other connections and IDs can share the bucket
+        if ((pRequest->pConn != pConn) || (pRequest->ReplyID != pPkt->ID))
+            continue;
+
+        // If it's keyed on payload too, the reply has to start the same way the request did
+        if ((pRequest->MatchSize > 0) &&
+            ((pPkt->Length < pRequest->MatchSize) || (memcmp(pPkt->Data, pRequest->Pkt.Data, pRequest->MatchSize) != 0)))
+            continue;
+
+        // This is the one: swap the request for its reply and finish it off
+        Unlink(pRequest, ORION_REQUEST_DONE);
+        memcpy(&pRequest->Pkt, pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+        pRequest->DoneUs = OrionCommGetTimeUs();
+        pReq->Stats.Completed++;
+        Finish(pRequest, ORION_REQUEST_DONE);
+        return TRUE;
+    }
+
+    // Nothing was waiting for it
+    pReq->Stats.Unmatched++;
+    return FALSE;
+
+}// OrionRequesterProcess
+
+/*!
+ * Time out any requests whose replies are overdue. Call this whenever OrionRequesterGetWaitUs
+ * says it's time, or every millisecond or so.
+ * \param pReq is the requester
+ * \return the number of requests that timed out
+ */
+int OrionRequesterService(OrionRequester_t *pReq)
+{
+    UInt64 NowTick = OrionCommGetTimeUs() / TICK_US, Tick;
+    OrionRequest_t *pExpired = NULL, *pRequest;
+    int Count = 0;
+
+    // Turn the wheel up to now, one slot per tick, but no more than once all the way round.
+    //  Requests in a slot that aren't due yet are waiting out another turn.
+    for (Tick = pReq->Tick + 1; (Tick <= NowTick) && (Tick <= pReq->Tick + WHEEL_SLOTS); Tick++)
+    {
+        OrionRequest_t *pNext;
+
+        for (pRequest = pReq->pWheel[Tick % WHEEL_SLOTS]; pRequest != NULL; pRequest = pNext)
+        {
+            pNext = pRequest->pWheelNext;
+            if (pRequest->ExpiryTick > NowTick)
+                continue;
+
+            // Collect it up, reusing the bucket link since it's leaving its bucket anyway. It's
+            //  marked as timed out straight away, so a handler that cancels other requests before
+            //  its turn comes can't take it out a second time.
+            Unlink(pRequest, ORION_REQUEST_TIMED_OUT);
+            pRequest->pNext = pExpired;
+            pExpired = pRequest;
+        }
+    }
+    if (NowTick > pReq->Tick)
+        pReq->Tick = NowTick;
+
+    // Only now call the handlers, which are free to send or cancel other requests
+    while ((pRequest = pExpired) != NULL)
+    {
+        pExpired = pRequest->pNext;
+        pReq->Stats.TimedOut++;
+        Finish(pRequest, ORION_REQUEST_TIMED_OUT);
+        Count++;
+    }
+
+    return Count;
+
+}// OrionRequesterService
+
+/*!
+ * Find out how long until a requester next needs servicing
+ * \param pReq is the requester
+ * \return the wait in microseconds, or 0xFFFFFFFF if nothing is pending
+ */
+UInt32 OrionRequesterGetWaitUs(OrionRequester_t *pReq)
+{
+    UInt64 NowUs = OrionCommGetTimeUs(), Tick;
+
+    // Nothing pending, nothing to wait for
+    if (pReq->Stats.InFlight == 0)
+        return 0xFFFFFFFF;
+
+    // Find the next slot with anything in it; its requests might not be due until a later turn,
+    //  but waking up early does no harm
+    for (Tick = pReq->Tick + 1; Tick <= pReq->Tick + WHEEL_SLOTS; Tick++)
+    {
+        if (pReq->pWheel[Tick % WHEEL_SLOTS] != NULL)
+            break;
+    }
+
+    return (Tick * TICK_US <= NowUs) ? 0 : (UInt32)(Tick * TICK_US - NowUs);
+
+}// OrionRequesterGetWaitUs
+
+/*!
+ * Cancel every pending request on a connection, e.g. because it's been closed. Their handlers
+ * are called with ORION_REQUEST_CANCELLED.
+ * \param pReq is the requester
+ * \param pConn is the connection
+ * \return the number of requests cancelled
+ */
+int OrionRequesterCancelConn(OrionRequester_t *pReq, OrionConn_t *pConn)
+{
+    OrionRequest_t *pCancelled = NULL, *pRequest;
+    UInt32 i;
+    int Count = 0;
+
+    // Collect them all up first, as with timeouts
+    for (i = 0; i < pReq->PoolSize; i++)
+    {
+        pRequest = &pReq->pPool[i];
+        if ((pRequest->State != ORION_REQUEST_PENDING) || (pRequest->pConn != pConn))
+            continue;
+
+        Unlink(pRequest, ORION_REQUEST_CANCELLED);
+        pRequest->pNext = pCancelled;
+        pCancelled = pRequest;
+    }
+
+    // Then let everyone know
+    while ((pRequest = pCancelled) != NULL)
+    {
+        pCancelled = pRequest->pNext;
+        pReq->Stats.Cancelled++;
+        Finish(pRequest, ORION_REQUEST_CANCELLED);
+        Count++;
+    }
+
+    return Count;
+
+}// OrionRequesterCancelConn
+
+/*!
+ * Get a requester's counters, optionally resetting them
+ * \param pReq is the requester
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward, apart from the number in flight
+ */
+void OrionRequesterGetStats(OrionRequester_t *pReq, OrionRequesterStats_t *pStats, BOOL Reset)
+{
+    UInt32 InFlight = pReq->Stats.InFlight;
+
+    *pStats = pReq->Stats;
+
+    // The number in flight is a level, not a count, so it carries on
+    if (Reset)
+    {
+        memset(&pReq->Stats, 0, sizeof(pReq->Stats));
+        pReq->Stats.InFlight = pReq->Stats.MaxInFlight = InFlight;
+    }
+
+}// OrionRequesterGetStats
+
+/*!
+ * Packet handler for an OrionEventLoop that passes every packet to a requester
+ * \param pConn is the connection the packet arrived on
+ * \param pPkt is the packet
+ * \param pContext is the requester
+ */
+void OrionRequesterHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext)
+{
+    OrionRequesterProcess((OrionRequester_t *)pContext, pConn, pPkt);
+
+}// OrionRequesterHandler
+
+/*!
+ * Timer handler for an OrionEventLoop that times out a requester's overdue requests
+ * \param pContext is the requester
+ */
+void OrionRequesterTimer(void *pContext)
+{
+    OrionRequesterService((OrionRequester_t *)pContext);
+
+}// OrionRequesterTimer
+
+// Find the hash bucket for requests on a connection waiting for a given reply ID
+static OrionRequestBucket_t *GetBucket(OrionRequester_t *pReq, const OrionConn_t *pConn, UInt8 ID)
+{
+    // Connections are allocated, so the low bits of their addresses carry little information
+    UInt32 Hash = (UInt32)((uintptr_t)pConn >> 4) * 2654435761u;
+
+    return &pReq->pBuckets[(Hash ^ (ID * 40503u)) & pReq->Mask];
+
+}// GetBucket
+
+// Take a pending request out of its hash bucket and timer wheel slot, marking it with the state
+//  it's leaving in. Returns FALSE without doing anything if it isn't pending.
+static BOOL Unlink(OrionRequest_t *pRequest, OrionRequestState_t State)
+{
+    OrionRequester_t *pReq = pRequest->pOwner;
+    OrionRequestBucket_t *pBucket;
+
+    // Anything that isn't pending has already been taken out
+    if (pRequest->State != ORION_REQUEST_PENDING)
+        return FALSE;
+
+    pBucket = GetBucket(pReq, pRequest->pConn, pRequest->ReplyID);
+
+    // Out of the bucket
+    if (pRequest->pPrev != NULL)
+        pRequest->pPrev->pNext = pRequest->pNext;
+    else
+        pBucket->pHead = pRequest->pNext;
+    if (pRequest->pNext != NULL)
+        pRequest->pNext->pPrev = pRequest->pPrev;
+    else
+        pBucket->pTail = pRequest->pPrev;
+
+    // Out of the wheel
+    if (pRequest->pWheelPrev != NULL)
+        pRequest->pWheelPrev->pWheelNext = pRequest->pWheelNext;
+    else
+        pReq->pWheel[pRequest->ExpiryTick % WHEEL_SLOTS] = pRequest->pWheelNext;
+    if (pRequest->pWheelNext != NULL)
+        pRequest->pWheelNext->pWheelPrev = pRequest->pWheelPrev;
+
+    pReq->Stats.InFlight--;
+    pRequest->State = State;
+    return TRUE;
+
+}// Unlink
+
+// Mark an unlinked request as finished, then hand it to its handler and free it, or leave it for
+//  its owner to collect
+static void Finish(OrionRequest_t *pRequest, OrionRequestState_t State)
+{
+    pRequest->State = State;
+    if (pRequest->pHandler == NULL)
+        return;
+
+    pRequest->pHandler(pRequest, (State == ORION_REQUEST_DONE) ? &pRequest->Pkt : NULL, pRequest->pContext);
+    OrionRequestRelease(pRequest);
+
+}// Finish
+
+#endif // __linux__ || __APPLE__
@@ -0,0 +1,77 @@
+#ifndef ORIONCOMMREQUEST_H
+#define ORIONCOMMREQUEST_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Keeps track of requests sent to any number of gimbals and matches each reply to the request it
+//  answers, so that many queries can be in flight at once instead of waiting on each in turn.
+//  Requests are keyed by connection and reply ID, and optionally by leading payload bytes shared
+//  with the reply (e.g. a camera index). Replies complete the oldest matching request. Requests
+//  that get no reply expire off a timer wheel. Not thread safe: use it from one thread, typically
+//  the one running an OrionEventLoop.
+typedef struct OrionRequester_s OrionRequester_t;
+
+// One outstanding or completed request
+typedef struct OrionRequest_s OrionRequest_t;
+
+// Where a request is up to
+typedef enum
+{
+    ORION_REQUEST_PENDING,      // Sent, and waiting for a reply
+    ORION_REQUEST_DONE,         // Answered; the reply is available
+    ORION_REQUEST_TIMED_OUT,    // No reply arrived in time
+    ORION_REQUEST_CANCELLED     // Cancelled, or its connection was dropped
+} OrionRequestState_t;
+
+// Called once when a request finishes one way or the other. pReply is NULL unless the request
+//  is ORION_REQUEST_DONE. The request is freed as soon as this returns.
+typedef void (*OrionRequestHandler_t)(OrionRequest_t *pRequest, const OrionPkt_t *pReply, void *pContext);
+
+// Requester counters
+typedef struct
+{
+    UInt32 Sent;            // Requests sent
+    UInt32 Completed;       // Requests answered
+    UInt32 TimedOut;        // Requests that got no reply in time
+    UInt32 Cancelled;       // Requests cancelled, directly or by dropping their connection
+    UInt32 Rejected;        // Requests refused because too many were outstanding, or the send failed
+    UInt32 Unmatched;       // Packets that didn't answer any request
+    UInt32 InFlight;        // Requests waiting for a reply right now
+    UInt32 MaxInFlight;     // Most requests waiting for a reply at once
+} OrionRequesterStats_t;
+
+OrionRequester_t *OrionRequesterCreate(UInt32 MaxRequests);
+void OrionRequesterDestroy(OrionRequester_t *pReq);
+OrionRequest_t *OrionRequestSend(OrionRequester_t *pReq, OrionConn_t *pConn, const OrionPkt_t *pPkt, UInt8 ReplyID, UInt32 MatchSize,
+                                 UInt32 TimeoutUs, OrionRequestHandler_t pHandler, void *pContext);
+OrionRequestState_t OrionRequestGetState(const OrionRequest_t *pRequest);
+const OrionPkt_t *OrionRequestGetReply(const OrionRequest_t *pRequest);
+OrionConn_t *OrionRequestGetConn(const OrionRequest_t *pRequest);
+UInt32 OrionRequestGetLatencyUs(const OrionRequest_t *pRequest);
+void OrionRequestRelease(OrionRequest_t *pRequest);
+BOOL OrionRequesterProcess(OrionRequester_t *pReq, OrionConn_t *pConn, const OrionPkt_t *pPkt);
+int  OrionRequesterService(OrionRequester_t *pReq);
+UInt32 OrionRequesterGetWaitUs(OrionRequester_t *pReq);
+int  OrionRequesterCancelConn(OrionRequester_t *pReq, OrionConn_t *pConn);
+void OrionRequesterGetStats(OrionRequester_t *pReq, OrionRequesterStats_t *pStats, BOOL Reset);
+
+// Adapters for an OrionEventLoop: register OrionRequesterHandler (with the requester as its
+//  context) for the reply IDs or as the default handler, and run OrionRequesterTimer off a timer
+//  every millisecond or so.
+void OrionRequesterHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+void OrionRequesterTimer(void *pContext);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMREQUEST_H
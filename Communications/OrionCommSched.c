@@ -0,0 +1,500 @@
+#include "OrionCommSched.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <stdlib.h>
+#include <string.h>
+
+// Bits on the wire per byte at 8N1: a start bit, eight data bits and a stop bit
+#define BITS_PER_BYTE       10
+
+// Link credit is kept in byte-microseconds so that it accrues exactly with integer math
+#define CREDIT_SCALE        1000000ULL
+
+// Longest stretch of its share a class can save up while it has nothing to send
+#define BUCKET_MS           100
+
+// A packet waiting to be sent
+typedef struct
+{
+    OrionPkt_t Pkt;         // The packet itself
+    UInt64 QueuedUs;        // When it was queued, or when the packet it replaced was queued
+} OrionSchedEntry_t;
+
+// Packets waiting in one traffic class, and the share of the link it's guaranteed
+typedef struct
+{
+    // Packets waiting to be sent, oldest first, in a ring whose slot count is a power of two
+    OrionSchedEntry_t *pEntries;
+    UInt32 Head;
+    UInt32 Count;
+
+    // Guaranteed percentage of the link, and the credit saved up toward it
+    UInt32 Share;
+    UInt64 Tokens;
+
+    // Counters since the last reset
+    OrionSchedStats_t Stats;
+} OrionSchedQueue_t;
+
+struct OrionSched_s
+{
+    // Connection the packets go out on
+    OrionConn_t *pConn;
+
+    // One queue per class, all with the same number of slots
+    OrionSchedQueue_t Queues[ORION_SCHED_NUM_CLASSES];
+    UInt32 Mask;
+
+    // Each ID's class, whether it's latest wins, and for those the ring slot holding its unsent
+    //  packet (or -1)
+    UInt8 Class[256];
+    BOOL LatestWins[256];
+    int Pending[256];
+
+    // Link rate in bytes per second (0 for unlimited), the credit that's built up at that rate
+    //  since it was last spent, when it was last brought up to date, and the credit that one
+    //  millisecond of link time is worth
+    UInt32 BytesPerSec;
+    UInt64 Credit;
+    UInt64 CreditUs;
+    UInt64 SlackCredit;
+};
+
+static void AddCredit(OrionSched_t *pSched, UInt64 NowUs);
+static OrionSchedQueue_t *NextQueue(OrionSched_t *pSched);
+static UInt64 CreditLimit(const OrionSched_t *pSched, UInt64 Cost);
+static UInt64 QueueCost(const OrionSchedQueue_t *pQueue);
+static void AddStats(OrionSchedStats_t *pTotal, const OrionSchedStats_t *pStats);
+
+/*!
+ * Create a transmit scheduler for a connection. Commands, geopoint commands and range data are
+ * control traffic guaranteed half the link; user data, KLV user data and paths are bulk traffic
+ * guaranteed a fifth of it; and everything else is normal traffic guaranteed the rest.
+ * \param pConn is the connection to send on, which must outlive the scheduler
+ * \param BaudRate is the link's bit rate, or 0 to send as fast as the connection will take packets
+ * \param Slots is the number of packets that can wait in each class, rounded up to a power of two
+ * \return a pointer to the new scheduler, or NULL on failure
+ */
+OrionSched_t *OrionSchedCreate(OrionConn_t *pConn, UInt32 BaudRate, UInt32 Slots)
+{
+    OrionSched_t *pSched;
+    UInt32 Size = 1, i;
+
+    // Nothing to schedule without a connection
+    if ((pConn == NULL) || ((pSched = (OrionSched_t *)calloc(1, sizeof(OrionSched_t))) == NULL))
+        return NULL;
+
+    // Round the slot count up to a power of two
+    while ((Size < Slots) && (Size < 0x80000000))
+        Size <<= 1;
+
+    pSched->Mask = Size - 1;
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+    {
+        // Out of memory: free whatever we got
+        if ((pSched->Queues[i].pEntries = (OrionSchedEntry_t *)malloc(Size * sizeof(OrionSchedEntry_t))) == NULL)
+        {
+            OrionSchedDestroy(pSched);
+            return NULL;
+        }
+    }
+
+    // Everything is normal traffic with nothing waiting, to start with
+    for (i = 0; i < 256; i++)
+    {
+        pSched->Class[i] = ORION_SCHED_NORMAL;
+        pSched->Pending[i] = -1;
+    }
+
+    // Start out with a millisecond of credit, which is as much as is ever allowed to build up
+    //  beyond the next packet
+    pSched->pConn = pConn;
+    pSched->BytesPerSec = BaudRate / BITS_PER_BYTE;
+    pSched->SlackCredit = pSched->Credit = (UInt64)pSched->BytesPerSec * CREDIT_SCALE / 1000;
+    pSched->CreditUs = OrionCommGetTimeUs();
+
+    // Pointing commands and the data they act on must get through promptly
+    pSched->Class[ORION_PKT_CMD] = ORION_SCHED_CONTROL;
+    pSched->Class[ORION_PKT_GEOPOINT_CMD] = ORION_SCHED_CONTROL;
+    pSched->Class[ORION_PKT_RANGE_DATA] = ORION_SCHED_CONTROL;
+
+    // Tunnelled data and large uploads can wait
+    pSched->Class[ORION_PKT_USER_DATA] = ORION_SCHED_BULK;
+    pSched->Class[ORION_PKT_KLV_USER_DATA] = ORION_SCHED_BULK;
+    pSched->Class[ORION_PKT_PATH] = ORION_SCHED_BULK;
+
+    // Guaranteed shares of the link
+    pSched->Queues[ORION_SCHED_CONTROL].Share = 50;
+    pSched->Queues[ORION_SCHED_NORMAL].Share = 30;
+    pSched->Queues[ORION_SCHED_BULK].Share = 20;
+
+    // Gimbal commands are only useful while they're fresh
+    pSched->LatestWins[ORION_PKT_CMD] = TRUE;
+
+    return pSched;
+
+}// OrionSchedCreate
+
+/*!
+ * Free a transmit scheduler, dropping any packets that haven't been sent
+ * \param pSched is the scheduler to free, which may be NULL
+ */
+void OrionSchedDestroy(OrionSched_t *pSched)
+{
+    int i;
+
+    if (pSched == NULL)
+        return;
+
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+        free(pSched->Queues[i].pEntries);
+    free(pSched);
+
+}// OrionSchedDestroy
+
+/*!
+ * Choose whether a newly queued packet replaces any unsent packet with the same ID. This is on
+ * for ORION_PKT_CMD by default. Packets with other IDs are all sent, in order.
+ * \param pSched is the scheduler
+ * \param ID is the packet ID
+ * \param LatestWins is TRUE if only the newest packet with this ID matters
+ */
+void OrionSchedSetLatestWins(OrionSched_t *pSched, UInt8 ID, BOOL LatestWins)
+{
+    // Any packet already waiting keeps its place either way; it just won't be replaced anymore
+    pSched->LatestWins[ID] = LatestWins;
+    if (!LatestWins)
+        pSched->Pending[ID] = -1;
+
+}// OrionSchedSetLatestWins
+
+/*!
+ * Move a packet ID to a different traffic class. Packets with that ID already waiting stay
+ * where they are.
+ * \param pSched is the scheduler
+ * \param ID is the packet ID
+ * \param Class is the class its packets will be queued in from now on
+ */
+void OrionSchedSetClass(OrionSched_t *pSched, UInt8 ID, OrionSchedClass_t Class)
+{
+    // Ignore nonsense classes
+    if ((Class < 0) || (Class >= ORION_SCHED_NUM_CLASSES))
+        return;
+
+    // A waiting latest wins packet in the old class can't be replaced from the new one
+    if (pSched->Class[ID] != Class)
+        pSched->Pending[ID] = -1;
+
+    pSched->Class[ID] = (UInt8)Class;
+
+}// OrionSchedSetClass
+
+/*!
+ * Set the share of the link a traffic class is guaranteed. Shares should add up to no more than
+ * 100 percent; a class can use more than its share whenever the others leave room.
+ * \param pSched is the scheduler
+ * \param Class is the traffic class
+ * \param Percent is its guaranteed share of the link rate
+ */
+void OrionSchedSetShare(OrionSched_t *pSched, OrionSchedClass_t Class, UInt32 Percent)
+{
+    if ((Class >= 0) && (Class < ORION_SCHED_NUM_CLASSES))
+        pSched->Queues[Class].Share = (Percent > 100) ? 100 : Percent;
+
+}// OrionSchedSetShare
+
+/*!
+ * Queue a packet to be sent, then send whatever the link has room for
+ * \param pSched is the scheduler
+ * \param pPkt is the packet to send, which is copied
+ * \return TRUE if the packet was queued, FALSE if its class's queue is full
+ */
+BOOL OrionSchedSend(OrionSched_t *pSched, const OrionPkt_t *pPkt)
+{
+    OrionSchedQueue_t *pQueue = &pSched->Queues[pSched->Class[pPkt->ID]];
+    UInt64 NowUs = OrionCommGetTimeUs();
+    OrionSchedEntry_t *pEntry;
+
+    // Settle up the credit earned while this packet wasn't waiting
+    AddCredit(pSched, NowUs);
+
+    // A latest wins packet overwrites its unsent predecessor, taking over its place in line and
+    //  the time it was queued, so the slot's wait is still measured from when it first filled
+    if (pSched->LatestWins[pPkt->ID] && (pSched->Pending[pPkt->ID] >= 0))
+    {
+        pEntry = &pQueue->pEntries[pSched->Pending[pPkt->ID]];
+        pQueue->Stats.Replaced++;
+    }
+    // Anything else goes on the back of its queue, if there's room
+    else if (pQueue->Count > pSched->Mask)
+    {
+        pQueue->Stats.Rejected++;
+        return FALSE;
+    }
+    else
+    {
+        UInt32 Slot = (pQueue->Head + pQueue->Count++) & pSched->Mask;
+
+        pEntry = &pQueue->pEntries[Slot];
+        pEntry->QueuedUs = NowUs;
+        if (pSched->LatestWins[pPkt->ID])
+            pSched->Pending[pPkt->ID] = (int)Slot;
+    }
+
+    // Copy in just the bytes that go on the wire
+    memcpy(&pEntry->Pkt, pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+
+    // Get it moving if the link has room
+    OrionSchedService(pSched);
+    return TRUE;
+
+}// OrionSchedSend
+
+/*!
+ * Send as many queued packets as the link has room for right now. Call this whenever
+ * OrionSchedGetWaitUs says it's time.
+ * \param pSched is the scheduler
+ * \return the number of packets sent
+ */
+int OrionSchedService(OrionSched_t *pSched)
+{
+    UInt64 NowUs = OrionCommGetTimeUs();
+    OrionSchedQueue_t *pQueue;
+    int Sent = 0;
+
+    // Bring the link credit and every class's tokens up to date
+    AddCredit(pSched, NowUs);
+
+    // Keep going as long as there's something to send
+    while ((pQueue = NextQueue(pSched)) != NULL)
+    {
+        OrionSchedEntry_t *pEntry = &pQueue->pEntries[pQueue->Head];
+        UInt64 Cost = QueueCost(pQueue);
+        UInt32 LatencyUs;
+
+        // Stop once the link is full, or if the connection won't take any more
+        if ((pSched->BytesPerSec != 0) && (pSched->Credit < Cost))
+            break;
+        if (OrionConnSend(pSched->pConn, &pEntry->Pkt) == FALSE)
+            break;
+
+        // Spend the link credit and the class's tokens; a class beyond its share has none to spend
+        if (pSched->BytesPerSec != 0)
+            pSched->Credit -= Cost;
+        pQueue->Tokens = (pQueue->Tokens > Cost) ? pQueue->Tokens - Cost : 0;
+
+        // Note how stale the packet was by the time it went out
+        LatencyUs = (UInt32)(NowUs - pEntry->QueuedUs);
+        if (LatencyUs > pQueue->Stats.MaxLatencyUs)
+            pQueue->Stats.MaxLatencyUs = LatencyUs;
+
+        // A latest wins ID has nothing unsent anymore
+        if ((pSched->Pending[pEntry->Pkt.ID] == (int)pQueue->Head) && (&pSched->Queues[pSched->Class[pEntry->Pkt.ID]] == pQueue))
+            pSched->Pending[pEntry->Pkt.ID] = -1;
+
+        pQueue->Head = (pQueue->Head + 1) & pSched->Mask;
+        pQueue->Count--;
+        pQueue->Stats.Sent++;
+        Sent++;
+    }
+
+    // If the connection batches packets, these ones have already waited their turn
+    if (Sent > 0)
+        OrionConnFlush(pSched->pConn);
+
+    return Sent;
+
+}// OrionSchedService
+
+/*!
+ * Find out how long until the link has room for the next queued packet
+ * \param pSched is the scheduler
+ * \return the wait in microseconds (0 to call OrionSchedService right away), or ORION_SCHED_IDLE
+ *         if there's nothing waiting to be sent
+ */
+UInt32 OrionSchedGetWaitUs(OrionSched_t *pSched)
+{
+    OrionSchedQueue_t *pQueue;
+    UInt64 Cost;
+
+    // Bring everything up to date, then see what would go next
+    AddCredit(pSched, OrionCommGetTimeUs());
+
+    // Nothing to send means nothing to wait for
+    if ((pQueue = NextQueue(pSched)) == NULL)
+        return ORION_SCHED_IDLE;
+
+    // An unlimited link (or one the connection pushed back on) is worth retrying right away
+    if (pSched->BytesPerSec == 0)
+        return 0;
+
+    // Otherwise work out how long the credit for that packet takes to build up, rounding up
+    Cost = QueueCost(pQueue);
+    if (pSched->Credit >= Cost)
+        return 0;
+
+    return (UInt32)((Cost - pSched->Credit + pSched->BytesPerSec - 1) / pSched->BytesPerSec);
+
+}// OrionSchedGetWaitUs
+
+/*!
+ * Work out the longest a control packet can take to get across the link. A control packet that
+ * finds its queue empty may have to wait for one packet from another class that's already in the
+ * driver, then for itself to cross the link. This holds as long as control traffic stays within
+ * its share of the link.
+ * \param pSched is the scheduler
+ * \param Size is the size of the control packet in bytes, including the packet overhead
+ * \return the bound in microseconds, or 0 if the link rate is unlimited
+ */
+UInt32 OrionSchedGetLatencyBoundUs(const OrionSched_t *pSched, UInt32 Size)
+{
+    // Without a link rate there's nothing to go on
+    if (pSched->BytesPerSec == 0)
+        return 0;
+
+    // The driver never holds more than one packet or a millisecond of link time, whichever's more
+    return (UInt32)((CreditLimit(pSched, sizeof(OrionPkt_t) * CREDIT_SCALE) + (UInt64)Size * CREDIT_SCALE + pSched->BytesPerSec - 1) / pSched->BytesPerSec);
+
+}// OrionSchedGetLatencyBoundUs
+
+/*!
+ * Get a scheduler's counters for all classes together, optionally resetting them
+ * \param pSched is the scheduler
+ * \param pStats receives the counters, with the worst latency of any class
+ * \param Reset is TRUE to zero every class's counters afterward
+ */
+void OrionSchedGetStats(OrionSched_t *pSched, OrionSchedStats_t *pStats, BOOL Reset)
+{
+    OrionSchedStats_t Stats;
+    int i;
+
+    // Add up the classes
+    memset(pStats, 0, sizeof(*pStats));
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+    {
+        OrionSchedGetClassStats(pSched, (OrionSchedClass_t)i, &Stats, Reset);
+        AddStats(pStats, &Stats);
+    }
+
+}// OrionSchedGetStats
+
+/*!
+ * Get a scheduler's counters for one traffic class, optionally resetting them
+ * \param pSched is the scheduler
+ * \param Class is the traffic class
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the class's counters afterward
+ */
+void OrionSchedGetClassStats(OrionSched_t *pSched, OrionSchedClass_t Class, OrionSchedStats_t *pStats, BOOL Reset)
+{
+    OrionSchedQueue_t *pQueue = &pSched->Queues[Class];
+
+    // Hand back a copy of the counters, along with the current queue depth
+    *pStats = pQueue->Stats;
+    pStats->Depth = pQueue->Count;
+
+    if (Reset)
+        memset(&pQueue->Stats, 0, sizeof(pQueue->Stats));
+
+}// OrionSchedGetClassStats
+
+// Accrue link credit and class tokens for the time that's passed, given that whatever's queued
+//  now was already waiting for all of that time
+static void AddCredit(OrionSched_t *pSched, UInt64 NowUs)
+{
+    UInt64 Elapsed = NowUs - pSched->CreditUs, Waiting = 0;
+    int i;
+
+    // Find the largest packet that's been waiting for credit
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+    {
+        if ((pSched->Queues[i].Count > 0) && (QueueCost(&pSched->Queues[i]) > Waiting))
+            Waiting = QueueCost(&pSched->Queues[i]);
+    }
+
+    // Credit builds up at one byte-microsecond per microsecond per byte per second of link rate,
+    //  but only as far as the waiting packets need
+    pSched->Credit += Elapsed * pSched->BytesPerSec;
+    if (pSched->Credit > CreditLimit(pSched, Waiting))
+        pSched->Credit = CreditLimit(pSched, Waiting);
+
+    // Each class earns tokens at its share of the link rate, saving up to a burst's worth
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+    {
+        OrionSchedQueue_t *pQueue = &pSched->Queues[i];
+        UInt64 Rate = (UInt64)pSched->BytesPerSec * pQueue->Share / 100;
+        UInt64 Bucket = Rate * CREDIT_SCALE * BUCKET_MS / 1000;
+
+        // A class's bucket must hold at least one packet of any size, or it could never send
+        if (Bucket < sizeof(OrionPkt_t) * CREDIT_SCALE)
+            Bucket = sizeof(OrionPkt_t) * CREDIT_SCALE;
+
+        pQueue->Tokens += Elapsed * Rate;
+        if (pQueue->Tokens > Bucket)
+            pQueue->Tokens = Bucket;
+    }
+
+    pSched->CreditUs = NowUs;
+
+}// AddCredit
+
+// Pick the queue to send from next: the highest priority class still within its share if there is
+//  one, otherwise the highest priority class with anything waiting. Returns NULL if nothing's waiting.
+static OrionSchedQueue_t *NextQueue(OrionSched_t *pSched)
+{
+    OrionSchedQueue_t *pBorrower = NULL;
+    int i;
+
+    for (i = 0; i < ORION_SCHED_NUM_CLASSES; i++)
+    {
+        OrionSchedQueue_t *pQueue = &pSched->Queues[i];
+
+        // Empty classes don't get a turn
+        if (pQueue->Count == 0)
+            continue;
+
+        // A class with tokens for its next packet is owed the link, and any class can go on an
+        //  unlimited link
+        if ((pSched->BytesPerSec == 0) || (pQueue->Tokens >= QueueCost(pQueue)))
+            return pQueue;
+
+        // Otherwise remember the first class that could use spare capacity
+        if (pBorrower == NULL)
+            pBorrower = pQueue;
+    }
+
+    return pBorrower;
+
+}// NextQueue
+
+// Most link credit that can build up while waiting to send a packet costing Cost: just enough for
+//  that packet, or a millisecond's worth if that's more. Any more would let packets pile up in the
+//  driver after an idle spell, and every packet queued after them would be that much staler.
+static UInt64 CreditLimit(const OrionSched_t *pSched, UInt64 Cost)
+{
+    return (Cost > pSched->SlackCredit) ? Cost : pSched->SlackCredit;
+
+}// CreditLimit
+
+// Link credit needed to send the packet at the head of a non-empty queue
+static UInt64 QueueCost(const OrionSchedQueue_t *pQueue)
+{
+    return (UInt64)(pQueue->pEntries[pQueue->Head].Pkt.Length + ORION_PKT_OVERHEAD) * CREDIT_SCALE;
+
+}// QueueCost
+
+// Add one set of counters to a running total, keeping the worst latency
+static void AddStats(OrionSchedStats_t *pTotal, const OrionSchedStats_t *pStats)
+{
+    pTotal->Sent += pStats->Sent;
+    pTotal->Replaced += pStats->Replaced;
+    pTotal->Rejected += pStats->Rejected;
+    pTotal->Depth += pStats->Depth;
+    if (pStats->MaxLatencyUs > pTotal->MaxLatencyUs)
+        pTotal->MaxLatencyUs = pStats->MaxLatencyUs;
+
+}// AddStats
+
+#endif // __linux__ || __APPLE__
@@ -0,0 +1,61 @@
+#ifndef ORIONCOMMSCHED_H
+#define ORIONCOMMSCHED_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Holds outgoing packets and feeds them to a connection no faster than the link can carry them,
+//  so they don't pile up in the driver where nothing can be done about them. Each packet ID
+//  belongs to a traffic class. Every class is guaranteed its share of the link, and whatever a
+//  class doesn't use goes to the others in priority order. Within a class packets go out in the
+//  order they were queued, except that a packet with a "latest wins" ID replaces any unsent packet
+//  with that ID in place, so the gimbal only ever sees the newest command.
+typedef struct OrionSched_s OrionSched_t;
+
+// Traffic classes, from highest priority to lowest
+typedef enum
+{
+    ORION_SCHED_CONTROL,    // Pointing commands and the data they depend on
+    ORION_SCHED_NORMAL,     // Everything not assigned to another class
+    ORION_SCHED_BULK,       // Large transfers that can tolerate delay
+    ORION_SCHED_NUM_CLASSES
+} OrionSchedClass_t;
+
+// Returned by OrionSchedGetWaitUs when there's nothing waiting to be sent
+#define ORION_SCHED_IDLE    0xFFFFFFFF
+
+// Scheduler counters, for one class or for all of them
+typedef struct
+{
+    UInt32 Sent;            // Packets written to the link
+    UInt32 Replaced;        // Unsent packets replaced by a newer packet with the same ID
+    UInt32 Rejected;        // Packets refused because the queue was full
+    UInt32 Depth;           // Packets waiting to be sent right now
+    UInt32 MaxLatencyUs;    // Longest any packet waited to be sent, counting from when its slot was first filled
+} OrionSchedStats_t;
+
+OrionSched_t *OrionSchedCreate(OrionConn_t *pConn, UInt32 BaudRate, UInt32 Slots);
+void OrionSchedDestroy(OrionSched_t *pSched);
+void OrionSchedSetLatestWins(OrionSched_t *pSched, UInt8 ID, BOOL LatestWins);
+void OrionSchedSetClass(OrionSched_t *pSched, UInt8 ID, OrionSchedClass_t Class);
+void OrionSchedSetShare(OrionSched_t *pSched, OrionSchedClass_t Class, UInt32 Percent);
+BOOL OrionSchedSend(OrionSched_t *pSched, const OrionPkt_t *pPkt);
+int  OrionSchedService(OrionSched_t *pSched);
+UInt32 OrionSchedGetWaitUs(OrionSched_t *pSched);
+UInt32 OrionSchedGetLatencyBoundUs(const OrionSched_t *pSched, UInt32 Size);
+void OrionSchedGetStats(OrionSched_t *pSched, OrionSchedStats_t *pStats, BOOL Reset);
+void OrionSchedGetClassStats(OrionSched_t *pSched, OrionSchedClass_t Class, OrionSchedStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMSCHED_H
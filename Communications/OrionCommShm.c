@@ -0,0 +1,756 @@
+#include "OrionCommShm.h"
+#include "OrionCommPrivate.h"
+
+#ifdef __linux__
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Marks a ring as fully set up, and the layout version readers have to agree on
+#define SHM_MAGIC           0x4D534E4F
+#define SHM_VERSION         1
+
+// Size of a cache line, used to keep the broker's and the readers' indices from sharing one
+#define CACHE_LINE_SIZE     64
+
+// Largest packet a slot holds, ring size when none is given, and size of the command ring
+#define SHM_PKT_SIZE        (ORION_PKT_MAX_SIZE + ORION_PKT_OVERHEAD)
+#define SHM_DEFAULT_SLOTS   4096
+#define SHM_COMMAND_SLOTS   256
+
+// Longest the broker waits on the link before checking the command ring, and whether it's been told to stop
+#define COMMAND_POLL_US     1000
+
+// One published packet. Seq is the packet's sequence number plus one once it's written, and 0
+//  while the broker is writing it, so a reader can tell whether the slot changed under it.
+typedef struct
+{
+    UInt64 Seq;
+    UInt64 TimeUs;
+    UInt32 Size;
+    UInt8 Data[SHM_PKT_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE))) ShmSlot_t;
+
+// One packet on its way from a reader to the broker. Seq says whose turn the slot is: the
+//  position a reader may claim it at, that plus one once it's filled, and so on around the ring.
+typedef struct
+{
+    UInt32 Seq;
+    UInt32 Size;
+    UInt8 Data[SHM_PKT_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE))) ShmCommand_t;
+
+// The start of the shared memory, followed by the packet slots and then the command slots
+typedef struct
+{
+    // Set once by the broker, with Magic last so readers never see a half built ring
+    UInt32 Magic;
+    UInt32 Version;
+    UInt32 Slots;
+    UInt32 CommandSlots;
+    UInt32 BrokerPid;
+    UInt32 Closed;
+    UInt8 SetupPad[CACHE_LINE_SIZE - 6 * sizeof(UInt32)];
+
+    // Broker's publishing side: packets published so far, the same count truncated for the
+    //  futex readers sleep on, and how many readers are asleep
+    UInt64 WriteSeq;
+    UInt32 Futex;
+    UInt32 Waiters;
+    UInt8 PublishPad[CACHE_LINE_SIZE - sizeof(UInt64) - 2 * sizeof(UInt32)];
+
+    // Readers' command side: the next command slot to claim
+    UInt32 CommandHead;
+    UInt8 CommandPad[CACHE_LINE_SIZE - sizeof(UInt32)];
+
+    // Broker's command side: the next command slot to empty
+    UInt32 CommandTail;
+    UInt8 ForwardPad[CACHE_LINE_SIZE - sizeof(UInt32)];
+} ShmHeader_t;
+
+// A mapping of the ring, which the broker and each reader have their own of
+typedef struct
+{
+    ShmHeader_t *pHeader;
+    ShmSlot_t *pSlots;
+    ShmCommand_t *pCommands;
+    size_t Size;
+} ShmMap_t;
+
+struct OrionShmBroker_s
+{
+    OrionConn_t *pConn;
+    char Name[NAME_MAX];
+    ShmMap_t Map;
+
+    // The one thread that uses the link, publishing what it receives and forwarding what readers send
+    pthread_t Thread;
+    UInt32 CommandTail;
+    int Stop;
+
+    OrionShmBrokerStats_t Stats;
+};
+
+// Everything a reader keeps track of, hung off its connection as the transport
+typedef struct
+{
+    ShmMap_t Map;
+
+    // Sequence number of the next packet to read
+    UInt64 Next;
+
+    // The slot OrionShmPeek handed out, and the sequence number it held at the time
+    const ShmSlot_t *pHeld;
+    UInt64 HeldSeq;
+
+    // Set once the broker's process has gone away without closing the ring
+    BOOL BrokerGone;
+
+    OrionShmStats_t Stats;
+} OrionShmReader_t;
+
+static BOOL MakeName(const char *pName, char *pBuffer, size_t Size);
+static size_t GetMapSize(UInt32 Slots, UInt32 CommandSlots);
+static void SetMap(ShmMap_t *pMap, void *pBase, UInt32 Slots, size_t Size);
+static long Futex(UInt32 *pWord, int Op, UInt32 Value, UInt32 TimeoutUs);
+static void *BrokerThread(void *pArg);
+static void ForwardCommands(OrionShmBroker_t *pBroker);
+static void Publish(OrionShmBroker_t *pBroker, const OrionPktView_t *pView);
+static void CloseRing(ShmHeader_t *pHeader);
+static const ShmSlot_t *NextSlot(OrionShmReader_t *pReader, UInt64 *pSeq);
+static BOOL PushCommand(OrionShmReader_t *pReader, const UInt8 *pData, UInt32 Size);
+static ssize_t ShmRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t ShmWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void ShmWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void ShmClose(OrionConn_t *pConn);
+static OrionShmReader_t *GetReader(const OrionConn_t *pConn);
+
+// Transport operations for shared memory readers
+static const OrionConnOps_t ShmOps = { ShmRead, ShmWrite, ShmWait, ShmClose };
+
+/*!
+ * Start publishing everything a connection receives to a shared memory ring, and forwarding
+ * packets that readers of the ring send back to the connection. The broker's thread takes over
+ * the connection until the broker is stopped: nothing else may send, receive, flush or close on
+ * it in the meantime, so a process that owns the link sends through a reader of its own ring.
+ * Readers' packets reach the link within COMMAND_POLL_US, or as soon as the next packet arrives.
+ * \param pConn is the connection to the gimbal, which stays open after the broker stops
+ * \param pName is the name of the ring, or NULL for ORION_SHM_DEFAULT_NAME; any ring left behind
+ *        under this name is replaced
+ * \param Slots is the number of packets the ring holds, rounded up to a power of two, or 0 for 4096
+ * \return the new broker, or NULL if the ring or thread couldn't be created
+ */
+OrionShmBroker_t *OrionShmStartBroker(OrionConn_t *pConn, const char *pName, UInt32 Slots)
+{
+    OrionShmBroker_t *pBroker;
+    UInt32 Size = 16, i;
+    void *pBase;
+    int Handle;
+
+    if (pConn == NULL)
+        return NULL;
+
+    // Round the slot count up to a power of two
+    if (Slots == 0)
+        Slots = SHM_DEFAULT_SLOTS;
+    while ((Size < Slots) && (Size < 0x10000000))
+        Size <<= 1;
+
+    if ((pBroker = (OrionShmBroker_t *)calloc(1, sizeof(OrionShmBroker_t))) == NULL)
+        return NULL;
+
+    pBroker->pConn = pConn;
+    if (MakeName(pName, pBroker->Name, sizeof(pBroker->Name)) == FALSE)
+    {
+        free(pBroker);
+        return NULL;
+    }
+
+    // Start from a fresh ring, so readers still attached to one from a broker that died don't
+    //  get mixed up with this one
+    shm_unlink(pBroker->Name);
+    Handle = shm_open(pBroker->Name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+    if ((Handle < 0) || (ftruncate(Handle, (off_t)GetMapSize(Size, SHM_COMMAND_SLOTS)) != 0) ||
+        ((pBase = mmap(NULL, GetMapSize(Size, SHM_COMMAND_SLOTS), PROT_READ | PROT_WRITE, MAP_SHARED, Handle, 0)) == MAP_FAILED))
+    {
+        if (Handle >= 0)
+        {
+            close(Handle);
+            shm_unlink(pBroker->Name);
+        }
+
+        free(pBroker);
+        return NULL;
+    }
+
+    // The mapping is all we need from here on
+    close(Handle);
+    SetMap(&pBroker->Map, pBase, Size, GetMapSize(Size, SHM_COMMAND_SLOTS));
+
+    // The new memory is zeroed, so only the sizes and the command slots' turns need setting
+    pBroker->Map.pHeader->Version = SHM_VERSION;
+    pBroker->Map.pHeader->Slots = Size;
+    pBroker->Map.pHeader->CommandSlots = SHM_COMMAND_SLOTS;
+    pBroker->Map.pHeader->BrokerPid = (UInt32)getpid();
+    for (i = 0; i < SHM_COMMAND_SLOTS; i++)
+        pBroker->Map.pCommands[i].Seq = i;
+
+    // Now readers can have it
+    __atomic_store_n(&pBroker->Map.pHeader->Magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    // Start publishing packets and forwarding commands
+    if (pthread_create(&pBroker->Thread, NULL, BrokerThread, pBroker) != 0)
+    {
+        shm_unlink(pBroker->Name);
+        munmap(pBase, pBroker->Map.Size);
+        free(pBroker);
+        return NULL;
+    }
+
+    return pBroker;
+
+}// OrionShmStartBroker
+
+/*!
+ * Stop a broker, telling its readers that nothing more is coming and removing the ring's name.
+ * Readers that still have the ring open keep it until they close it.
+ * \param pBroker is the broker to stop, which may be NULL
+ */
+void OrionShmStopBroker(OrionShmBroker_t *pBroker)
+{
+    if (pBroker == NULL)
+        return;
+
+    // The thread checks in at least every COMMAND_POLL_US
+    __atomic_store_n(&pBroker->Stop, 1, __ATOMIC_RELEASE);
+    pthread_join(pBroker->Thread, NULL);
+
+    // Let the readers know, then let go of the ring
+    CloseRing(pBroker->Map.pHeader);
+    shm_unlink(pBroker->Name);
+    munmap(pBroker->Map.pHeader, pBroker->Map.Size);
+    free(pBroker);
+
+}// OrionShmStopBroker
+
+/*!
+ * Get a broker's counters
+ * \param pBroker is the broker
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ */
+void OrionShmGetBrokerStats(OrionShmBroker_t *pBroker, OrionShmBrokerStats_t *pStats, BOOL Reset)
+{
+    *pStats = pBroker->Stats;
+    if (Reset)
+        memset(&pBroker->Stats, 0, sizeof(pBroker->Stats));
+
+}// OrionShmGetBrokerStats
+
+/*!
+ * Open a connection that reads the packets a broker publishes, starting with the next one, and
+ * sends packets to the gimbal through the broker
+ * \param pName is the name the broker was started with, or NULL for ORION_SHM_DEFAULT_NAME
+ * \return the new connection, or NULL if there's no broker running under that name
+ */
+OrionConn_t *OrionConnOpenShm(const char *pName)
+{
+    OrionShmReader_t *pReader;
+    OrionConn_t *pConn;
+    char Name[NAME_MAX];
+    ShmHeader_t *pHeader;
+    struct stat Info;
+    void *pBase;
+    int Handle;
+
+    if ((MakeName(pName, Name, sizeof(Name)) == FALSE) || ((Handle = shm_open(Name, O_RDWR | O_CLOEXEC, 0)) < 0))
+        return NULL;
+
+    // Map however much the broker made, which has to at least cover the header
+    if ((fstat(Handle, &Info) != 0) || (Info.st_size < (off_t)sizeof(ShmHeader_t)) ||
+        ((pBase = mmap(NULL, (size_t)Info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, Handle, 0)) == MAP_FAILED))
+    {
+        close(Handle);
+        return NULL;
+    }
+
+    close(Handle);
+
+    // The ring has to be finished, laid out the way we expect and as big as it says it is
+    pHeader = (ShmHeader_t *)pBase;
+    if ((__atomic_load_n(&pHeader->Magic, __ATOMIC_ACQUIRE) != SHM_MAGIC) || (pHeader->Version != SHM_VERSION) ||
+        (pHeader->Slots == 0) || ((pHeader->Slots & (pHeader->Slots - 1)) != 0) || (pHeader->CommandSlots != SHM_COMMAND_SLOTS) ||
+        (GetMapSize(pHeader->Slots, pHeader->CommandSlots) != (size_t)Info.st_size) ||
+        ((pReader = (OrionShmReader_t *)calloc(1, sizeof(OrionShmReader_t))) == NULL))
+    {
+        munmap(pBase, (size_t)Info.st_size);
+        return NULL;
+    }
+
+    // Pick up from whatever the broker publishes next
+    SetMap(&pReader->Map, pBase, pHeader->Slots, (size_t)Info.st_size);
+    pReader->Next = __atomic_load_n(&pHeader->WriteSeq, __ATOMIC_ACQUIRE);
+
+    if ((pConn = OrionConnCreate(-1, &ShmOps, pReader)) == NULL)
+    {
+        munmap(pBase, (size_t)Info.st_size);
+        free(pReader);
+    }
+
+    return pConn;
+
+}// OrionConnOpenShm
+
+/*!
+ * Replace the default connection with a shared memory reader
+ * \param pName is the name the broker was started with, or NULL for ORION_SHM_DEFAULT_NAME
+ * \return TRUE if the connection was opened
+ */
+BOOL OrionCommOpenShm(const char *pName)
+{
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenShm(pName));
+
+}// OrionCommOpenShm
+
+/*!
+ * Look at the next packet right where it sits in the shared ring, without copying it. The broker
+ * never waits for readers, so the packet may be overwritten while it's being looked at; call
+ * OrionShmRelease when done with it to find out whether it was. Don't mix this with the
+ * connection's receive functions while they have part of a packet buffered.
+ * \param pConn is a shared memory connection
+ * \param pView receives the packet and when it arrived at the broker
+ * \param TimeoutUs is how long to wait for a packet if there isn't one yet
+ * \return TRUE if there was a packet, FALSE if not or if pConn isn't a shared memory connection
+ */
+BOOL OrionShmPeek(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs)
+{
+    OrionShmReader_t *pReader = GetReader(pConn);
+    const ShmSlot_t *pSlot;
+    UInt64 Seq;
+
+    if (pReader == NULL)
+        return FALSE;
+
+    // Anything still held is finished with, whether or not the caller said so
+    pReader->pHeld = NULL;
+
+    // Find the next intact packet, waiting for one if need be
+    if (((pSlot = NextSlot(pReader, &Seq)) == NULL) && (TimeoutUs > 0))
+    {
+        ShmWait(pConn, TimeoutUs);
+        pSlot = NextSlot(pReader, &Seq);
+    }
+
+    if (pSlot == NULL)
+        return FALSE;
+
+    // Hand it over in place, remembering which packet it was so the release can check for it
+    pView->pPkt = (const OrionPkt_t *)pSlot->Data;
+    pView->Size = pSlot->Size;
+    pView->TimeUs = pSlot->TimeUs;
+    pReader->pHeld = pSlot;
+    pReader->HeldSeq = Seq;
+    pReader->Stats.Received++;
+    return TRUE;
+
+}// OrionShmPeek
+
+/*!
+ * Finish with the packet from OrionShmPeek
+ * \param pConn is a shared memory connection
+ * \return TRUE if the packet was left alone the whole time it was being looked at, or FALSE if
+ *         the broker overwrote it, in which case anything taken from it must be thrown away
+ */
+BOOL OrionShmRelease(OrionConn_t *pConn)
+{
+    OrionShmReader_t *pReader = GetReader(pConn);
+    BOOL Intact;
+
+    if ((pReader == NULL) || (pReader->pHeld == NULL))
+        return FALSE;
+
+    // Everything read from the slot has to be done before checking it's still the same packet
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    Intact = (__atomic_load_n(&pReader->pHeld->Seq, __ATOMIC_RELAXED) == pReader->HeldSeq + 1);
+    pReader->pHeld = NULL;
+
+    // It didn't really arrive after all
+    if (Intact == FALSE)
+    {
+        pReader->Stats.Received--;
+        pReader->Stats.Lost++;
+    }
+
+    return Intact;
+
+}// OrionShmRelease
+
+/*!
+ * Get a shared memory connection's counters
+ * \param pConn is a shared memory connection
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ * \return TRUE if pConn is a shared memory connection
+ */
+BOOL OrionShmGetStats(OrionConn_t *pConn, OrionShmStats_t *pStats, BOOL Reset)
+{
+    OrionShmReader_t *pReader = GetReader(pConn);
+
+    if (pReader == NULL)
+        return FALSE;
+
+    *pStats = pReader->Stats;
+    if (Reset)
+        memset(&pReader->Stats, 0, sizeof(pReader->Stats));
+
+    return TRUE;
+
+}// OrionShmGetStats
+
+// Turn a ring name into a POSIX shared memory name, which has to start with a slash
+static BOOL MakeName(const char *pName, char *pBuffer, size_t Size)
+{
+    int Length;
+
+    if (pName == NULL)
+        pName = ORION_SHM_DEFAULT_NAME;
+
+    Length = snprintf(pBuffer, Size, "%s%s", (pName[0] == '/') ? "" : "/", pName);
+    return (Length > 1) && ((size_t)Length < Size);
+
+}// MakeName
+
+// Bytes of shared memory needed for a ring with the given numbers of slots
+static size_t GetMapSize(UInt32 Slots, UInt32 CommandSlots)
+{
+    return sizeof(ShmHeader_t) + Slots * sizeof(ShmSlot_t) + CommandSlots * sizeof(ShmCommand_t);
+
+}// GetMapSize
+
+// Point a mapping's pieces at the right places in the shared memory
+static void SetMap(ShmMap_t *pMap, void *pBase, UInt32 Slots, size_t Size)
+{
+    pMap->pHeader = (ShmHeader_t *)pBase;
+    pMap->pSlots = (ShmSlot_t *)(pMap->pHeader + 1);
+    pMap->pCommands = (ShmCommand_t *)(pMap->pSlots + Slots);
+    pMap->Size = Size;
+
+}// SetMap
+
+// Wait on or wake a futex shared between processes, with a timeout for waits
+static long Futex(UInt32 *pWord, int Op, UInt32 Value, UInt32 TimeoutUs)
+{
+    struct timespec Timeout = { (time_t)(TimeoutUs / 1000000), (long)(TimeoutUs % 1000000) * 1000 };
+
+    return syscall(SYS_futex, pWord, Op, Value, (Op == FUTEX_WAIT) ? &Timeout : NULL, NULL, 0);
+
+}// Futex
+
+// Broker thread: publish every packet the link delivers, and send on whatever readers put in the
+//  command ring between packets, until the link drops or we're stopped. Doing both from here means
+//  nothing else ever touches the connection while the broker has it.
+static void *BrokerThread(void *pArg)
+{
+    OrionShmBroker_t *pBroker = (OrionShmBroker_t *)pArg;
+    OrionPktView_t View;
+
+    while (__atomic_load_n(&pBroker->Stop, __ATOMIC_ACQUIRE) == 0)
+    {
+        ForwardCommands(pBroker);
+
+        if (OrionConnReceiveViewTimeout(pBroker->pConn, &View, COMMAND_POLL_US))
+            Publish(pBroker, &View);
+        else if (OrionConnIsOpen(pBroker->pConn) == FALSE)
+            break;
+    }
+
+    // Finish off whatever readers already sent, which a link that's only stopped sending may still
+    //  take, then if the link went away rather than us being stopped, so does everything downstream of it
+    ForwardCommands(pBroker);
+    if (__atomic_load_n(&pBroker->Stop, __ATOMIC_ACQUIRE) == 0)
+        CloseRing(pBroker->Map.pHeader);
+
+    return NULL;
+
+}// BrokerThread
+
+// Send each packet readers have put in the command ring on to the link
+static void ForwardCommands(OrionShmBroker_t *pBroker)
+{
+    ShmHeader_t *pHeader = pBroker->Map.pHeader;
+    UInt32 Mask = pHeader->CommandSlots - 1;
+
+    while (1)
+    {
+        ShmCommand_t *pCommand = &pBroker->Map.pCommands[pBroker->CommandTail & Mask];
+        OrionPkt_t Pkt;
+        UInt32 Size;
+
+        // A slot is ready once the reader that claimed it has filled it in, so stop at the first that isn't
+        if (__atomic_load_n(&pCommand->Seq, __ATOMIC_ACQUIRE) != pBroker->CommandTail + 1)
+            break;
+
+        // Copy the packet out, then hand the slot back for its next turn around the ring
+        if ((Size = pCommand->Size) > SHM_PKT_SIZE)
+            Size = 0;
+        memcpy(&Pkt, pCommand->Data, Size);
+        __atomic_store_n(&pCommand->Seq, pBroker->CommandTail + pHeader->CommandSlots, __ATOMIC_RELEASE);
+        __atomic_store_n(&pHeader->CommandTail, ++pBroker->CommandTail, __ATOMIC_RELEASE);
+
+        // Only whole packets go to the gimbal
+        if ((Size >= ORION_PKT_OVERHEAD) && ((UInt32)Pkt.Length + ORION_PKT_OVERHEAD == Size) && OrionConnSend(pBroker->pConn, &Pkt))
+            pBroker->Stats.Forwarded++;
+        else
+            pBroker->Stats.ForwardFailures++;
+    }
+
+}// ForwardCommands
+
+// Write a packet into the next slot of the ring and wake any readers waiting for it
+static void Publish(OrionShmBroker_t *pBroker, const OrionPktView_t *pView)
+{
+    ShmHeader_t *pHeader = pBroker->Map.pHeader;
+    UInt64 Seq = pHeader->WriteSeq;
+    ShmSlot_t *pSlot = &pBroker->Map.pSlots[Seq & (pHeader->Slots - 1)];
+
+    // Mark the slot as changing before touching its contents, so a reader still looking at the
+    //  packet that was in it can tell
+    __atomic_store_n(&pSlot->Seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(pSlot->Data, pView->pPkt, pView->Size);
+    pSlot->Size = pView->Size;
+    pSlot->TimeUs = pView->TimeUs;
+
+    // Then publish the packet, and the new count readers wait on. This has to be ordered before
+    //  the check of Waiters below, or a reader just going to sleep could miss it.
+    __atomic_store_n(&pSlot->Seq, Seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&pHeader->WriteSeq, Seq + 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&pHeader->Futex, (UInt32)(Seq + 1), __ATOMIC_SEQ_CST);
+    pBroker->Stats.Published++;
+
+    // Only make the system call if someone's actually asleep
+    if (__atomic_load_n(&pHeader->Waiters, __ATOMIC_SEQ_CST) != 0)
+        Futex(&pHeader->Futex, FUTEX_WAKE, INT_MAX, 0);
+
+}// Publish
+
+// Mark a ring as finished and wake every reader so they find out
+static void CloseRing(ShmHeader_t *pHeader)
+{
+    __atomic_store_n(&pHeader->Closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&pHeader->Futex, 0x80000000, __ATOMIC_SEQ_CST);
+    Futex(&pHeader->Futex, FUTEX_WAKE, INT_MAX, 0);
+
+}// CloseRing
+
+// Find the next packet that's still intact in the ring, skipping over any that were overwritten
+//  before we got to them, and return its slot and sequence number, or NULL if we've caught up
+static const ShmSlot_t *NextSlot(OrionShmReader_t *pReader, UInt64 *pSeq)
+{
+    ShmHeader_t *pHeader = pReader->Map.pHeader;
+    UInt64 Write;
+
+    while ((Write = __atomic_load_n(&pHeader->WriteSeq, __ATOMIC_ACQUIRE)) != pReader->Next)
+    {
+        const ShmSlot_t *pSlot;
+        UInt64 Seq;
+
+        // If we're a whole ring behind, everything before the oldest slot is already gone
+        if (Write - pReader->Next > pHeader->Slots)
+        {
+            pReader->Stats.Lost += (UInt32)(Write - pReader->Next - pHeader->Slots);
+            pReader->Next = Write - pHeader->Slots;
+        }
+
+        // The slot has to still hold the packet we're after
+        pSlot = &pReader->Map.pSlots[pReader->Next & (pHeader->Slots - 1)];
+        Seq = pReader->Next++;
+        if ((__atomic_load_n(&pSlot->Seq, __ATOMIC_ACQUIRE) == Seq + 1) && (pSlot->Size <= SHM_PKT_SIZE))
+        {
+            *pSeq = Seq;
+            return pSlot;
+        }
+
+        pReader->Stats.Lost++;
+    }
+
+    return NULL;
+
+}// NextSlot
+
+// Add a packet to the command ring, returning FALSE if the ring is full
+static BOOL PushCommand(OrionShmReader_t *pReader, const UInt8 *pData, UInt32 Size)
+{
+    ShmHeader_t *pHeader = pReader->Map.pHeader;
+    UInt32 Position = __atomic_load_n(&pHeader->CommandHead, __ATOMIC_RELAXED), Mask = pHeader->CommandSlots - 1;
+    ShmCommand_t *pCommand;
+
+    // Claim the next slot, unless another reader beats us to it, in which case try the one after
+    while (1)
+    {
+        SInt32 Turn;
+
+        pCommand = &pReader->Map.pCommands[Position & Mask];
+        Turn = (SInt32)(__atomic_load_n(&pCommand->Seq, __ATOMIC_ACQUIRE) - Position);
+
+        // Our turn at this slot: try to claim it, which updates Position if someone else got there first
+        if (Turn == 0)
+        {
+            if (__atomic_compare_exchange_n(&pHeader->CommandHead, &Position, Position + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        // The broker hasn't emptied this slot from last time around, so the ring is full
+        else if (Turn < 0)
+            return FALSE;
+        // Someone else already claimed it
+        else
+            Position = __atomic_load_n(&pHeader->CommandHead, __ATOMIC_RELAXED);
+    }
+
+    // Fill it in and hand it to the broker
+    memcpy(pCommand->Data, pData, Size);
+    pCommand->Size = Size;
+    __atomic_store_n(&pCommand->Seq, Position + 1, __ATOMIC_RELEASE);
+
+    return TRUE;
+
+}// PushCommand
+
+// Transport read: copy out the next intact packet, along with when it arrived at the broker
+static ssize_t ShmRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    OrionShmReader_t *pReader = (OrionShmReader_t *)pConn->pTransport;
+    const ShmSlot_t *pSlot;
+    UInt64 Seq;
+
+    while ((pSlot = NextSlot(pReader, &Seq)) != NULL)
+    {
+        UInt32 Count = pSlot->Size;
+        UInt64 TimeUs = pSlot->TimeUs;
+
+        if (Count > Size)
+            Count = 0;
+        memcpy(pBuffer, pSlot->Data, Count);
+
+        // Only keep the copy if the broker didn't start overwriting the slot while we made it
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ((Count > 0) && (__atomic_load_n(&pSlot->Seq, __ATOMIC_RELAXED) == Seq + 1))
+        {
+            pReader->Stats.Received++;
+            pConn->RxReadUs = TimeUs;
+            return (ssize_t)Count;
+        }
+
+        pReader->Stats.Lost++;
+    }
+
+    // Caught up; that's the end of the stream if the broker has gone
+    if (__atomic_load_n(&pReader->Map.pHeader->Closed, __ATOMIC_ACQUIRE) || pReader->BrokerGone)
+        return 0;
+
+    errno = EAGAIN;
+    return -1;
+
+}// ShmRead
+
+// Transport write: put each packet in the buffer into the command ring for the broker to send
+static ssize_t ShmWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    OrionShmReader_t *pReader = (OrionShmReader_t *)pConn->pTransport;
+    const UInt8 *pBytes = (const UInt8 *)pData;
+    size_t Used = 0;
+
+    // Nobody's listening
+    if (__atomic_load_n(&pReader->Map.pHeader->Closed, __ATOMIC_ACQUIRE) || pReader->BrokerGone)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    // Batching can hand us several packets at once, which go in one to a slot
+    while (Used < Size)
+    {
+        size_t Length = Size - Used, Packet;
+
+        // Take one packet's worth, going by its length byte, if there's a whole one here
+        if ((Length >= ORION_PKT_OVERHEAD) && ((Packet = (size_t)pBytes[Used + 3] + ORION_PKT_OVERHEAD) <= Length))
+            Length = Packet;
+        if (Length > SHM_PKT_SIZE)
+            Length = SHM_PKT_SIZE;
+
+        if (PushCommand(pReader, &pBytes[Used], (UInt32)Length) == FALSE)
+        {
+            pReader->Stats.SendFailures++;
+            break;
+        }
+
+        pReader->Stats.Sent++;
+        Used += Length;
+    }
+
+    // Nothing fit at all
+    if (Used == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return (ssize_t)Used;
+
+}// ShmWrite
+
+// Transport wait: sleep on the futex until the broker publishes something or closes the ring
+static void ShmWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    OrionShmReader_t *pReader = (OrionShmReader_t *)pConn->pTransport;
+    ShmHeader_t *pHeader = pReader->Map.pHeader;
+    UInt32 Value;
+
+    // Say we're going to sleep before taking one last look, so the broker either sees us waiting
+    //  or changes the futex before we sleep on it
+    __atomic_add_fetch(&pHeader->Waiters, 1, __ATOMIC_SEQ_CST);
+    Value = __atomic_load_n(&pHeader->Futex, __ATOMIC_SEQ_CST);
+    if ((Value == (UInt32)pReader->Next) && (__atomic_load_n(&pHeader->Closed, __ATOMIC_SEQ_CST) == 0))
+        Futex(&pHeader->Futex, FUTEX_WAIT, Value, TimeoutUs);
+
+    __atomic_sub_fetch(&pHeader->Waiters, 1, __ATOMIC_SEQ_CST);
+
+    // If nothing came, make sure there's still a broker to send anything
+    if ((__atomic_load_n(&pHeader->WriteSeq, __ATOMIC_ACQUIRE) == pReader->Next) &&
+        (kill((pid_t)pHeader->BrokerPid, 0) != 0) && (errno == ESRCH))
+        pReader->BrokerGone = TRUE;
+
+}// ShmWait
+
+// Transport close: let go of the ring
+static void ShmClose(OrionConn_t *pConn)
+{
+    OrionShmReader_t *pReader = (OrionShmReader_t *)pConn->pTransport;
+
+    munmap(pReader->Map.pHeader, pReader->Map.Size);
+    free(pReader);
+
+}// ShmClose
+
+// Get a connection's shared memory reader, or NULL if it isn't a shared memory connection
+static OrionShmReader_t *GetReader(const OrionConn_t *pConn)
+{
+    return ((pConn != NULL) && (pConn->pOps == &ShmOps)) ? (OrionShmReader_t *)pConn->pTransport : NULL;
+
+}// GetReader
+
+#endif // __linux__
@@ -0,0 +1,63 @@
+#ifndef ORIONCOMMSHM_H
+#define ORIONCOMMSHM_H
+
+#include "OrionComm.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A shared memory broker lets several local processes share one gimbal link. The process that
+//  owns the link starts a broker on it, which publishes every packet it receives into a ring in
+//  POSIX shared memory, stamped with a sequence number and its arrival time. Any number of other
+//  processes open the ring by name and read it as an ordinary connection, without a system call
+//  per packet and without the broker ever waiting on them; a reader that falls a whole ring behind
+//  skips ahead and counts what it lost. Readers sleep on a futex when the ring is empty. Packets
+//  they send go back through a second ring that any number of readers can add to, and the broker
+//  forwards them to the gimbal between received packets. While the broker runs, its thread is
+//  the only one that may use the link's connection; the process that owns the link sends through
+//  a reader of its own ring like everyone else. Shared memory connections have no handle, so they
+//  can't be watched by an OrionEventLoop.
+
+// Name of the shared memory ring used when none is given
+#define ORION_SHM_DEFAULT_NAME  "/orion-telemetry"
+
+// Broker counters
+typedef struct
+{
+    UInt32 Published;       // Packets received from the link and published to the ring
+    UInt32 Forwarded;       // Packets from readers sent on to the link
+    UInt32 ForwardFailures; // Packets from readers that the link wouldn't take
+} OrionShmBrokerStats_t;
+
+// Reader counters
+typedef struct
+{
+    UInt32 Received;        // Packets read from the ring
+    UInt32 Lost;            // Packets overwritten before they could be read
+    UInt32 Sent;            // Packets added to the broker's command ring
+    UInt32 SendFailures;    // Packets that couldn't be sent because the command ring was full
+} OrionShmStats_t;
+
+typedef struct OrionShmBroker_s OrionShmBroker_t;
+
+OrionShmBroker_t *OrionShmStartBroker(OrionConn_t *pConn, const char *pName, UInt32 Slots);
+void OrionShmStopBroker(OrionShmBroker_t *pBroker);
+void OrionShmGetBrokerStats(OrionShmBroker_t *pBroker, OrionShmBrokerStats_t *pStats, BOOL Reset);
+
+OrionConn_t *OrionConnOpenShm(const char *pName);
+BOOL OrionCommOpenShm(const char *pName);
+BOOL OrionShmPeek(OrionConn_t *pConn, OrionPktView_t *pView, UInt32 TimeoutUs);
+BOOL OrionShmRelease(OrionConn_t *pConn);
+BOOL OrionShmGetStats(OrionConn_t *pConn, OrionShmStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__
+
+#endif // ORIONCOMMSHM_H
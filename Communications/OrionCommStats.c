@@ -0,0 +1,355 @@
+#include "OrionCommStats.h"
+#include "OrionCommPrivate.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <stdlib.h>
+#include <string.h>
+
+// Arrival timing for one packet ID; the histogram is only allocated once the ID turns up
+typedef struct
+{
+    UInt32 RxBytes;
+    UInt32 TxBytes;
+    UInt64 LastUs;
+    UInt32 LastIntervalUs;
+    UInt32 Jitter16;
+    UInt32 MaxGapUs;
+    OrionHistogram_t *pIntervals;
+} OrionIdTiming_t;
+
+struct OrionConnStats_s
+{
+    // Connection-wide counters and histograms, laid out just as they're handed out
+    OrionLinkStats_t Link;
+
+    // When the statistics were started
+    UInt64 StartUs;
+
+    // Per ID byte counts and timing
+    OrionIdTiming_t Ids[256];
+};
+
+static void ResetStats(OrionConn_t *pConn);
+static UInt32 GetBucket(UInt32 Value);
+static UInt32 GetBucketTop(UInt32 Bucket);
+
+/*!
+ * Turn a connection's link statistics on or off. Turning them on starts them from zero. The
+ * statistics are updated by whichever thread reads from or sends on the connection, so a
+ * snapshot taken from another thread may be slightly out of step with itself.
+ * \param pConn is the connection
+ * \param Enable is TRUE to start collecting statistics, or FALSE to stop and free them
+ * \return TRUE if successful, or FALSE if pConn is NULL or out of memory
+ */
+BOOL OrionConnEnableStats(OrionConn_t *pConn, BOOL Enable)
+{
+    int i;
+
+    if (pConn == NULL)
+        return FALSE;
+
+    // Turning them off frees everything, including the per ID histograms
+    if (Enable == FALSE)
+    {
+        if (pConn->pStats != NULL)
+        {
+            for (i = 0; i < 256; i++)
+                free(pConn->pStats->Ids[i].pIntervals);
+        }
+
+        free(pConn->pStats);
+        pConn->pStats = NULL;
+        return TRUE;
+    }
+
+    // Turning them on when they're already on is fine
+    if ((pConn->pStats == NULL) && ((pConn->pStats = (OrionConnStats_t *)malloc(sizeof(OrionConnStats_t))) == NULL))
+        return FALSE;
+
+    memset(pConn->pStats->Ids, 0, sizeof(pConn->pStats->Ids));
+    ResetStats(pConn);
+    return TRUE;
+
+}// OrionConnEnableStats
+
+/*!
+ * Take a snapshot of a connection's link statistics
+ * \param pConn is the connection
+ * \param pStats receives the statistics
+ * \param Reset is TRUE to start the statistics over from zero afterward, including those per ID
+ * \return TRUE if successful, or FALSE if statistics aren't turned on for pConn
+ */
+BOOL OrionConnGetLinkStats(OrionConn_t *pConn, OrionLinkStats_t *pStats, BOOL Reset)
+{
+    if ((pConn == NULL) || (pConn->pStats == NULL))
+        return FALSE;
+
+    // The parser's counters live in the connection, since they cost nothing to keep
+    *pStats = pConn->pStats->Link;
+    pStats->ElapsedUs = (UInt32)(OrionCommGetTimeUs() - pConn->pStats->StartUs);
+    pStats->Discarded = pConn->RxParseStats.Discarded;
+    pStats->ChecksumFailures = pConn->RxParseStats.ChecksumFailures;
+    pStats->OversizeRejects = pConn->RxParseStats.OversizeRejects;
+
+    if (Reset)
+        ResetStats(pConn);
+
+    return TRUE;
+
+}// OrionConnGetLinkStats
+
+/*!
+ * Take a snapshot of the link statistics for one packet ID on a connection
+ * \param pConn is the connection
+ * \param ID is the packet ID
+ * \param pStats receives the statistics
+ * \return TRUE if successful, or FALSE if statistics aren't turned on for pConn
+ */
+BOOL OrionConnGetIdStats(OrionConn_t *pConn, UInt8 ID, OrionIdStats_t *pStats)
+{
+    const OrionIdTiming_t *pId;
+
+    if ((pConn == NULL) || (pConn->pStats == NULL))
+        return FALSE;
+
+    pId = &pConn->pStats->Ids[ID];
+
+    // Counts come from the connection-wide tables
+    pStats->RxPackets = pConn->pStats->Link.RxIdPackets[ID];
+    pStats->TxPackets = pConn->pStats->Link.TxIdPackets[ID];
+    pStats->RxBytes = pId->RxBytes;
+    pStats->TxBytes = pId->TxBytes;
+    pStats->JitterUs = pId->Jitter16 / 16;
+    pStats->MaxGapUs = pId->MaxGapUs;
+
+    // Timing comes from the histogram, if this ID has arrived more than once
+    if (pId->pIntervals != NULL)
+        pStats->Intervals = *pId->pIntervals;
+    else
+        OrionHistogramReset(&pStats->Intervals);
+
+    pStats->MeanIntervalUs = (pStats->Intervals.Count > 0) ? (UInt32)(pStats->Intervals.Sum / pStats->Intervals.Count) : 0;
+    return TRUE;
+
+}// OrionConnGetIdStats
+
+/*!
+ * Turn the default connection's link statistics on or off
+ * \param Enable is TRUE to start collecting statistics, or FALSE to stop and free them
+ * \return TRUE if successful
+ */
+BOOL OrionCommEnableStats(BOOL Enable)
+{
+    return OrionConnEnableStats(OrionCommGetDefaultConn(), Enable);
+
+}// OrionCommEnableStats
+
+/*!
+ * Take a snapshot of the default connection's link statistics
+ * \param pStats receives the statistics
+ * \param Reset is TRUE to start the statistics over from zero afterward
+ * \return TRUE if successful
+ */
+BOOL OrionCommGetLinkStats(OrionLinkStats_t *pStats, BOOL Reset)
+{
+    return OrionConnGetLinkStats(OrionCommGetDefaultConn(), pStats, Reset);
+
+}// OrionCommGetLinkStats
+
+/*!
+ * Take a snapshot of the default connection's link statistics for one packet ID
+ * \param ID is the packet ID
+ * \param pStats receives the statistics
+ * \return TRUE if successful
+ */
+BOOL OrionCommGetIdStats(UInt8 ID, OrionIdStats_t *pStats)
+{
+    return OrionConnGetIdStats(OrionCommGetDefaultConn(), ID, pStats);
+
+}// OrionCommGetIdStats
+
+/*!
+ * Empty a histogram
+ * \param pHist is the histogram
+ */
+void OrionHistogramReset(OrionHistogram_t *pHist)
+{
+    memset(pHist, 0, sizeof(OrionHistogram_t));
+
+}// OrionHistogramReset
+
+/*!
+ * Record a value in a histogram
+ * \param pHist is the histogram
+ * \param Value is the value to record
+ */
+void OrionHistogramAdd(OrionHistogram_t *pHist, UInt32 Value)
+{
+    // Keep the extremes exactly, since the buckets only keep them approximately
+    if ((pHist->Count == 0) || (Value < pHist->Min))
+        pHist->Min = Value;
+    if (Value > pHist->Max)
+        pHist->Max = Value;
+
+    pHist->Count++;
+    pHist->Sum += Value;
+    pHist->Buckets[GetBucket(Value)]++;
+
+}// OrionHistogramAdd
+
+/*!
+ * Look up a percentile in a histogram
+ * \param pHist is the histogram
+ * \param Percent is the percentile, from 0 to 100
+ * \return the value that Percent percent of the values recorded are at or below, to within the
+ *         histogram's resolution, or 0 if the histogram is empty
+ */
+UInt32 OrionHistogramGetPercentile(const OrionHistogram_t *pHist, double Percent)
+{
+    UInt64 Target, Seen = 0;
+    UInt32 i;
+
+    if (pHist->Count == 0)
+        return 0;
+
+    // The number of values that have to be at or below the answer, at least one
+    Target = (UInt64)(Percent / 100.0 * pHist->Count + 0.5);
+    if (Target < 1)
+        Target = 1;
+
+    // Walk up the buckets until we've seen that many, and report the top of the bucket, but never
+    //  anything outside the range actually recorded
+    for (i = 0; i < ORION_HIST_BUCKETS; i++)
+    {
+        if ((Seen += pHist->Buckets[i]) >= Target)
+        {
+            UInt32 Top = GetBucketTop(i);
+
+            return (Top > pHist->Max) ? pHist->Max : (Top < pHist->Min) ? pHist->Min : Top;
+        }
+    }
+
+    return pHist->Max;
+
+}// OrionHistogramGetPercentile
+
+// Statistics hook: a read from the link has returned some data
+void OrionConnStatsRead(OrionConn_t *pConn, UInt32 Bytes)
+{
+    OrionConnStats_t *pStats = pConn->pStats;
+
+    pStats->Link.RxBytes += Bytes;
+    OrionHistogramAdd(&pStats->Link.ReadSizes, Bytes);
+
+}// OrionConnStatsRead
+
+// Statistics hook: a valid packet that arrived at TimeUs has been framed and is about to be handed over
+void OrionConnStatsRx(OrionConn_t *pConn, const OrionPkt_t *pPkt, UInt64 TimeUs)
+{
+    OrionConnStats_t *pStats = pConn->pStats;
+    OrionIdTiming_t *pId = &pStats->Ids[pPkt->ID];
+    UInt64 NowUs = OrionCommGetTimeUs();
+
+    pStats->Link.RxPackets++;
+    pStats->Link.RxIdPackets[pPkt->ID]++;
+    pId->RxBytes += pPkt->Length + ORION_PKT_OVERHEAD;
+
+    // However long it sat in the kernel or the receive buffer waiting for the application is on
+    //  us, not the link
+    OrionHistogramAdd(&pStats->Link.DispatchDelays, (NowUs > TimeUs) ? (UInt32)(NowUs - TimeUs) : 0);
+
+    // Time it against the last packet with this ID, going by when each one arrived
+    if (pId->LastUs != 0)
+    {
+        UInt32 IntervalUs = (TimeUs > pId->LastUs) ? (UInt32)(TimeUs - pId->LastUs) : 0;
+        SInt32 Change = (SInt32)(IntervalUs - pId->LastIntervalUs);
+
+        // First time round, make room for the histogram; if that fails, just do without
+        if ((pId->pIntervals == NULL) && ((pId->pIntervals = (OrionHistogram_t *)malloc(sizeof(OrionHistogram_t))) != NULL))
+            OrionHistogramReset(pId->pIntervals);
+        if (pId->pIntervals != NULL)
+            OrionHistogramAdd(pId->pIntervals, IntervalUs);
+
+        // Jitter is a running average of how much each interval differs from the one before it,
+        //  kept scaled up by 16 as in RFC 3550, once there's a previous interval to compare with
+        if (pId->LastIntervalUs != 0)
+            pId->Jitter16 += (UInt32)(((Change < 0) ? -Change : Change) - (SInt32)((pId->Jitter16 + 8) / 16));
+
+        if (IntervalUs > pId->MaxGapUs)
+            pId->MaxGapUs = IntervalUs;
+
+        pId->LastIntervalUs = IntervalUs;
+    }
+
+    pId->LastUs = TimeUs;
+
+}// OrionConnStatsRx
+
+// Statistics hook: a packet has been sent (or batched up to be sent)
+void OrionConnStatsTx(OrionConn_t *pConn, const OrionPkt_t *pPkt)
+{
+    OrionConnStats_t *pStats = pConn->pStats;
+    UInt32 Size = pPkt->Length + ORION_PKT_OVERHEAD;
+
+    pStats->Link.TxPackets++;
+    pStats->Link.TxBytes += Size;
+    pStats->Link.TxIdPackets[pPkt->ID]++;
+    pStats->Ids[pPkt->ID].TxBytes += Size;
+
+}// OrionConnStatsTx
+
+// Start a connection's statistics over, keeping the per ID histograms allocated
+static void ResetStats(OrionConn_t *pConn)
+{
+    OrionConnStats_t *pStats = pConn->pStats;
+    int i;
+
+    memset(&pStats->Link, 0, sizeof(pStats->Link));
+    memset(&pConn->RxParseStats, 0, sizeof(pConn->RxParseStats));
+    pStats->StartUs = OrionCommGetTimeUs();
+
+    // Arrival times carry on, so the first interval after a reset is still a real one
+    for (i = 0; i < 256; i++)
+    {
+        OrionIdTiming_t *pId = &pStats->Ids[i];
+
+        pId->RxBytes = pId->TxBytes = pId->MaxGapUs = pId->Jitter16 = 0;
+        if (pId->pIntervals != NULL)
+            OrionHistogramReset(pId->pIntervals);
+    }
+
+}// ResetStats
+
+// Find the histogram bucket for a value: values under 16 get a bucket each, and every power of
+//  two above that is split into 16 buckets
+static UInt32 GetBucket(UInt32 Value)
+{
+    UInt32 Shift;
+
+    if (Value < (1u << ORION_HIST_SUB_BITS))
+        return Value;
+
+    // How far the value has to be shifted down to leave just its top five bits
+    Shift = (31 - (UInt32)__builtin_clz(Value)) - ORION_HIST_SUB_BITS;
+
+    return ((Shift + 1) << ORION_HIST_SUB_BITS) + ((Value >> Shift) & ((1u << ORION_HIST_SUB_BITS) - 1));
+
+}// GetBucket
+
+// Find the largest value that falls in a histogram bucket
+static UInt32 GetBucketTop(UInt32 Bucket)
+{
+    UInt32 Shift, Sub;
+
+    if (Bucket < (1u << ORION_HIST_SUB_BITS))
+        return Bucket;
+
+    Shift = (Bucket >> ORION_HIST_SUB_BITS) - 1;
+    Sub = Bucket & ((1u << ORION_HIST_SUB_BITS) - 1);
+
+    return (((1u << ORION_HIST_SUB_BITS) + Sub) << Shift) + ((1u << Shift) - 1);
+
+}// GetBucketTop
+
+#endif // __linux__ || __APPLE__
@@ -0,0 +1,79 @@
+#ifndef ORIONCOMMSTATS_H
+#define ORIONCOMMSTATS_H
+
+#include "OrionComm.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Each power of two is split into this many linear sub-buckets, so values are recorded to within
+//  1/16 (about 6%) across the whole 32-bit range, in the style of an HDR histogram
+#define ORION_HIST_SUB_BITS     4
+#define ORION_HIST_BUCKETS      ((32 - ORION_HIST_SUB_BITS + 1) << ORION_HIST_SUB_BITS)
+
+// A log-linear histogram of 32-bit values, typically microseconds or bytes
+typedef struct
+{
+    UInt32 Count;                           // Number of values recorded
+    UInt32 Min;                             // Smallest value recorded, exactly
+    UInt32 Max;                             // Largest value recorded, exactly
+    UInt64 Sum;                             // Total of every value recorded
+    UInt32 Buckets[ORION_HIST_BUCKETS];     // Number of values in each bucket
+} OrionHistogram_t;
+
+// Link statistics for one packet ID on one connection
+typedef struct
+{
+    UInt32 RxPackets;           // Packets received
+    UInt32 RxBytes;             // Bytes received in those packets, including headers and checksums
+    UInt32 TxPackets;           // Packets sent
+    UInt32 TxBytes;             // Bytes sent in those packets, including headers and checksums
+    UInt32 MeanIntervalUs;      // Average time between arrivals
+    UInt32 JitterUs;            // Smoothed change in the time between arrivals, as in RFC 3550
+    UInt32 MaxGapUs;            // Longest time between arrivals
+    OrionHistogram_t Intervals; // Times between arrivals, in microseconds
+} OrionIdStats_t;
+
+// Link statistics for a whole connection
+typedef struct
+{
+    UInt32 ElapsedUs;           // Time since the statistics were turned on or last reset
+
+    UInt32 RxPackets;           // Valid packets received
+    UInt32 RxBytes;             // Bytes read from the link, valid or not
+    UInt32 TxPackets;           // Packets sent
+    UInt32 TxBytes;             // Bytes sent in those packets
+
+    UInt32 Discarded;           // Bytes the parser threw away while resynchronizing
+    UInt32 ChecksumFailures;    // Packets dropped because their checksum didn't match
+    UInt32 OversizeRejects;     // Headers dropped because their length was too long
+
+    UInt32 RxIdPackets[256];    // Packets received, by ID
+    UInt32 TxIdPackets[256];    // Packets sent, by ID
+
+    OrionHistogram_t ReadSizes;         // Bytes returned by each read from the link
+    OrionHistogram_t DispatchDelays;    // Microseconds from each packet arriving to handing it over
+} OrionLinkStats_t;
+
+BOOL OrionConnEnableStats(OrionConn_t *pConn, BOOL Enable);
+BOOL OrionConnGetLinkStats(OrionConn_t *pConn, OrionLinkStats_t *pStats, BOOL Reset);
+BOOL OrionConnGetIdStats(OrionConn_t *pConn, UInt8 ID, OrionIdStats_t *pStats);
+BOOL OrionCommEnableStats(BOOL Enable);
+BOOL OrionCommGetLinkStats(OrionLinkStats_t *pStats, BOOL Reset);
+BOOL OrionCommGetIdStats(UInt8 ID, OrionIdStats_t *pStats);
+
+void OrionHistogramReset(OrionHistogram_t *pHist);
+void OrionHistogramAdd(OrionHistogram_t *pHist, UInt32 Value);
+UInt32 OrionHistogramGetPercentile(const OrionHistogram_t *pHist, double Percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__ || __APPLE__
+
+#endif // ORIONCOMMSTATS_H
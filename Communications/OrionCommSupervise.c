@@ -0,0 +1,635 @@
+// Needed for ppoll()
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "OrionCommSupervise.h"
+#include "OrionCommPrivate.h"
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Everything a supervised connection keeps track of, hung off the connection as its transport
+typedef struct
+{
+    OrionSuperviseOptions_t Options;
+
+    // Where to connect, the socket (or -1 while there isn't one), and the timer that wakes the
+    //  connection's handle up when the next deadline passes
+    struct sockaddr_in Address;
+    int Socket;
+    int TimerHandle;
+    UInt64 ArmedUs;
+
+    // Link state, and when the current attempt times out or the next one is due
+    OrionSuperviseState_t State;
+    UInt64 DeadlineUs;
+    UInt32 BackoffUs;
+
+    // When data last arrived, when the link went down, and whether it's ever been up
+    UInt64 LastRxUs;
+    UInt64 DownUs;
+    BOOL EverUp;
+
+    // Set on reconnecting, so the next read starts the parser afresh
+    BOOL ResetParser;
+
+    // Packets to send again after reconnecting, by ID, and the order they were registered in
+    OrionPkt_t *pSticky[256];
+    UInt8 StickyOrder[256];
+    UInt32 StickyCount;
+
+    // Who to tell about outages, and whether they're being told right now
+    OrionSuperviseHandler_t pHandler;
+    void *pContext;
+    BOOL InHandler;
+
+    OrionSuperviseStats_t Stats;
+} OrionSupervisor_t;
+
+static ssize_t SuperviseRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t SuperviseWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void SuperviseWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void SuperviseClose(OrionConn_t *pConn);
+static void Service(OrionConn_t *pConn, OrionSupervisor_t *pSup);
+static void StartConnect(OrionConn_t *pConn, OrionSupervisor_t *pSup, UInt64 NowUs);
+static void Connected(OrionConn_t *pConn, OrionSupervisor_t *pSup, UInt64 NowUs);
+static void ConnectFailed(OrionSupervisor_t *pSup, UInt64 NowUs);
+static void LinkLost(OrionConn_t *pConn, OrionSupervisor_t *pSup);
+static void CloseSocket(OrionConn_t *pConn, OrionSupervisor_t *pSup);
+static void ArmTimer(OrionSupervisor_t *pSup);
+static OrionSupervisor_t *GetSupervisor(OrionConn_t *pConn);
+
+// Transport operations for supervised connections
+static const OrionConnOps_t SuperviseOps = { SuperviseRead, SuperviseWrite, SuperviseWait, SuperviseClose };
+
+/*!
+ * Fill out a set of supervision options with the defaults
+ * \param pOptions receives the default options
+ */
+void OrionSuperviseDefaultOptions(OrionSuperviseOptions_t *pOptions)
+{
+    // The gimbal streams telemetry several times a second, so two seconds of silence means it's
+    //  gone; TCP probes an idle link every second; retries start at 100 ms and back off to 2 s
+    pOptions->Port = TCP_PORT;
+    pOptions->SilenceUs = 2000000;
+    pOptions->KeepaliveUs = 1000000;
+    pOptions->ConnectTimeoutUs = 2000000;
+    pOptions->MinBackoffUs = 100000;
+    pOptions->MaxBackoffUs = 2000000;
+
+}// OrionSuperviseDefaultOptions
+
+/*!
+ * Open a supervised TCP connection to a gimbal. If the address is the broadcast address, the
+ * gimbal is found with the usual discovery request first, and later reconnections go to whichever
+ * gimbal answered. This waits up to the connect timeout for the first connection, but returns the
+ * connection either way; it keeps trying in the background.
+ * \param pAddress is the gimbal's IP address as a string, or "255.255.255.255" to discover it
+ * \param pOptions are the supervision options, or NULL to use the defaults
+ * \return the new connection, or NULL if the address is bad or discovery failed
+ */
+OrionConn_t *OrionConnOpenSupervised(const char *pAddress, const OrionSuperviseOptions_t *pOptions)
+{
+    struct epoll_event Event;
+    OrionSupervisor_t *pSup;
+    OrionConn_t *pConn;
+    uint32_t Address;
+    UInt64 StartUs;
+    int Handle;
+
+    // Turn the address string into something we can connect to
+    if ((OrionCommIpStringValid(pAddress) == FALSE) || (inet_pton(AF_INET, pAddress, &Address) != 1))
+        return NULL;
+
+    // A broadcast address needs a gimbal to answer it, and we remember the one that did
+    if (Address == htonl(INADDR_BROADCAST))
+    {
+        OrionConn_t *pFound = OrionConnOpenNetworkIp(pAddress);
+        struct sockaddr_in Peer;
+        socklen_t Size = sizeof(Peer);
+
+        Handle = OrionConnGetHandle(pFound);
+        if ((Handle < 0) || (getpeername(Handle, (struct sockaddr *)&Peer, &Size) != 0))
+        {
+            OrionConnClose(pFound);
+            return NULL;
+        }
+
+        Address = Peer.sin_addr.s_addr;
+        OrionConnClose(pFound);
+    }
+
+    // Set up the supervisor with nothing connected yet
+    if ((pSup = (OrionSupervisor_t *)calloc(1, sizeof(OrionSupervisor_t))) == NULL)
+        return NULL;
+
+    if (pOptions != NULL)
+        pSup->Options = *pOptions;
+    else
+        OrionSuperviseDefaultOptions(&pSup->Options);
+    if (pSup->Options.MinBackoffUs == 0)
+        pSup->Options.MinBackoffUs = 1000;
+    if (pSup->Options.MaxBackoffUs < pSup->Options.MinBackoffUs)
+        pSup->Options.MaxBackoffUs = pSup->Options.MinBackoffUs;
+
+    pSup->Address.sin_family = AF_INET;
+    pSup->Address.sin_addr.s_addr = Address;
+    pSup->Address.sin_port = htons(pSup->Options.Port);
+    pSup->Socket = -1;
+    pSup->BackoffUs = pSup->Options.MinBackoffUs;
+
+    // The connection's handle is an epoll instance holding the timer and whichever socket is
+    //  current, so anyone polling it wakes up for data, connection attempts and deadlines alike
+    Handle = epoll_create1(EPOLL_CLOEXEC);
+    pSup->TimerHandle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    if ((Handle < 0) || (pSup->TimerHandle < 0) || (epoll_ctl(Handle, EPOLL_CTL_ADD, pSup->TimerHandle, &Event) != 0) ||
+        ((pConn = OrionConnCreate(Handle, &SuperviseOps, pSup)) == NULL))
+    {
+        if (Handle >= 0)
+            close(Handle);
+        if (pSup->TimerHandle >= 0)
+            close(pSup->TimerHandle);
+        free(pSup);
+        return NULL;
+    }
+
+    // Start connecting, and give the first attempt its full timeout to come good
+    StartUs = pSup->DownUs = OrionCommGetTimeUs();
+    StartConnect(pConn, pSup, StartUs);
+    while ((pSup->State != ORION_SUPERVISE_UP) && (OrionCommGetTimeUs() < StartUs + pSup->Options.ConnectTimeoutUs))
+    {
+        SuperviseWait(pConn, 10000);
+        Service(pConn, pSup);
+    }
+
+    return pConn;
+
+}// OrionConnOpenSupervised
+
+/*!
+ * Replace the default connection with a supervised one
+ * \param pAddress is the gimbal's IP address as a string, or "255.255.255.255" to discover it
+ * \param pOptions are the supervision options, or NULL to use the defaults
+ * \return TRUE if the connection was created, even if it isn't up yet
+ */
+BOOL OrionCommOpenSupervised(const char *pAddress, const OrionSuperviseOptions_t *pOptions)
+{
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenSupervised(pAddress, pOptions));
+
+}// OrionCommOpenSupervised
+
+/*!
+ * Set the function to call when a supervised link goes down and comes back
+ * \param pConn is a supervised connection
+ * \param pHandler is the handler, or NULL for none
+ * \param pContext is passed through to the handler
+ * \return TRUE if pConn is a supervised connection
+ */
+BOOL OrionSuperviseSetHandler(OrionConn_t *pConn, OrionSuperviseHandler_t pHandler, void *pContext)
+{
+    OrionSupervisor_t *pSup = GetSupervisor(pConn);
+
+    if (pSup == NULL)
+        return FALSE;
+
+    pSup->pHandler = pHandler;
+    pSup->pContext = pContext;
+    return TRUE;
+
+}// OrionSuperviseSetHandler
+
+/*!
+ * Send a packet now, and again every time the link is reconnected. Each packet ID has one sticky
+ * packet, so this replaces any earlier sticky packet with the same ID, which keeps its place in
+ * the order they go out in.
+ * \param pConn is a supervised connection
+ * \param pPkt is the packet, which is copied
+ * \return TRUE if the packet was remembered; it's sent now if the link is up, and later if not
+ */
+BOOL OrionSuperviseSetSticky(OrionConn_t *pConn, const OrionPkt_t *pPkt)
+{
+    OrionSupervisor_t *pSup = GetSupervisor(pConn);
+
+    if (pSup == NULL)
+        return FALSE;
+
+    // New IDs go on the end of the list
+    if (pSup->pSticky[pPkt->ID] == NULL)
+    {
+        if ((pSup->pSticky[pPkt->ID] = (OrionPkt_t *)malloc(sizeof(OrionPkt_t))) == NULL)
+            return FALSE;
+
+        pSup->StickyOrder[pSup->StickyCount++] = pPkt->ID;
+    }
+
+    // Keep a copy for next time, and send it off now if we can
+    memcpy(pSup->pSticky[pPkt->ID], pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+    OrionConnSend(pConn, pPkt);
+    return TRUE;
+
+}// OrionSuperviseSetSticky
+
+/*!
+ * Stop sending a packet ID again on reconnecting
+ * \param pConn is a supervised connection
+ * \param ID is the packet ID to forget
+ * \return TRUE if a sticky packet with that ID was forgotten
+ */
+BOOL OrionSuperviseClearSticky(OrionConn_t *pConn, UInt8 ID)
+{
+    OrionSupervisor_t *pSup = GetSupervisor(pConn);
+    UInt32 i;
+
+    if ((pSup == NULL) || (pSup->pSticky[ID] == NULL))
+        return FALSE;
+
+    // Free the copy and close up the gap it leaves in the order
+    free(pSup->pSticky[ID]);
+    pSup->pSticky[ID] = NULL;
+    for (i = 0; pSup->StickyOrder[i] != ID; i++);
+    memmove(&pSup->StickyOrder[i], &pSup->StickyOrder[i + 1], --pSup->StickyCount - i);
+    return TRUE;
+
+}// OrionSuperviseClearSticky
+
+/*!
+ * Get a supervised connection's counters, optionally resetting them
+ * \param pConn is a supervised connection
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ * \return TRUE if pConn is a supervised connection
+ */
+BOOL OrionSuperviseGetStats(OrionConn_t *pConn, OrionSuperviseStats_t *pStats, BOOL Reset)
+{
+    OrionSupervisor_t *pSup = GetSupervisor(pConn);
+
+    if (pSup == NULL)
+        return FALSE;
+
+    // Fill in the state and the outage in progress, which aren't counters
+    pSup->Stats.State = pSup->State;
+    pSup->Stats.CurrentOutageUs = (pSup->State == ORION_SUPERVISE_UP) ? 0 : (UInt32)(OrionCommGetTimeUs() - pSup->DownUs);
+    *pStats = pSup->Stats;
+
+    if (Reset)
+        memset(&pSup->Stats, 0, sizeof(pSup->Stats));
+
+    return TRUE;
+
+}// OrionSuperviseGetStats
+
+// Transport read: keeps the link supervised, and only ever reports that there's nothing to read
+//  while it's down, so the connection itself never looks closed
+static ssize_t SuperviseRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    OrionSupervisor_t *pSup = (OrionSupervisor_t *)pConn->pTransport;
+    ssize_t Count;
+
+    Service(pConn, pSup);
+
+    // Anything half parsed from the old link is garbage now. The receive buffer is always empty
+    //  when we get here, so the parser is the only thing left to reset.
+    if (pSup->ResetParser)
+    {
+        memset(&pConn->RxPkt, 0, sizeof(pConn->RxPkt));
+        pSup->ResetParser = FALSE;
+    }
+
+    if (pSup->State != ORION_SUPERVISE_UP)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Note when data arrives for the watchdog, and start over if the far end hung up or failed
+    Count = OrionCommReadTimestamped(pSup->Socket, pBuffer, Size, &pConn->RxReadUs);
+    if (Count > 0)
+        pSup->LastRxUs = OrionCommGetTimeUs();
+    else if ((Count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+    {
+        LinkLost(pConn, pSup);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return Count;
+
+}// SuperviseRead
+
+// Transport write: fails while the link is down, and takes it down if the socket has failed
+static ssize_t SuperviseWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    OrionSupervisor_t *pSup = (OrionSupervisor_t *)pConn->pTransport;
+    ssize_t Count;
+    int Error;
+
+    Service(pConn, pSup);
+
+    if (pSup->State != ORION_SUPERVISE_UP)
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    // A dead peer mustn't be allowed to kill the process with SIGPIPE
+    Count = send(pSup->Socket, pData, Size, MSG_NOSIGNAL);
+    if ((Count < 0) && ((Error = errno) != EAGAIN) && (Error != EWOULDBLOCK) && (Error != EINTR))
+    {
+        LinkLost(pConn, pSup);
+        errno = Error;
+    }
+
+    return Count;
+
+}// SuperviseWrite
+
+// Transport wait: the epoll handle wakes up for data, connection attempts and deadlines
+static void SuperviseWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    struct pollfd Poll = { pConn->Handle, POLLIN, 0 };
+    struct timespec Timeout = { (time_t)(TimeoutUs / 1000000), (long)(TimeoutUs % 1000000) * 1000 };
+
+    ppoll(&Poll, 1, &Timeout, NULL);
+
+}// SuperviseWait
+
+// Transport close: release the socket, timer, epoll instance and sticky packets
+static void SuperviseClose(OrionConn_t *pConn)
+{
+    OrionSupervisor_t *pSup = (OrionSupervisor_t *)pConn->pTransport;
+    int i;
+
+    CloseSocket(pConn, pSup);
+    close(pSup->TimerHandle);
+    close(pConn->Handle);
+    for (i = 0; i < 256; i++)
+        free(pSup->pSticky[i]);
+
+    free(pSup);
+
+}// SuperviseClose
+
+// Move the link along: check the watchdog, finish or time out connection attempts, and start the
+//  next attempt once the backoff is up
+static void Service(OrionConn_t *pConn, OrionSupervisor_t *pSup)
+{
+    UInt64 NowUs = OrionCommGetTimeUs();
+
+    // A handler that sends gets here too, in the middle of the link changing state; leave the
+    //  link alone until the handler's done, or it could start a connection attempt of its own
+    if (pSup->InHandler)
+        return;
+
+    // Once the timer has gone off, clear it so the handle stops polling as readable
+    if ((pSup->ArmedUs != 0) && (NowUs >= pSup->ArmedUs))
+    {
+        UInt64 Expirations;
+
+        if (read(pSup->TimerHandle, &Expirations, sizeof(Expirations)) < 0)
+            Expirations = 0;
+
+        pSup->ArmedUs = 0;
+    }
+
+    switch (pSup->State)
+    {
+    case ORION_SUPERVISE_UP:
+        // A gimbal that's gone quiet is as good as gone. Sends get here too, and so do reads that
+        //  come further apart than the watchdog, so before giving up make sure there isn't data
+        //  waiting that just hasn't been read yet; if there is, the gimbal's still talking.
+        if ((pSup->Options.SilenceUs != 0) && (NowUs - pSup->LastRxUs >= pSup->Options.SilenceUs))
+        {
+            int Waiting = 0;
+
+            if ((ioctl(pSup->Socket, FIONREAD, &Waiting) == 0) && (Waiting > 0))
+                pSup->LastRxUs = NowUs;
+            else
+                LinkLost(pConn, pSup);
+        }
+        break;
+
+    case ORION_SUPERVISE_CONNECTING:
+    {
+        struct pollfd Poll = { pSup->Socket, POLLOUT, 0 };
+        socklen_t Size = sizeof(int);
+        int Error = 0;
+
+        // A non-blocking connect is finished when the socket becomes writable, one way or the other
+        if (poll(&Poll, 1, 0) > 0)
+        {
+            if ((getsockopt(pSup->Socket, SOL_SOCKET, SO_ERROR, &Error, &Size) == 0) && (Error == 0))
+                Connected(pConn, pSup, NowUs);
+            else
+                ConnectFailed(pSup, NowUs);
+        }
+        else if (NowUs >= pSup->DeadlineUs)
+            ConnectFailed(pSup, NowUs);
+        break;
+    }
+
+    case ORION_SUPERVISE_BACKOFF:
+        // Time for another go
+        if (NowUs >= pSup->DeadlineUs)
+            StartConnect(pConn, pSup, NowUs);
+        break;
+    }
+
+    ArmTimer(pSup);
+
+}// Service
+
+// Open a fresh socket and start connecting it without waiting for the result
+static void StartConnect(OrionConn_t *pConn, OrionSupervisor_t *pSup, UInt64 NowUs)
+{
+    int KeepaliveS = (int)((pSup->Options.KeepaliveUs + 999999) / 1000000), Probes = 3, On = 1;
+    unsigned int UserTimeoutMs = (unsigned int)(KeepaliveS * (Probes + 1) * 1000);
+    struct epoll_event Event;
+
+    pSup->Stats.Attempts++;
+
+    // Non-blocking from the start, so the connect doesn't hold anything up
+    pSup->Socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (pSup->Socket < 0)
+    {
+        ConnectFailed(pSup, NowUs);
+        return;
+    }
+
+    // Send packets straight away, have the kernel stamp data as it arrives, have it probe an
+    //  idle link and give up on one that stops answering, and give up just as quickly on data
+    //  that never gets acknowledged
+    setsockopt(pSup->Socket, IPPROTO_TCP, TCP_NODELAY, &On, sizeof(On));
+    OrionCommEnableRxTimestamps(pSup->Socket);
+    if (KeepaliveS > 0)
+    {
+        setsockopt(pSup->Socket, SOL_SOCKET, SO_KEEPALIVE, &On, sizeof(On));
+        setsockopt(pSup->Socket, IPPROTO_TCP, TCP_KEEPIDLE, &KeepaliveS, sizeof(KeepaliveS));
+        setsockopt(pSup->Socket, IPPROTO_TCP, TCP_KEEPINTVL, &KeepaliveS, sizeof(KeepaliveS));
+        setsockopt(pSup->Socket, IPPROTO_TCP, TCP_KEEPCNT, &Probes, sizeof(Probes));
+        setsockopt(pSup->Socket, IPPROTO_TCP, TCP_USER_TIMEOUT, &UserTimeoutMs, sizeof(UserTimeoutMs));
+    }
+
+    // Watch for the connection completing, which makes the socket writable
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLOUT;
+    epoll_ctl(pConn->Handle, EPOLL_CTL_ADD, pSup->Socket, &Event);
+
+    // Local connections can come good straight away; usually the attempt is left in progress
+    if (connect(pSup->Socket, (struct sockaddr *)&pSup->Address, sizeof(pSup->Address)) == 0)
+        Connected(pConn, pSup, NowUs);
+    else if (errno == EINPROGRESS)
+    {
+        pSup->State = ORION_SUPERVISE_CONNECTING;
+        pSup->DeadlineUs = NowUs + pSup->Options.ConnectTimeoutUs;
+    }
+    else
+        ConnectFailed(pSup, NowUs);
+
+}// StartConnect
+
+// The link is up: switch over to reading, tally up the outage, and restore the sticky state
+static void Connected(OrionConn_t *pConn, OrionSupervisor_t *pSup, UInt64 NowUs)
+{
+    UInt32 OutageUs = (UInt32)(NowUs - pSup->DownUs), i;
+    struct epoll_event Event;
+
+    // From now on the socket wakes the handle for incoming data
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    epoll_ctl(pConn->Handle, EPOLL_CTL_MOD, pSup->Socket, &Event);
+
+    pSup->State = ORION_SUPERVISE_UP;
+    pSup->LastRxUs = NowUs;
+    pSup->BackoffUs = pSup->Options.MinBackoffUs;
+    pSup->ResetParser = TRUE;
+
+    // The first connection isn't the end of an outage
+    if (pSup->EverUp)
+    {
+        pSup->Stats.Reconnects++;
+        pSup->Stats.LastOutageUs = OutageUs;
+        pSup->Stats.TotalOutageUs += OutageUs;
+        if (OutageUs > pSup->Stats.LongestOutageUs)
+            pSup->Stats.LongestOutageUs = OutageUs;
+    }
+
+    // Put the gimbal back the way it was, straight onto the new socket, ahead of anything else
+    for (i = 0; i < pSup->StickyCount; i++)
+    {
+        const OrionPkt_t *pPkt = pSup->pSticky[pSup->StickyOrder[i]];
+
+        if (send(pSup->Socket, pPkt, pPkt->Length + ORION_PKT_OVERHEAD, MSG_NOSIGNAL) > 0)
+            pSup->Stats.StickySent++;
+    }
+
+    // Let the application know, unless this is the connection it's been waiting on from the start
+    if (pSup->EverUp && (pSup->pHandler != NULL))
+    {
+        pSup->InHandler = TRUE;
+        pSup->pHandler(pConn, TRUE, OutageUs, pSup->pContext);
+        pSup->InHandler = FALSE;
+    }
+
+    pSup->EverUp = TRUE;
+
+}// Connected
+
+// A connection attempt didn't work out: wait a while before the next, a little longer each time
+static void ConnectFailed(OrionSupervisor_t *pSup, UInt64 NowUs)
+{
+    if (pSup->Socket >= 0)
+        close(pSup->Socket);
+
+    pSup->Socket = -1;
+    pSup->State = ORION_SUPERVISE_BACKOFF;
+    pSup->DeadlineUs = NowUs + pSup->BackoffUs;
+
+    pSup->BackoffUs *= 2;
+    if (pSup->BackoffUs > pSup->Options.MaxBackoffUs)
+        pSup->BackoffUs = pSup->Options.MaxBackoffUs;
+
+}// ConnectFailed
+
+// The link has failed: drop the socket, let the application know, and try again right away
+static void LinkLost(OrionConn_t *pConn, OrionSupervisor_t *pSup)
+{
+    CloseSocket(pConn, pSup);
+    pSup->DownUs = OrionCommGetTimeUs();
+    pSup->Stats.Outages++;
+
+    if (pSup->pHandler != NULL)
+    {
+        pSup->InHandler = TRUE;
+        pSup->pHandler(pConn, FALSE, 0, pSup->pContext);
+        pSup->InHandler = FALSE;
+    }
+
+    StartConnect(pConn, pSup, pSup->DownUs);
+
+}// LinkLost
+
+// Close the current socket, if there is one; closing it also takes it out of the epoll instance
+static void CloseSocket(OrionConn_t *pConn, OrionSupervisor_t *pSup)
+{
+    if (pSup->Socket >= 0)
+    {
+        epoll_ctl(pConn->Handle, EPOLL_CTL_DEL, pSup->Socket, NULL);
+        close(pSup->Socket);
+    }
+
+    pSup->Socket = -1;
+    pSup->State = ORION_SUPERVISE_BACKOFF;
+
+}// CloseSocket
+
+// Make sure the timer goes off by the next deadline. While the link is up the deadline moves with
+//  every read, so rather than rearm it each time, let it go off early and rearm it then.
+static void ArmTimer(OrionSupervisor_t *pSup)
+{
+    struct itimerspec Timer;
+    UInt64 DeadlineUs;
+
+    // While up, the only deadline is the watchdog's
+    if (pSup->State == ORION_SUPERVISE_UP)
+        DeadlineUs = (pSup->Options.SilenceUs != 0) ? pSup->LastRxUs + pSup->Options.SilenceUs : 0;
+    else
+        DeadlineUs = pSup->DeadlineUs;
+
+    // Nothing to do if there's no deadline, or the timer will go off before it anyway
+    if ((DeadlineUs == 0) || ((pSup->ArmedUs != 0) && (pSup->ArmedUs <= DeadlineUs)))
+        return;
+
+    // Absolute time on the same clock as OrionCommGetTimeUs
+    memset(&Timer, 0, sizeof(Timer));
+    Timer.it_value.tv_sec = (time_t)(DeadlineUs / 1000000);
+    Timer.it_value.tv_nsec = (long)(DeadlineUs % 1000000) * 1000;
+    if (timerfd_settime(pSup->TimerHandle, TFD_TIMER_ABSTIME, &Timer, NULL) == 0)
+        pSup->ArmedUs = DeadlineUs;
+
+}// ArmTimer
+
+// Get the supervisor behind a connection, or NULL if it isn't a supervised connection
+static OrionSupervisor_t *GetSupervisor(OrionConn_t *pConn)
+{
+    return ((pConn != NULL) && (pConn->pOps == &SuperviseOps)) ? (OrionSupervisor_t *)pConn->pTransport : NULL;
+
+}// GetSupervisor
+
+#endif // __linux__
@@ -0,0 +1,74 @@
+#ifndef ORIONCOMMSUPERVISE_H
+#define ORIONCOMMSUPERVISE_H
+
+#include "OrionComm.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A supervised TCP connection watches its own link and puts it back together when it fails. The
+//  link is declared dead when the far end hangs up, when TCP keepalive or the retransmit timeout
+//  gives up on it, or when nothing at all has been received for a while. It is then reconnected
+//  in the background, backing off between attempts, and the "sticky" packets registered with it
+//  (video settings, paths, INS options and so on) are sent again as soon as it's back. All of
+//  this is driven by the connection's own receive and send calls and never blocks them, so the
+//  connection works with the ordinary OrionConn functions and with an OrionEventLoop. Its handle
+//  is an epoll instance that stays the same across reconnects.
+
+// Where a supervised link is up to
+typedef enum
+{
+    ORION_SUPERVISE_UP,             // Connected
+    ORION_SUPERVISE_CONNECTING,     // Waiting for a connection attempt to finish
+    ORION_SUPERVISE_BACKOFF         // Waiting to try again after a failed attempt
+} OrionSuperviseState_t;
+
+// Supervision tuning parameters
+typedef struct
+{
+    UInt16 Port;                // TCP port to connect to
+    UInt32 SilenceUs;           // Time without receiving anything before the link is declared dead, or 0 to leave it to TCP
+    UInt32 KeepaliveUs;         // Idle time before TCP probes the far end, and the interval between probes; three missed probes kill the link
+    UInt32 ConnectTimeoutUs;    // Time to give each connection attempt
+    UInt32 MinBackoffUs;        // Wait after the first failed attempt, doubling with each failure after that
+    UInt32 MaxBackoffUs;        // Longest wait between attempts
+} OrionSuperviseOptions_t;
+
+// Supervision counters
+typedef struct
+{
+    OrionSuperviseState_t State;    // Where the link is up to right now
+    UInt32 Outages;                 // Times the link was lost
+    UInt32 Reconnects;              // Times it was put back together
+    UInt32 Attempts;                // Connection attempts, successful or not
+    UInt32 StickySent;              // Sticky packets sent again after reconnecting
+    UInt32 CurrentOutageUs;         // How long the link has been down, or 0 if it's up
+    UInt32 LastOutageUs;            // Length of the last outage that has ended
+    UInt32 LongestOutageUs;         // Length of the longest outage that has ended
+    UInt64 TotalOutageUs;           // Total length of every outage that has ended
+} OrionSuperviseStats_t;
+
+// Called when the link goes down (Up is FALSE), and again when it's back (Up is TRUE) along with
+//  how long it was out for. This is called from inside the connection's receive and send calls,
+//  so it may send on the connection but must not receive from it.
+typedef void (*OrionSuperviseHandler_t)(OrionConn_t *pConn, BOOL Up, UInt32 OutageUs, void *pContext);
+
+void OrionSuperviseDefaultOptions(OrionSuperviseOptions_t *pOptions);
+OrionConn_t *OrionConnOpenSupervised(const char *pAddress, const OrionSuperviseOptions_t *pOptions);
+BOOL OrionCommOpenSupervised(const char *pAddress, const OrionSuperviseOptions_t *pOptions);
+BOOL OrionSuperviseSetHandler(OrionConn_t *pConn, OrionSuperviseHandler_t pHandler, void *pContext);
+BOOL OrionSuperviseSetSticky(OrionConn_t *pConn, const OrionPkt_t *pPkt);
+BOOL OrionSuperviseClearSticky(OrionConn_t *pConn, UInt8 ID);
+BOOL OrionSuperviseGetStats(OrionConn_t *pConn, OrionSuperviseStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__
+
+#endif // ORIONCOMMSUPERVISE_H
@@ -0,0 +1,318 @@
+// Needed for recvmmsg() and ppoll()
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "OrionCommUdp.h"
+#include "OrionCommPrivate.h"
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Number of datagrams pulled in with each system call, and the largest datagram we'll take
+#define UDP_BATCH           32
+#define UDP_DATAGRAM_SIZE   2048
+
+// Room for the kernel's receive timestamp on one datagram
+typedef union
+{
+    struct cmsghdr Header;
+    UInt8 Space[CMSG_SPACE(sizeof(struct timespec))];
+} UdpControl_t;
+
+// Everything a UDP connection keeps track of, hung off the connection as its transport
+typedef struct
+{
+    // Where sends go: a fixed address, or whoever sent the latest datagram
+    struct sockaddr_in Remote;
+    BOOL FixedRemote;
+    BOOL HaveRemote;
+
+    // The latest batch of datagrams, each in its own slot, and the next one to hand over
+    struct mmsghdr Msgs[UDP_BATCH];
+    struct iovec Iovs[UDP_BATCH];
+    struct sockaddr_in Sources[UDP_BATCH];
+    UdpControl_t Controls[UDP_BATCH];
+    UInt8 Data[UDP_BATCH][UDP_DATAGRAM_SIZE];
+    int Count, Next;
+
+    // Offset from the kernel's timestamps to our clock, as of when the batch came in
+    SInt64 ClockOffsetUs;
+
+    // Where the datagram currently being framed came from
+    struct sockaddr_in Source;
+    BOOL HaveSource;
+
+    OrionUdpStats_t Stats;
+} OrionUdp_t;
+
+static ssize_t UdpRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t UdpWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void UdpWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void UdpClose(OrionConn_t *pConn);
+static OrionUdp_t *GetUdp(const OrionConn_t *pConn);
+
+// Transport operations for UDP connections
+static const OrionConnOps_t UdpOps = { UdpRead, UdpWrite, UdpWait, UdpClose };
+
+/*!
+ * Open a UDP connection that receives packets from any gimbal sending to a local port
+ * \param Port is the local port to listen on, or 0 for UDP_TELEMETRY_PORT
+ * \param pRemoteAddress is the IP address of the gimbal to send to, on the same port, or NULL to
+ *        send to whichever gimbal the latest datagram came from
+ * \return the new connection, or NULL if the address is bad or the port can't be opened
+ */
+OrionConn_t *OrionConnOpenUdp(UInt16 Port, const char *pRemoteAddress)
+{
+    struct sockaddr_in Local;
+    OrionConn_t *pConn = NULL;
+    OrionUdp_t *pUdp;
+    int Handle, Size = 4 * 1024 * 1024, i;
+
+    // Port 0 means the usual telemetry port
+    if (Port == 0)
+        Port = UDP_TELEMETRY_PORT;
+
+    if ((pUdp = (OrionUdp_t *)calloc(1, sizeof(OrionUdp_t))) == NULL)
+        return NULL;
+
+    // If we were given a gimbal to send to, turn its address into something we can use
+    if (pRemoteAddress != NULL)
+    {
+        if ((OrionCommIpStringValid(pRemoteAddress) == FALSE) || (inet_pton(AF_INET, pRemoteAddress, &pUdp->Remote.sin_addr) != 1))
+        {
+            free(pUdp);
+            return NULL;
+        }
+
+        pUdp->Remote.sin_family = AF_INET;
+        pUdp->Remote.sin_port = htons(Port);
+        pUdp->FixedRemote = pUdp->HaveRemote = TRUE;
+    }
+
+    // Point each slot in the batch at its own buffer, source address and timestamp
+    for (i = 0; i < UDP_BATCH; i++)
+    {
+        pUdp->Iovs[i].iov_base = pUdp->Data[i];
+        pUdp->Iovs[i].iov_len = UDP_DATAGRAM_SIZE;
+        pUdp->Msgs[i].msg_hdr.msg_iov = &pUdp->Iovs[i];
+        pUdp->Msgs[i].msg_hdr.msg_iovlen = 1;
+        pUdp->Msgs[i].msg_hdr.msg_name = &pUdp->Sources[i];
+        pUdp->Msgs[i].msg_hdr.msg_control = &pUdp->Controls[i];
+    }
+
+    // Listen on the port for datagrams from anywhere
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family = AF_INET;
+    Local.sin_addr.s_addr = htonl(INADDR_ANY);
+    Local.sin_port = htons(Port);
+    Handle = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if ((Handle < 0) || (bind(Handle, (struct sockaddr *)&Local, sizeof(Local)) != 0) ||
+        ((pConn = OrionConnCreate(Handle, &UdpOps, pUdp)) == NULL))
+    {
+        if (Handle >= 0)
+            close(Handle);
+        free(pUdp);
+        return NULL;
+    }
+
+    // Ask for plenty of buffering, so a burst from many gimbals at once isn't dropped while we're
+    //  busy (the kernel caps this at its own limit), and have each datagram stamped as it arrives
+    setsockopt(Handle, SOL_SOCKET, SO_RCVBUF, &Size, sizeof(Size));
+    pConn->RxKernelTime = OrionCommEnableRxTimestamps(Handle);
+    return pConn;
+
+}// OrionConnOpenUdp
+
+/*!
+ * Replace the default connection with a UDP one
+ * \param Port is the local port to listen on, or 0 for UDP_TELEMETRY_PORT
+ * \param pRemoteAddress is the IP address of the gimbal to send to, or NULL to send to whichever
+ *        gimbal the latest datagram came from
+ * \return TRUE if the connection was opened
+ */
+BOOL OrionCommOpenUdp(UInt16 Port, const char *pRemoteAddress)
+{
+    OrionCommClose();
+    return OrionCommSetDefaultConn(OrionConnOpenUdp(Port, pRemoteAddress));
+
+}// OrionCommOpenUdp
+
+/*!
+ * Find out which gimbal the packet most recently received on a UDP connection came from. This
+ * only applies when the connection is read directly, not through a receive queue.
+ * \param pConn is a UDP connection
+ * \param pAddress receives the sender's IPv4 address in host byte order, may be NULL
+ * \param pPort receives the sender's UDP port, may be NULL
+ * \return TRUE if successful, or FALSE if pConn isn't a UDP connection or nothing has arrived yet
+ */
+BOOL OrionUdpGetSource(const OrionConn_t *pConn, UInt32 *pAddress, UInt16 *pPort)
+{
+    OrionUdp_t *pUdp = GetUdp(pConn);
+
+    if ((pUdp == NULL) || (pUdp->HaveSource == FALSE))
+        return FALSE;
+
+    if (pAddress != NULL)
+        *pAddress = ntohl(pUdp->Source.sin_addr.s_addr);
+    if (pPort != NULL)
+        *pPort = ntohs(pUdp->Source.sin_port);
+
+    return TRUE;
+
+}// OrionUdpGetSource
+
+/*!
+ * Get a UDP connection's receive counters
+ * \param pConn is a UDP connection
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ * \return TRUE if pConn is a UDP connection
+ */
+BOOL OrionUdpGetStats(OrionConn_t *pConn, OrionUdpStats_t *pStats, BOOL Reset)
+{
+    OrionUdp_t *pUdp = GetUdp(pConn);
+
+    if (pUdp == NULL)
+        return FALSE;
+
+    *pStats = pUdp->Stats;
+    if (Reset)
+        memset(&pUdp->Stats, 0, sizeof(pUdp->Stats));
+
+    return TRUE;
+
+}// OrionUdpGetStats
+
+// Transport read: hands over one datagram at a time from the latest batch, fetching a new batch
+//  once that one's used up
+static ssize_t UdpRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    OrionUdp_t *pUdp = (OrionUdp_t *)pConn->pTransport;
+
+    // Packets never span datagrams, so anything left half parsed from the last one is junk. The
+    //  receive buffer is always empty when we get here, so the parser is all there is to reset.
+    if (pConn->RxPkt.Info.State != 0)
+    {
+        pConn->RxParseStats.Discarded += pConn->RxPkt.Info.State;
+        memset(&pConn->RxPkt.Info, 0, sizeof(pConn->RxPkt.Info));
+    }
+
+    while (1)
+    {
+        struct mmsghdr *pMsg;
+
+        // Once the batch is used up, pull in as many datagrams as are waiting, up to a batch
+        if (pUdp->Next >= pUdp->Count)
+        {
+            int i, Count;
+
+            // The kernel overwrites each address and timestamp length with the size of what it stored
+            for (i = 0; i < UDP_BATCH; i++)
+            {
+                pUdp->Msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                pUdp->Msgs[i].msg_hdr.msg_controllen = sizeof(UdpControl_t);
+            }
+
+            pUdp->Next = pUdp->Count = 0;
+            if ((Count = recvmmsg(pConn->Handle, pUdp->Msgs, UDP_BATCH, MSG_DONTWAIT, NULL)) <= 0)
+            {
+                // A datagram socket never reaches the end of the stream, and an ICMP error left
+                //  over from an earlier send mustn't make the connection look closed either
+                if ((Count == 0) || (errno == ECONNREFUSED))
+                    errno = EAGAIN;
+
+                return -1;
+            }
+
+            pUdp->Count = Count;
+            pUdp->Stats.RecvCalls++;
+            if (pConn->RxKernelTime)
+                pUdp->ClockOffsetUs = OrionCommGetClockOffsetUs();
+        }
+
+        pMsg = &pUdp->Msgs[pUdp->Next];
+        pUdp->Stats.Datagrams++;
+
+        // Part of a datagram is no good to us, and an empty one would look like the end of the stream
+        if (pMsg->msg_hdr.msg_flags & MSG_TRUNC)
+            pUdp->Stats.Truncated++;
+        else if ((pMsg->msg_len > 0) && (pMsg->msg_len <= Size))
+        {
+            // Note who sent it, so the packets in it can be traced back to their gimbal and any
+            //  reply goes back the same way
+            pUdp->Source = pUdp->Sources[pUdp->Next];
+            pUdp->HaveSource = TRUE;
+            if (pUdp->FixedRemote == FALSE)
+            {
+                pUdp->Remote = pUdp->Source;
+                pUdp->HaveRemote = TRUE;
+            }
+
+            // Each datagram has its own arrival time
+            if (pConn->RxKernelTime)
+                pConn->RxReadUs = OrionCommGetMsgTimeUs(&pMsg->msg_hdr, pUdp->ClockOffsetUs);
+
+            memcpy(pBuffer, pUdp->Data[pUdp->Next++], pMsg->msg_len);
+            pUdp->Stats.Bytes += pMsg->msg_len;
+            return (ssize_t)pMsg->msg_len;
+        }
+
+        pUdp->Next++;
+    }
+
+}// UdpRead
+
+// Transport write: each write goes out as one datagram, to the fixed gimbal or the latest sender
+static ssize_t UdpWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    OrionUdp_t *pUdp = (OrionUdp_t *)pConn->pTransport;
+
+    // Nowhere to send it until someone's sent us something
+    if (pUdp->HaveRemote == FALSE)
+    {
+        errno = EDESTADDRREQ;
+        return -1;
+    }
+
+    return sendto(pConn->Handle, pData, Size, 0, (const struct sockaddr *)&pUdp->Remote, sizeof(pUdp->Remote));
+
+}// UdpWrite
+
+// Transport wait: sleep until a datagram arrives, unless there are some left in the batch
+static void UdpWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    OrionUdp_t *pUdp = (OrionUdp_t *)pConn->pTransport;
+    struct pollfd Poll = { pConn->Handle, POLLIN, 0 };
+    struct timespec Timeout = { (time_t)(TimeoutUs / 1000000), (long)(TimeoutUs % 1000000) * 1000 };
+
+    if (pUdp->Next >= pUdp->Count)
+        ppoll(&Poll, 1, &Timeout, NULL);
+
+}// UdpWait
+
+// Transport close: release the socket and the batch
+static void UdpClose(OrionConn_t *pConn)
+{
+    close(pConn->Handle);
+    free(pConn->pTransport);
+
+}// UdpClose
+
+// Get a connection's UDP state, or NULL if it isn't a UDP connection
+static OrionUdp_t *GetUdp(const OrionConn_t *pConn)
+{
+    return ((pConn != NULL) && (pConn->pOps == &UdpOps)) ? (OrionUdp_t *)pConn->pTransport : NULL;
+
+}// GetUdp
+
+#endif // __linux__
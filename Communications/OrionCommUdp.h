@@ -0,0 +1,40 @@
+#ifndef ORIONCOMMUDP_H
+#define ORIONCOMMUDP_H
+
+#include "OrionComm.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A UDP connection listens on a port for datagrams from any number of gimbals, pulling in many
+//  datagrams per system call, and hands the packets in them to the ordinary OrionConn receive
+//  functions, dispatchers and event loops. Each datagram is framed on its own, so a damaged one
+//  can't corrupt the next, and OrionUdpGetSource tells which gimbal the latest packet came from.
+//  Lost datagrams are simply gone rather than holding up everything behind them, which suits
+//  telemetry over lossy radio links better than TCP does.
+
+// UDP receive counters
+typedef struct
+{
+    UInt32 RecvCalls;   // Number of system calls that returned datagrams
+    UInt32 Datagrams;   // Number of datagrams received
+    UInt32 Bytes;       // Number of bytes in those datagrams
+    UInt32 Truncated;   // Datagrams dropped because they were too big to receive whole
+} OrionUdpStats_t;
+
+OrionConn_t *OrionConnOpenUdp(UInt16 Port, const char *pRemoteAddress);
+BOOL OrionCommOpenUdp(UInt16 Port, const char *pRemoteAddress);
+BOOL OrionUdpGetSource(const OrionConn_t *pConn, UInt32 *pAddress, UInt16 *pPort);
+BOOL OrionUdpGetStats(OrionConn_t *pConn, OrionUdpStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__
+
+#endif // ORIONCOMMUDP_H
@@ -0,0 +1,1181 @@
+#include "OrionCommUring.h"
+#include "OrionCommPrivate.h"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Size of each receive buffer the kernel fills, and of each connection's send buffer
+#define URING_RECV_SIZE     2048
+#define URING_SEND_SIZE     4096
+
+// Buffer group the receive buffers are registered as
+#define URING_BUFFER_GROUP  0
+
+// Fewest and most receive buffers and submission queue entries a ring will have
+#define URING_MIN_ENTRIES   64
+#define URING_MAX_BUFFERS   32768
+#define URING_MAX_ENTRIES   4096
+
+// What a completion is for, kept in the low bits of its user data with the connection's slot above them
+#define URING_OP_RECV       0
+#define URING_OP_SEND       1
+#define URING_OP_CANCEL     2
+#define URING_OP_WAKE       3
+#define URING_OP_BITS       2
+#define URING_OP_MASK       ((1 << URING_OP_BITS) - 1)
+
+// Longest OrionUringDestroy waits for the kernel to let go of the ring's buffers
+#define URING_DRAIN_MS      1000
+
+// One connection slot in the ring
+typedef struct
+{
+    // Connection being serviced, or NULL once it has left the ring
+    OrionConn_t *pConn;
+
+    // The ring, and the connection's own transport, which is put back when it leaves the ring
+    struct OrionUring_s *pRing;
+    const OrionConnOps_t *pOps;
+    void *pTransport;
+
+    // Slot number, which is also the socket's index in the ring's file table
+    UInt32 Slot;
+
+    // Set while the slot is taken, and once its connection has left the ring but the kernel may
+    //  still be working on it
+    BOOL InUse;
+    BOOL Removed;
+
+    // Set when it's on the ring's list of slots with something to post
+    BOOL Listed;
+
+    // The multishot receive: posted, waiting to be posted, being cancelled, and whether it ended
+    //  for good with end of stream (RecvError 0) or an error
+    BOOL RecvPosted;
+    BOOL RecvWanted;
+    BOOL Cancelling;
+    BOOL RecvEnded;
+    int RecvError;
+
+    // Received buffer waiting to be framed, with its size and arrival time, and the buffer being
+    //  framed now (-1 for none)
+    int PendingBuffer;
+    UInt32 PendingSize;
+    UInt64 PendingUs;
+    int LentBuffer;
+
+    // Send buffer: bytes queued, how many of them the kernel has, and whether the link failed
+    UInt8 *pSend;
+    UInt32 SendUsed, SendPosted;
+    BOOL SendFailed;
+} UringEntry_t;
+
+// A handler and the context pointer to pass it
+typedef struct
+{
+    OrionPktHandler_t pHandler;
+    void *pContext;
+} UringHandler_t;
+
+struct OrionUring_s
+{
+    // Ring file descriptor, and the memory the kernel shares the queues through
+    int Handle;
+    UInt8 *pRingMap;
+    size_t RingMapSize;
+
+    // Submission queue, and how many entries in it the kernel hasn't seen yet
+    UInt32 *pSqHead, *pSqTail;
+    UInt32 SqMask, SqEntries;
+    struct io_uring_sqe *pSqes;
+    size_t SqesSize;
+    UInt32 Unsubmitted;
+
+    // Completion queue
+    UInt32 *pCqHead, *pCqTail;
+    UInt32 CqMask;
+    struct io_uring_cqe *pCqes;
+
+    // Receive buffers, and the ring that hands them to the kernel
+    struct io_uring_buf_ring *pBufRing;
+    UInt8 *pBuffers;
+    UInt32 BufCount;
+    UInt16 BufTail;
+
+    // Send buffers, one per slot, and whether the kernel has them registered
+    UInt8 *pSendBuffers;
+    BOOL SendFixed;
+
+    // Connection slots, the ones with something to post, and how many removed ones are draining
+    UringEntry_t *pEntries;
+    UInt32 MaxConns;
+    UInt32 *pWork;
+    UInt32 WorkCount;
+    UInt32 Draining;
+
+    // Number of operations the kernel still owes a final completion for
+    UInt32 Outstanding;
+
+    // eventfd used to wake the ring up from other threads, and whether its poll is posted
+    int WakeHandle;
+    BOOL WakePosted;
+
+    // Per packet ID handlers, the handler for everything else, and the hangup handler
+    UringHandler_t Handlers[256];
+    UringHandler_t DefaultHandler;
+    OrionConnHandler_t pClose;
+    void *pCloseContext;
+
+    // Set while the ring is being destroyed, so nothing new is posted
+    BOOL Closing;
+
+    // Set by OrionUringStop to break out of OrionUringRun
+    volatile BOOL Stop;
+
+    OrionUringStats_t Stats;
+};
+
+static ssize_t UringRead(OrionConn_t *pConn, void *pBuffer, size_t Size);
+static ssize_t UringReadInPlace(OrionConn_t *pConn, const UInt8 **ppData);
+static ssize_t UringWrite(OrionConn_t *pConn, const void *pData, size_t Size);
+static void UringWait(OrionConn_t *pConn, UInt32 TimeoutUs);
+static void UringClose(OrionConn_t *pConn);
+static BOOL MapRing(OrionUring_t *pRing, const struct io_uring_params *pParams);
+static BOOL SetupBuffers(OrionUring_t *pRing);
+static int UringEnter(OrionUring_t *pRing, UInt32 MinComplete, int TimeoutMs);
+static BOOL SetFile(OrionUring_t *pRing, UInt32 Slot, int Handle);
+static struct io_uring_sqe *GetSqe(OrionUring_t *pRing);
+static void PushSqe(OrionUring_t *pRing);
+static void AddBuffer(OrionUring_t *pRing, int Buffer);
+static void QueueWork(OrionUring_t *pRing, UringEntry_t *pEntry);
+static void PostWork(OrionUring_t *pRing);
+static void PostRecv(OrionUring_t *pRing, UringEntry_t *pEntry);
+static void PostSend(OrionUring_t *pRing, UringEntry_t *pEntry);
+static void PostCancel(OrionUring_t *pRing, UInt32 Slot, UInt64 UserData, UInt32 Flags);
+static void PostWake(OrionUring_t *pRing);
+static int Reap(OrionUring_t *pRing);
+static int HandleCompletion(OrionUring_t *pRing, const struct io_uring_cqe *pCqe, UInt64 NowUs);
+static int ServiceConn(OrionUring_t *pRing, UringEntry_t *pEntry);
+static void DetachEntry(OrionUring_t *pRing, UringEntry_t *pEntry);
+static void FreeDrained(OrionUring_t *pRing);
+static int FlushBatches(OrionUring_t *pRing, int TimeoutMs);
+static UInt32 RoundUpPow2(UInt32 Value, UInt32 Min, UInt32 Max);
+
+// Transport operations for connections in a ring
+static const OrionConnOps_t UringOps = { UringRead, UringWrite, UringWait, UringClose, UringReadInPlace };
+
+/*!
+ * Create a new, empty io_uring ring
+ * \param MaxConns is the most connections the ring will service at once
+ * \return a pointer to the ring, or NULL if io_uring isn't available or is too old
+ */
+OrionUring_t *OrionUringCreate(UInt32 MaxConns)
+{
+    struct io_uring_params Params;
+    struct iovec Region;
+    OrionUring_t *pRing;
+    UInt32 Entries, i;
+    int *pFiles, Result;
+
+    // The slot number has to fit in the user data next to the operation
+    if ((MaxConns == 0) || (MaxConns > (0xFFFFFFFFu >> URING_OP_BITS)))
+        return NULL;
+
+    if ((pRing = (OrionUring_t *)calloc(1, sizeof(OrionUring_t))) == NULL)
+        return NULL;
+
+    pRing->Handle = pRing->WakeHandle = -1;
+    pRing->MaxConns = MaxConns;
+
+    // Slots, the work list, and a send buffer for each slot, page aligned so the kernel can pin it
+    pRing->pEntries = (UringEntry_t *)calloc(MaxConns, sizeof(UringEntry_t));
+    pRing->pWork = (UInt32 *)calloc(MaxConns, sizeof(UInt32));
+    pRing->pSendBuffers = (UInt8 *)mmap(NULL, (size_t)MaxConns * URING_SEND_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pRing->pSendBuffers == MAP_FAILED)
+        pRing->pSendBuffers = NULL;
+
+    if ((pRing->pEntries == NULL) || (pRing->pWork == NULL) || (pRing->pSendBuffers == NULL))
+    {
+        OrionUringDestroy(pRing);
+        return NULL;
+    }
+
+    // Room to post a receive and a send for every connection at once, within reason. Receives
+    //  keep completing without being posted again, so the completion queue is bigger.
+    Entries = RoundUpPow2(2 * MaxConns + 2, URING_MIN_ENTRIES, URING_MAX_ENTRIES);
+    memset(&Params, 0, sizeof(Params));
+    Params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+    Params.cq_entries = 4 * Entries;
+    pRing->Handle = (int)syscall(__NR_io_uring_setup, Entries, &Params);
+
+    // Kernels before 5.19 don't know the last two flags, which are only there to save work
+    if ((pRing->Handle < 0) && (errno == EINVAL))
+    {
+        Params.flags = IORING_SETUP_CQSIZE;
+        pRing->Handle = (int)syscall(__NR_io_uring_setup, Entries, &Params);
+    }
+
+    // Waiting with a timeout needs EXT_ARG, and the receive buffers need 5.19 or later
+    if ((pRing->Handle < 0) || ((Params.features & IORING_FEAT_EXT_ARG) == 0) || ((Params.features & IORING_FEAT_SINGLE_MMAP) == 0) ||
+        (MapRing(pRing, &Params) == FALSE) || (SetupBuffers(pRing) == FALSE))
+    {
+        OrionUringDestroy(pRing);
+        return NULL;
+    }
+
+    // Sockets go into a file table, so the kernel doesn't look them up on every operation and
+    //  keeps hold of them until it's done, even if they're closed first
+    if ((pFiles = (int *)malloc(MaxConns * sizeof(int))) == NULL)
+    {
+        OrionUringDestroy(pRing);
+        return NULL;
+    }
+
+    for (i = 0; i < MaxConns; i++)
+        pFiles[i] = -1;
+
+    Result = (int)syscall(__NR_io_uring_register, pRing->Handle, IORING_REGISTER_FILES, pFiles, MaxConns);
+    free(pFiles);
+
+    // A way to wake the ring up from other threads
+    pRing->WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((Result != 0) || (pRing->WakeHandle < 0))
+    {
+        OrionUringDestroy(pRing);
+        return NULL;
+    }
+
+    // Registering the send buffers saves pinning them for every send, but it counts against the
+    //  locked memory limit, so do without if that's too low
+    Region.iov_base = pRing->pSendBuffers;
+    Region.iov_len = (size_t)MaxConns * URING_SEND_SIZE;
+    pRing->SendFixed = (syscall(__NR_io_uring_register, pRing->Handle, IORING_REGISTER_BUFFERS, &Region, 1) == 0);
+
+    PostWake(pRing);
+    return pRing;
+
+}// OrionUringCreate
+
+/*!
+ * Destroy a ring. Connections still in it are handed back as they were, but left open.
+ * \param pRing is the ring to destroy
+ */
+void OrionUringDestroy(OrionUring_t *pRing)
+{
+    UInt32 i;
+
+    // Nothing to do for a NULL ring
+    if (pRing == NULL)
+        return;
+
+    if (pRing->pRingMap != NULL)
+    {
+        UInt64 Deadline = OrionCommGetTimeUs() + URING_DRAIN_MS * 1000ull;
+
+        // Stop posting anything new, and give back every connection still in the ring
+        pRing->Closing = TRUE;
+        for (i = 0; i < pRing->MaxConns; i++)
+        {
+            if (pRing->pEntries[i].InUse && !pRing->pEntries[i].Removed)
+                DetachEntry(pRing, &pRing->pEntries[i]);
+        }
+
+        // Cancel whatever the kernel is still working on, and wait until it's let go of our
+        //  buffers before they're freed
+        if (pRing->Outstanding > 0)
+            PostCancel(pRing, pRing->MaxConns, 0, IORING_ASYNC_CANCEL_ANY);
+
+        while ((pRing->Outstanding > 0) && (OrionCommGetTimeUs() < Deadline))
+        {
+            UringEnter(pRing, 1, 10);
+            Reap(pRing);
+        }
+    }
+
+    // Closing the ring releases the file table and registered buffers
+    if (pRing->Handle >= 0)
+        close(pRing->Handle);
+
+    if (pRing->WakeHandle >= 0)
+        close(pRing->WakeHandle);
+
+    // Then the memory shared with the kernel can go
+    if (pRing->pRingMap != NULL)
+        munmap(pRing->pRingMap, pRing->RingMapSize);
+
+    if (pRing->pSqes != NULL)
+        munmap(pRing->pSqes, pRing->SqesSize);
+
+    if (pRing->pBufRing != NULL)
+        munmap(pRing->pBufRing, pRing->BufCount * sizeof(struct io_uring_buf));
+
+    if (pRing->pBuffers != NULL)
+        munmap(pRing->pBuffers, (size_t)pRing->BufCount * URING_RECV_SIZE);
+
+    if (pRing->pSendBuffers != NULL)
+        munmap(pRing->pSendBuffers, (size_t)pRing->MaxConns * URING_SEND_SIZE);
+
+    free(pRing->pEntries);
+    free(pRing->pWork);
+    free(pRing);
+
+}// OrionUringDestroy
+
+/*!
+ * Start servicing a connection
+ * \param pRing is the ring
+ * \param pConn is a connection on a stream socket with no receive thread, which must stay open
+ *        until it is removed or closed
+ * \return TRUE if the connection was added, or FALSE if it can't go in a ring or the ring is full
+ */
+BOOL OrionUringAddConn(OrionUring_t *pRing, OrionConn_t *pConn)
+{
+    UringEntry_t *pEntry = NULL;
+    socklen_t Size = sizeof(int);
+    int Type = 0;
+    UInt32 Slot;
+
+    // Only stream sockets that nothing else is reading from can go in a ring
+    if ((pConn == NULL) || (pConn->pQueueOps != NULL) || (pConn->pOps == &UringOps) ||
+        (getsockopt(pConn->Handle, SOL_SOCKET, SO_TYPE, &Type, &Size) != 0) || (Type != SOCK_STREAM))
+        return FALSE;
+
+    // Find a free slot, and put the socket in the matching spot in the file table
+    for (Slot = 0; (Slot < pRing->MaxConns) && pRing->pEntries[Slot].InUse; Slot++);
+    if ((Slot == pRing->MaxConns) || (SetFile(pRing, Slot, pConn->Handle) == FALSE))
+        return FALSE;
+
+    // Set up the slot, keeping the connection's own transport to put back later
+    pEntry = &pRing->pEntries[Slot];
+    memset(pEntry, 0, sizeof(UringEntry_t));
+    pEntry->pConn = pConn;
+    pEntry->pRing = pRing;
+    pEntry->pOps = pConn->pOps;
+    pEntry->pTransport = pConn->pTransport;
+    pEntry->Slot = Slot;
+    pEntry->InUse = TRUE;
+    pEntry->PendingBuffer = pEntry->LentBuffer = -1;
+    pEntry->pSend = &pRing->pSendBuffers[(size_t)Slot * URING_SEND_SIZE];
+
+    // Reads and writes go through the ring from now on, starting with a receive that stays posted
+    pConn->pOps = &UringOps;
+    pConn->pTransport = pEntry;
+    pEntry->RecvWanted = TRUE;
+    QueueWork(pRing, pEntry);
+    return TRUE;
+
+}// OrionUringAddConn
+
+/*!
+ * Stop servicing a connection. The connection itself is not closed, and can be read directly
+ * again, though data the kernel had already received for the ring may be lost.
+ * \param pRing is the ring
+ * \param pConn is the connection to remove
+ */
+void OrionUringRemoveConn(OrionUring_t *pRing, OrionConn_t *pConn)
+{
+    // Only connections in this ring have anything to undo
+    if ((pConn != NULL) && (pConn->pOps == &UringOps) && (((UringEntry_t *)pConn->pTransport)->pRing == pRing))
+        DetachEntry(pRing, (UringEntry_t *)pConn->pTransport);
+
+}// OrionUringRemoveConn
+
+/*!
+ * Register a handler for all incoming packets with a given ID
+ * \param pRing is the ring
+ * \param ID is the packet ID
+ * \param pHandler is the handler, or NULL to stop handling this ID
+ * \param pContext is passed through to pHandler
+ */
+void OrionUringSetHandler(OrionUring_t *pRing, UInt8 ID, OrionPktHandler_t pHandler, void *pContext)
+{
+    pRing->Handlers[ID].pHandler = pHandler;
+    pRing->Handlers[ID].pContext = pContext;
+
+}// OrionUringSetHandler
+
+/*!
+ * Register a handler for incoming packets whose ID has no handler of its own
+ * \param pRing is the ring
+ * \param pHandler is the handler, or NULL to drop unhandled packets
+ * \param pContext is passed through to pHandler
+ */
+void OrionUringSetDefaultHandler(OrionUring_t *pRing, OrionPktHandler_t pHandler, void *pContext)
+{
+    pRing->DefaultHandler.pHandler = pHandler;
+    pRing->DefaultHandler.pContext = pContext;
+
+}// OrionUringSetDefaultHandler
+
+/*!
+ * Register a handler to be called when a connection hangs up
+ * \param pRing is the ring
+ * \param pHandler is the handler, which may close the connection
+ * \param pContext is passed through to pHandler
+ */
+void OrionUringSetCloseHandler(OrionUring_t *pRing, OrionConnHandler_t pHandler, void *pContext)
+{
+    pRing->pClose = pHandler;
+    pRing->pCloseContext = pContext;
+
+}// OrionUringSetCloseHandler
+
+/*!
+ * Submit everything queued up, wait for completions, and dispatch them
+ * \param pRing is the ring
+ * \param TimeoutMs is the longest time to wait in milliseconds, or -1 to wait forever
+ * \return the number of packets dispatched, or -1 on error
+ */
+int OrionUringRunOnce(OrionUring_t *pRing, int TimeoutMs)
+{
+    int Packets;
+
+    // Send any overdue outgoing batches, and wake up in time for the next one to come due
+    TimeoutMs = FlushBatches(pRing, TimeoutMs);
+
+    // Post the receives and sends queued up since last time, then hand them all to the kernel
+    //  and wait, in one system call. There's no waiting if completions are already in.
+    PostWork(pRing);
+    if ((UringEnter(pRing, (__atomic_load_n(pRing->pCqTail, __ATOMIC_ACQUIRE) == *pRing->pCqHead) && (TimeoutMs != 0), TimeoutMs) < 0) &&
+        (errno != ETIME) && (errno != EINTR) && (errno != EBUSY))
+        return -1;
+
+    // Frame and dispatch whatever came in
+    Packets = Reap(pRing);
+
+    // Send any batches that came due while we were waiting or dispatching
+    FlushBatches(pRing, TimeoutMs);
+
+    // Now that we're done with this batch it's safe to free removed slots
+    FreeDrained(pRing);
+
+    return Packets;
+
+}// OrionUringRunOnce
+
+/*!
+ * Run the ring until OrionUringStop is called
+ * \param pRing is the ring
+ */
+void OrionUringRun(OrionUring_t *pRing)
+{
+    // Keep dispatching until we're told to stop or something breaks
+    pRing->Stop = FALSE;
+    while (!pRing->Stop && (OrionUringRunOnce(pRing, -1) >= 0));
+
+}// OrionUringRun
+
+/*!
+ * Make OrionUringRun return. This may be called from a handler or any other thread.
+ * \param pRing is the ring
+ */
+void OrionUringStop(OrionUring_t *pRing)
+{
+    uint64_t Value = 1;
+
+    // Set the flag, then kick the ring in case it's waiting
+    pRing->Stop = TRUE;
+    write(pRing->WakeHandle, &Value, sizeof(Value));
+
+}// OrionUringStop
+
+/*!
+ * Get a ring's counters
+ * \param pRing is the ring
+ * \param pStats receives the counters
+ * \param Reset is TRUE to zero the counters afterward
+ */
+void OrionUringGetStats(OrionUring_t *pRing, OrionUringStats_t *pStats, BOOL Reset)
+{
+    *pStats = pRing->Stats;
+    if (Reset)
+        memset(&pRing->Stats, 0, sizeof(pRing->Stats));
+
+}// OrionUringGetStats
+
+// Transport read, for anyone who wants a copy: takes the next buffer framed in place and copies it
+static ssize_t UringRead(OrionConn_t *pConn, void *pBuffer, size_t Size)
+{
+    const UInt8 *pData;
+    ssize_t Count = UringReadInPlace(pConn, &pData);
+
+    // Buffers are never bigger than a read, but don't trust that blindly
+    if (Count > (ssize_t)Size)
+        Count = (ssize_t)Size;
+
+    if (Count > 0)
+        memcpy(pBuffer, pData, (size_t)Count);
+
+    return Count;
+
+}// UringRead
+
+// Transport read in place: gives the kernel back the buffer that was just framed, and hands over
+//  the one that's come in since, if any
+static ssize_t UringReadInPlace(OrionConn_t *pConn, const UInt8 **ppData)
+{
+    UringEntry_t *pEntry = (UringEntry_t *)pConn->pTransport;
+    OrionUring_t *pRing = pEntry->pRing;
+
+    // The parser's done with the last buffer, having kept any partial packet for itself
+    if (pEntry->LentBuffer >= 0)
+    {
+        AddBuffer(pRing, pEntry->LentBuffer);
+        pEntry->LentBuffer = -1;
+    }
+
+    // Frame the next buffer right where the kernel put it
+    if (pEntry->PendingBuffer >= 0)
+    {
+        *ppData = &pRing->pBuffers[(size_t)pEntry->PendingBuffer * URING_RECV_SIZE];
+        pConn->RxReadUs = pEntry->PendingUs;
+        pEntry->LentBuffer = pEntry->PendingBuffer;
+        pEntry->PendingBuffer = -1;
+        return (ssize_t)pEntry->PendingSize;
+    }
+
+    // Otherwise there's nothing until the next completion, unless the stream has ended
+    if (pEntry->RecvEnded && (pEntry->RecvError == 0))
+        return 0;
+
+    errno = pEntry->RecvEnded ? pEntry->RecvError : EAGAIN;
+    return -1;
+
+}// UringReadInPlace
+
+// Transport write: queues the data in the connection's send buffer, to go out with the next submission
+static ssize_t UringWrite(OrionConn_t *pConn, const void *pData, size_t Size)
+{
+    UringEntry_t *pEntry = (UringEntry_t *)pConn->pTransport;
+    UInt32 Free = URING_SEND_SIZE - pEntry->SendUsed;
+
+    // Once a send has failed the link is gone
+    if (pEntry->SendFailed)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    // Like a socket, take all of it if it fits and nothing if there's no room, but let batches
+    //  too big to ever fit go out a piece at a time
+    if ((Size > Free) && ((Size <= URING_SEND_SIZE) || (Free == 0)))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (Size > Free)
+        Size = Free;
+
+    memcpy(&pEntry->pSend[pEntry->SendUsed], pData, Size);
+    pEntry->SendUsed += (UInt32)Size;
+    QueueWork(pEntry->pRing, pEntry);
+    return (ssize_t)Size;
+
+}// UringWrite
+
+// Transport wait: the ring does the waiting for connections in it, so anyone else just sleeps
+static void UringWait(OrionConn_t *pConn, UInt32 TimeoutUs)
+{
+    struct timespec Sleep = { (time_t)(TimeoutUs / 1000000), (long)(TimeoutUs % 1000000) * 1000 };
+
+    nanosleep(&Sleep, NULL);
+
+}// UringWait
+
+// Transport close: takes the connection out of the ring, then closes it as it would have been
+static void UringClose(OrionConn_t *pConn)
+{
+    UringEntry_t *pEntry = (UringEntry_t *)pConn->pTransport;
+
+    DetachEntry(pEntry->pRing, pEntry);
+    pConn->pOps->pClose(pConn);
+
+}// UringClose
+
+// Map the submission and completion queues the kernel shares with us
+static BOOL MapRing(OrionUring_t *pRing, const struct io_uring_params *pParams)
+{
+    size_t SqSize = pParams->sq_off.array + pParams->sq_entries * sizeof(UInt32);
+    size_t CqSize = pParams->cq_off.cqes + pParams->cq_entries * sizeof(struct io_uring_cqe);
+    UInt32 *pArray, i;
+    void *pMap;
+
+    // Both queues live in one mapping on any kernel new enough to matter
+    pRing->RingMapSize = (SqSize > CqSize) ? SqSize : CqSize;
+    pMap = mmap(NULL, pRing->RingMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->Handle, IORING_OFF_SQ_RING);
+    if (pMap == MAP_FAILED)
+        return FALSE;
+
+    pRing->pRingMap = (UInt8 *)pMap;
+
+    // The submission queue entries are mapped on their own
+    pRing->SqesSize = pParams->sq_entries * sizeof(struct io_uring_sqe);
+    pMap = mmap(NULL, pRing->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->Handle, IORING_OFF_SQES);
+    if (pMap == MAP_FAILED)
+        return FALSE;
+
+    pRing->pSqes = (struct io_uring_sqe *)pMap;
+
+    // Find the indices and entries within the mapping
+    pRing->pSqHead = (UInt32 *)(pRing->pRingMap + pParams->sq_off.head);
+    pRing->pSqTail = (UInt32 *)(pRing->pRingMap + pParams->sq_off.tail);
+    pRing->SqMask = *(UInt32 *)(pRing->pRingMap + pParams->sq_off.ring_mask);
+    pRing->SqEntries = pParams->sq_entries;
+    pRing->pCqHead = (UInt32 *)(pRing->pRingMap + pParams->cq_off.head);
+    pRing->pCqTail = (UInt32 *)(pRing->pRingMap + pParams->cq_off.tail);
+    pRing->CqMask = *(UInt32 *)(pRing->pRingMap + pParams->cq_off.ring_mask);
+    pRing->pCqes = (struct io_uring_cqe *)(pRing->pRingMap + pParams->cq_off.cqes);
+
+    // Submission queue entries are always used in order, so the index array never changes
+    pArray = (UInt32 *)(pRing->pRingMap + pParams->sq_off.array);
+    for (i = 0; i < pRing->SqEntries; i++)
+        pArray[i] = i;
+
+    return TRUE;
+
+}// MapRing
+
+// Allocate the receive buffers and register them with the kernel as one group it picks from
+static BOOL SetupBuffers(OrionUring_t *pRing)
+{
+    struct io_uring_buf_reg Reg;
+    void *pMap;
+    UInt32 i;
+
+    // Two buffers per connection is plenty, since each is handed back as soon as it's framed
+    pRing->BufCount = RoundUpPow2(2 * pRing->MaxConns, URING_MIN_ENTRIES, URING_MAX_BUFFERS);
+
+    // The ring of buffer descriptors has to be page aligned, which mmap takes care of
+    pMap = mmap(NULL, pRing->BufCount * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMap == MAP_FAILED)
+        return FALSE;
+
+    pRing->pBufRing = (struct io_uring_buf_ring *)pMap;
+    pMap = mmap(NULL, (size_t)pRing->BufCount * URING_RECV_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMap == MAP_FAILED)
+        return FALSE;
+
+    pRing->pBuffers = (UInt8 *)pMap;
+
+    // Tell the kernel where the descriptors are
+    memset(&Reg, 0, sizeof(Reg));
+    Reg.ring_addr = (UInt64)(uintptr_t)pRing->pBufRing;
+    Reg.ring_entries = pRing->BufCount;
+    Reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, pRing->Handle, IORING_REGISTER_PBUF_RING, &Reg, 1) != 0)
+        return FALSE;
+
+    // Then give it every buffer
+    for (i = 0; i < pRing->BufCount; i++)
+        AddBuffer(pRing, (int)i);
+
+    return TRUE;
+
+}// SetupBuffers
+
+// Submit everything queued, and wait for at least MinComplete completions or the timeout (in
+//  milliseconds, -1 for none). Returns the kernel's result.
+static int UringEnter(OrionUring_t *pRing, UInt32 MinComplete, int TimeoutMs)
+{
+    struct io_uring_getevents_arg Arg;
+    struct __kernel_timespec Timeout;
+    int Result;
+
+    // The timeout only applies to waiting
+    memset(&Arg, 0, sizeof(Arg));
+    Arg.sigmask_sz = _NSIG / 8;
+    if ((MinComplete > 0) && (TimeoutMs >= 0))
+    {
+        Timeout.tv_sec = TimeoutMs / 1000;
+        Timeout.tv_nsec = (long long)(TimeoutMs % 1000) * 1000000;
+        Arg.ts = (UInt64)(uintptr_t)&Timeout;
+    }
+
+    // Always ask for events, which also runs any completion work the kernel has put off until now
+    Result = (int)syscall(__NR_io_uring_enter, pRing->Handle, pRing->Unsubmitted, MinComplete,
+                          IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &Arg, sizeof(Arg));
+    pRing->Stats.Enters++;
+
+    // Whatever the kernel has taken off the submission queue is no longer ours to submit
+    pRing->Unsubmitted = *pRing->pSqTail - __atomic_load_n(pRing->pSqHead, __ATOMIC_ACQUIRE);
+    return Result;
+
+}// UringEnter
+
+// Put a socket in the ring's file table, or take it out with a handle of -1
+static BOOL SetFile(OrionUring_t *pRing, UInt32 Slot, int Handle)
+{
+    struct io_uring_rsrc_update Update;
+
+    memset(&Update, 0, sizeof(Update));
+    Update.offset = Slot;
+    Update.data = (UInt64)(uintptr_t)&Handle;
+    return syscall(__NR_io_uring_register, pRing->Handle, IORING_REGISTER_FILES_UPDATE, &Update, 1) == 1;
+
+}// SetFile
+
+// Get a blank submission queue entry, submitting what's queued if there's no room
+static struct io_uring_sqe *GetSqe(OrionUring_t *pRing)
+{
+    UInt32 Tail = *pRing->pSqTail;
+    struct io_uring_sqe *pSqe;
+
+    // If the queue's full, hand it to the kernel to make room
+    if (Tail - __atomic_load_n(pRing->pSqHead, __ATOMIC_ACQUIRE) >= pRing->SqEntries)
+    {
+        UringEnter(pRing, 0, 0);
+        if (Tail - __atomic_load_n(pRing->pSqHead, __ATOMIC_ACQUIRE) >= pRing->SqEntries)
+            return NULL;
+    }
+
+    pSqe = &pRing->pSqes[Tail & pRing->SqMask];
+    memset(pSqe, 0, sizeof(struct io_uring_sqe));
+    return pSqe;
+
+}// GetSqe
+
+// Publish the entry from GetSqe, to go with the next submission
+static void PushSqe(OrionUring_t *pRing)
+{
+    __atomic_store_n(pRing->pSqTail, *pRing->pSqTail + 1, __ATOMIC_RELEASE);
+    pRing->Unsubmitted++;
+
+}// PushSqe
+
+// Give a receive buffer to the kernel to fill
+static void AddBuffer(OrionUring_t *pRing, int Buffer)
+{
+    struct io_uring_buf *pBuf = &pRing->pBufRing->bufs[pRing->BufTail & (pRing->BufCount - 1)];
+
+    // Fill in the descriptor, then publish it. The tail shares space with the first descriptor,
+    //  so only touch the fields that are ours.
+    pBuf->addr = (UInt64)(uintptr_t)&pRing->pBuffers[(size_t)Buffer * URING_RECV_SIZE];
+    pBuf->len = URING_RECV_SIZE;
+    pBuf->bid = (UInt16)Buffer;
+    __atomic_store_n(&pRing->pBufRing->tail, ++pRing->BufTail, __ATOMIC_RELEASE);
+
+}// AddBuffer
+
+// Put a slot on the list of slots with something to post, if it isn't there already
+static void QueueWork(OrionUring_t *pRing, UringEntry_t *pEntry)
+{
+    if (!pEntry->Listed)
+    {
+        pEntry->Listed = TRUE;
+        pRing->pWork[pRing->WorkCount++] = pEntry->Slot;
+    }
+
+}// QueueWork
+
+// Post a receive or send for every slot that needs one
+static void PostWork(OrionUring_t *pRing)
+{
+    UInt32 Count = pRing->WorkCount, i;
+
+    // Nothing new gets posted while the ring is going away
+    if (pRing->Closing)
+        return;
+
+    pRing->WorkCount = 0;
+    for (i = 0; i < Count; i++)
+    {
+        UringEntry_t *pEntry = &pRing->pEntries[pRing->pWork[i]];
+
+        pEntry->Listed = FALSE;
+
+        // Receives stay posted as long as the connection's in the ring
+        if (pEntry->RecvWanted && !pEntry->RecvPosted && !pEntry->Removed)
+            PostRecv(pRing, pEntry);
+
+        // One send at a time per connection, so the stream stays in order; the rest waits for it
+        if ((pEntry->SendUsed > 0) && (pEntry->SendPosted == 0) && !pEntry->SendFailed)
+            PostSend(pRing, pEntry);
+    }
+
+}// PostWork
+
+// Post a multishot receive, which keeps filling buffers from the group until it's cancelled
+static void PostRecv(OrionUring_t *pRing, UringEntry_t *pEntry)
+{
+    struct io_uring_sqe *pSqe = GetSqe(pRing);
+
+    // If the kernel won't take it now, try again next time
+    if (pSqe == NULL)
+    {
+        QueueWork(pRing, pEntry);
+        return;
+    }
+
+    pSqe->opcode = IORING_OP_RECV;
+    pSqe->fd = (int)pEntry->Slot;
+    pSqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    pSqe->ioprio = IORING_RECV_MULTISHOT;
+    pSqe->buf_group = URING_BUFFER_GROUP;
+    pSqe->user_data = ((UInt64)pEntry->Slot << URING_OP_BITS) | URING_OP_RECV;
+    PushSqe(pRing);
+
+    pEntry->RecvPosted = TRUE;
+    pEntry->RecvWanted = FALSE;
+    pRing->Outstanding++;
+
+}// PostRecv
+
+// Post a send of everything queued on a connection, as a write from its registered buffer if we can
+static void PostSend(OrionUring_t *pRing, UringEntry_t *pEntry)
+{
+    struct io_uring_sqe *pSqe = GetSqe(pRing);
+
+    // If the kernel won't take it now, try again next time
+    if (pSqe == NULL)
+    {
+        QueueWork(pRing, pEntry);
+        return;
+    }
+
+    // Sends can't use registered buffers until Linux 6.10, but writes always could
+    pSqe->opcode = pRing->SendFixed ? IORING_OP_WRITE_FIXED : IORING_OP_SEND;
+    pSqe->fd = (int)pEntry->Slot;
+    pSqe->flags = IOSQE_FIXED_FILE;
+    pSqe->addr = (UInt64)(uintptr_t)pEntry->pSend;
+    pSqe->len = pEntry->SendUsed;
+    pSqe->user_data = ((UInt64)pEntry->Slot << URING_OP_BITS) | URING_OP_SEND;
+    if (!pRing->SendFixed)
+        pSqe->msg_flags = MSG_NOSIGNAL;
+
+    PushSqe(pRing);
+
+    pEntry->SendPosted = pEntry->SendUsed;
+    pRing->Stats.Sends++;
+    pRing->Outstanding++;
+
+}// PostSend
+
+// Post a cancellation of whatever matches UserData, or everything for IORING_ASYNC_CANCEL_ANY
+static void PostCancel(OrionUring_t *pRing, UInt32 Slot, UInt64 UserData, UInt32 Flags)
+{
+    struct io_uring_sqe *pSqe = GetSqe(pRing);
+
+    if (pSqe == NULL)
+        return;
+
+    pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+    pSqe->addr = UserData;
+    pSqe->cancel_flags = Flags;
+    pSqe->user_data = ((UInt64)Slot << URING_OP_BITS) | URING_OP_CANCEL;
+    PushSqe(pRing);
+
+    pRing->Outstanding++;
+
+}// PostCancel
+
+// Post a multishot poll on the wakeup event
+static void PostWake(OrionUring_t *pRing)
+{
+    struct io_uring_sqe *pSqe;
+
+    if (pRing->Closing || pRing->WakePosted || ((pSqe = GetSqe(pRing)) == NULL))
+        return;
+
+    pSqe->opcode = IORING_OP_POLL_ADD;
+    pSqe->fd = pRing->WakeHandle;
+    pSqe->len = IORING_POLL_ADD_MULTI;
+    pSqe->poll32_events = POLLIN;
+    pSqe->user_data = URING_OP_WAKE;
+    PushSqe(pRing);
+
+    pRing->WakePosted = TRUE;
+    pRing->Outstanding++;
+
+}// PostWake
+
+// Handle every completion waiting in the queue, returning the number of packets dispatched
+static int Reap(OrionUring_t *pRing)
+{
+    UInt32 Head = *pRing->pCqHead;
+    UInt64 NowUs = 0;
+    int Packets = 0;
+
+    while (Head != __atomic_load_n(pRing->pCqTail, __ATOMIC_ACQUIRE))
+    {
+        // Take a copy and free up the slot before handling it, since handlers can post more work
+        struct io_uring_cqe Cqe = pRing->pCqes[Head & pRing->CqMask];
+
+        __atomic_store_n(pRing->pCqHead, ++Head, __ATOMIC_RELEASE);
+
+        // Everything in this batch arrived by now, so one look at the clock does for all of it
+        if (NowUs == 0)
+            NowUs = OrionCommGetTimeUs();
+
+        Packets += HandleCompletion(pRing, &Cqe, NowUs);
+    }
+
+    return Packets;
+
+}// Reap
+
+// Handle one completion, returning the number of packets it let us dispatch
+static int HandleCompletion(OrionUring_t *pRing, const struct io_uring_cqe *pCqe, UInt64 NowUs)
+{
+    UInt32 Op = (UInt32)(pCqe->user_data & URING_OP_MASK), Slot = (UInt32)(pCqe->user_data >> URING_OP_BITS);
+    BOOL More = (pCqe->flags & IORING_CQE_F_MORE) != 0;
+    UringEntry_t *pEntry;
+    int Packets = 0;
+
+    // Once an operation stops saying there's more to come, the kernel's done with it
+    pRing->Stats.Completions++;
+    if (!More)
+        pRing->Outstanding--;
+
+    // The wakeup event just needs to be cleared, and its poll posted again if it stopped
+    if (Op == URING_OP_WAKE)
+    {
+        uint64_t Value;
+
+        read(pRing->WakeHandle, &Value, sizeof(Value));
+        if (!More)
+        {
+            pRing->WakePosted = FALSE;
+            PostWake(pRing);
+        }
+
+        return 0;
+    }
+
+    // Cancelling everything at the end doesn't belong to any slot
+    if (Slot >= pRing->MaxConns)
+        return 0;
+
+    pEntry = &pRing->pEntries[Slot];
+    if (Op == URING_OP_RECV)
+    {
+        if (!More)
+            pEntry->RecvPosted = FALSE;
+
+        if (pCqe->flags & IORING_CQE_F_BUFFER)
+        {
+            int Buffer = (int)(pCqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+            // Data for a connection that's left the ring has nowhere to go
+            if (pEntry->Removed || pRing->Closing)
+                AddBuffer(pRing, Buffer);
+            else
+            {
+                // Frame and dispatch it right away, so the buffer goes straight back to the kernel
+                pEntry->PendingBuffer = Buffer;
+                pEntry->PendingSize = (UInt32)pCqe->res;
+                pEntry->PendingUs = NowUs;
+                pRing->Stats.RecvBuffers++;
+                Packets = ServiceConn(pRing, pEntry);
+            }
+        }
+        // Every buffer was in use, so the receive stopped; it's posted again below
+        else if (pCqe->res == -ENOBUFS)
+            pRing->Stats.NoBuffers++;
+        // End of stream or a real error ends the connection, unless we stopped it ourselves
+        else if ((pCqe->res != -ECANCELED) && !pEntry->Removed && !pRing->Closing)
+        {
+            pEntry->RecvEnded = TRUE;
+            pEntry->RecvError = -pCqe->res;
+            Packets = ServiceConn(pRing, pEntry);
+        }
+
+        // A receive that stopped for any other reason goes straight back up
+        if (!More && !pEntry->RecvPosted && !pEntry->RecvEnded && !pEntry->Removed && pEntry->InUse)
+        {
+            pEntry->RecvWanted = TRUE;
+            QueueWork(pRing, pEntry);
+        }
+    }
+    else if (Op == URING_OP_SEND)
+    {
+        // A kernel that won't write to this socket from registered buffers, or that gives up on a
+        //  full one rather than waiting for room, gets the same data again as an ordinary send
+        if (((pCqe->res == -EINVAL) || (pCqe->res == -EAGAIN)) && pRing->SendFixed)
+            pRing->SendFixed = FALSE;
+        // Any other error means the link is gone, along with whatever was queued for it
+        else if (pCqe->res < 0)
+        {
+            pEntry->SendFailed = TRUE;
+            pEntry->SendUsed = 0;
+        }
+        // Otherwise drop what went out, which may not be all of it, and keep going with the rest
+        else
+        {
+            pEntry->SendUsed -= (UInt32)pCqe->res;
+            memmove(pEntry->pSend, &pEntry->pSend[pCqe->res], pEntry->SendUsed);
+        }
+
+        pEntry->SendPosted = 0;
+        if ((pEntry->SendUsed > 0) && !pEntry->SendFailed)
+            QueueWork(pRing, pEntry);
+    }
+    else if (Op == URING_OP_CANCEL)
+        pEntry->Cancelling = FALSE;
+
+    return Packets;
+
+}// HandleCompletion
+
+// Frame all the packets in a connection's received data and hand each to its handler
+static int ServiceConn(OrionUring_t *pRing, UringEntry_t *pEntry)
+{
+    OrionConn_t *pConn = pEntry->pConn;
+    OrionPktView_t View;
+    int Packets = 0;
+
+    // Pull packets out until the connection runs dry, or a handler removes it. Handlers get the
+    //  packet where the kernel put it, so packets nobody handles are never copied at all.
+    while (!pEntry->Removed && OrionConnReceiveView(pConn, &View))
+    {
+        UringHandler_t *pHandler = &pRing->Handlers[View.pPkt->ID];
+
+        // Fall back on the default handler if this ID doesn't have one
+        if (pHandler->pHandler == NULL)
+            pHandler = &pRing->DefaultHandler;
+
+        if (pHandler->pHandler != NULL)
+            pHandler->pHandler(pConn, View.pPkt, pHandler->pContext);
+
+        Packets++;
+    }
+
+    // If the far end hung up, drop the connection and let the user know
+    if (!pEntry->Removed && !OrionConnIsOpen(pConn))
+    {
+        DetachEntry(pRing, pEntry);
+        if (pRing->pClose != NULL)
+            pRing->pClose(pConn, pRing->pCloseContext);
+    }
+
+    return Packets;
+
+}// ServiceConn
+
+// Take a connection out of the ring, giving it back its own transport. The slot drains until
+//  the kernel is done with it.
+static void DetachEntry(OrionUring_t *pRing, UringEntry_t *pEntry)
+{
+    OrionConn_t *pConn = pEntry->pConn;
+
+    // Anything not framed yet moves into the connection's own buffer. The buffer it was in goes
+    //  back to the kernel after this batch of completions, since a handler may be looking at it.
+    if (pConn->pRxData != pConn->RxBuffer)
+    {
+        memcpy(&pConn->RxBuffer[pConn->RxTail], &pConn->pRxData[pConn->RxTail], pConn->RxHead - pConn->RxTail);
+        pConn->pRxData = pConn->RxBuffer;
+    }
+
+    pConn->pOps = pEntry->pOps;
+    pConn->pTransport = pEntry->pTransport;
+
+    // The slot stays taken until its receive is cancelled and anything queued has been sent
+    pEntry->pConn = NULL;
+    pEntry->Removed = TRUE;
+    pEntry->RecvWanted = FALSE;
+    pRing->Draining++;
+    if (pEntry->RecvPosted && !pEntry->Cancelling && !pRing->Closing)
+    {
+        // Submit the cancel now, so the receive can't take anything that arrives after this
+        PostCancel(pRing, pEntry->Slot, ((UInt64)pEntry->Slot << URING_OP_BITS) | URING_OP_RECV, IORING_ASYNC_CANCEL_ALL);
+        pEntry->Cancelling = TRUE;
+        UringEnter(pRing, 0, 0);
+    }
+
+}// DetachEntry
+
+// Free every removed slot the kernel is done with
+static void FreeDrained(OrionUring_t *pRing)
+{
+    UInt32 i;
+
+    for (i = 0; (i < pRing->MaxConns) && (pRing->Draining > 0); i++)
+    {
+        UringEntry_t *pEntry = &pRing->pEntries[i];
+
+        if (!pEntry->InUse || !pEntry->Removed)
+            continue;
+
+        // Buffers it was holding can go back to the kernel now that the batch is done
+        if (pEntry->LentBuffer >= 0)
+            AddBuffer(pRing, pEntry->LentBuffer);
+        if (pEntry->PendingBuffer >= 0)
+            AddBuffer(pRing, pEntry->PendingBuffer);
+
+        pEntry->LentBuffer = pEntry->PendingBuffer = -1;
+
+        // Wait for the receive to stop and anything still queued to go out
+        if (pEntry->RecvPosted || pEntry->Cancelling || (pEntry->SendPosted > 0) || ((pEntry->SendUsed > 0) && !pEntry->SendFailed))
+            continue;
+
+        // Let go of the socket, and free up the slot
+        SetFile(pRing, pEntry->Slot, -1);
+        pEntry->InUse = pEntry->Removed = FALSE;
+        pRing->Draining--;
+    }
+
+}// FreeDrained
+
+// Flush every connection whose outgoing batch is overdue, returning the timeout shortened to the next deadline
+static int FlushBatches(OrionUring_t *pRing, int TimeoutMs)
+{
+    UInt64 NowUs = 0;
+    UInt32 i;
+
+    for (i = 0; i < pRing->MaxConns; i++)
+    {
+        OrionConn_t *pConn = pRing->pEntries[i].pConn;
+        int WaitMs;
+
+        // Only connections with packets waiting on a deadline matter here
+        if ((pConn == NULL) || (pConn->TxDeadlineUs == 0))
+            continue;
+
+        // Only look at the clock if there's a deadline to compare it to
+        if (NowUs == 0)
+            NowUs = OrionCommGetTimeUs();
+
+        // Queue it if it's due; if the send buffer didn't take all of it, the flush sets a new deadline
+        if (NowUs >= pConn->TxDeadlineUs)
+            OrionConnFlush(pConn);
+
+        // Don't sleep past the deadline, rounding up so we don't wake up just short of it
+        if (pConn->TxDeadlineUs != 0)
+        {
+            WaitMs = (pConn->TxDeadlineUs > NowUs) ? (int)((pConn->TxDeadlineUs - NowUs + 999) / 1000) : 0;
+            if ((TimeoutMs < 0) || (WaitMs < TimeoutMs))
+                TimeoutMs = WaitMs;
+        }
+    }
+
+    return TimeoutMs;
+
+}// FlushBatches
+
+// Round a count up to a power of two, within limits
+static UInt32 RoundUpPow2(UInt32 Value, UInt32 Min, UInt32 Max)
+{
+    UInt32 Result = Min;
+
+    while ((Result < Value) && (Result < Max))
+        Result <<= 1;
+
+    return Result;
+
+}// RoundUpPow2
+
+#endif // __linux__
@@ -0,0 +1,54 @@
+#ifndef ORIONCOMMURING_H
+#define ORIONCOMMURING_H
+
+#include "OrionComm.h"
+#include "OrionCommEventLoop.h"
+
+#ifdef __linux__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// An io_uring ring services many TCP connections from one thread, much like an OrionEventLoop,
+//  for servers with hundreds of links. Each connection keeps a multishot receive posted, which
+//  the kernel fills from a pool of buffers shared by the whole ring, and packets are framed
+//  straight out of those buffers with no read call per connection. Packets sent on a connection
+//  in the ring are queued in a send buffer registered with the kernel, and everything queued on
+//  every connection goes out with the next wait, in the same system call. Handlers have the same
+//  types and the same rules as the event loop's. While a connection is in a ring it must only be
+//  read through the ring's handlers and sent on from the thread running the ring. Needs Linux 6.0
+//  or later; on anything older, or where io_uring is turned off, OrionUringCreate fails and the
+//  event loop should be used instead.
+typedef struct OrionUring_s OrionUring_t;
+
+// Ring counters
+typedef struct
+{
+    UInt32 Enters;          // io_uring_enter system calls, each of which submits and waits
+    UInt32 Completions;     // Completions reaped
+    UInt32 RecvBuffers;     // Buffers of received data framed in place
+    UInt32 Sends;           // Sends submitted, each taking everything queued on one connection
+    UInt32 NoBuffers;       // Times a connection stopped receiving because every buffer was in use
+} OrionUringStats_t;
+
+OrionUring_t *OrionUringCreate(UInt32 MaxConns);
+void OrionUringDestroy(OrionUring_t *pRing);
+BOOL OrionUringAddConn(OrionUring_t *pRing, OrionConn_t *pConn);
+void OrionUringRemoveConn(OrionUring_t *pRing, OrionConn_t *pConn);
+void OrionUringSetHandler(OrionUring_t *pRing, UInt8 ID, OrionPktHandler_t pHandler, void *pContext);
+void OrionUringSetDefaultHandler(OrionUring_t *pRing, OrionPktHandler_t pHandler, void *pContext);
+void OrionUringSetCloseHandler(OrionUring_t *pRing, OrionConnHandler_t pHandler, void *pContext);
+int  OrionUringRunOnce(OrionUring_t *pRing, int TimeoutMs);
+void OrionUringRun(OrionUring_t *pRing);
+void OrionUringStop(OrionUring_t *pRing);
+void OrionUringGetStats(OrionUring_t *pRing, OrionUringStats_t *pStats, BOOL Reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __linux__
+
+#endif // ORIONCOMMURING_H
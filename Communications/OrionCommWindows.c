@@ -8,6 +8,7 @@
 
 static HANDLE SerialHandle = INVALID_HANDLE_VALUE;
 static SOCKET TcpSocket = INVALID_SOCKET;
+static OrionCommRxStats_t RxStats = { 0 };
 
 static struct sockaddr *GetSockAddr(uint32_t Address, unsigned short Port);
 
@@ -237,12 +238,15 @@ BOOL OrionCommReceive(OrionPkt_t *pPkt)
 
             // Read a byte
             ReadFile(SerialHandle, &Byte, 1, &BytesRead, NULL);
+            RxStats.ReadCalls++;
+            RxStats.Bytes += BytesRead;
 
             // If this byte is the end of a valid packet
             if ((BytesRead == 1) && (LookForOrionPacketInByte(&Pkt, Byte) == TRUE))
             {
                 // Copy the packet into the passed-in location and return a success
                 *pPkt = Pkt;
+                RxStats.Packets++;
                 return TRUE;
             }
             // Otherwise, if some sort of error occurred
@@ -257,13 +261,24 @@ BOOL OrionCommReceive(OrionPkt_t *pPkt)
     else
     {
         // As long as we keep getting bytes, keep reading them in one by one
-        while (recv(TcpSocket, (char *)&Byte, 1, 0) == 1)
+        while (1)
         {
+            // Try to read a byte, counting the call either way
+            int Count = recv(TcpSocket, (char *)&Byte, 1, 0);
+            RxStats.ReadCalls++;
+
+            // Stop once the socket runs dry
+            if (Count != 1)
+                break;
+
+            RxStats.Bytes++;
+
             // If this byte is the end of a valid packet
             if (LookForOrionPacketInByte(&Pkt, Byte))
             {
                 // Copy the packet into the passed-in location and return a success
                 *pPkt = Pkt;
+                RxStats.Packets++;
                 return TRUE;
             }
         }
@@ -274,6 +289,45 @@ BOOL OrionCommReceive(OrionPkt_t *pPkt)
 
 }// OrionCommReceive
 
+BOOL OrionCommReceiveTimeout(OrionPkt_t *pPkt, UInt32 TimeoutUs)
+{
+    ULONGLONG Deadline = GetTickCount64() + (TimeoutUs + 999) / 1000;
+
+    // Keep checking for a packet, yielding for a millisecond between tries, until we run out of time
+    while (OrionCommReceive(pPkt) == FALSE)
+    {
+        if (GetTickCount64() >= Deadline)
+            return FALSE;
+
+        Sleep(1);
+    }
+
+    return TRUE;
+
+}// OrionCommReceiveTimeout
+
+BOOL OrionCommWaitFor(OrionPkt_t *pPkt, UInt8 ID, UInt32 TimeoutUs)
+{
+    ULONGLONG Deadline = GetTickCount64() + (TimeoutUs + 999) / 1000, Now;
+
+    // Keep receiving packets until we get the right one or run out of time
+    while ((Now = GetTickCount64()) <= Deadline)
+    {
+        // If the next packet is the one we want, we're done; anything else gets dropped
+        if (OrionCommReceiveTimeout(pPkt, (UInt32)(Deadline - Now) * 1000))
+        {
+            if (pPkt->ID == ID)
+                return TRUE;
+        }
+        // Nothing came in before the deadline
+        else
+            break;
+    }
+
+    return FALSE;
+
+}// OrionCommWaitFor
+
 BOOL OrionCommIsOpen(void)
 {
     // Return TRUE if one of the handles is valid
@@ -281,6 +335,15 @@ BOOL OrionCommIsOpen(void)
 
 }// OrionCommIsOpen
 
+void OrionCommGetRxStats(OrionCommRxStats_t *pStats, BOOL Reset)
+{
+    // Hand over a copy of the receive counters, clearing them if asked to
+    *pStats = RxStats;
+    if (Reset)
+        memset(&RxStats, 0, sizeof(RxStats));
+
+}// OrionCommGetRxStats
+
 // Quickly and easily constructs a sockaddr pointer for a bunch of different functions.
 //   Call this function with Address == Port == 0 to access the pointer, or pass in
 //   actual values to construct a new sockaddr.
@@ -0,0 +1,3634 @@
+// Needed for posix_openpt()
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "OrionPublicPacketShim.h"
+#include "OrionCommEventLoop.h"
+#include "OrionCommConfig.h"
+#include "OrionCommLog.h"
+#include "OrionCommQueue.h"
+#include "OrionCommDispatch.h"
+#include "OrionCommSched.h"
+#include "OrionCommPipe.h"
+#include "OrionCommRequest.h"
+#include "OrionCommSupervise.h"
+#include "OrionCommStats.h"
+#include "OrionCommUdp.h"
+#include "OrionCommShm.h"
+#include "OrionCommUring.h"
+#include "ClockSync.h"
+#include "GeolocateTelemetry.h"
+
+#include <sys/resource.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Signature shared by each of the individual benchmarks
+typedef int (*BenchmarkFunc_t)(int argc, char **argv);
+
+// Running tally of the packets a parser produced, used to prove two parsers agree
+typedef struct
+{
+    UInt32 Count;
+    UInt32 Hash;
+} PacketTally_t;
+
+// Simulated links feeding the event loop benchmark, and the latency samples it collects
+typedef struct
+{
+    int Links;
+    int RateHz;
+    double Duration;
+    int *pHandles;
+    double *pLatency;
+    UInt32 Samples;
+    UInt32 MaxSamples;
+} LoopBench_t;
+
+// Simulated gimbal for the config upload benchmark, which echoes packets after a delay
+typedef struct
+{
+    int Handle;
+    double Latency;
+    int DropPercent;
+    volatile BOOL Stop;
+} ConfigBench_t;
+
+// Producer side of the queue benchmark: a queue to fill directly, or a socket to write to
+typedef struct
+{
+    OrionPkt_t Template;
+    OrionPktQueue_t *pQueue;
+    int Handle;
+    UInt32 Packets;
+    UInt32 FullSpins;
+} QueueBench_t;
+
+// Receiving end of the batching benchmark's TCP connection, and a tally of what arrived
+typedef struct
+{
+    int Handle;
+    UInt32 Bytes;
+    UInt32 Hash;
+} BatchBench_t;
+
+// Simulated serial link for the scheduler benchmark: the far end of a pty, drained at the baud
+//  rate, along with the send time of every command and how stale each one was when it arrived
+typedef struct
+{
+    int Handle;
+    UInt32 BytesPerSec;
+    double SendTime[65536];
+    double *pAges;
+    UInt32 Ages;
+    UInt32 MaxAges;
+    UInt32 IdBytes[256];
+    volatile BOOL Stop;
+} SchedBench_t;
+
+// Request engine benchmark: how many requests to send and how many have finished, plus the
+//  round trip of every one that was answered
+typedef struct
+{
+    OrionRequester_t *pReq;
+    UInt32 TimeoutUs;
+    UInt32 Total;
+    UInt32 Next;
+    UInt32 Answered;
+    UInt32 TimedOut;
+    UInt32 Wrong;
+    double *pLatency;
+} RequestBench_t;
+
+// Things a reconnect benchmark gimbal can be told to do to its client
+enum
+{
+    RECONNECT_NONE,
+    RECONNECT_HANG_UP,
+    RECONNECT_GO_SILENT,
+    RECONNECT_GO_DOWN
+};
+
+// Simulated gimbal for the reconnect benchmark, which streams telemetry to one TCP client at a
+//  time and counts the sticky packets each new client sends it, along with the client side's
+//  record of when the link went down and came back
+typedef struct
+{
+    UInt16 Port;
+    volatile int Action;
+    UInt32 DownMs;
+    volatile UInt32 Accepts;
+    volatile UInt32 StickyRx;
+    volatile BOOL Stop;
+    double DownTime;
+    double UpTime;
+    UInt32 OutageUs;
+} ReconnectBench_t;
+
+// Far end of the link statistics benchmark: either a canned stream to write out as fast as the
+//  socket will take it, or telemetry to send at a steady rate with one pause part way through
+typedef struct
+{
+    int Handle;
+    const UInt8 *pStream;
+    UInt32 Length;
+    double Seconds;
+    UInt32 Sent;
+} StatsBench_t;
+
+// Largest number of simulated gimbals in the UDP benchmark, and how many packets each one sends
+//  per round
+#define UDP_BENCH_GIMBALS   64
+#define UDP_BENCH_BURST     16
+
+// Receiving end of the UDP benchmark: the port each simulated gimbal sends from, the port the
+//  packet being tallied came from, and how many packets arrived and were traced to the wrong gimbal
+typedef struct
+{
+    UInt16 Ports[UDP_BENCH_GIMBALS];
+    UInt16 Source;
+    UInt32 Received;
+    UInt32 Mistagged;
+} UdpBench_t;
+
+// Sending end of the timestamp and fan-out benchmarks: the handle to write to, how many packets to
+//  send, how far apart (0 for 2 to 8 ms at random) and the time each one was sent at, on the
+//  OrionCommGetTimeUs clock
+typedef struct
+{
+    int Handle;
+    UInt32 Packets;
+    UInt32 IntervalUs;
+    UInt64 *pSendUs;
+} TimestampBench_t;
+
+// Largest number of consumers in the fan-out benchmark, and how often each one sends a command back
+#define FANOUT_READERS      16
+#define FANOUT_COMMAND_EVERY 100
+
+// One consumer in the fan-out benchmark: its connection, whether it views packets in place in
+//  shared memory, when each packet was sent, and what it measured
+typedef struct
+{
+    OrionConn_t *pConn;
+    BOOL ZeroCopy;
+    BOOL SendCommands;
+    const UInt64 *pSendUs;
+    UInt32 Packets;
+    double Deadline;
+    double *pLatency;
+    UInt32 Received;
+    UInt32 Torn;
+} FanoutReader_t;
+
+// Relay process of the fan-out benchmark: the link to the gimbal and a socket to each consumer
+typedef struct
+{
+    OrionConn_t *pLink;
+    int Clients[FANOUT_READERS];
+    int Readers;
+} FanoutRelay_t;
+
+// Number of packet types with handlers in the dispatch benchmark's packet mix
+#define DISPATCH_TYPES  8
+
+// Structures the dispatch benchmark decodes into, one per handled packet type
+typedef struct
+{
+    GeolocateTelemetryCore_t Geo;
+    OrionPerformance_t Perf;
+    GpsData_t Gps;
+    OrionDiagnostics_t Diag;
+    OrionSoftwareDiagnostics_t SwDiag;
+    NetworkDiagnostics_t NetDiag;
+    OrionUserData_t UserData;
+    OrionCrownVersion_t Version;
+} DispatchStructs_t;
+
+// One run of the io_uring benchmark: its connections to the simulator, the event loop or ring
+//  servicing them, and what it measured
+typedef struct
+{
+    int Conns;
+    BOOL UseRing;
+    OrionConn_t **pConns;
+    OrionEventLoop_t *pLoop;
+    OrionUring_t *pRing;
+    double *pLatency;
+    UInt32 Echoes;
+    UInt32 MaxEchoes;
+    UInt32 Telemetry;
+    UInt32 Closed;
+    UInt32 SystemCalls;
+    double Cpu;
+} UringBench_t;
+
+// Individual benchmarks
+static int BenchmarkParse(int argc, char **argv);
+static int BenchmarkChecksum(int argc, char **argv);
+static int BenchmarkLoop(int argc, char **argv);
+static int BenchmarkConfig(int argc, char **argv);
+static int BenchmarkReplay(int argc, char **argv);
+static int BenchmarkQueue(int argc, char **argv);
+static int BenchmarkDispatch(int argc, char **argv);
+static int BenchmarkBatch(int argc, char **argv);
+static int BenchmarkSched(int argc, char **argv);
+static int BenchmarkPriority(int argc, char **argv);
+static int BenchmarkPipe(int argc, char **argv);
+static int BenchmarkRequests(int argc, char **argv);
+static int BenchmarkReconnect(int argc, char **argv);
+static int BenchmarkStats(int argc, char **argv);
+static int BenchmarkUdp(int argc, char **argv);
+static int BenchmarkTimestamps(int argc, char **argv);
+static int BenchmarkClockSync(int argc, char **argv);
+static int BenchmarkShm(int argc, char **argv);
+static int BenchmarkUring(int argc, char **argv);
+
+// A few helper functions, etc.
+static double GetTime(void);
+static UInt8 *LoadStream(const char *pPath, UInt32 *pLength);
+static UInt8 *MakeStream(UInt32 Length);
+static void TallyPacket(PacketTally_t *pTally, const OrionPkt_t *pPkt);
+static BOOL TallyCallback(const TrilliumPkt_t *pPkt, void *pContext);
+static void *LoopProducer(void *pContext);
+static void LoopHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+static void *ConfigResponder(void *pContext);
+static int CompareDoubles(const void *pA, const void *pB);
+static BOOL MakeLog(const char *pPath, UInt32 Packets);
+static double ReplayLog(const char *pPath, BOOL UseViews, PacketTally_t *pTally, UInt32 *pBytes, UInt32 *pDecoded);
+static void MakeSequencePacket(OrionPkt_t *pPkt, UInt32 Sequence);
+static void CopySequencePacket(OrionPkt_t *pPkt, const OrionPkt_t *pTemplate, UInt32 Sequence);
+static void *QueueProducer(void *pContext);
+static void *QueueWriter(void *pContext);
+static double DrainConn(OrionConn_t *pConn, UInt32 Packets, UInt32 *pReceived, BOOL *pInOrder);
+static UInt32 MakeDispatchMix(OrionPkt_t *pPkts);
+static BOOL DecodeChain(const OrionPkt_t *pPkt, DispatchStructs_t *pStructs, UInt32 *pCounts);
+static void CountHandler(const OrionPkt_t *pPkt, void *pDecoded, void *pContext);
+static BOOL OpenTcpPair(int *pClient, int *pServer);
+static void *BatchReader(void *pContext);
+static double GetCpuTime(void);
+static int OpenPty(char *pSlavePath, size_t Size);
+static void *PtyReader(void *pContext);
+static void SleepUs(UInt32 Us);
+static void MakeRequest(OrionPkt_t *pPkt, UInt32 Sequence, UInt32 *pMatchSize);
+static BOOL SendRequest(RequestBench_t *pBench, OrionConn_t *pConn);
+static void RequestDone(OrionRequest_t *pRequest, const OrionPkt_t *pReply, void *pContext);
+static void *ReconnectGimbal(void *pContext);
+static int OpenListener(UInt16 Port);
+static int CountOpenFiles(void);
+static void ReconnectHandler(OrionConn_t *pConn, BOOL Up, UInt32 OutageUs, void *pContext);
+static UInt8 *MakeFaultyStream(UInt32 Length, UInt32 *pGood, TrilliumParseStats_t *pExpected);
+static double DrainStats(const UInt8 *pStream, UInt32 Length, BOOL Enable, UInt32 *pReceived, OrionLinkStats_t *pStats);
+static void *StatsStreamWriter(void *pContext);
+static void *StatsTelemetryWriter(void *pContext);
+static BOOL UdpTally(const OrionPkt_t *pPkt, void *pContext);
+static void *TimestampWriter(void *pContext);
+static void *FanoutReader(void *pContext);
+static void *FanoutRelay(void *pContext);
+static int ConnectSimulator(const char *pAddress);
+static BOOL RunUringBench(UringBench_t *pBench, const char *pAddress, int RateHz, double Duration);
+static void UringBenchRunOnce(UringBench_t *pBench, int TimeoutMs);
+static void UringEchoHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+static void UringTelemetryHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+static void UringCloseHandler(OrionConn_t *pConn, void *pContext);
+
+int main(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *pName;
+        BenchmarkFunc_t pFunc;
+        const char *pUsage;
+    } Benchmarks[] = {
+        { "parse", BenchmarkParse, "parse [capture file]" },
+        { "checksum", BenchmarkChecksum, "checksum" },
+        { "loop", BenchmarkLoop, "loop [links] [rate Hz] [seconds]" },
+        { "config", BenchmarkConfig, "config [packets] [latency ms] [drop %]" },
+        { "replay", BenchmarkReplay, "replay [log file]" },
+        { "queue", BenchmarkQueue, "queue [packets] [slots]" },
+        { "dispatch", BenchmarkDispatch, "dispatch [packets]" },
+        { "batch", BenchmarkBatch, "batch [ticks] [rate Hz]" },
+        { "sched", BenchmarkSched, "sched [seconds] [command Hz] [baud]" },
+        { "priority", BenchmarkPriority, "priority [seconds] [baud]" },
+        { "pipe", BenchmarkPipe, "pipe [simulator address] [kilobytes]" },
+        { "requests", BenchmarkRequests, "requests [connections] [requests] [latency ms]" },
+        { "reconnect", BenchmarkReconnect, "reconnect [silence ms] [down ms]" },
+        { "stats", BenchmarkStats, "stats [seconds]" },
+        { "udp", BenchmarkUdp, "udp [gimbals] [rounds]" },
+        { "timestamps", BenchmarkTimestamps, "timestamps [packets]" },
+        { "clocksync", BenchmarkClockSync, "clocksync [minutes] [rate Hz] [drift ppm]" },
+        { "shm", BenchmarkShm, "shm [readers] [packets]" },
+        { "uring", BenchmarkUring, "uring [simulator address] [echo Hz] [seconds]" },
+    };
+    int i;
+
+    // If we got a benchmark name, find it and run it
+    if (argc >= 2)
+    {
+        for (i = 0; i < (int)(sizeof(Benchmarks) / sizeof(Benchmarks[0])); i++)
+        {
+            if (strcmp(argv[1], Benchmarks[i].pName) == 0)
+                return Benchmarks[i].pFunc(argc - 2, &argv[2]);
+        }
+    }
+
+    // Otherwise tell the user what's available
+    printf("Usage:\n");
+    for (i = 0; i < (int)(sizeof(Benchmarks) / sizeof(Benchmarks[0])); i++)
+        printf("  %s %s\n", argv[0], Benchmarks[i].pUsage);
+
+    return 1;
+
+}// main
+
+// Compare the bytewise packet parser against the bulk buffer scanner
+static int BenchmarkParse(int argc, char **argv)
+{
+    PacketTally_t ByteTally = { 0, 2166136261u }, BulkTally = { 0, 2166136261u };
+    UInt32 Length, i, Chunk = 1460;
+    double Start, ByteTime, BulkTime;
+    OrionPkt_t Pkt;
+    UInt8 *pStream;
+
+    // Use a recorded stream if we were given one, otherwise make up 64 MB of noisy traffic
+    if (argc >= 1)
+        pStream = LoadStream(argv[0], &Length);
+    else
+        pStream = MakeStream(Length = 64 * 1024 * 1024);
+
+    // Bail out if there's nothing to chew on
+    if (pStream == NULL)
+        return 1;
+
+    // First the bytewise state machine
+    memset(&Pkt, 0, sizeof(Pkt));
+    Start = GetTime();
+    for (i = 0; i < Length; i++)
+    {
+        if (LookForOrionPacketInByte(&Pkt, pStream[i]))
+            TallyPacket(&ByteTally, &Pkt);
+    }
+    ByteTime = GetTime() - Start;
+
+    // Now the buffer scanner, fed in TCP segment sized chunks so packets straddle calls
+    memset(&Pkt, 0, sizeof(Pkt));
+    Start = GetTime();
+    for (i = 0; i < Length; i += Chunk)
+        LookForOrionPacketsInBuffer(&Pkt, &pStream[i], (Length - i < Chunk) ? Length - i : Chunk, TallyCallback, &BulkTally);
+    BulkTime = GetTime() - Start;
+
+    // Print out the results
+    printf("%u bytes, %u packets\n", Length, ByteTally.Count);
+    printf("  Bytewise: %8.1f MB/s\n", Length / ByteTime / 1e6);
+    printf("  Buffer:   %8.1f MB/s (%.1fx)\n", Length / BulkTime / 1e6, ByteTime / BulkTime);
+
+    // Free up the stream buffer
+    free(pStream);
+
+    // The two parsers had better agree exactly
+    if ((ByteTally.Count != BulkTally.Count) || (ByteTally.Hash != BulkTally.Hash))
+    {
+        printf("MISMATCH: buffer scanner found %u packets\n", BulkTally.Count);
+        return 1;
+    }
+
+    return 0;
+
+}// BenchmarkParse
+
+// Compare a bytewise Fletcher-251 checksum against the block checksum routine
+static int BenchmarkChecksum(int argc, char **argv)
+{
+    static const UInt32 Sizes[] = { ORION_PKT_MAX_SIZE + TRILLIUM_PKT_HEADER_SIZE, 64 * 1024 };
+    UInt32 Length = 16 * 1024 * 1024, i, j, k;
+    UInt8 *pStream = MakeStream(Length);
+    int Result = 0;
+
+    // Bail out if we couldn't get a buffer
+    if (pStream == NULL)
+        return 1;
+
+    // First make sure the block checksum matches bytewise for every alignment and plenty of lengths
+    for (i = 0; i < 20000; i++)
+    {
+        UInt32 Offset = rand() % 64, Size = rand() % 10000;
+        UInt16 A0 = rand() % 251, B0 = rand() % 251, A1 = A0, B1 = B0;
+
+        // Bytewise reference
+        for (j = 0; j < Size; j++)
+        {
+            A0 = (A0 + pStream[Offset + j]) % 251;
+            B0 = (B0 + A0) % 251;
+        }
+
+        // Block version
+        UpdateTrilliumChecksum(&pStream[Offset], Size, &A1, &B1);
+
+        // These had better match
+        if ((A0 != A1) || (B0 != B1))
+        {
+            printf("MISMATCH: offset %u, length %u\n", Offset, Size);
+            free(pStream);
+            return 1;
+        }
+    }
+
+    // Now time both over packet-sized and bulk blocks
+    for (k = 0; k < sizeof(Sizes) / sizeof(Sizes[0]); k++)
+    {
+        UInt16 A0 = 1, B0 = 0, A1 = 1, B1 = 0;
+        double Start, ByteTime, BlockTime;
+
+        Start = GetTime();
+        for (i = 0; i + Sizes[k] <= Length; i += Sizes[k])
+        {
+            for (j = 0; j < Sizes[k]; j++)
+            {
+                A0 = (A0 + pStream[i + j]) % 251;
+                B0 = (B0 + A0) % 251;
+            }
+        }
+        ByteTime = GetTime() - Start;
+
+        Start = GetTime();
+        for (i = 0; i + Sizes[k] <= Length; i += Sizes[k])
+            UpdateTrilliumChecksum(&pStream[i], Sizes[k], &A1, &B1);
+        BlockTime = GetTime() - Start;
+
+        // Print out the results
+        printf("%6u byte blocks\n", Sizes[k]);
+        printf("  Bytewise: %8.1f MB/s\n", Length / ByteTime / 1e6);
+        printf("  Block:    %8.1f MB/s (%.1fx)\n", Length / BlockTime / 1e6, ByteTime / BlockTime);
+
+        // Keep the compiler honest, and double check the results
+        if ((A0 != A1) || (B0 != B1))
+            Result = 1;
+    }
+
+    free(pStream);
+    return Result;
+
+}// BenchmarkChecksum
+
+// Service many simulated links from one event loop thread, measuring dispatch latency and CPU use
+static int BenchmarkLoop(int argc, char **argv)
+{
+    LoopBench_t Bench = { 50, 100, 5.0 };
+    OrionConn_t **pConns;
+    OrionEventLoop_t *pLoop;
+    struct rusage Usage;
+    pthread_t Producer;
+    double Start, Cpu;
+    int i;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Bench.Links = atoi(argv[0]);
+    if (argc >= 2) Bench.RateHz = atoi(argv[1]);
+    if (argc >= 3) Bench.Duration = atof(argv[2]);
+
+    // Room for every packet we expect to see, with some slack
+    Bench.MaxSamples = (UInt32)(Bench.Links * Bench.RateHz * (Bench.Duration + 1));
+    Bench.pLatency = malloc(Bench.MaxSamples * sizeof(double));
+    Bench.pHandles = malloc(Bench.Links * sizeof(int));
+    pConns = malloc(Bench.Links * sizeof(OrionConn_t *));
+    pLoop = OrionEventLoopCreate();
+
+    // Bail out if anything went wrong
+    if ((Bench.pLatency == NULL) || (Bench.pHandles == NULL) || (pConns == NULL) || (pLoop == NULL))
+        return 1;
+
+    // Each link is a socket pair: the producer writes to one end, the loop services the other
+    for (i = 0; i < Bench.Links; i++)
+    {
+        int Pair[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+            return 1;
+
+        Bench.pHandles[i] = Pair[0];
+        pConns[i] = OrionConnOpenHandle(Pair[1]);
+        OrionEventLoopAddConn(pLoop, pConns[i]);
+    }
+
+    // Telemetry packets get timed, everything else is ignored
+    OrionEventLoopSetHandler(pLoop, ORION_PKT_GEOLOCATE_TELEMETRY, LoopHandler, &Bench);
+
+    // Start generating traffic, then run the loop until it's all been delivered
+    Start = GetTime();
+    getrusage(RUSAGE_SELF, &Usage);
+    Cpu = -(Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec * 1e-6 + Usage.ru_stime.tv_sec + Usage.ru_stime.tv_usec * 1e-6);
+    pthread_create(&Producer, NULL, LoopProducer, &Bench);
+    while (GetTime() - Start < Bench.Duration + 0.1)
+        OrionEventLoopRunOnce(pLoop, 10);
+
+    pthread_join(Producer, NULL);
+
+    // Figure out how much CPU time the whole process (loop and producer) used
+    getrusage(RUSAGE_SELF, &Usage);
+    Cpu += Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec * 1e-6 + Usage.ru_stime.tv_sec + Usage.ru_stime.tv_usec * 1e-6;
+
+    // Sort the latencies so we can pull out percentiles
+    qsort(Bench.pLatency, Bench.Samples, sizeof(double), CompareDoubles);
+
+    // Print out the results
+    printf("%d links at %d Hz for %.1f s: %u packets, %.1f%% CPU (loop and producer)\n", Bench.Links, Bench.RateHz, Bench.Duration, Bench.Samples, 100.0 * Cpu / Bench.Duration);
+    if (Bench.Samples > 0)
+    {
+        printf("  Dispatch latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               Bench.pLatency[Bench.Samples / 2] * 1e6,
+               Bench.pLatency[(UInt32)(Bench.Samples * 0.99)] * 1e6,
+               Bench.pLatency[Bench.Samples - 1] * 1e6);
+    }
+
+    // Clean up
+    for (i = 0; i < Bench.Links; i++)
+    {
+        OrionEventLoopRemoveConn(pLoop, pConns[i]);
+        OrionConnClose(pConns[i]);
+        close(Bench.pHandles[i]);
+    }
+
+    OrionEventLoopDestroy(pLoop);
+    free(pConns);
+    free(Bench.pHandles);
+    free(Bench.pLatency);
+
+    // Every packet should have made it through
+    return (Bench.Samples == 0);
+
+}// BenchmarkLoop
+
+// Producer thread for the event loop benchmark: writes timestamped telemetry to each link at its rate
+static void *LoopProducer(void *pContext)
+{
+    LoopBench_t *pBench = (LoopBench_t *)pContext;
+    double Start = GetTime(), Period = 1.0 / pBench->RateHz;
+    UInt32 Tick = 0;
+    int i;
+
+    // Send one packet per link per period, spread evenly across the period
+    while (Tick * Period < pBench->Duration)
+    {
+        for (i = 0; i < pBench->Links; i++)
+        {
+            double Due = Start + (Tick + (double)i / pBench->Links) * Period, Now;
+            struct timespec Sleep;
+            OrionPkt_t Pkt;
+
+            // Sleep until this link's packet is due
+            while ((Now = GetTime()) < Due)
+            {
+                Sleep.tv_sec = 0;
+                Sleep.tv_nsec = (long)((Due - Now) * 1e9);
+                nanosleep(&Sleep, NULL);
+            }
+
+            // Stamp the packet with the send time and ship it
+            memcpy(Pkt.Data, &Now, sizeof(Now));
+            memset(&Pkt.Data[sizeof(Now)], 0, 72);
+            MakeOrionPacket(&Pkt, ORION_PKT_GEOLOCATE_TELEMETRY, sizeof(Now) + 72);
+            write(pBench->pHandles[i], &Pkt, Pkt.Length + ORION_PKT_OVERHEAD);
+        }
+
+        Tick++;
+    }
+
+    return NULL;
+
+}// LoopProducer
+
+// Event loop handler: records how long the packet took to get here
+static void LoopHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext)
+{
+    LoopBench_t *pBench = (LoopBench_t *)pContext;
+    double Sent;
+
+    // Pull the send time out of the packet and log the difference
+    memcpy(&Sent, pPkt->Data, sizeof(Sent));
+    if (pBench->Samples < pBench->MaxSamples)
+        pBench->pLatency[pBench->Samples++] = GetTime() - Sent;
+
+}// LoopHandler
+
+// Upload a configuration to a simulated gimbal with a range of window sizes
+static int BenchmarkConfig(int argc, char **argv)
+{
+    static const UInt32 Windows[] = { 1, 4, 16, 64 };
+    int Packets = 500, Result = 0, i, w;
+    ConfigBench_t Bench = { -1, 0.005, 1 };
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Packets = atoi(argv[0]);
+    if (argc >= 2) Bench.Latency = atof(argv[1]) * 1e-3;
+    if (argc >= 3) Bench.DropPercent = atoi(argv[2]);
+
+    printf("%d packets, %.1f ms response latency, %d%% of packets dropped\n", Packets, Bench.Latency * 1e3, Bench.DropPercent);
+
+    for (w = 0; w < (int)(sizeof(Windows) / sizeof(Windows[0])); w++)
+    {
+        OrionConfigXferOptions_t Options;
+        OrionConfigXferStats_t Stats;
+        OrionConfigXfer_t *pXfer;
+        OrionConn_t *pConn;
+        pthread_t Responder;
+        int Pair[2];
+
+        // The transfer runs on one end of a socket pair and the simulated gimbal on the other
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+            return 1;
+
+        OrionConfigXferDefaultOptions(&Options);
+        Options.Window = Windows[w];
+        pXfer = OrionConfigXferCreate(&Options);
+        pConn = OrionConnOpenHandle(Pair[0]);
+
+        // Queue up packets with distinct ID and index byte pairs, finishing with a barrier
+        for (i = 0; i < Packets; i++)
+        {
+            OrionPkt_t Pkt;
+
+            memset(Pkt.Data, 0, 32);
+            Pkt.Data[0] = (UInt8)i;
+            MakeOrionPacket(&Pkt, (UInt8)(0x40 + (i % 40)), 32);
+            OrionConfigXferAdd(pXfer, &Pkt, i == Packets - 1);
+        }
+
+        // Start the gimbal, run the upload, then shut the gimbal down
+        Bench.Handle = Pair[1];
+        Bench.Stop = FALSE;
+        pthread_create(&Responder, NULL, ConfigResponder, &Bench);
+        OrionConfigXferRunConn(pXfer, pConn);
+        Bench.Stop = TRUE;
+        pthread_join(Responder, NULL);
+
+        // Print out the results
+        OrionConfigXferGetStats(pXfer, &Stats);
+        printf("  Window %2u: %.3f s, %.0f packets/s, %u acked, %u failed, %u retries\n",
+               Windows[w], Stats.ElapsedUs * 1e-6, Stats.Acked / (Stats.ElapsedUs * 1e-6), Stats.Acked, Stats.Failed, Stats.Retries);
+
+        // Every packet should have gone through
+        if (Stats.Acked + Stats.Failed != (UInt32)Packets)
+            Result = 1;
+
+        // Clean up
+        OrionConfigXferDestroy(pXfer);
+        OrionConnClose(pConn);
+    }
+
+    return Result;
+
+}// BenchmarkConfig
+
+// Simulated gimbal thread: echoes each packet back once the response latency has passed, dropping some
+static void *ConfigResponder(void *pContext)
+{
+    ConfigBench_t *pBench = (ConfigBench_t *)pContext;
+    OrionConn_t *pConn = OrionConnOpenHandle(pBench->Handle);
+    unsigned int Seed = 1;
+    UInt32 Head = 0, Tail = 0;
+    OrionPkt_t Pkt;
+    struct
+    {
+        double Due;
+        OrionPkt_t Pkt;
+    } Pending[256];
+
+    while (pBench->Stop == FALSE)
+    {
+        double Now = GetTime(), Wait = 0.01;
+
+        // Send every response that's due, and figure out how long until the next one
+        while (Tail != Head)
+        {
+            if (Pending[Tail % 256].Due > Now)
+            {
+                Wait = Pending[Tail % 256].Due - Now;
+                break;
+            }
+
+            OrionConnSend(pConn, &Pending[Tail++ % 256].Pkt);
+        }
+
+        // Wait for the next packet, queueing up a response unless this one gets dropped
+        if (OrionConnReceiveTimeout(pConn, &Pkt, (UInt32)(Wait * 1e6)))
+        {
+            if ((Head - Tail < 256) && ((int)(rand_r(&Seed) % 100) >= pBench->DropPercent))
+            {
+                Pending[Head % 256].Due = GetTime() + pBench->Latency;
+                memcpy(&Pending[Head++ % 256].Pkt, &Pkt, Pkt.Length + ORION_PKT_OVERHEAD);
+            }
+        }
+    }
+
+    OrionConnClose(pConn);
+    return NULL;
+
+}// ConfigResponder
+
+// Replay a raw stream log through the whole receive and decode path as fast as possible, copying
+//  each packet out and then decoding packets in place
+static int BenchmarkReplay(int argc, char **argv)
+{
+    static const char *pRuns[2] = { "Copies", "Views" };
+    PacketTally_t Tally[2] = { { 0, 2166136261u }, { 0, 2166136261u } };
+    char Path[] = "/tmp/BenchmarkXXXXXX.orionlog";
+    UInt32 Bytes = 0, Decoded = 0;
+    double Time[2];
+    int i;
+
+    // Use the given log, or record a synthetic one if there isn't one
+    if (argc >= 1)
+        strcpy(Path, argv[0]);
+    else
+    {
+        int Handle = mkstemps(Path, 9);
+
+        if ((Handle < 0) || (MakeLog(Path, 1000000) == FALSE))
+            return 1;
+        close(Handle);
+    }
+
+    // Replay it both ways: the results had better be identical
+    for (i = 0; i < 2; i++)
+    {
+        if ((Time[i] = ReplayLog(Path, i == 1, &Tally[i], &Bytes, &Decoded)) < 0)
+            return 1;
+    }
+
+    // Clean up the synthetic log
+    if (argc < 1)
+        unlink(Path);
+
+    // Print out the results
+    printf("%u bytes, %u packets, %u telemetry packets decoded\n", Bytes, Tally[0].Count, Decoded);
+    for (i = 0; i < 2; i++)
+        printf("  %-6s %8.1f MB/s, %10.0f packets/s\n", pRuns[i], Bytes / Time[i] / 1e6, Tally[i].Count / Time[i]);
+
+    if ((Tally[0].Count != Tally[1].Count) || (Tally[0].Hash != Tally[1].Hash))
+    {
+        printf("MISMATCH: views produced %u packets\n", Tally[1].Count);
+        return 1;
+    }
+
+    return 0;
+
+}// BenchmarkReplay
+
+// Measure the cost of the receive queue: uncontended, between two threads, and behind a receive thread
+static int BenchmarkQueue(int argc, char **argv)
+{
+    QueueBench_t Bench = { { 0 }, NULL, -1, 10000000, 0 };
+    UInt32 Slots = 1024, Packets, i, Expected = 0, Received[2];
+    OrionPktQueueStats_t Stats;
+    BOOL InOrder = TRUE, ConnInOrder[2];
+    double Start, Time, ConnTime[2];
+    pthread_t Producer;
+    OrionPkt_t Pkt;
+    int Pass;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Bench.Packets = (UInt32)atoi(argv[0]);
+    if (argc >= 2) Slots = (UInt32)atoi(argv[1]);
+    Packets = Bench.Packets;
+
+    if ((Bench.pQueue = OrionPktQueueCreate(Slots)) == NULL)
+        return 1;
+
+    // Queued packets are copies of a template with the sequence number patched in, so that building
+    //  them costs no more than the copy a receive thread makes framing a packet into its slot
+    MakeSequencePacket(&Bench.Template, 0);
+
+    // Uncontended: push and pop one packet at a time from this thread, so every access hits cache
+    Start = GetTime();
+    for (i = 0; i < Bench.Packets; i++)
+    {
+        CopySequencePacket(OrionPktQueueBack(Bench.pQueue), &Bench.Template, i);
+        OrionPktQueuePush(Bench.pQueue);
+        OrionPktQueuePop(Bench.pQueue, &Pkt);
+    }
+    Time = GetTime() - Start;
+    printf("%u packets of %u bytes through %u slots\n", Bench.Packets, Pkt.Length + ORION_PKT_OVERHEAD, Slots);
+    printf("  One thread:  %6.1f ns per push and pop\n", Time / Bench.Packets * 1e9);
+
+    // Two threads: the producer fills the queue as fast as it can while we drain it, checking the order
+    OrionPktQueueGetStats(Bench.pQueue, &Stats, TRUE);
+    Start = GetTime();
+    pthread_create(&Producer, NULL, QueueProducer, &Bench);
+    while (Expected < Bench.Packets)
+    {
+        if (OrionPktQueuePop(Bench.pQueue, &Pkt))
+        {
+            UInt32 Sequence;
+
+            memcpy(&Sequence, Pkt.Data, sizeof(Sequence));
+            InOrder = InOrder && (Sequence == Expected);
+            Expected++;
+        }
+        // Let the producer have the CPU if it has to share one with us
+        else
+            sched_yield();
+    }
+    Time = GetTime() - Start;
+    pthread_join(Producer, NULL);
+    OrionPktQueueGetStats(Bench.pQueue, &Stats, FALSE);
+    printf("  Two threads: %6.1f ns per packet, %.1f M packets/s, max depth %u, producer found it full %u times\n",
+           Time / Bench.Packets * 1e9, Bench.Packets / Time / 1e6, Stats.MaxDepth, Bench.FullSpins);
+    OrionPktQueueDestroy(Bench.pQueue);
+    Bench.pQueue = NULL;
+
+    // End to end: a writer thread streams packets down a socket, read directly and then through a receive thread
+    Bench.Packets /= 10;
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        OrionConn_t *pConn;
+        int Pair[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+            return 1;
+
+        pConn = OrionConnOpenHandle(Pair[1]);
+        Bench.Handle = Pair[0];
+        if ((Pass == 1) && (OrionConnStartRxThread(pConn, Slots) == FALSE))
+            return 1;
+
+        pthread_create(&Producer, NULL, QueueWriter, &Bench);
+        ConnTime[Pass] = DrainConn(pConn, Bench.Packets, &Received[Pass], &ConnInOrder[Pass]);
+        pthread_join(Producer, NULL);
+
+        OrionConnGetQueueStats(pConn, &Stats, FALSE);
+        OrionConnClose(pConn);
+        close(Pair[0]);
+    }
+
+    printf("%u packets over a local socket\n", Bench.Packets);
+    printf("  Direct:         %6.1f ns per packet, %u received\n", ConnTime[0] / Bench.Packets * 1e9, Received[0]);
+    printf("  Receive thread: %6.1f ns per packet, %u received, %u dropped, max depth %u\n",
+           ConnTime[1] / Bench.Packets * 1e9, Received[1], Stats.Dropped, Stats.MaxDepth);
+
+    // Nothing may be lost or reordered, except what the receive thread reports dropping
+    if (!InOrder || (Expected != Packets) || !ConnInOrder[0] || (Received[0] != Bench.Packets) ||
+        !ConnInOrder[1] || (Received[1] + Stats.Dropped != Bench.Packets) || (Stats.Queued != Received[1]))
+    {
+        printf("MISMATCH: packets lost or out of order\n");
+        return 1;
+    }
+
+    return 0;
+
+}// BenchmarkQueue
+
+// Compare handing packets to a chain of decoders, each checking the packet ID in turn, against
+//  a single lookup in an OrionDispatcher table
+static int BenchmarkDispatch(int argc, char **argv)
+{
+    OrionDispatcher_t *pDisp = OrionDispatcherCreate();
+    UInt32 Packets = 20000000, Mix, i, Unhandled[2] = { 0, 0 };
+    UInt32 Counts[2][DISPATCH_TYPES];
+    OrionDispatchStats_t Stats;
+    DispatchStructs_t Structs;
+    OrionPkt_t Pkts[16];
+    double Start, Time[2];
+    BOOL Match = TRUE;
+
+    // Optionally override the packet count
+    if (argc >= 1)
+        Packets = strtoul(argv[0], NULL, 10);
+
+    if (pDisp == NULL)
+        return 1;
+
+    memset(Counts, 0, sizeof(Counts));
+    Mix = MakeDispatchMix(Pkts);
+
+    // Register a counting handler for each type, each decoding into its own structure
+    OrionDispatcherSetStruct(pDisp, getGeolocateTelemetryCorePacketID(), &Structs.Geo, CountHandler, &Counts[1][0]);
+    OrionDispatcherSetStruct(pDisp, getOrionPerformancePacketID(), &Structs.Perf, CountHandler, &Counts[1][1]);
+    OrionDispatcherSetStruct(pDisp, getGpsDataPacketID(), &Structs.Gps, CountHandler, &Counts[1][2]);
+    OrionDispatcherSetStruct(pDisp, getOrionDiagnosticsPacketID(), &Structs.Diag, CountHandler, &Counts[1][3]);
+    OrionDispatcherSetStruct(pDisp, getOrionSoftwareDiagnosticsPacketID(), &Structs.SwDiag, CountHandler, &Counts[1][4]);
+    OrionDispatcherSetStruct(pDisp, getNetworkDiagnosticsPacketID(), &Structs.NetDiag, CountHandler, &Counts[1][5]);
+    OrionDispatcherSetStruct(pDisp, getOrionUserDataPacketID(), &Structs.UserData, CountHandler, &Counts[1][6]);
+    OrionDispatcherSetStruct(pDisp, getOrionCrownVersionPacketID(), &Structs.Version, CountHandler, &Counts[1][7]);
+
+    // Run the mix through the decode chain...
+    Start = GetTime();
+    for (i = 0; i < Packets; i++)
+    {
+        if (DecodeChain(&Pkts[i % Mix], &Structs, Counts[0]) == FALSE)
+            Unhandled[0]++;
+    }
+    Time[0] = GetTime() - Start;
+
+    // ...and then through the dispatcher
+    Start = GetTime();
+    for (i = 0; i < Packets; i++)
+        OrionDispatch(pDisp, &Pkts[i % Mix]);
+    Time[1] = GetTime() - Start;
+
+    OrionDispatcherGetStats(pDisp, &Stats, FALSE);
+    Unhandled[1] = Stats.Unhandled;
+    OrionDispatcherDestroy(pDisp);
+
+    // Print out the results
+    printf("%u packets, %u types handled, %u unhandled\n", Packets, DISPATCH_TYPES, Unhandled[0]);
+    printf("  Decode chain: %6.1f ns per packet\n", Time[0] / Packets * 1e9);
+    printf("  Dispatcher:   %6.1f ns per packet (%.1fx)\n", Time[1] / Packets * 1e9, Time[0] / Time[1]);
+
+    // Both had better have handled exactly the same packets
+    for (i = 0; i < DISPATCH_TYPES; i++)
+    {
+        if (Counts[0][i] != Counts[1][i])
+            Match = FALSE;
+    }
+
+    if (!Match || (Unhandled[0] != Unhandled[1]) || (Stats.Failed != 0) || (Stats.Handled + Stats.Unhandled != Packets))
+    {
+        printf("MISMATCH: dispatcher handled %u packets, failed to decode %u\n", Stats.Handled, Stats.Failed);
+        return 1;
+    }
+
+    return 0;
+
+}// BenchmarkDispatch
+
+// Build a repeating mix of packets weighted roughly like a gimbal's output, returning its length
+static UInt32 MakeDispatchMix(OrionPkt_t *pPkts)
+{
+    DispatchStructs_t Structs;
+    UInt32 Count = 0, i;
+
+    memset(&Structs, 0, sizeof(Structs));
+
+    // Telemetry dominates, followed by performance and GPS data
+    for (i = 0; i < 4; i++)
+        encodeGeolocateTelemetryCorePacketStructure(&pPkts[Count++], &Structs.Geo);
+    for (i = 0; i < 2; i++)
+        encodeOrionPerformancePacketStructure(&pPkts[Count++], &Structs.Perf);
+    for (i = 0; i < 2; i++)
+        encodeGpsDataPacketStructure(&pPkts[Count++], &Structs.Gps);
+
+    // One each of the slower streams
+    encodeOrionDiagnosticsPacketStructure(&pPkts[Count++], &Structs.Diag);
+    encodeOrionSoftwareDiagnosticsPacketStructure(&pPkts[Count++], &Structs.SwDiag);
+    encodeNetworkDiagnosticsPacketStructure(&pPkts[Count++], &Structs.NetDiag);
+    encodeOrionUserDataPacketStructure(&pPkts[Count++], &Structs.UserData);
+    encodeOrionCrownVersionPacketStructure(&pPkts[Count++], &Structs.Version);
+
+    // And a few packets that nothing handles
+    for (i = 0; i < 3; i++)
+        MakeOrionPacket(&pPkts[Count++], ORION_PKT_PRIVATE_90 + i, 0);
+
+    return Count;
+
+}// MakeDispatchMix
+
+// Try each decoder in turn until one accepts the packet, the way a hand-written receive loop might
+static BOOL DecodeChain(const OrionPkt_t *pPkt, DispatchStructs_t *pStructs, UInt32 *pCounts)
+{
+    if (decodeGeolocateTelemetryCorePacketStructure(pPkt, &pStructs->Geo))
+        pCounts[0]++;
+    else if (decodeOrionPerformancePacketStructure(pPkt, &pStructs->Perf))
+        pCounts[1]++;
+    else if (decodeGpsDataPacketStructure(pPkt, &pStructs->Gps))
+        pCounts[2]++;
+    else if (decodeOrionDiagnosticsPacketStructure(pPkt, &pStructs->Diag))
+        pCounts[3]++;
+    else if (decodeOrionSoftwareDiagnosticsPacketStructure(pPkt, &pStructs->SwDiag))
+        pCounts[4]++;
+    else if (decodeNetworkDiagnosticsPacketStructure(pPkt, &pStructs->NetDiag))
+        pCounts[5]++;
+    else if (decodeOrionUserDataPacketStructure(pPkt, &pStructs->UserData))
+        pCounts[6]++;
+    else if (decodeOrionCrownVersionPacketStructure(pPkt, &pStructs->Version))
+        pCounts[7]++;
+    else
+        return FALSE;
+
+    return TRUE;
+
+}// DecodeChain
+
+// Dispatcher handler for the dispatch benchmark, which just counts packets
+static void CountHandler(const OrionPkt_t *pPkt, void *pDecoded, void *pContext)
+{
+    (*(UInt32 *)pContext)++;
+
+}// CountHandler
+
+// Send a command and the usual aiding data to a TCP peer at a fixed tick rate, first with a write
+//  per packet and then with one batched write per tick
+static int BenchmarkBatch(int argc, char **argv)
+{
+    static const char *pRuns[2] = { "Unbatched", "Batched" };
+    UInt32 Ticks = 2000, RateHz = 1000, TickBytes = 0, Hash[2] = { 0, 0 }, i, j;
+    OrionPkt_t Pkts[4];
+    OrionCmd_t Cmd;
+    GpsData_t Gps;
+    int Result = 0, Run;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Ticks = strtoul(argv[0], NULL, 10);
+    if (argc >= 2) RateHz = strtoul(argv[1], NULL, 10);
+
+    if ((Ticks == 0) || (RateHz == 0))
+        return 1;
+
+    memset(&Cmd, 0, sizeof(Cmd));
+    memset(&Gps, 0, sizeof(Gps));
+
+    // Every tick sends a command along with GPS, external heading and range updates
+    encodeOrionCmdPacket(&Pkts[0], &Cmd);
+    encodeGpsDataPacketStructure(&Pkts[1], &Gps);
+    encodeOrionExtHeadingDataPacket(&Pkts[2], 0.0f, 0.01f, 0, 0, 0.0f);
+    encodeOrionRangeDataPacket(&Pkts[3], 100.0f, 10, RANGE_SRC_OTHER);
+    for (j = 0; j < 4; j++)
+        TickBytes += Pkts[j].Length + ORION_PKT_OVERHEAD;
+
+    printf("%u ticks at %u Hz, 4 packets (%u bytes) per tick\n", Ticks, RateHz, TickBytes);
+
+    for (Run = 0; Run < 2; Run++)
+    {
+        BatchBench_t Bench = { -1, 0, 2166136261u };
+        OrionCommTxStats_t Stats;
+        struct timespec Next;
+        OrionConn_t *pConn;
+        pthread_t Reader;
+        double Cpu;
+        int Client;
+
+        // Send over a real TCP connection so that the kernel's segment counts mean something
+        if (OpenTcpPair(&Client, &Bench.Handle) == FALSE)
+            return 1;
+
+        // The second run holds each tick's packets for up to one tick, though it flushes sooner
+        pConn = OrionConnOpenHandle(Client);
+        if ((Run == 1) && (OrionConnSetBatching(pConn, 1460, 1000000 / RateHz) == FALSE))
+            return 1;
+
+        pthread_create(&Reader, NULL, BatchReader, &Bench);
+        clock_gettime(CLOCK_MONOTONIC, &Next);
+        Cpu = -GetCpuTime();
+
+        for (i = 0; i < Ticks; i++)
+        {
+            // Send this tick's packets, then push them out (which does nothing without batching)
+            for (j = 0; j < 4; j++)
+                OrionConnSend(pConn, &Pkts[j]);
+            OrionConnFlush(pConn);
+
+            // Sleep until the next tick
+            Next.tv_nsec += 1000000000 / RateHz;
+            if (Next.tv_nsec >= 1000000000)
+            {
+                Next.tv_sec++;
+                Next.tv_nsec -= 1000000000;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Next, NULL);
+        }
+
+        // Closing the connection lets the reader know it's seen everything
+        OrionConnGetTxStats(pConn, &Stats, FALSE);
+        OrionConnClose(pConn);
+        pthread_join(Reader, NULL);
+        close(Bench.Handle);
+        Cpu += GetCpuTime();
+        Hash[Run] = Bench.Hash;
+
+        // Print out the results
+        printf("  %-9s %6u writes, %6u segments, %.1f packets and %.0f bytes per flush, %.1f us CPU per tick\n",
+               pRuns[Run], Stats.WriteCalls, Stats.Segments, (double)Stats.Packets / Stats.Flushes,
+               (double)Stats.Bytes / Stats.Flushes, Cpu / Ticks * 1e6);
+
+        // Everything sent had better have arrived
+        if ((Stats.Packets != Ticks * 4) || (Stats.Bytes != Ticks * TickBytes) || (Bench.Bytes != Stats.Bytes))
+        {
+            printf("MISMATCH: sent %u packets, %u bytes received\n", Stats.Packets, Bench.Bytes);
+            Result = 1;
+        }
+    }
+
+    // And it had better be the same both ways
+    if (Hash[0] != Hash[1])
+    {
+        printf("MISMATCH: batched stream differs\n");
+        Result = 1;
+    }
+
+    return Result;
+
+}// BenchmarkBatch
+
+// Connect a pair of TCP sockets to each other over the loopback interface
+static BOOL OpenTcpPair(int *pClient, int *pServer)
+{
+    struct sockaddr_in Address;
+    socklen_t Size = sizeof(Address);
+    int Listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    *pClient = *pServer = -1;
+
+    // Listen on any free loopback port
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((Listener < 0) || (bind(Listener, (struct sockaddr *)&Address, sizeof(Address)) != 0) ||
+        (listen(Listener, 1) != 0) || (getsockname(Listener, (struct sockaddr *)&Address, &Size) != 0))
+    {
+        close(Listener);
+        return FALSE;
+    }
+
+    // Connect to it, then pick up the other end
+    *pClient = socket(AF_INET, SOCK_STREAM, 0);
+    if ((*pClient >= 0) && (connect(*pClient, (struct sockaddr *)&Address, sizeof(Address)) == 0))
+        *pServer = accept(Listener, NULL, NULL);
+
+    close(Listener);
+    return *pServer >= 0;
+
+}// OpenTcpPair
+
+// Reader thread for the batching benchmark: hashes everything that arrives until the sender hangs up
+static void *BatchReader(void *pContext)
+{
+    BatchBench_t *pBench = (BatchBench_t *)pContext;
+    UInt8 Buffer[4096];
+    ssize_t Count, i;
+
+    while ((Count = read(pBench->Handle, Buffer, sizeof(Buffer))) > 0)
+    {
+        for (i = 0; i < Count; i++)
+            pBench->Hash = (pBench->Hash ^ Buffer[i]) * 16777619u;
+
+        pBench->Bytes += (UInt32)Count;
+    }
+
+    return NULL;
+
+}// BatchReader
+
+// Stream gimbal commands down a simulated serial link faster than it can carry them, writing
+//  each one straight to the link and then going through a latest-wins OrionSched
+static int BenchmarkSched(int argc, char **argv)
+{
+    static const char *pRuns[2] = { "Direct", "Latest wins" };
+    static SchedBench_t Bench;
+    UInt32 CommandHz = 2000, Baud = 115200, Sent;
+    double Duration = 3.0;
+    OrionPkt_t Pkt;
+    OrionCmd_t Cmd;
+    int Result = 0, Run;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Duration = atof(argv[0]);
+    if (argc >= 2) CommandHz = strtoul(argv[1], NULL, 10);
+    if (argc >= 3) Baud = strtoul(argv[2], NULL, 10);
+
+    // Room for every command we could possibly send
+    Bench.MaxAges = (UInt32)(Duration * CommandHz) + 1;
+    Bench.BytesPerSec = Baud / 10;
+    if ((CommandHz == 0) || (Bench.BytesPerSec == 0) || ((Bench.pAges = malloc(Bench.MaxAges * sizeof(double))) == NULL))
+        return 1;
+
+    // Commands all look the same except for a sequence number in place of the pan target
+    memset(&Cmd, 0, sizeof(Cmd));
+    encodeOrionCmdPacket(&Pkt, &Cmd);
+
+    printf("%.1f s of %u byte commands at %u Hz over %u baud (%u commands/s capacity)\n", Duration,
+           Pkt.Length + ORION_PKT_OVERHEAD, CommandHz, Baud, Bench.BytesPerSec / (Pkt.Length + ORION_PKT_OVERHEAD));
+
+    for (Run = 0; Run < 2; Run++)
+    {
+        OrionSched_t *pSched = NULL;
+        OrionSchedStats_t Stats;
+        OrionConn_t *pConn;
+        pthread_t Reader;
+        double Start, Now, NextTick;
+        char Path[64];
+
+        // The application opens one end of the pty as a serial port, and the "gimbal" reads the other
+        if (((Bench.Handle = OpenPty(Path, sizeof(Path))) < 0) || ((pConn = OrionConnOpenSerial(Path)) == NULL))
+            return 1;
+
+        if (Run == 1)
+            pSched = OrionSchedCreate(pConn, Baud, 64);
+
+        Bench.Ages = 0;
+        Bench.Stop = FALSE;
+        pthread_create(&Reader, NULL, PtyReader, &Bench);
+
+        Start = NextTick = GetTime();
+        Sent = 0;
+        while ((Now = GetTime()) - Start < Duration)
+        {
+            double WaitUs;
+
+            // Time for the joystick to send another command
+            if (Now >= NextTick)
+            {
+                UInt16 Sequence = (UInt16)Sent++;
+
+                memcpy(Pkt.Data, &Sequence, sizeof(Sequence));
+                MakeOrionPacket(&Pkt, ORION_PKT_CMD, Pkt.Length);
+                Bench.SendTime[Sequence] = Now;
+
+                if (pSched != NULL)
+                    OrionSchedSend(pSched, &Pkt);
+                else
+                    OrionConnSend(pConn, &Pkt);
+
+                NextTick += 1.0 / CommandHz;
+            }
+
+            // Sleep until the next command, or until the scheduler can send something
+            WaitUs = (NextTick - GetTime()) * 1e6;
+            if (pSched != NULL)
+            {
+                OrionSchedService(pSched);
+                if (OrionSchedGetWaitUs(pSched) < WaitUs)
+                    WaitUs = OrionSchedGetWaitUs(pSched);
+            }
+
+            if (WaitUs > 0)
+                SleepUs((UInt32)WaitUs);
+        }
+
+        // Stop reading, and tally up what the gimbal saw
+        Bench.Stop = TRUE;
+        pthread_join(Reader, NULL);
+        qsort(Bench.pAges, Bench.Ages, sizeof(double), CompareDoubles);
+
+        printf("  %-11s %5u sent, %5u arrived", pRuns[Run], Sent, Bench.Ages);
+        if (Bench.Ages > 0)
+        {
+            printf(", command age p50 %.1f ms, p99 %.1f ms, max %.1f ms", Bench.pAges[Bench.Ages / 2] * 1e3,
+                   Bench.pAges[(UInt32)(Bench.Ages * 0.99)] * 1e3, Bench.pAges[Bench.Ages - 1] * 1e3);
+        }
+        printf("\n");
+
+        // The scheduler's own view of things
+        if (pSched != NULL)
+        {
+            OrionSchedGetStats(pSched, &Stats, FALSE);
+            printf("              %u replaced before sending, worst wait in scheduler %.1f ms\n", Stats.Replaced, Stats.MaxLatencyUs * 1e-3);
+
+            // Commands must stay fresh: no more than a couple of packet times at the link rate
+            if ((Bench.Ages == 0) || (Bench.pAges[(UInt32)(Bench.Ages * 0.99)] > 0.010))
+                Result = 1;
+        }
+
+        OrionSchedDestroy(pSched);
+        OrionConnClose(pConn);
+        close(Bench.Handle);
+    }
+
+    free(Bench.pAges);
+    return Result;
+
+}// BenchmarkSched
+
+// Share a simulated serial link between a bulk user data transfer, pointing commands and GPS
+//  updates, first writing everything straight to the link and then going through an OrionSched
+static int BenchmarkPriority(int argc, char **argv)
+{
+    static const char *pRuns[2] = { "Direct", "Scheduled" };
+    static SchedBench_t Bench;
+    UInt32 Baud = 115200, Sent, Bound = 0;
+    double Duration = 5.0;
+    OrionPkt_t Cmd, Range, Gps, Bulk;
+    OrionUserData_t UserData;
+    GpsData_t GpsData;
+    OrionCmd_t Command;
+    int Result = 0, Run;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Duration = atof(argv[0]);
+    if (argc >= 2) Baud = strtoul(argv[1], NULL, 10);
+
+    // Room for every command we could possibly send
+    Bench.MaxAges = (UInt32)(Duration * 100) + 1;
+    Bench.BytesPerSec = Baud / 10;
+    if ((Bench.BytesPerSec == 0) || ((Bench.pAges = malloc(Bench.MaxAges * sizeof(double))) == NULL))
+        return 1;
+
+    // Commands at 100 Hz and range updates at 20 Hz are control traffic, GPS at 10 Hz is normal
+    //  traffic, and full-size user data packets sent as fast as possible are bulk traffic
+    memset(&Command, 0, sizeof(Command));
+    memset(&GpsData, 0, sizeof(GpsData));
+    memset(&UserData, 0, sizeof(UserData));
+    UserData.size = sizeof(UserData.data);
+    encodeOrionCmdPacket(&Cmd, &Command);
+    encodeOrionRangeDataPacket(&Range, 100.0f, 10, RANGE_SRC_OTHER);
+    encodeGpsDataPacketStructure(&Gps, &GpsData);
+    encodeOrionUserDataPacketStructure(&Bulk, &UserData);
+
+    printf("%.1f s over %u baud: 100 Hz commands, 20 Hz range, 10 Hz GPS and %u byte user data packets\n",
+           Duration, Baud, Bulk.Length + ORION_PKT_OVERHEAD);
+
+    for (Run = 0; Run < 2; Run++)
+    {
+        double Start, Now, NextCmd, NextRange, NextGps;
+        OrionSched_t *pSched = NULL;
+        OrionConn_t *pConn;
+        pthread_t Reader;
+        char Path[64];
+
+        // The application opens one end of the pty as a serial port, and the "gimbal" reads the other
+        if (((Bench.Handle = OpenPty(Path, sizeof(Path))) < 0) || ((pConn = OrionConnOpenSerial(Path)) == NULL))
+            return 1;
+
+        if (Run == 1)
+        {
+            pSched = OrionSchedCreate(pConn, Baud, 16);
+            Bound = OrionSchedGetLatencyBoundUs(pSched, Cmd.Length + ORION_PKT_OVERHEAD);
+        }
+
+        Bench.Ages = 0;
+        Bench.Stop = FALSE;
+        memset(Bench.IdBytes, 0, sizeof(Bench.IdBytes));
+        pthread_create(&Reader, NULL, PtyReader, &Bench);
+
+        Start = NextCmd = NextRange = NextGps = GetTime();
+        Sent = 0;
+        while ((Now = GetTime()) - Start < Duration)
+        {
+            OrionSchedStats_t Stats;
+            double WaitUs = 1000;
+
+            // Time for another command?
+            if (Now >= NextCmd)
+            {
+                UInt16 Sequence = (UInt16)Sent++;
+
+                memcpy(Cmd.Data, &Sequence, sizeof(Sequence));
+                MakeOrionPacket(&Cmd, ORION_PKT_CMD, Cmd.Length);
+                Bench.SendTime[Sequence] = Now;
+                (pSched != NULL) ? OrionSchedSend(pSched, &Cmd) : OrionConnSend(pConn, &Cmd);
+                NextCmd += 0.01;
+            }
+
+            // Range and GPS updates
+            if (Now >= NextRange)
+            {
+                (pSched != NULL) ? OrionSchedSend(pSched, &Range) : OrionConnSend(pConn, &Range);
+                NextRange += 0.05;
+            }
+            if (Now >= NextGps)
+            {
+                (pSched != NULL) ? OrionSchedSend(pSched, &Gps) : OrionConnSend(pConn, &Gps);
+                NextGps += 0.1;
+            }
+
+            // Keep the bulk transfer going flat out: straight into the driver until it's full, or
+            //  into the scheduler's bulk queue
+            if (pSched == NULL)
+                while (OrionConnSend(pConn, &Bulk));
+            else
+            {
+                OrionSchedGetClassStats(pSched, ORION_SCHED_BULK, &Stats, FALSE);
+                while ((Stats.Depth++ < 8) && OrionSchedSend(pSched, &Bulk));
+
+                // Wake up when the scheduler can send something, if that's soon
+                OrionSchedService(pSched);
+                if (OrionSchedGetWaitUs(pSched) < WaitUs)
+                    WaitUs = OrionSchedGetWaitUs(pSched);
+            }
+
+            // Don't sleep past the next command
+            if ((NextCmd - GetTime()) * 1e6 < WaitUs)
+                WaitUs = (NextCmd - GetTime()) * 1e6;
+            if (WaitUs > 0)
+                SleepUs((UInt32)WaitUs);
+        }
+
+        // Stop reading, and tally up what the gimbal saw
+        Bench.Stop = TRUE;
+        pthread_join(Reader, NULL);
+        qsort(Bench.pAges, Bench.Ages, sizeof(double), CompareDoubles);
+
+        printf("  %-9s %4u/%u commands arrived", pRuns[Run], Bench.Ages, Sent);
+        if (Bench.Ages > 0)
+        {
+            printf(", age p50 %.1f ms, p99 %.1f ms, max %.1f ms", Bench.pAges[Bench.Ages / 2] * 1e3,
+                   Bench.pAges[(UInt32)(Bench.Ages * 0.99)] * 1e3, Bench.pAges[Bench.Ages - 1] * 1e3);
+        }
+        printf("\n            control %.0f B/s, GPS %.0f B/s, bulk %.0f B/s (%.0f%% of the link in use)\n",
+               (Bench.IdBytes[ORION_PKT_CMD] + Bench.IdBytes[ORION_PKT_RANGE_DATA]) / Duration,
+               Bench.IdBytes[ORION_PKT_GPS_DATA] / Duration, Bench.IdBytes[ORION_PKT_USER_DATA] / Duration,
+               100.0 * (Bench.IdBytes[ORION_PKT_CMD] + Bench.IdBytes[ORION_PKT_RANGE_DATA] + Bench.IdBytes[ORION_PKT_GPS_DATA] +
+                        Bench.IdBytes[ORION_PKT_USER_DATA]) / Duration / Bench.BytesPerSec);
+
+        // Commands have to stay inside the bound, give or take the reader's millisecond polling. The
+        //  odd command can still be held up by the host not running one thread or the other in time,
+        //  so it's the 99th percentile that's held to it.
+        if (pSched != NULL)
+        {
+            OrionSchedStats_t Stats;
+
+            OrionSchedGetClassStats(pSched, ORION_SCHED_CONTROL, &Stats, FALSE);
+            printf("            latency bound for commands %.1f ms, worst wait in scheduler %.1f ms\n",
+                   Bound * 1e-3, Stats.MaxLatencyUs * 1e-3);
+            if ((Bench.Ages == 0) || (Bench.pAges[(UInt32)(Bench.Ages * 0.99)] > Bound * 1e-6 + 0.002))
+                Result = 1;
+        }
+
+        OrionSchedDestroy(pSched);
+        OrionConnClose(pConn);
+        close(Bench.Handle);
+    }
+
+    free(Bench.pAges);
+    return Result;
+
+}// BenchmarkPriority
+
+// Stream data through a byte pipe to the simulator and back with a range of window sizes
+static int BenchmarkPipe(int argc, char **argv)
+{
+    static const UInt32 Windows[] = { 1, 8, 64 };
+    const char *pAddress = "127.0.0.1";
+    UInt32 Size = 2048 * 1024, i;
+    UInt8 *pSource, *pSink;
+    OrionConn_t *pConn;
+    int Result = 0, w;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) pAddress = argv[0];
+    if (argc >= 2) Size = (UInt32)atoi(argv[1]) * 1024;
+
+    // The simulator echoes user data back, so one pipe ends up talking to itself
+    if ((pConn = OrionConnOpenNetworkIp(pAddress)) == NULL)
+    {
+        printf("No simulator at %s; start ../Simulator/Simulator first\n", pAddress);
+        return 1;
+    }
+
+    // Make up some data that's easy to spot if it comes back out of order
+    pSource = (UInt8 *)malloc(Size);
+    pSink = (UInt8 *)malloc(Size);
+    if ((pSource == NULL) || (pSink == NULL))
+        return 1;
+
+    for (i = 0; i < Size; i++)
+        pSource[i] = (UInt8)((i * 2654435761u) >> 24);
+
+    printf("%u KB through the simulator at %s\n", Size / 1024, pAddress);
+
+    for (w = 0; w < (int)(sizeof(Windows) / sizeof(Windows[0])); w++)
+    {
+        OrionPipe_t *pPipe = OrionPipeCreate(pConn, USER_DATA_PORT_PRIMARY, Windows[w]);
+        UInt32 Written = 0, Read = 0;
+        OrionPipeStats_t Stats;
+        double Start, Elapsed;
+        OrionPkt_t Pkt;
+
+        if (pPipe == NULL)
+            return 1;
+
+        // Keep the pipe full and drain whatever comes back until every byte has been read and
+        //  acknowledged, giving up if that takes unreasonably long
+        Start = GetTime();
+        memset(pSink, 0, Size);
+        while (((Read < Size) || (OrionPipeGetPending(pPipe) > 0)) && (GetTime() - Start < 10.0 + Size * 1e-5))
+        {
+            UInt32 WaitUs = OrionPipeGetWaitUs(pPipe);
+
+            if (Written < Size)
+                Written += OrionPipeWrite(pPipe, &pSource[Written], Size - Written);
+
+            // Wait for a packet, but no longer than the pipe can go without servicing, then hand
+            //  over everything that's come in; the simulator's telemetry gets ignored
+            if (WaitUs > 10000)
+                WaitUs = 10000;
+            if (OrionConnReceiveTimeout(pConn, &Pkt, WaitUs))
+            {
+                do
+                {
+                    OrionPipeProcess(pPipe, &Pkt);
+                } while (OrionConnReceive(pConn, &Pkt));
+            }
+
+            Read += OrionPipeRead(pPipe, &pSink[Read], Size - Read);
+            OrionPipeService(pPipe);
+        }
+        Elapsed = GetTime() - Start;
+
+        // Print out the results
+        OrionPipeGetStats(pPipe, &Stats, FALSE);
+        printf("  Window %2u: %.3f s, %.0f KB/s, %u packets sent, %u retransmitted, %u duplicates, RTT %.2f ms\n",
+               Windows[w], Elapsed, Read / 1024.0 / Elapsed, Stats.Sent, Stats.Retransmits, Stats.Duplicates, Stats.RttUs * 1e-3);
+
+        // Every byte has to come back, in order
+        if ((Read != Size) || (memcmp(pSource, pSink, Size) != 0))
+        {
+            printf("  Data came back wrong: %u of %u bytes\n", Read, Size);
+            Result = 1;
+        }
+
+        // Let any stray retransmissions die away so they can't confuse the next pipe
+        OrionPipeDestroy(pPipe);
+        while (OrionConnReceiveTimeout(pConn, &Pkt, 100000));
+    }
+
+    free(pSource);
+    free(pSink);
+    OrionConnClose(pConn);
+    return Result;
+
+}// BenchmarkPipe
+
+// Query simulated gimbals one request at a time, waiting on each reply, then keep hundreds of
+//  requests in flight at once over several connections with the request engine
+static int BenchmarkRequests(int argc, char **argv)
+{
+    RequestBench_t Bench = { NULL, 50000, 4000 };
+    UInt32 Depth = 32, Sequential, MatchSize, i;
+    OrionRequest_t *pReleased, *pCancelled;
+    OrionRequesterStats_t Stats;
+    OrionPkt_t Pkt;
+    ConfigBench_t *pGimbals;
+    pthread_t *pResponders;
+    OrionConn_t **pConns;
+    OrionEventLoop_t *pLoop;
+    double Latency = 0.005, Start, Elapsed;
+    int Connections = 8, Result = 0, c;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Connections = atoi(argv[0]);
+    if (argc >= 2) Bench.Total = (UInt32)atoi(argv[1]);
+    if (argc >= 3) Latency = atof(argv[2]) * 1e-3;
+
+    // The sequential run takes a full round trip per request, so it only does a few. Requests
+    //  are given up on after ten times the usual wait, with a 50 ms minimum.
+    Sequential = (Bench.Total + 19) / 20;
+    if (Latency * 1e7 > Bench.TimeoutUs)
+        Bench.TimeoutUs = (UInt32)(Latency * 1e7);
+
+    // Room for every connection, every simulated gimbal and every latency sample
+    pConns = (OrionConn_t **)calloc(Connections, sizeof(OrionConn_t *));
+    pGimbals = (ConfigBench_t *)calloc(Connections, sizeof(ConfigBench_t));
+    pResponders = (pthread_t *)calloc(Connections, sizeof(pthread_t));
+    Bench.pLatency = (double *)malloc(Bench.Total * sizeof(double));
+    Bench.pReq = OrionRequesterCreate(Connections * Depth);
+    pLoop = OrionEventLoopCreate();
+    if ((Connections <= 0) || (pConns == NULL) || (pGimbals == NULL) || (pResponders == NULL) ||
+        (Bench.pLatency == NULL) || (Bench.pReq == NULL) || (pLoop == NULL))
+        return 1;
+
+    // Each connection is a socket pair with a gimbal on the far end that echoes every packet after
+    //  the response latency, and loses one in a hundred
+    for (c = 0; c < Connections; c++)
+    {
+        int Pair[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+            return 1;
+
+        pGimbals[c].Handle = Pair[1];
+        pGimbals[c].Latency = Latency;
+        pGimbals[c].DropPercent = 1;
+        pthread_create(&pResponders[c], NULL, ConfigResponder, &pGimbals[c]);
+
+        pConns[c] = OrionConnOpenHandle(Pair[0]);
+        OrionEventLoopAddConn(pLoop, pConns[c]);
+    }
+
+    printf("%u requests, %.1f ms response latency, 1%% of requests lost\n", Bench.Total, Latency * 1e3);
+
+    // First the old way: send a query and wait for its answer before sending the next
+    Start = GetTime();
+    for (i = 0; i < Sequential; i++)
+    {
+        OrionPkt_t Request, Reply;
+        UInt32 MatchSize;
+
+        MakeRequest(&Request, i, &MatchSize);
+        OrionConnSend(pConns[0], &Request);
+        OrionConnWaitFor(pConns[0], &Reply, Request.ID, Bench.TimeoutUs);
+    }
+    Elapsed = GetTime() - Start;
+    printf("  Sequential, 1 connection: %u requests in %.3f s, %.0f requests/s\n", Sequential, Elapsed, Sequential / Elapsed);
+
+    // Then the new way: start a full window of requests on every connection, then send another
+    //  each time one finishes until they've all gone
+    OrionEventLoopSetDefaultHandler(pLoop, OrionRequesterHandler, Bench.pReq);
+    OrionEventLoopAddTimer(pLoop, 1000, OrionRequesterTimer, Bench.pReq);
+    OrionRequesterGetStats(Bench.pReq, &Stats, TRUE);
+    Start = GetTime();
+    for (c = 0; c < Connections; c++)
+    {
+        for (i = 0; i < Depth; i++)
+            SendRequest(&Bench, pConns[c]);
+    }
+
+    // Run the loop until every request has been answered or given up on
+    while ((Bench.Answered + Bench.TimedOut < Bench.Total) && (GetTime() - Start < 10.0 + Bench.Total * 1e-3))
+        OrionEventLoopRunOnce(pLoop, 10);
+    Elapsed = GetTime() - Start;
+
+    // Print out the results
+    OrionRequesterGetStats(Bench.pReq, &Stats, FALSE);
+    qsort(Bench.pLatency, Bench.Answered, sizeof(double), CompareDoubles);
+    printf("  Concurrent, %d connections: %u requests in %.3f s, %.0f requests/s, %u in flight at most\n",
+           Connections, Stats.Sent, Elapsed, Stats.Sent / Elapsed, Stats.MaxInFlight);
+    if (Bench.Answered > 0)
+    {
+        printf("    Round trip: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               Bench.pLatency[Bench.Answered / 2] * 1e3,
+               Bench.pLatency[(UInt32)(Bench.Answered * 0.99)] * 1e3,
+               Bench.pLatency[Bench.Answered - 1] * 1e3);
+    }
+    printf("    %u answered, %u timed out, %u wrong answers\n", Bench.Answered, Bench.TimedOut, Bench.Wrong);
+
+    // Every request has to be accounted for, and every answer has to fit its request
+    if ((Stats.Sent != Bench.Total) || (Bench.Answered + Bench.TimedOut != Bench.Total) || (Bench.Wrong > 0))
+        Result = 1;
+
+    // A request that's released while pending is gone for good, so cancelling its connection
+    //  afterward should only find the one still waiting there
+    MakeRequest(&Pkt, Bench.Total, &MatchSize);
+    pReleased = OrionRequestSend(Bench.pReq, pConns[0], &Pkt, Pkt.ID, MatchSize, Bench.TimeoutUs, NULL, NULL);
+    pCancelled = OrionRequestSend(Bench.pReq, pConns[0], &Pkt, Pkt.ID, MatchSize, Bench.TimeoutUs, NULL, NULL);
+    OrionRequestRelease(pReleased);
+    c = OrionRequesterCancelConn(Bench.pReq, pConns[0]);
+    OrionRequesterGetStats(Bench.pReq, &Stats, FALSE);
+    printf("    Release then cancel: %d of 1 cancelled, %u in flight afterward\n", c, Stats.InFlight);
+    if ((pReleased == NULL) || (pCancelled == NULL) || (c != 1) || (Stats.InFlight != 0) ||
+        (OrionRequestGetState(pCancelled) != ORION_REQUEST_CANCELLED))
+        Result = 1;
+
+    OrionRequestRelease(pCancelled);
+
+    // Clean up
+    for (c = 0; c < Connections; c++)
+    {
+        pGimbals[c].Stop = TRUE;
+        pthread_join(pResponders[c], NULL);
+        OrionEventLoopRemoveConn(pLoop, pConns[c]);
+        OrionConnClose(pConns[c]);
+    }
+
+    OrionEventLoopDestroy(pLoop);
+    OrionRequesterDestroy(Bench.pReq);
+    free(Bench.pLatency);
+    free(pResponders);
+    free(pGimbals);
+    free(pConns);
+    return Result;
+
+}// BenchmarkRequests
+
+// Make the request with a given sequence number for the request benchmark. Most are user data
+//  packets keyed on the sequence number in their first four bytes, so that replies have to be
+//  told apart by payload; one in eight is an empty version query, matched on its ID alone.
+static void MakeRequest(OrionPkt_t *pPkt, UInt32 Sequence, UInt32 *pMatchSize)
+{
+    if (Sequence % 8 == 7)
+    {
+        MakeOrionPacket(pPkt, ORION_PKT_CROWN_VERSION, 0);
+        *pMatchSize = 0;
+    }
+    else
+    {
+        memcpy(pPkt->Data, &Sequence, sizeof(Sequence));
+        memset(&pPkt->Data[sizeof(Sequence)], (UInt8)Sequence, 28);
+        MakeOrionPacket(pPkt, ORION_PKT_USER_DATA, sizeof(Sequence) + 28);
+        *pMatchSize = sizeof(Sequence);
+    }
+
+}// MakeRequest
+
+// Send the next request in the request benchmark on a connection, if there are any left
+static BOOL SendRequest(RequestBench_t *pBench, OrionConn_t *pConn)
+{
+    UInt32 MatchSize;
+    OrionPkt_t Pkt;
+
+    // Nothing more to do once they've all gone out
+    if (pBench->Next >= pBench->Total)
+        return FALSE;
+
+    MakeRequest(&Pkt, pBench->Next, &MatchSize);
+    if (OrionRequestSend(pBench->pReq, pConn, &Pkt, Pkt.ID, MatchSize, pBench->TimeoutUs, RequestDone, pBench) == NULL)
+        return FALSE;
+
+    pBench->Next++;
+    return TRUE;
+
+}// SendRequest
+
+// Request handler for the request benchmark: tallies up the result and sends the next request
+static void RequestDone(OrionRequest_t *pRequest, const OrionPkt_t *pReply, void *pContext)
+{
+    RequestBench_t *pBench = (RequestBench_t *)pContext;
+
+    // Answered requests get timed, and their replies checked against the request they answer
+    if (pReply != NULL)
+    {
+        OrionPkt_t Expected;
+        UInt32 Sequence, MatchSize;
+
+        memcpy(&Sequence, pReply->Data, sizeof(Sequence));
+        MakeRequest(&Expected, (pReply->ID == ORION_PKT_CROWN_VERSION) ? 7 : Sequence, &MatchSize);
+        if ((pReply->ID != Expected.ID) || (pReply->Length != Expected.Length) || (memcmp(pReply->Data, Expected.Data, Expected.Length) != 0))
+            pBench->Wrong++;
+
+        pBench->pLatency[pBench->Answered++] = OrionRequestGetLatencyUs(pRequest) * 1e-6;
+    }
+    else if (OrionRequestGetState(pRequest) == ORION_REQUEST_TIMED_OUT)
+        pBench->TimedOut++;
+
+    // Keep the connection busy
+    SendRequest(pBench, OrionRequestGetConn(pRequest));
+
+}// RequestDone
+
+// Knock a supervised connection down in several different ways and time how long it takes to
+//  notice, how long the outage lasts, and whether the sticky state makes it back
+static int BenchmarkReconnect(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *pName;
+        int Action;
+    } Faults[] = {
+        { "Gimbal hangs up", RECONNECT_HANG_UP },
+        { "Gimbal goes silent", RECONNECT_GO_SILENT },
+        { "Gimbal goes down", RECONNECT_GO_DOWN },
+    };
+    ReconnectBench_t Bench = { TCP_PORT + 100, RECONNECT_NONE, 1000 };
+    OrionSuperviseOptions_t Options;
+    OrionSuperviseStats_t Stats;
+    OrionPkt_t Video, Ins;
+    OrionConn_t *pConn;
+    pthread_t Gimbal;
+    int Result = 0, Files, f;
+    double Start, Cpu;
+
+    // Pull the optional arguments off the command line
+    OrionSuperviseDefaultOptions(&Options);
+    Options.Port = Bench.Port;
+    if (argc >= 1) Options.SilenceUs = (UInt32)atoi(argv[0]) * 1000;
+    if (argc >= 2) Bench.DownMs = (UInt32)atoi(argv[1]);
+
+    // Start the gimbal up and connect to it
+    pthread_create(&Gimbal, NULL, ReconnectGimbal, &Bench);
+    SleepUs(10000);
+    if ((pConn = OrionConnOpenSupervised("127.0.0.1", &Options)) == NULL)
+        return 1;
+
+    // Video and INS settings have to survive reconnecting
+    memset(Video.Data, 0, 32);
+    memset(Ins.Data, 0, 8);
+    MakeOrionPacket(&Video, ORION_PKT_NETWORK_VIDEO, 32);
+    MakeOrionPacket(&Ins, ORION_PKT_INS_OPTIONS, 8);
+    OrionSuperviseSetHandler(pConn, ReconnectHandler, &Bench);
+    OrionSuperviseSetSticky(pConn, &Video);
+    OrionSuperviseSetSticky(pConn, &Ins);
+
+    printf("%.0f ms silence watchdog, gimbal down for %u ms\n", Options.SilenceUs * 1e-3, Bench.DownMs);
+
+    // The handler sends whenever the link changes, which mustn't start a connection attempt of
+    //  its own, so the same files should be open once it's all over. Give the gimbal time to
+    //  pick up the connection first.
+    SleepUs(100000);
+    Files = CountOpenFiles();
+
+    for (f = 0; f < (int)(sizeof(Faults) / sizeof(Faults[0])); f++)
+    {
+        UInt32 Accepts = Bench.Accepts, Packets = 0;
+        double Blocked = 0;
+        OrionPkt_t Pkt;
+
+        // Let the link settle, then break it
+        SleepUs(100000);
+        while (OrionConnReceive(pConn, &Pkt));
+        Bench.DownTime = Bench.UpTime = 0;
+        Start = GetTime();
+        Bench.Action = Faults[f].Action;
+
+        // Keep receiving the way any application would until the link is back and the gimbal
+        //  has had its settings again, noting the longest any call took to return
+        while (((Bench.Accepts == Accepts) || (Bench.StickyRx < 2) || (Bench.UpTime == 0)) && (GetTime() - Start < 10.0))
+        {
+            double Call = GetTime();
+
+            if (OrionConnReceiveTimeout(pConn, &Pkt, 10000))
+                Packets++;
+
+            if (GetTime() - Call > Blocked)
+                Blocked = GetTime() - Call;
+        }
+
+        // Print out the results
+        if (Bench.UpTime == 0)
+        {
+            printf("  %s: never reconnected\n", Faults[f].pName);
+            Result = 1;
+            continue;
+        }
+
+        printf("  %s: noticed after %.1f ms, back after %.1f ms (outage %.1f ms), %u sticky packets resent, receive blocked at most %.1f ms\n",
+               Faults[f].pName, (Bench.DownTime - Start) * 1e3, (Bench.UpTime - Start) * 1e3, Bench.OutageUs * 1e-3, Bench.StickyRx, Blocked * 1e3);
+
+        // No call should ever have waited much past its own timeout
+        if ((Bench.StickyRx != 2) || (Blocked > 0.05))
+            Result = 1;
+    }
+
+    // Once it's all back to normal, waiting for data should be just that, rather than spinning
+    //  on a socket left over from a stray connection attempt
+    Start = GetTime();
+    Cpu = -GetCpuTime();
+    while (GetTime() - Start < 0.5)
+    {
+        OrionPkt_t Pkt;
+
+        OrionConnReceiveTimeout(pConn, &Pkt, 10000);
+    }
+    Cpu += GetCpuTime();
+
+    // Sum it all up
+    OrionSuperviseGetStats(pConn, &Stats, FALSE);
+    printf("  %u outages, %u reconnects from %u attempts, %.1f ms out in total, longest %.1f ms\n",
+           Stats.Outages, Stats.Reconnects, Stats.Attempts, Stats.TotalOutageUs * 1e-3, Stats.LongestOutageUs * 1e-3);
+    printf("  %d files opened and left open, %.1f%% CPU while receiving afterward\n", CountOpenFiles() - Files, 100.0 * Cpu / 0.5);
+    if ((CountOpenFiles() != Files) || (Cpu > 0.1))
+        Result = 1;
+
+    // Clean up
+    OrionConnClose(pConn);
+    Bench.Stop = TRUE;
+    pthread_join(Gimbal, NULL);
+    return Result;
+
+}// BenchmarkReconnect
+
+// Simulated gimbal thread for the reconnect benchmark: serves one client at a time, streaming
+//  telemetry at 50 Hz, and hangs up, goes quiet or shuts down altogether when told to
+static void *ReconnectGimbal(void *pContext)
+{
+    ReconnectBench_t *pBench = (ReconnectBench_t *)pContext;
+    int Listener = OpenListener(pBench->Port), Handle;
+    double Reopen = 0, NextTelemetry = 0;
+    OrionConn_t *pClient = NULL;
+    BOOL Silent = FALSE;
+    OrionPkt_t Pkt;
+
+    while (pBench->Stop == FALSE)
+    {
+        double Now = GetTime();
+
+        // Do whatever the benchmark asked for
+        switch (pBench->Action)
+        {
+        case RECONNECT_HANG_UP:
+            OrionConnClose(pClient);
+            pClient = NULL;
+            break;
+
+        case RECONNECT_GO_SILENT:
+            Silent = TRUE;
+            break;
+
+        case RECONNECT_GO_DOWN:
+            OrionConnClose(pClient);
+            pClient = NULL;
+            close(Listener);
+            Listener = -1;
+            Reopen = Now + pBench->DownMs * 1e-3;
+            break;
+        }
+        pBench->Action = RECONNECT_NONE;
+
+        // Come back up after being down for a while
+        if ((Listener < 0) && (Now >= Reopen))
+            Listener = OpenListener(pBench->Port);
+
+        // A new client replaces the old one, and starts out with no sticky packets
+        if ((Listener >= 0) && ((Handle = accept(Listener, NULL, NULL)) >= 0))
+        {
+            OrionConnClose(pClient);
+            pClient = OrionConnOpenHandle(Handle);
+            Silent = FALSE;
+            pBench->StickyRx = 0;
+            pBench->Accepts++;
+        }
+
+        if (pClient != NULL)
+        {
+            // Stream telemetry unless we've gone quiet
+            if (!Silent && (Now >= NextTelemetry))
+            {
+                memset(Pkt.Data, 0, 80);
+                MakeOrionPacket(&Pkt, ORION_PKT_GEOLOCATE_TELEMETRY, 80);
+                OrionConnSend(pClient, &Pkt);
+                NextTelemetry = Now + 0.02;
+            }
+
+            // Count the settings the client restores
+            while (OrionConnReceive(pClient, &Pkt))
+            {
+                if ((Pkt.ID == ORION_PKT_NETWORK_VIDEO) || (Pkt.ID == ORION_PKT_INS_OPTIONS))
+                    pBench->StickyRx++;
+            }
+
+            // Let go of clients that hang up on us
+            if (!OrionConnIsOpen(pClient))
+            {
+                OrionConnClose(pClient);
+                pClient = NULL;
+            }
+        }
+
+        SleepUs(1000);
+    }
+
+    OrionConnClose(pClient);
+    if (Listener >= 0)
+        close(Listener);
+
+    return NULL;
+
+}// ReconnectGimbal
+
+// Open a non-blocking TCP listening socket on the loopback interface
+static int OpenListener(UInt16 Port)
+{
+    struct sockaddr_in Address;
+    int Handle = socket(AF_INET, SOCK_STREAM, 0), On = 1;
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Address.sin_port = htons(Port);
+
+    // Reuse the port straight away after going down
+    setsockopt(Handle, SOL_SOCKET, SO_REUSEADDR, &On, sizeof(On));
+    if ((bind(Handle, (struct sockaddr *)&Address, sizeof(Address)) != 0) || (listen(Handle, 4) != 0))
+    {
+        close(Handle);
+        return -1;
+    }
+
+    fcntl(Handle, F_SETFL, fcntl(Handle, F_GETFL) | O_NONBLOCK);
+    return Handle;
+
+}// OpenListener
+
+// Count the files this process has open
+static int CountOpenFiles(void)
+{
+    DIR *pDir = opendir("/proc/self/fd");
+    int Count = 0;
+
+    if (pDir == NULL)
+        return -1;
+
+    while (readdir(pDir) != NULL)
+        Count++;
+
+    closedir(pDir);
+    return Count;
+
+}// CountOpenFiles
+
+// Supervision handler for the reconnect benchmark: notes when the link went down and came back
+static void ReconnectHandler(OrionConn_t *pConn, BOOL Up, UInt32 OutageUs, void *pContext)
+{
+    ReconnectBench_t *pBench = (ReconnectBench_t *)pContext;
+    OrionPkt_t Pkt;
+
+    if (Up)
+    {
+        pBench->UpTime = GetTime();
+        pBench->OutageUs = OutageUs;
+    }
+    else
+        pBench->DownTime = GetTime();
+
+    // Applications often tell the gimbal something when the link changes, which fails while it's
+    //  down but mustn't upset the reconnection
+    MakeOrionPacket(&Pkt, ORION_PKT_CROWN_VERSION, 0);
+    OrionConnSend(pConn, &Pkt);
+
+}// ReconnectHandler
+
+// Check the link statistics against a stream with known faults in it, measure what they cost,
+//  then use them to tell a pause on the link apart from a stall in the application
+static int BenchmarkStats(int argc, char **argv)
+{
+    static const UInt32 Chunks[] = { 0, 1460, 7, 1 };
+    UInt32 Length = 4 * 1024 * 1024, Good, Received, c, i;
+    TrilliumParseStats_t Expected;
+    OrionLinkStats_t Link;
+    OrionIdStats_t Telemetry;
+    StatsBench_t Bench = { -1, NULL, 0, 3.0 };
+    double OffTime = 1e9, OnTime = 1e9, Start, Stalled = 0;
+    OrionPktView_t View;
+    OrionConn_t *pConn;
+    pthread_t Writer;
+    UInt8 *pStream;
+    int Result = 0, Pair[2];
+
+    // Pull the optional argument off the command line
+    if (argc >= 1) Bench.Seconds = atof(argv[0]);
+
+    // Make up a stream with a known number of junk bytes, bad checksums and bad lengths in it
+    if ((pStream = MakeFaultyStream(Length, &Good, &Expected)) == NULL)
+        return 1;
+
+    printf("%u bytes, %u good packets, %u junk bytes, %u bad checksums, %u bad lengths\n",
+           Length, Good, Expected.Discarded, Expected.ChecksumFailures, Expected.OversizeRejects);
+
+    // The parser's counts shouldn't depend on how the stream is split up
+    for (c = 0; c < sizeof(Chunks) / sizeof(Chunks[0]); c++)
+    {
+        UInt32 Chunk = (Chunks[c] == 0) ? Length : Chunks[c];
+        TrilliumParseStats_t Parse = { 0, 0, 0 };
+        PacketTally_t Tally = { 0, 2166136261u };
+        OrionPkt_t Pkt;
+
+        memset(&Pkt, 0, sizeof(Pkt));
+        for (i = 0; i < Length; i += Chunk)
+            LookForOrionPacketsInBufferEx(&Pkt, &pStream[i], (Length - i < Chunk) ? Length - i : Chunk, TallyCallback, &Tally, &Parse);
+
+        printf("  Parser, %7u byte reads: %u packets, %u discarded, %u checksum failures, %u oversize\n",
+               Chunk, Tally.Count, Parse.Discarded, Parse.ChecksumFailures, Parse.OversizeRejects);
+
+        if ((Tally.Count != Good) || (memcmp(&Parse, &Expected, sizeof(Parse)) != 0))
+            Result = 1;
+    }
+
+    // Now through a connection, with the statistics off and on, taking the best of three runs
+    for (i = 0; i < 3; i++)
+    {
+        double Time;
+
+        if ((Time = DrainStats(pStream, Length, FALSE, &Received, NULL)) < OffTime)
+            OffTime = Time;
+
+        if (Received != Good)
+            Result = 1;
+
+        if ((Time = DrainStats(pStream, Length, TRUE, &Received, &Link)) < OnTime)
+            OnTime = Time;
+
+        if ((Received != Good) || (Link.RxPackets != Good) || (Link.RxBytes != Length) ||
+            (Link.Discarded != Expected.Discarded) || (Link.ChecksumFailures != Expected.ChecksumFailures) || (Link.OversizeRejects != Expected.OversizeRejects))
+            Result = 1;
+    }
+
+    printf("  Connection, stats off: %6.1f ns/packet\n", OffTime / Good * 1e9);
+    printf("  Connection, stats on:  %6.1f ns/packet (+%.1f ns), %u packets, %u discarded, %u checksum failures, %u oversize\n",
+           OnTime / Good * 1e9, (OnTime - OffTime) / Good * 1e9, Link.RxPackets, Link.Discarded, Link.ChecksumFailures, Link.OversizeRejects);
+
+    free(pStream);
+
+    // Then a steady telemetry stream, which pauses once a third of the way through
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+        return 1;
+
+    pConn = OrionConnOpenHandle(Pair[0]);
+    OrionConnEnableStats(pConn, TRUE);
+    Bench.Handle = Pair[1];
+    pthread_create(&Writer, NULL, StatsTelemetryWriter, &Bench);
+    Start = GetTime();
+
+    // Read it like a busy application would, which stalls once two thirds of the way through
+    while (OrionConnReceiveViewTimeout(pConn, &View, 500000))
+    {
+        double Spin = GetTime();
+
+        while (GetTime() - Spin < 50e-6);
+
+        if ((Stalled == 0) && (GetTime() - Start > Bench.Seconds * 2 / 3))
+        {
+            Stalled = GetTime();
+            SleepUs(200000);
+        }
+    }
+
+    pthread_join(Writer, NULL);
+    OrionConnGetLinkStats(pConn, &Link, FALSE);
+    OrionConnGetIdStats(pConn, ORION_PKT_GEOLOCATE_TELEMETRY, &Telemetry);
+
+    // Both the pause and the stall stand out as gaps between arrivals, but only the stall leaves
+    //  a backlog behind it: one big read, then a burst of packets arriving all at once
+    printf("  Telemetry: %u of %u packets, interval mean %.2f ms, jitter %.2f ms, p1 %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.1f ms\n",
+           Telemetry.RxPackets, Bench.Sent, Telemetry.MeanIntervalUs * 1e-3, Telemetry.JitterUs * 1e-3,
+           OrionHistogramGetPercentile(&Telemetry.Intervals, 1) * 1e-3, OrionHistogramGetPercentile(&Telemetry.Intervals, 50) * 1e-3,
+           OrionHistogramGetPercentile(&Telemetry.Intervals, 99) * 1e-3, Telemetry.MaxGapUs * 1e-3);
+    printf("  Reads: %u bytes p50, %u bytes max; dispatch delay %u us p50, %u us p99, %u us max\n",
+           OrionHistogramGetPercentile(&Link.ReadSizes, 50), Link.ReadSizes.Max,
+           OrionHistogramGetPercentile(&Link.DispatchDelays, 50), OrionHistogramGetPercentile(&Link.DispatchDelays, 99), Link.DispatchDelays.Max);
+
+    // Everything should have arrived, the gaps should show, and so should the stall's backlog
+    if ((Telemetry.RxPackets != Bench.Sent) || (Telemetry.MaxGapUs < 150000) || (Link.ReadSizes.Max < 10 * 68))
+        Result = 1;
+
+    // Clean up
+    OrionConnClose(pConn);
+    close(Pair[1]);
+    return Result;
+
+}// BenchmarkStats
+
+// Build a stream of good packets broken up by runs of junk, packets with bad checksums and
+//  headers with bad lengths, keeping track of what the parser ought to make of it
+static UInt8 *MakeFaultyStream(UInt32 Length, UInt32 *pGood, TrilliumParseStats_t *pExpected)
+{
+    UInt8 *pStream = malloc(Length);
+    UInt32 i = 0, j;
+
+    // Make sure the allocation worked
+    if (pStream == NULL)
+        return NULL;
+
+    // Make the stream repeatable
+    srand(2);
+    memset(pExpected, 0, sizeof(TrilliumParseStats_t));
+    *pGood = 0;
+
+    while (i < Length)
+    {
+        OrionPkt_t Pkt;
+        UInt32 Size;
+        int Type = rand() % 16;
+
+        // Junk never includes the first sync byte, so every byte of it gets thrown away
+        if (Type == 0)
+        {
+            for (j = 1 + rand() % 8; (j > 0) && (i < Length); j--, pExpected->Discarded++)
+                pStream[i++] = (UInt8)(0x01 + rand() % 0xC0);
+            continue;
+        }
+
+        // A header with a bad length loses just the header
+        if ((Type == 1) && (Length - i >= ORION_PKT_OVERHEAD))
+        {
+            pStream[i++] = ORION_SYNC >> 8;
+            pStream[i++] = ORION_SYNC & 0xFF;
+            pStream[i++] = (UInt8)rand();
+            pStream[i++] = ORION_PKT_MAX_SIZE + 1;
+            pExpected->Discarded += TRILLIUM_PKT_HEADER_SIZE;
+            pExpected->OversizeRejects++;
+            continue;
+        }
+
+        // Otherwise build a real packet with random contents
+        for (j = 0; j < ORION_PKT_MAX_SIZE; j++)
+            Pkt.Data[j] = (UInt8)rand();
+        MakeOrionPacket(&Pkt, (UInt8)rand(), rand() % 128);
+        Size = Pkt.Length + ORION_PKT_OVERHEAD;
+
+        // Stop once packets no longer fit, padding out the rest with junk
+        if (Length - i < Size)
+        {
+            pExpected->Discarded += Length - i;
+            memset(&pStream[i], 0x55, Length - i);
+            break;
+        }
+
+        // A bad second checksum byte loses the whole packet
+        if (Type == 2)
+        {
+            Pkt.Data[Pkt.Length + 1] ^= 0x55;
+            pExpected->Discarded += Size;
+            pExpected->ChecksumFailures++;
+        }
+        else
+            (*pGood)++;
+
+        memcpy(&pStream[i], &Pkt, Size);
+        i += Size;
+    }
+
+    return pStream;
+
+}// MakeFaultyStream
+
+// Push a stream through a connection over a socket pair, with or without link statistics, and
+//  return how long it took to receive every packet in it
+static double DrainStats(const UInt8 *pStream, UInt32 Length, BOOL Enable, UInt32 *pReceived, OrionLinkStats_t *pStats)
+{
+    StatsBench_t Bench = { -1, pStream, Length };
+    OrionPktView_t View;
+    OrionConn_t *pConn;
+    pthread_t Writer;
+    double Start, Time;
+    int Pair[2];
+
+    *pReceived = 0;
+
+    // Hook the connection up to a writer thread
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+        return 1e9;
+
+    pConn = OrionConnOpenHandle(Pair[0]);
+    if (Enable)
+        OrionConnEnableStats(pConn, TRUE);
+
+    Bench.Handle = Pair[1];
+    Start = GetTime();
+    pthread_create(&Writer, NULL, StatsStreamWriter, &Bench);
+
+    // Receive until the writer hangs up
+    while (OrionConnReceiveViewTimeout(pConn, &View, 1000000))
+        (*pReceived)++;
+
+    Time = GetTime() - Start;
+
+    // Grab the statistics and clean up
+    if (pStats != NULL)
+        OrionConnGetLinkStats(pConn, pStats, FALSE);
+
+    pthread_join(Writer, NULL);
+    OrionConnClose(pConn);
+    close(Pair[1]);
+    return Time;
+
+}// DrainStats
+
+// Writer thread for the link statistics benchmark: write out the whole stream, then hang up
+static void *StatsStreamWriter(void *pContext)
+{
+    StatsBench_t *pBench = (StatsBench_t *)pContext;
+    UInt32 Offset = 0;
+
+    while (Offset < pBench->Length)
+    {
+        ssize_t Count = write(pBench->Handle, &pBench->pStream[Offset], pBench->Length - Offset);
+
+        if (Count <= 0)
+            break;
+
+        Offset += (UInt32)Count;
+    }
+
+    shutdown(pBench->Handle, SHUT_WR);
+    return NULL;
+
+}// StatsStreamWriter
+
+// Writer thread for the link statistics benchmark: send telemetry at 100 Hz and performance
+//  data at 10 Hz, pausing for 200 ms a third of the way through, then hang up
+static void *StatsTelemetryWriter(void *pContext)
+{
+    StatsBench_t *pBench = (StatsBench_t *)pContext;
+    double Start = GetTime(), Next = Start;
+    BOOL Paused = FALSE;
+    OrionPkt_t Perf;
+    UInt32 Tick;
+
+    memset(Perf.Data, 0, 32);
+    MakeOrionPacket(&Perf, ORION_PKT_PERFORMANCE, 32);
+
+    for (Tick = 0; GetTime() - Start < pBench->Seconds; Tick++)
+    {
+        OrionPkt_t Pkt;
+
+        // Send this tick's packets
+        MakeSequencePacket(&Pkt, Tick);
+        if (write(pBench->Handle, &Pkt, Pkt.Length + ORION_PKT_OVERHEAD) > 0)
+            pBench->Sent++;
+
+        if ((Tick % 10) == 0)
+            (void)write(pBench->Handle, &Perf, Perf.Length + ORION_PKT_OVERHEAD);
+
+        // Go quiet once, picking the schedule back up from wherever that leaves us
+        if ((Paused == FALSE) && (GetTime() - Start > pBench->Seconds / 3))
+        {
+            Paused = TRUE;
+            SleepUs(200000);
+            Next = GetTime();
+        }
+
+        // Wait for the next tick
+        Next += 0.01;
+        while (GetTime() < Next)
+            SleepUs(500);
+    }
+
+    shutdown(pBench->Handle, SHUT_WR);
+    return NULL;
+
+}// StatsTelemetryWriter
+
+// Receive telemetry from several gimbals over UDP, one datagram per system call and then in
+//  batches through a UDP connection, checking that every packet is traced to the right gimbal
+static int BenchmarkUdp(int argc, char **argv)
+{
+    static const char *pNames[] = { "recvfrom", "recvmmsg" };
+    int Gimbals = 8, Rounds = 2000, Result = 0, Pass, g, r, i;
+    int Senders[UDP_BENCH_GIMBALS];
+    UdpBench_t Bench;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Gimbals = atoi(argv[0]);
+    if (argc >= 2) Rounds = atoi(argv[1]);
+    if (Gimbals < 1) Gimbals = 1;
+    if (Gimbals > UDP_BENCH_GIMBALS) Gimbals = UDP_BENCH_GIMBALS;
+
+    printf("%d gimbals each sending %d packets per round, %d rounds\n", Gimbals, UDP_BENCH_BURST, Rounds);
+
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        struct sockaddr_in Local, Remote;
+        UInt32 Sent = 0, Calls = 0, Sequence = 0;
+        OrionConn_t *pConn = NULL;
+        int Handle = -1, Size = 4 * 1024 * 1024;
+        double Time = 0;
+        OrionPkt_t Pkt;
+
+        memset(&Bench, 0, sizeof(Bench));
+        memset(&Pkt, 0, sizeof(Pkt));
+        memset(&Remote, 0, sizeof(Remote));
+        Remote.sin_family = AF_INET;
+        Remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        Remote.sin_port = htons(UDP_TELEMETRY_PORT + 100);
+
+        // First a plain socket with as much buffering as the UDP connection asks for, then a UDP connection
+        if (Pass == 0)
+        {
+            if (((Handle = socket(AF_INET, SOCK_DGRAM, 0)) < 0) || (bind(Handle, (struct sockaddr *)&Remote, sizeof(Remote)) != 0))
+                return 1;
+
+            setsockopt(Handle, SOL_SOCKET, SO_RCVBUF, &Size, sizeof(Size));
+        }
+        else if ((pConn = OrionConnOpenUdp(UDP_TELEMETRY_PORT + 100, NULL)) == NULL)
+            return 1;
+
+        // Each gimbal gets its own socket, and we note the port it sends from
+        for (g = 0; g < Gimbals; g++)
+        {
+            socklen_t Length = sizeof(Local);
+
+            if (((Senders[g] = socket(AF_INET, SOCK_DGRAM, 0)) < 0) || (connect(Senders[g], (struct sockaddr *)&Remote, sizeof(Remote)) != 0) ||
+                (getsockname(Senders[g], (struct sockaddr *)&Local, &Length) != 0))
+                return 1;
+
+            Bench.Ports[g] = ntohs(Local.sin_port);
+        }
+
+        for (r = 0; r < Rounds; r++)
+        {
+            double Start;
+
+            // Every gimbal sends a burst of telemetry, one packet to a datagram, while we're busy
+            for (g = 0; g < Gimbals; g++)
+            {
+                for (i = 0; i < UDP_BENCH_BURST; i++)
+                {
+                    MakeSequencePacket(&Pkt, ((UInt32)g << 24) | (Sequence++ & 0xFFFFFF));
+                    if (send(Senders[g], &Pkt, Pkt.Length + ORION_PKT_OVERHEAD, 0) > 0)
+                        Sent++;
+                }
+            }
+
+            // Then time how long it takes to get through everything waiting
+            Start = GetTime();
+            if (Pass == 0)
+            {
+                struct sockaddr_in From;
+                socklen_t Length = sizeof(From);
+                UInt8 Buffer[2048];
+                ssize_t Count;
+
+                // One system call per datagram, then frame it and tally it against its sender
+                memset(&Pkt, 0, sizeof(Pkt));
+                while ((Count = recvfrom(Handle, Buffer, sizeof(Buffer), MSG_DONTWAIT, (struct sockaddr *)&From, &Length)) > 0)
+                {
+                    Calls++;
+                    Bench.Source = ntohs(From.sin_port);
+                    LookForOrionPacketsInBuffer(&Pkt, Buffer, (UInt32)Count, UdpTally, &Bench);
+                    Length = sizeof(From);
+                }
+            }
+            else
+            {
+                OrionPktView_t View;
+
+                // The connection batches the system calls and tags each packet with its sender
+                while (OrionConnReceiveView(pConn, &View))
+                {
+                    OrionUdpGetSource(pConn, NULL, &Bench.Source);
+                    UdpTally(View.pPkt, &Bench);
+                }
+            }
+
+            Time += GetTime() - Start;
+        }
+
+        // Clean up, grabbing the connection's system call count on the way
+        for (g = 0; g < Gimbals; g++)
+            close(Senders[g]);
+
+        if (Pass == 0)
+            close(Handle);
+        else
+        {
+            OrionUdpStats_t Stats;
+
+            OrionUdpGetStats(pConn, &Stats, FALSE);
+            Calls = Stats.RecvCalls;
+            OrionConnClose(pConn);
+        }
+
+        // Print out the results
+        printf("  %s: %u of %u packets, %.1f packets per call, %.0f ns per packet, %u traced to the wrong gimbal\n",
+               pNames[Pass], Bench.Received, Sent, Calls ? (double)Bench.Received / Calls : 0.0,
+               Bench.Received ? Time / Bench.Received * 1e9 : 0.0, Bench.Mistagged);
+
+        // Every packet has to arrive and be traced to its gimbal
+        if ((Bench.Mistagged != 0) || (Bench.Received != Sent))
+            Result = 1;
+    }
+
+    return Result;
+
+}// BenchmarkUdp
+
+// Count a packet against the gimbal it claims to come from, checking it came from that gimbal's port
+static BOOL UdpTally(const OrionPkt_t *pPkt, void *pContext)
+{
+    UdpBench_t *pBench = (UdpBench_t *)pContext;
+    UInt32 Sequence;
+
+    memcpy(&Sequence, pPkt->Data, sizeof(Sequence));
+    if ((Sequence >> 24) >= UDP_BENCH_GIMBALS)
+        return TRUE;
+
+    pBench->Received++;
+    if (pBench->Ports[Sequence >> 24] != pBench->Source)
+        pBench->Mistagged++;
+
+    return TRUE;
+
+}// UdpTally
+
+// Send packets at random intervals to a connection that only gets around to reading every 20 ms,
+//  comparing the arrival time each packet is stamped with against the time it was read out
+static int BenchmarkTimestamps(int argc, char **argv)
+{
+    static const char *pNames[] = { "TCP", "UDP" };
+    UInt32 Packets = 300;
+    TimestampBench_t Bench;
+    int Result = 0, Pass;
+
+    // Pull the optional argument off the command line
+    if (argc >= 1) Packets = (UInt32)atoi(argv[0]);
+    if (Packets < 10) Packets = 10;
+
+    printf("%u packets every 2-8 ms, read every 20 ms\n", Packets);
+
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        double *pStamped = (double *)calloc(Packets, sizeof(double));
+        double *pRead = (double *)calloc(Packets, sizeof(double));
+        OrionConn_t *pConn = NULL;
+        UInt32 Received = 0;
+        double Deadline;
+        pthread_t Writer;
+        int Handle = -1;
+
+        memset(&Bench, 0, sizeof(Bench));
+        Bench.Packets = Packets;
+        Bench.pSendUs = (UInt64 *)calloc(Packets, sizeof(UInt64));
+        if ((pStamped == NULL) || (pRead == NULL) || (Bench.pSendUs == NULL))
+            return 1;
+
+        // A TCP connection over loopback, then a UDP connection with a socket sending to it
+        if (Pass == 0)
+        {
+            if (OpenTcpPair(&Bench.Handle, &Handle) == FALSE)
+                return 1;
+
+            pConn = OrionConnOpenHandle(Handle);
+        }
+        else
+        {
+            struct sockaddr_in Remote;
+
+            memset(&Remote, 0, sizeof(Remote));
+            Remote.sin_family = AF_INET;
+            Remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            Remote.sin_port = htons(UDP_TELEMETRY_PORT + 100);
+
+            pConn = OrionConnOpenUdp(UDP_TELEMETRY_PORT + 100, NULL);
+            if (((Bench.Handle = socket(AF_INET, SOCK_DGRAM, 0)) < 0) || (connect(Bench.Handle, (struct sockaddr *)&Remote, sizeof(Remote)) != 0))
+                return 1;
+        }
+
+        if ((pConn == NULL) || (pthread_create(&Writer, NULL, TimestampWriter, &Bench) != 0))
+            return 1;
+
+        // Wake up every 20 ms, as a busy control loop might, and take everything that has arrived
+        Deadline = GetTime() + Packets * 0.008 + 2.0;
+        while ((Received < Packets) && (GetTime() < Deadline))
+        {
+            UInt64 TimeUs;
+            OrionPkt_t Pkt;
+
+            SleepUs(20000);
+            while ((Received < Packets) && OrionConnReceiveTimed(pConn, &Pkt, &TimeUs, 0))
+            {
+                UInt64 NowUs = OrionCommGetTimeUs();
+                UInt32 Sequence;
+
+                // Measure both the stamp and the time we got to it against when the packet was sent
+                memcpy(&Sequence, Pkt.Data, sizeof(Sequence));
+                if (Sequence >= Packets)
+                    continue;
+
+                pStamped[Received] = ((double)TimeUs - (double)Bench.pSendUs[Sequence]);
+                pRead[Received] = ((double)NowUs - (double)Bench.pSendUs[Sequence]);
+                Received++;
+            }
+        }
+
+        // Clean up
+        pthread_join(Writer, NULL);
+        close(Bench.Handle);
+        OrionConnClose(pConn);
+
+        // Sort the errors so we can pull out percentiles, and print out the results
+        qsort(pStamped, Received, sizeof(double), CompareDoubles);
+        qsort(pRead, Received, sizeof(double), CompareDoubles);
+        printf("  %s: %u of %u packets\n", pNames[Pass], Received, Packets);
+        if (Received > 0)
+        {
+            printf("    Arrival stamp:    p50 %7.1f us, p99 %7.1f us, max %7.1f us after sending\n",
+                   pStamped[Received / 2], pStamped[(UInt32)(Received * 0.99)], pStamped[Received - 1]);
+            printf("    Read by the loop: p50 %7.1f us, p99 %7.1f us, max %7.1f us after sending\n",
+                   pRead[Received / 2], pRead[(UInt32)(Received * 0.99)], pRead[Received - 1]);
+        }
+
+        // Everything has to arrive, and the stamps have to see through the reader's 20 ms naps. TCP
+        //  stamps a whole read with its latest segment, so there they only have to be earlier
+        if ((Received != Packets) || (Received == 0))
+            Result = 1;
+        else if (pStamped[Received / 2] * ((Pass == 0) ? 1 : 4) >= pRead[Received / 2])
+            Result = 1;
+
+        free(pStamped);
+        free(pRead);
+        free(Bench.pSendUs);
+    }
+
+    return Result;
+
+}// BenchmarkTimestamps
+
+// Sending end of the timestamp and fan-out benchmarks: one sequence packet at a time
+static void *TimestampWriter(void *pContext)
+{
+    TimestampBench_t *pBench = (TimestampBench_t *)pContext;
+    OrionPkt_t Pkt;
+    UInt32 i;
+
+    srand(22);
+    for (i = 0; i < pBench->Packets; i++)
+    {
+        SleepUs(pBench->IntervalUs ? pBench->IntervalUs : 2000 + rand() % 6000);
+
+        // Note the time just before the packet goes out
+        MakeSequencePacket(&Pkt, i);
+        pBench->pSendUs[i] = OrionCommGetTimeUs();
+        if (write(pBench->Handle, &Pkt, Pkt.Length + ORION_PKT_OVERHEAD) <= 0)
+            break;
+    }
+
+    return NULL;
+
+}// TimestampWriter
+
+// Feed a clock estimator simulated telemetry from a drifting gimbal clock over a link with latency
+//  jitter, late packets, reader stalls and a reboot, checking its conversions against the truth
+static int BenchmarkClockSync(int argc, char **argv)
+{
+    static const char *pNames[] = { "Latest offset", "Estimator" };
+    double Minutes = 10, RateHz = 50, DriftPpm = 40, StallUntil = 0, Time, *pTruth, *pErrors[2];
+    UInt32 Packets, Samples = 0, RoundTrip = 0, *pSystemTimes, i;
+    UInt64 *pArrivals;
+    int Result = 0, Run;
+    ClockSync_t Sync;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) Minutes = atof(argv[0]);
+    if (argc >= 2) RateHz = atof(argv[1]);
+    if (argc >= 3) DriftPpm = atof(argv[2]);
+    if (Minutes < 1) Minutes = 1;
+    if (RateHz < 1) RateHz = 1;
+
+    Packets = (UInt32)(Minutes * 60 * RateHz);
+    pSystemTimes = (UInt32 *)calloc(Packets, sizeof(UInt32));
+    pArrivals = (UInt64 *)calloc(Packets, sizeof(UInt64));
+    pTruth = (double *)calloc(Packets, sizeof(double));
+    pErrors[0] = (double *)calloc(Packets, sizeof(double));
+    pErrors[1] = (double *)calloc(Packets, sizeof(double));
+    if ((pSystemTimes == NULL) || (pArrivals == NULL) || (pTruth == NULL) || (pErrors[0] == NULL) || (pErrors[1] == NULL))
+        return 1;
+
+    printf("%.0f minutes of %.0f Hz telemetry, gimbal clock %+.0f ppm, 300 us latency plus 200 us jitter,\n"
+           "  1%% of packets up to 20 ms late, a 200 ms reader stall every minute, a reboot two thirds in\n",
+           Minutes, RateHz, -DriftPpm);
+
+    // Simulate the telemetry up front, so the estimator can be timed on its own
+    srand(23);
+    for (i = 0; i < Packets; i++)
+    {
+        // Host time the gimbal sampled this packet, up to a millisecond off its schedule, and the gimbal's
+        //  clock at that moment, which restarts from 10 s when it reboots two thirds of the way through
+        double Sent = 1000.0 + i / RateHz + (rand() % 1000) * 1e-6, Boot = (i >= Packets * 2 / 3) ? Packets * 2 / 3 / RateHz : 0;
+        double Gimbal = (Boot > 0 ? 10.0 : 3600.0) + (Sent - 1000.0 - Boot) * (1.0 - DriftPpm * 1e-6);
+        double Arrived;
+
+        pSystemTimes[i] = (UInt32)floor(Gimbal * 1000.0);
+
+        // The host time that systemTime really maps to, including the minimum latency
+        pTruth[i] = (Sent - (Gimbal * 1000.0 - pSystemTimes[i]) * 1e-3 * (1.0 + DriftPpm * 1e-6) + 300e-6) * 1e6;
+
+        // Work out when it arrives: latency, jitter, the odd late packet, and a stall every minute
+        Arrived = Sent + 300e-6 - 200e-6 * log((rand() + 1.0) / (RAND_MAX + 2.0));
+        if ((rand() % 100) == 0)
+            Arrived += (rand() % 20000) * 1e-6;
+
+        if (fmod(Sent, 60.0) < 1.0 / RateHz)
+            StallUntil = Sent + 0.2;
+        if (Arrived < StallUntil)
+            Arrived = StallUntil;
+
+        pArrivals[i] = (UInt64)(Arrived * 1e6);
+
+        // Note when the gimbal has been up long enough for there to be a fit worth checking
+        if ((Sent - 1000.0 - Boot) < 10.0)
+            pTruth[i] = 0;
+    }
+
+    // Time the estimator by itself
+    InitClockSync(&Sync);
+    Time = GetTime();
+    for (i = 0; i < Packets; i++)
+        UpdateClockSync(&Sync, pSystemTimes[i], pArrivals[i]);
+    Time = GetTime() - Time;
+
+    // Then run it again, comparing it to the naive approach of taking each packet's offset at face value
+    InitClockSync(&Sync);
+    for (i = 0; i < Packets; i++)
+    {
+        SInt64 LatestOffset = (SInt64)pArrivals[i] - (SInt64)pSystemTimes[i] * 1000;
+
+        UpdateClockSync(&Sync, pSystemTimes[i], pArrivals[i]);
+        if (pTruth[i] == 0)
+            continue;
+
+        pErrors[0][Samples] = fabs((double)((SInt64)pSystemTimes[i] * 1000 + LatestOffset) - pTruth[i]);
+        pErrors[1][Samples] = fabs((double)OrionTimeToHost(&Sync, pSystemTimes[i]) - pTruth[i]);
+        Samples++;
+
+        // Going back the other way has to land on the same millisecond
+        if (HostToOrionTime(&Sync, OrionTimeToHost(&Sync, pSystemTimes[i])) == pSystemTimes[i])
+            RoundTrip++;
+    }
+
+    // Print out the results
+    for (Run = 0; Run < 2; Run++)
+    {
+        qsort(pErrors[Run], Samples, sizeof(double), CompareDoubles);
+        printf("  %-14s error p50 %7.1f us, p99 %7.1f us, max %8.1f us\n", pNames[Run],
+               pErrors[Run][Samples / 2], pErrors[Run][(UInt32)(Samples * 0.99)], pErrors[Run][Samples - 1]);
+    }
+
+    printf("  Estimated drift %+.1f ppm, %u outlier blocks, %u restarts, %u of %u round trips exact, %.0f ns per update\n",
+           -Sync.DriftPpm, Sync.Outliers, Sync.Resets, RoundTrip, Samples, Time / Packets * 1e9);
+
+    // The estimate has to stay well inside a video frame, get the drift about right and see the reboot
+    if ((Samples == 0) || (pErrors[1][(UInt32)(Samples * 0.99)] > 1000) || (fabs(Sync.DriftPpm - DriftPpm) > 5) || (Sync.Resets == 0) || (RoundTrip != Samples))
+        Result = 1;
+
+    free(pSystemTimes);
+    free(pArrivals);
+    free(pTruth);
+    free(pErrors[0]);
+    free(pErrors[1]);
+    return Result;
+
+}// BenchmarkClockSync
+
+// Fan telemetry from one gimbal link out to several consumers, first through a relay that copies
+//  it to each of them over TCP and then through a shared memory broker, comparing latency and CPU
+static int BenchmarkShm(int argc, char **argv)
+{
+    static const char *pNames[] = { "TCP relay", "Shared memory" };
+    FanoutReader_t Readers[FANOUT_READERS];
+    int ReaderCount = 4, Result = 0, Pass, r;
+    TimestampBench_t Bench;
+    UInt32 Packets = 2000, i;
+    int NoDelay = 1;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) ReaderCount = atoi(argv[0]);
+    if (argc >= 2) Packets = (UInt32)atoi(argv[1]);
+    if (ReaderCount < 1) ReaderCount = 1;
+    if (ReaderCount > FANOUT_READERS) ReaderCount = FANOUT_READERS;
+    if (Packets < 100) Packets = 100;
+
+    printf("%d consumers, %u packets 500 us apart\n", ReaderCount, Packets);
+
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        pthread_t Writer, Relay, Threads[FANOUT_READERS];
+        OrionShmBroker_t *pBroker = NULL;
+        UInt32 Expected = 0, Received = 0, Torn = 0;
+        double Cpu, *pLatency;
+        FanoutRelay_t Relayer;
+        PacketTally_t Commands;
+        int Link;
+
+        memset(&Bench, 0, sizeof(Bench));
+        memset(&Relayer, 0, sizeof(Relayer));
+        memset(&Commands, 0, sizeof(Commands));
+        Bench.Packets = Packets;
+        Bench.IntervalUs = 500;
+        Bench.pSendUs = (UInt64 *)calloc(Packets, sizeof(UInt64));
+        pLatency = (double *)calloc(Packets * ReaderCount, sizeof(double));
+        if ((Bench.pSendUs == NULL) || (pLatency == NULL) || (OpenTcpPair(&Bench.Handle, &Link) == FALSE) ||
+            ((Relayer.pLink = OrionConnOpenHandle(Link)) == NULL))
+            return 1;
+
+        // The gimbal sends each packet as soon as it has it, even with commands coming the other way
+        setsockopt(Bench.Handle, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+
+        // Each consumer gets a TCP connection from the relay, or opens the ring by name just as
+        //  another process would
+        for (r = 0; r < ReaderCount; r++)
+        {
+            memset(&Readers[r], 0, sizeof(Readers[r]));
+            Readers[r].pSendUs = Bench.pSendUs;
+            Readers[r].Packets = Packets;
+            Readers[r].Deadline = GetTime() + Packets * 500e-6 + 2.0;
+            Readers[r].pLatency = &pLatency[r * Packets];
+
+            if (Pass == 0)
+            {
+                int Client;
+
+                if (OpenTcpPair(&Relayer.Clients[r], &Client) == FALSE)
+                    return 1;
+
+                Readers[r].pConn = OrionConnOpenHandle(Client);
+                Relayer.Readers++;
+            }
+            else
+            {
+                if ((r == 0) && ((pBroker = OrionShmStartBroker(Relayer.pLink, "orion-benchmark", 0)) == NULL))
+                    return 1;
+
+                // Half of them look at packets in place, and all of them send commands back
+                Readers[r].pConn = OrionConnOpenShm("orion-benchmark");
+                Readers[r].ZeroCopy = (r % 2) == 1;
+                Readers[r].SendCommands = TRUE;
+                Expected += Packets / FANOUT_COMMAND_EVERY;
+            }
+
+            if ((Readers[r].pConn == NULL) || (pthread_create(&Threads[r], NULL, FanoutReader, &Readers[r]) != 0))
+                return 1;
+        }
+
+        // Send the telemetry, timing the CPU used by everything in the process from here until
+        //  the last consumer has it all
+        Cpu = -GetCpuTime();
+        if ((Pass == 0) && (pthread_create(&Relay, NULL, FanoutRelay, &Relayer) != 0))
+            return 1;
+        if (pthread_create(&Writer, NULL, TimestampWriter, &Bench) != 0)
+            return 1;
+
+        pthread_join(Writer, NULL);
+        for (r = 0; r < ReaderCount; r++)
+            pthread_join(Threads[r], NULL);
+        Cpu += GetCpuTime();
+
+        // Hang up on the relay or stop the broker, then close everything
+        shutdown(Bench.Handle, SHUT_WR);
+        if (Pass == 0)
+            pthread_join(Relay, NULL);
+        OrionShmStopBroker(pBroker);
+        for (r = 0; r < ReaderCount; r++)
+        {
+            Received += Readers[r].Received;
+            Torn += Readers[r].Torn;
+            OrionConnClose(Readers[r].pConn);
+            if (Pass == 0)
+                close(Relayer.Clients[r]);
+        }
+
+        OrionConnClose(Relayer.pLink);
+
+        // Count the commands that made it back to the gimbal
+        if (Pass == 1)
+        {
+            UInt8 Buffer[4096];
+            OrionPkt_t Pkt;
+            ssize_t Count;
+
+            memset(&Pkt, 0, sizeof(Pkt));
+            while ((Count = recv(Bench.Handle, Buffer, sizeof(Buffer), MSG_DONTWAIT)) > 0)
+                LookForOrionPacketsInBuffer(&Pkt, Buffer, (UInt32)Count, TallyCallback, &Commands);
+        }
+
+        close(Bench.Handle);
+
+        // Print out the results, packing the latencies together first so they can be sorted
+        for (r = 0, i = 0; r < ReaderCount; r++)
+        {
+            memmove(&pLatency[i], Readers[r].pLatency, Readers[r].Received * sizeof(double));
+            i += Readers[r].Received;
+        }
+
+        qsort(pLatency, Received, sizeof(double), CompareDoubles);
+        printf("  %-13s: %u of %u packets, latency p50 %5.1f us, p99 %6.1f us, %.1f us CPU per packet",
+               pNames[Pass], Received, Packets * ReaderCount, Received ? pLatency[Received / 2] : 0.0,
+               Received ? pLatency[(UInt32)(Received * 0.99)] : 0.0, Cpu / Packets * 1e6);
+        if (Pass == 1)
+            printf(", %u of %u commands forwarded, %u views overwritten", Commands.Count, Expected, Torn);
+        printf("\n");
+
+        // Every consumer has to get everything, and every command has to reach the gimbal
+        if ((Received != Packets * ReaderCount) || (Commands.Count != Expected) || (Torn != 0))
+            Result = 1;
+
+        free(Bench.pSendUs);
+        free(pLatency);
+    }
+
+    return Result;
+
+}// BenchmarkShm
+
+// Consumer in the fan-out benchmark: note how long each packet took to arrive, and send a command
+//  back every so often
+static void *FanoutReader(void *pContext)
+{
+    FanoutReader_t *pReader = (FanoutReader_t *)pContext;
+    OrionPkt_t Command;
+
+    while ((pReader->Received < pReader->Packets) && (GetTime() < pReader->Deadline))
+    {
+        OrionPktView_t View;
+        UInt32 Sequence;
+        UInt64 NowUs;
+
+        // Either look at the packet where the broker put it, or have the connection frame a copy
+        if (pReader->ZeroCopy ? OrionShmPeek(pReader->pConn, &View, 100000) == FALSE :
+                                OrionConnReceiveViewTimeout(pReader->pConn, &View, 100000) == FALSE)
+            continue;
+
+        NowUs = OrionCommGetTimeUs();
+        memcpy(&Sequence, View.pPkt->Data, sizeof(Sequence));
+
+        // A packet viewed in place only counts if the broker left it alone while we looked
+        if (pReader->ZeroCopy && (OrionShmRelease(pReader->pConn) == FALSE))
+        {
+            pReader->Torn++;
+            continue;
+        }
+
+        if (Sequence >= pReader->Packets)
+            continue;
+
+        pReader->pLatency[pReader->Received++] = (double)(NowUs - pReader->pSendUs[Sequence]);
+
+        // Every so often, ask the gimbal for something
+        if (pReader->SendCommands && ((pReader->Received % FANOUT_COMMAND_EVERY) == 0))
+        {
+            MakeSequencePacket(&Command, pReader->Received);
+            OrionConnSend(pReader->pConn, &Command);
+        }
+    }
+
+    return NULL;
+
+}// FanoutReader
+
+// Relay in the fan-out benchmark: copy each packet from the link out to every consumer's socket
+static void *FanoutRelay(void *pContext)
+{
+    FanoutRelay_t *pRelay = (FanoutRelay_t *)pContext;
+    OrionPktView_t View;
+    int r;
+
+    while (OrionConnIsOpen(pRelay->pLink))
+    {
+        if (OrionConnReceiveViewTimeout(pRelay->pLink, &View, 100000))
+        {
+            for (r = 0; r < pRelay->Readers; r++)
+                (void)write(pRelay->Clients[r], View.pPkt, View.Size);
+        }
+    }
+
+    return NULL;
+
+}// FanoutRelay
+
+// Compare an io_uring ring against the epoll event loop, each servicing hundreds of connections to
+//  the simulator from one thread
+static int BenchmarkUring(int argc, char **argv)
+{
+    static const int Conns[] = { 100, 500, 1000 };
+    static const char *pNames[] = { "epoll", "io_uring" };
+    const char *pAddress = "127.0.0.1";
+    int RateHz = 20, Result = 0, Handle, c, Pass;
+    double Duration = 3.0;
+    OrionUring_t *pRing;
+
+    // Pull the optional arguments off the command line
+    if (argc >= 1) pAddress = argv[0];
+    if (argc >= 2) RateHz = atoi(argv[1]);
+    if (argc >= 3) Duration = atof(argv[2]);
+    if (RateHz < 1) RateHz = 1;
+
+    // If the simulator hangs up on a connection, that gets counted rather than killing us
+    signal(SIGPIPE, SIG_IGN);
+
+    // Everything talks to the simulator, so make sure it's there
+    if ((Handle = ConnectSimulator(pAddress)) < 0)
+    {
+        printf("No simulator at %s; start ../Simulator/Simulator first\n", pAddress);
+        return 1;
+    }
+
+    close(Handle);
+
+    // Kernels that are too old, or have io_uring turned off, can only use the event loop
+    if ((pRing = OrionUringCreate(1)) == NULL)
+    {
+        printf("io_uring isn't available on this kernel\n");
+        return 1;
+    }
+
+    OrionUringDestroy(pRing);
+
+    printf("Echoes at %d Hz on every connection to the simulator at %s for %.1f s\n", RateHz, pAddress, Duration);
+
+    for (c = 0; c < (int)(sizeof(Conns) / sizeof(Conns[0])); c++)
+    {
+        for (Pass = 0; Pass < 2; Pass++)
+        {
+            UringBench_t Bench;
+            UInt32 Packets;
+
+            memset(&Bench, 0, sizeof(Bench));
+            Bench.Conns = Conns[c];
+            Bench.UseRing = (Pass == 1);
+
+            if (RunUringBench(&Bench, pAddress, RateHz, Duration) == FALSE)
+            {
+                printf("  %4d connections, %-8s: couldn't connect them all\n", Bench.Conns, pNames[Pass]);
+                return 1;
+            }
+
+            // Print out the results, with the CPU and system calls spread over every packet received
+            qsort(Bench.pLatency, Bench.Echoes, sizeof(double), CompareDoubles);
+            Packets = Bench.Echoes + Bench.Telemetry;
+            printf("  %4d connections, %-8s: %u of %u echoes, RTT p50 %6.0f us, p99 %6.0f us, %7u packets, %5.2f us CPU and %5.3f system calls per packet\n",
+                   Bench.Conns, pNames[Pass], Bench.Echoes, Bench.MaxEchoes,
+                   Bench.Echoes ? Bench.pLatency[Bench.Echoes / 2] : 0.0,
+                   Bench.Echoes ? Bench.pLatency[(UInt32)(Bench.Echoes * 0.99)] : 0.0,
+                   Packets, Packets ? Bench.Cpu / Packets * 1e6 : 0.0, Packets ? (double)Bench.SystemCalls / Packets : 0.0);
+
+            // Every echo has to come back, and the simulator mustn't have hung up on anyone
+            if (Bench.Closed != 0)
+                printf("  The simulator hung up on %u connections\n", Bench.Closed);
+            if ((Bench.Echoes != Bench.MaxEchoes) || (Bench.Closed != 0))
+                Result = 1;
+
+            free(Bench.pLatency);
+
+            // Give the simulator time to drop the old connections before opening the next lot
+            SleepUs(1000000);
+        }
+    }
+
+    return Result;
+
+}// BenchmarkUring
+
+// One pass of the io_uring benchmark: connect to the simulator and add every connection to an
+//  event loop or a ring, send echoes on all of them for a while, then hang up
+static BOOL RunUringBench(UringBench_t *pBench, const char *pAddress, int RateHz, double Duration)
+{
+    UInt32 Ticks = (UInt32)(RateHz * Duration), Tick = 0, Loops = 0;
+    double Period = 1.0 / RateHz, Start, Now;
+    OrionCommRxStats_t RxStats;
+    OrionCommTxStats_t TxStats;
+    OrionUringStats_t RingStats;
+    BOOL Result = TRUE;
+    OrionPkt_t Pkt;
+    int i;
+
+    pBench->MaxEchoes = Ticks * (UInt32)pBench->Conns;
+    pBench->pLatency = (double *)malloc(pBench->MaxEchoes * sizeof(double));
+    pBench->pConns = (OrionConn_t **)calloc(pBench->Conns, sizeof(OrionConn_t *));
+    if ((pBench->pLatency == NULL) || (pBench->pConns == NULL))
+        return FALSE;
+
+    // Both get the same handlers: echoes are timed, and the simulator's telemetry is just counted
+    if (pBench->UseRing)
+    {
+        if ((pBench->pRing = OrionUringCreate((UInt32)pBench->Conns)) == NULL)
+            return FALSE;
+
+        OrionUringSetHandler(pBench->pRing, ORION_PKT_USER_DATA, UringEchoHandler, pBench);
+        OrionUringSetDefaultHandler(pBench->pRing, UringTelemetryHandler, pBench);
+        OrionUringSetCloseHandler(pBench->pRing, UringCloseHandler, pBench);
+    }
+    else
+    {
+        if ((pBench->pLoop = OrionEventLoopCreate()) == NULL)
+            return FALSE;
+
+        OrionEventLoopSetHandler(pBench->pLoop, ORION_PKT_USER_DATA, UringEchoHandler, pBench);
+        OrionEventLoopSetDefaultHandler(pBench->pLoop, UringTelemetryHandler, pBench);
+        OrionEventLoopSetCloseHandler(pBench->pLoop, UringCloseHandler, pBench);
+    }
+
+    // Connect straight to the simulator's TCP port, rather than going through discovery every time
+    for (i = 0; (i < pBench->Conns) && Result; i++)
+    {
+        int Handle = ConnectSimulator(pAddress);
+
+        if ((Handle < 0) || ((pBench->pConns[i] = OrionConnOpenHandle(Handle)) == NULL))
+            Result = FALSE;
+        else if (pBench->UseRing)
+            Result = OrionUringAddConn(pBench->pRing, pBench->pConns[i]);
+        else
+            Result = OrionEventLoopAddConn(pBench->pLoop, pBench->pConns[i]);
+    }
+
+    // Give the simulator time to pick them all up and start streaming, then start counting
+    Start = GetTime();
+    while (Result && (GetTime() - Start < 0.5))
+        UringBenchRunOnce(pBench, 10);
+
+    pBench->Telemetry = 0;
+    for (i = 0; Result && (i < pBench->Conns); i++)
+    {
+        OrionConnGetRxStats(pBench->pConns[i], &RxStats, TRUE);
+        OrionConnGetTxStats(pBench->pConns[i], &TxStats, TRUE);
+    }
+
+    if (pBench->UseRing)
+        OrionUringGetStats(pBench->pRing, &RingStats, TRUE);
+
+    // Send an echo on every connection each tick, then service them all until the next tick is
+    //  due, and keep going for a little while after the last one so the echoes can all come back
+    pBench->Cpu = -GetCpuTime();
+    Start = GetTime();
+    while (Result && ((Now = GetTime()) < Start + Duration + 0.5))
+    {
+        int TimeoutMs = 10;
+
+        if ((Tick < Ticks) && (Now >= Start + Tick * Period))
+        {
+            for (i = 0; i < pBench->Conns; i++)
+            {
+                UInt64 SentUs = OrionCommGetTimeUs();
+
+                memcpy(Pkt.Data, &SentUs, sizeof(SentUs));
+                MakeOrionPacket(&Pkt, ORION_PKT_USER_DATA, sizeof(SentUs));
+                OrionConnSend(pBench->pConns[i], &Pkt);
+            }
+
+            Tick++;
+        }
+
+        if (Tick < Ticks)
+        {
+            TimeoutMs = (int)((Start + Tick * Period - GetTime()) * 1000.0) + 1;
+            if (TimeoutMs < 0)
+                TimeoutMs = 0;
+        }
+
+        UringBenchRunOnce(pBench, TimeoutMs);
+        Loops++;
+    }
+
+    pBench->Cpu += GetCpuTime();
+
+    // The ring submits everything and waits in a single call, whereas the loop waits in one call
+    //  and then reads and writes each connection with calls of its own
+    if (pBench->UseRing)
+    {
+        OrionUringGetStats(pBench->pRing, &RingStats, FALSE);
+        pBench->SystemCalls = RingStats.Enters;
+    }
+    else
+    {
+        pBench->SystemCalls = Loops;
+        for (i = 0; Result && (i < pBench->Conns); i++)
+        {
+            OrionConnGetRxStats(pBench->pConns[i], &RxStats, FALSE);
+            OrionConnGetTxStats(pBench->pConns[i], &TxStats, FALSE);
+            pBench->SystemCalls += RxStats.ReadCalls + TxStats.WriteCalls;
+        }
+    }
+
+    // Hang up on the simulator and clean up
+    for (i = 0; i < pBench->Conns; i++)
+    {
+        if (pBench->pConns[i] == NULL)
+            continue;
+
+        if (pBench->UseRing)
+            OrionUringRemoveConn(pBench->pRing, pBench->pConns[i]);
+        else
+            OrionEventLoopRemoveConn(pBench->pLoop, pBench->pConns[i]);
+
+        OrionConnClose(pBench->pConns[i]);
+    }
+
+    if (pBench->UseRing)
+        OrionUringDestroy(pBench->pRing);
+    else
+        OrionEventLoopDestroy(pBench->pLoop);
+
+    free(pBench->pConns);
+    return Result;
+
+}// RunUringBench
+
+// Service the io_uring benchmark's connections once, with whichever backend it's using
+static void UringBenchRunOnce(UringBench_t *pBench, int TimeoutMs)
+{
+    if (pBench->UseRing)
+        OrionUringRunOnce(pBench->pRing, TimeoutMs);
+    else
+        OrionEventLoopRunOnce(pBench->pLoop, TimeoutMs);
+
+}// UringBenchRunOnce
+
+// Open a TCP connection straight to the simulator, skipping discovery, returning the handle or -1
+static int ConnectSimulator(const char *pAddress)
+{
+    struct sockaddr_in Address;
+    int Handle = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&Address, 0, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(TCP_PORT);
+    if ((Handle >= 0) && ((inet_pton(AF_INET, pAddress, &Address.sin_addr) != 1) ||
+                          (connect(Handle, (struct sockaddr *)&Address, sizeof(Address)) != 0)))
+    {
+        close(Handle);
+        Handle = -1;
+    }
+
+    return Handle;
+
+}// ConnectSimulator
+
+// Echo handler for the io_uring benchmark: note how long the echo took to come back
+static void UringEchoHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext)
+{
+    UringBench_t *pBench = (UringBench_t *)pContext;
+    UInt64 SentUs;
+
+    // Anything that isn't one of our echoes is ignored
+    if ((pPkt->Length != sizeof(SentUs)) || (pBench->Echoes >= pBench->MaxEchoes))
+        return;
+
+    memcpy(&SentUs, pPkt->Data, sizeof(SentUs));
+    pBench->pLatency[pBench->Echoes++] = (double)(OrionCommGetTimeUs() - SentUs);
+
+}// UringEchoHandler
+
+// Default handler for the io_uring benchmark: count the simulator's telemetry
+static void UringTelemetryHandler(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext)
+{
+    ((UringBench_t *)pContext)->Telemetry++;
+
+}// UringTelemetryHandler
+
+// Close handler for the io_uring benchmark: count connections the simulator hung up on
+static void UringCloseHandler(OrionConn_t *pConn, void *pContext)
+{
+    ((UringBench_t *)pContext)->Closed++;
+
+}// UringCloseHandler
+
+// Open a pseudo-terminal, returning the handle for the master end and the path of the slave end
+static int OpenPty(char *pSlavePath, size_t Size)
+{
+    int Master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    // Unlock the slave end so it can be opened by path
+    if ((Master >= 0) && (grantpt(Master) == 0) && (unlockpt(Master) == 0) && (ptsname_r(Master, pSlavePath, Size) == 0))
+    {
+        // The far end is read on a schedule, so it can't block
+        fcntl(Master, F_SETFL, fcntl(Master, F_GETFL) | O_NONBLOCK);
+        return Master;
+    }
+
+    if (Master >= 0)
+        close(Master);
+    return -1;
+
+}// OpenPty
+
+// Reader thread for the scheduler benchmark: drains the pty no faster than the baud rate allows
+//  and notes how stale each command was by the time it got through
+static void *PtyReader(void *pContext)
+{
+    SchedBench_t *pBench = (SchedBench_t *)pContext;
+    double Start = GetTime(), Budget = 0;
+    OrionPkt_t Pkt;
+    UInt8 Buffer[4096];
+
+    memset(&Pkt, 0, sizeof(Pkt));
+
+    while (!pBench->Stop)
+    {
+        ssize_t Count, i;
+        double Now;
+
+        // Read whatever the link could have carried since last time
+        SleepUs(1000);
+        Now = GetTime();
+        Budget += (Now - Start) * pBench->BytesPerSec;
+        Start = Now;
+        if (Budget > sizeof(Buffer))
+            Budget = sizeof(Buffer);
+
+        // Time the link spends idle is gone for good, apart from a couple of milliseconds of slack
+        if ((Count = read(pBench->Handle, Buffer, (size_t)Budget)) <= 0)
+        {
+            if (Budget > pBench->BytesPerSec * 0.002)
+                Budget = pBench->BytesPerSec * 0.002;
+            continue;
+        }
+
+        Budget -= Count;
+
+        // Count up the traffic, and work out how long ago each command was sent
+        for (i = 0; i < Count; i++)
+        {
+            if (LookForOrionPacketInByte(&Pkt, Buffer[i]) == FALSE)
+                continue;
+
+            pBench->IdBytes[Pkt.ID] += Pkt.Length + ORION_PKT_OVERHEAD;
+            if ((Pkt.ID == ORION_PKT_CMD) && (pBench->Ages < pBench->MaxAges))
+            {
+                UInt16 Sequence;
+
+                memcpy(&Sequence, Pkt.Data, sizeof(Sequence));
+                pBench->pAges[pBench->Ages++] = Now - pBench->SendTime[Sequence];
+            }
+        }
+    }
+
+    return NULL;
+
+}// PtyReader
+
+// Sleep for a number of microseconds
+static void SleepUs(UInt32 Us)
+{
+    struct timespec Time = { (time_t)(Us / 1000000), (long)(Us % 1000000) * 1000 };
+    nanosleep(&Time, NULL);
+
+}// SleepUs
+
+// Fill out a packet of typical telemetry size carrying a sequence number
+static void MakeSequencePacket(OrionPkt_t *pPkt, UInt32 Sequence)
+{
+    memcpy(pPkt->Data, &Sequence, sizeof(Sequence));
+    memset(&pPkt->Data[sizeof(Sequence)], 0, 60);
+    MakeOrionPacket(pPkt, ORION_PKT_GEOLOCATE_TELEMETRY, sizeof(Sequence) + 60);
+
+}// MakeSequencePacket
+
+// Copy a sequence packet, patching in a new sequence number (which leaves the checksum stale)
+static void CopySequencePacket(OrionPkt_t *pPkt, const OrionPkt_t *pTemplate, UInt32 Sequence)
+{
+    memcpy(pPkt, pTemplate, pTemplate->Length + ORION_PKT_OVERHEAD);
+    memcpy(pPkt->Data, &Sequence, sizeof(Sequence));
+
+}// CopySequencePacket
+
+// Producer thread for the queue benchmark: fills the queue in order, spinning whenever it's full
+static void *QueueProducer(void *pContext)
+{
+    QueueBench_t *pBench = (QueueBench_t *)pContext;
+    UInt32 i;
+
+    for (i = 0; i < pBench->Packets; i++)
+    {
+        OrionPkt_t *pSlot;
+
+        // Let the consumer have the CPU if it has to share one with us
+        while ((pSlot = OrionPktQueueBack(pBench->pQueue)) == NULL)
+        {
+            pBench->FullSpins++;
+            sched_yield();
+        }
+
+        CopySequencePacket(pSlot, &pBench->Template, i);
+        OrionPktQueuePush(pBench->pQueue);
+    }
+
+    return NULL;
+
+}// QueueProducer
+
+// Writer thread for the queue benchmark: streams packets down a socket in TCP segment sized bursts
+static void *QueueWriter(void *pContext)
+{
+    QueueBench_t *pBench = (QueueBench_t *)pContext;
+    UInt8 Buffer[1460];
+    UInt32 i = 0, Used = 0;
+
+    while (i < pBench->Packets)
+    {
+        OrionPkt_t Pkt;
+        UInt32 Size;
+
+        MakeSequencePacket(&Pkt, i++);
+        Size = Pkt.Length + ORION_PKT_OVERHEAD;
+
+        // Flush the burst once the next packet won't fit, or we're out of packets
+        if (Used + Size > sizeof(Buffer))
+        {
+            write(pBench->Handle, Buffer, Used);
+            Used = 0;
+        }
+
+        memcpy(&Buffer[Used], &Pkt, Size);
+        Used += Size;
+    }
+
+    write(pBench->Handle, Buffer, Used);
+    return NULL;
+
+}// QueueWriter
+
+// Receive packets from a connection until they've all arrived (or been dropped), returning the time it took
+static double DrainConn(OrionConn_t *pConn, UInt32 Packets, UInt32 *pReceived, BOOL *pInOrder)
+{
+    OrionPktQueueStats_t Stats = { 0 };
+    double Start = GetTime();
+    UInt32 Last = 0;
+    OrionPkt_t Pkt;
+
+    *pReceived = 0;
+    *pInOrder = TRUE;
+
+    // Sequence numbers have to keep going up, though the receive thread may drop some when it's full
+    while (*pReceived + Stats.Dropped < Packets)
+    {
+        UInt32 Sequence;
+
+        // If the link goes quiet, check whether the rest were dropped before giving up
+        if (OrionConnReceiveTimeout(pConn, &Pkt, 200000) == FALSE)
+        {
+            OrionConnGetQueueStats(pConn, &Stats, FALSE);
+            if (*pReceived + Stats.Dropped < Packets)
+                break;
+            continue;
+        }
+
+        memcpy(&Sequence, Pkt.Data, sizeof(Sequence));
+        *pInOrder = *pInOrder && ((*pReceived == 0) || (Sequence > Last));
+        Last = Sequence;
+        (*pReceived)++;
+    }
+
+    return GetTime() - Start;
+
+}// DrainConn
+
+// Record a log of telemetry in TCP segment sized chunks, one chunk per millisecond
+static BOOL MakeLog(const char *pPath, UInt32 Packets)
+{
+    OrionLog_t *pLog = OrionLogCreate(pPath);
+    GeolocateTelemetryCore_t Core;
+    UInt8 Chunk[1460];
+    UInt32 Used = 0, i;
+    UInt64 TimeUs = 0;
+
+    if (pLog == NULL)
+        return FALSE;
+
+    memset(&Core, 0, sizeof(Core));
+
+    for (i = 0; i < Packets; i++)
+    {
+        OrionPkt_t Pkt;
+        UInt32 Size, j;
+
+        // Vary the telemetry a little so every packet is different
+        Core.systemTime = i;
+        Core.pan = (float)(i % 6283) * 1e-3f;
+        encodeGeolocateTelemetryCorePacketStructure(&Pkt, &Core);
+        Size = Pkt.Length + ORION_PKT_OVERHEAD;
+
+        // Pack it into the chunk, writing the chunk out whenever it fills up
+        for (j = 0; j < Size; j++)
+        {
+            Chunk[Used++] = ((UInt8 *)&Pkt)[j];
+            if (Used == sizeof(Chunk))
+            {
+                OrionLogWrite(pLog, TimeUs += 1000, Chunk, Used);
+                Used = 0;
+            }
+        }
+    }
+
+    // Write out whatever's left over
+    if (Used > 0)
+        OrionLogWrite(pLog, TimeUs + 1000, Chunk, Used);
+
+    OrionLogClose(pLog);
+    return TRUE;
+
+}// MakeLog
+
+// Replay a log as fast as possible, decoding every telemetry packet with or without copying it, and return the time it took
+static double ReplayLog(const char *pPath, BOOL UseViews, PacketTally_t *pTally, UInt32 *pBytes, UInt32 *pDecoded)
+{
+    OrionConn_t *pConn = OrionConnOpenReplay(pPath, ORION_REPLAY_AFAP);
+    OrionCommRxStats_t Stats;
+    GeolocateTelemetry_t Geo;
+    double Start = GetTime(), Elapsed;
+    OrionPktView_t View;
+    OrionPkt_t Pkt;
+
+    if (pConn == NULL)
+        return -1;
+
+    // Pull every packet out of the log until the link goes down at the end of it
+    *pDecoded = 0;
+    while (OrionConnIsOpen(pConn))
+    {
+        // Either decode straight out of the receive buffer, or from a copy of each packet
+        while (UseViews ? OrionConnReceiveView(pConn, &View) : OrionConnReceive(pConn, &Pkt))
+        {
+            const OrionPkt_t *pPkt = UseViews ? View.pPkt : &Pkt;
+
+            TallyPacket(pTally, pPkt);
+            if ((pPkt->ID == ORION_PKT_GEOLOCATE_TELEMETRY) && DecodeGeolocateTelemetry(pPkt, &Geo))
+                (*pDecoded)++;
+        }
+    }
+
+    Elapsed = GetTime() - Start;
+
+    // Note how much data went through
+    OrionConnGetRxStats(pConn, &Stats, FALSE);
+    *pBytes = Stats.Bytes;
+    OrionConnClose(pConn);
+
+    return Elapsed;
+
+}// ReplayLog
+
+// qsort comparison function for doubles
+static int CompareDoubles(const void *pA, const void *pB)
+{
+    double A = *(const double *)pA, B = *(const double *)pB;
+    return (A > B) - (A < B);
+
+}// CompareDoubles
+
+// CPU time used by the whole process in seconds
+static double GetCpuTime(void)
+{
+    struct rusage Usage;
+
+    getrusage(RUSAGE_SELF, &Usage);
+    return Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec * 1e-6 + Usage.ru_stime.tv_sec + Usage.ru_stime.tv_usec * 1e-6;
+
+}// GetCpuTime
+
+// Monotonic time in seconds
+static double GetTime(void)
+{
+    struct timespec Now;
+
+    // Grab the monotonic clock and convert it to seconds
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return Now.tv_sec + Now.tv_nsec * 1e-9;
+
+}// GetTime
+
+// Load a raw capture of gimbal traffic from disk
+static UInt8 *LoadStream(const char *pPath, UInt32 *pLength)
+{
+    FILE *pFile = fopen(pPath, "rb");
+    UInt8 *pStream = NULL;
+    long Size;
+
+    // If the file won't open, tell the user
+    if (pFile == NULL)
+    {
+        printf("Failed to open %s\n", pPath);
+        return NULL;
+    }
+
+    // Figure out how big the file is, then read the whole thing in
+    fseek(pFile, 0, SEEK_END);
+    Size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    // Read the whole thing in one go
+    if ((Size > 0) && ((pStream = malloc(Size)) != NULL))
+        *pLength = (UInt32)fread(pStream, 1, Size, pFile);
+
+    fclose(pFile);
+    return pStream;
+
+}// LoadStream
+
+// Build a stream of valid packets mixed with line noise, bad checksums and bogus lengths
+static UInt8 *MakeStream(UInt32 Length)
+{
+    UInt8 *pStream = malloc(Length);
+    UInt32 i = 0, j;
+
+    // Make sure the allocation worked
+    if (pStream == NULL)
+        return NULL;
+
+    // Make the stream repeatable
+    srand(1);
+
+    while (i < Length)
+    {
+        OrionPkt_t Pkt;
+        UInt32 Size;
+        int Type = rand() % 16;
+
+        // Every so often, throw in a few bytes of junk (heavy on sync bytes)
+        if (Type == 0)
+        {
+            for (j = rand() % 8; (j > 0) && (i < Length); j--)
+                pStream[i++] = (rand() & 1) ? 0xD0 : (UInt8)rand();
+            continue;
+        }
+
+        // Otherwise build a real packet with random contents
+        for (j = 0; j < ORION_PKT_MAX_SIZE; j++)
+            Pkt.Data[j] = (UInt8)rand();
+        MakeOrionPacket(&Pkt, (UInt8)rand(), rand() % (ORION_PKT_MAX_SIZE + 1));
+        Size = Pkt.Length + ORION_PKT_OVERHEAD;
+
+        // Now and then corrupt a checksum or the length byte
+        if (Type == 1)
+            Pkt.Data[Pkt.Length + (rand() & 1)] ^= 0x55;
+        else if (Type == 2)
+            Pkt.Length = ORION_PKT_MAX_SIZE + 1 + rand() % 100;
+
+        // Copy as much of it as fits into the stream
+        for (j = 0; (j < Size) && (i < Length); j++)
+            pStream[i++] = ((UInt8 *)&Pkt)[j];
+    }
+
+    return pStream;
+
+}// MakeStream
+
+// Roll a packet into the running count and FNV-1a hash
+static void TallyPacket(PacketTally_t *pTally, const OrionPkt_t *pPkt)
+{
+    const UInt8 *pData = (const UInt8 *)pPkt;
+    int i;
+
+    // Hash the entire packet, including header and checksum
+    for (i = 0; i < pPkt->Length + ORION_PKT_OVERHEAD; i++)
+        pTally->Hash = (pTally->Hash ^ pData[i]) * 16777619u;
+
+    pTally->Count++;
+
+}// TallyPacket
+
+static BOOL TallyCallback(const TrilliumPkt_t *pPkt, void *pContext)
+{
+    // Tally the packet and keep going
+    TallyPacket((PacketTally_t *)pContext, pPkt);
+    return TRUE;
+
+}// TallyCallback
@@ -12,4 +12,6 @@ SUBDIRS += \
     UserData
 
 unix:SUBDIRS += \
+    Benchmark \
+    Simulator \
     VideoPlayer
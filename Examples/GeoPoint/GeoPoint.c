@@ -6,20 +6,17 @@
 #include <stdlib.h>
 #include <string.h>
 
-// Incoming and outgoing packet structures. Incoming structure *MUST* be persistent
-//  between calls to ProcessData.
+// Incoming and outgoing packet structures
 static OrionPkt_t PktIn, PktOut;
 
 // A few helper functions, etc.
 static void KillProcess(const char *pMessage, int Value);
 static void ProcessArgs(int argc, char **argv, double Pos[3], float Vel[3]);
-static BOOL ProcessData(void);
 
 int main(int argc, char **argv)
 {
     double TargetPosLla[] = { deg2rad(45.7), deg2rad(-121.5), 30.0 };
     float TargetVelNed[] = { 0.0, 0.0, 0.0 };
-    int WaitCount = 0;
 
     // Process the command line arguments
     ProcessArgs(argc, argv, TargetPosLla, TargetVelNed);
@@ -31,30 +28,14 @@ int main(int argc, char **argv)
     OrionCommSend(&PktOut);
 
     // Wait for confirmation from the gimbal, or 5 seconds - whichever comes first
-    while ((++WaitCount < 50) && (ProcessData() == FALSE)) usleep(100000);
-
-    // If we timed out waiting, tell the user and return an error code
-    if (WaitCount >= 50) KillProcess("Gimbal failed to respond", -1);
+    if (OrionCommWaitFor(&PktIn, ORION_PKT_GEOPOINT_CMD, 5000000) == FALSE)
+        KillProcess("Gimbal failed to respond", -1);
 
     // Done
     return 0;
 
 }// main
 
-static BOOL ProcessData(void)
-{
-    // Loop through any new incoming packets
-    while (OrionCommReceive(&PktIn))
-    {
-        // If this is a response to the command we just sent, return TRUE
-        if (PktIn.ID == ORION_PKT_GEOPOINT_CMD)
-            return TRUE;
-    }
-
-    return FALSE;
-
-}// ProcessData
-
 // This function just shuts things down consistently with a nice message for the user
 static void KillProcess(const char *pMessage, int Value)
 {
@@ -5,20 +5,17 @@
 #include <stdlib.h>
 #include <string.h>
 
-// Incoming and outgoing packet structures. Inco0ming structure *MUST* be persistent
-//  between calls to ProcessData.
+// Incoming and outgoing packet structures
 static OrionPkt_t PktIn, PktOut;
 
 // A few helper functions, etc.
 static void KillProcess(const char *pMessage, int Value);
 static void ProcessArgs(int argc, char **argv, double Pos[3], float Vel[3], float *pHeading);
-static BOOL ProcessData(void);
 
 int main(int argc, char **argv)
 {
     // Heading and estimated heading noise in radians
     float Heading = deg2radf(270.0f), HeadingNoise = deg2radf(3.0f);
-    int WaitCount = 0;
     GpsData_t Gps = { 0 };
 
     // Default latitude, longitude, and altitude. Note that lat/lon are double-precision
@@ -52,13 +49,8 @@ int main(int argc, char **argv)
     OrionCommSend(&PktOut);
 
     // Wait for confirmation from the gimbal, or 5 seconds - whichever comes first
-    while ((++WaitCount < 50) && (ProcessData() == FALSE)) usleep(100000);
-
-    // If we timed out waiting, tell the user and return an error code
-    if (WaitCount >= 50)
+    if (OrionCommWaitFor(&PktIn, PktOut.ID, 5000000) == FALSE)
         KillProcess("Gimbal failed to respond", -1);
-    else
-        WaitCount = 0;
 
     // Now form an external heading packet
     encodeOrionExtHeadingDataPacket(&PktOut, Heading, HeadingNoise, 0, 0, 0);
@@ -67,33 +59,14 @@ int main(int argc, char **argv)
     OrionCommSend(&PktOut);
 
     // Wait for confirmation from the gimbal, or 5 seconds - whichever comes first
-    while ((++WaitCount < 50) && (ProcessData() == FALSE)) usleep(100000);
-
-    // If we timed out waiting, tell the user and return an error code
-    if (WaitCount >= 50)
+    if (OrionCommWaitFor(&PktIn, PktOut.ID, 5000000) == FALSE)
         KillProcess("Gimbal failed to respond", -1);
-    else
-        WaitCount = 0;
 
     // Done
     return 0;
 
 }// main
 
-static BOOL ProcessData(void)
-{
-    // Loop through any new incoming packets
-    while (OrionCommReceive(&PktIn))
-    {
-        // If this is a response to the command we just sent, return TRUE
-        if (PktIn.ID == PktOut.ID)
-            return TRUE;
-    }
-
-    return FALSE;
-
-}// ProcessData
-
 // This function just shuts things down consistently with a nice message for the user
 static void KillProcess(const char *pMessage, int Value)
 {
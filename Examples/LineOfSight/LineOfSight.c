@@ -35,13 +35,13 @@ int main(int argc, char **argv)
     // Process the command line arguments
     ProcessArgs(argc, argv, &TileLevel);
 
-    // Loop forever
-    while (1)
+    // Loop until the link goes down (e.g. at the end of a recording)
+    while (OrionCommIsOpen())
     {
         GeolocateTelemetry_t Geo;
 
-        // Pull all queued up packets off the comm interface
-        while (OrionCommReceive(&PktIn))
+        // Pull packets off the comm interface, sleeping for up to 20 ms until each one arrives
+        while (OrionCommReceiveTimeout(&PktIn, 20000))
         {
             // If this packet is a geolocate telemetry packet
             if (DecodeGeolocateTelemetry(&PktIn, &Geo))
@@ -77,6 +77,7 @@ int main(int argc, char **argv)
                 {
                     // Let the user know that we didn't come up with a valid image location and move on
                     printf("TARGET LLA: %-44s\r", "INVALID");
+                    fflush(stdout);
                     continue;
                 }
 
@@ -86,12 +87,9 @@ int main(int argc, char **argv)
                        degrees(TargetLla[LON]),
                        TargetLla[ALT] - Geo.base.geoidUndulation,
                        Range);
+                fflush(stdout);
             }
         }
-
-        // Sleep for 20 ms so as not to hog the entire CPU
-        fflush(stdout);
-        usleep(20000);
     }
 
     // Finally, be done!
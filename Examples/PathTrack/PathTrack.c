@@ -29,11 +29,11 @@ int main(int argc, char **argv)
         encodeOrionPathPacketStructure(&PktOut, &Path);
         OrionCommSend(&PktOut);
 
-        // Now just loop forever, looking for packets
-        while (1)
+        // Now just loop until the link goes down, looking for packets
+        while (OrionCommIsOpen())
         {
-            // Pull any pending packets off the comm port
-            while (OrionCommReceive(&PktIn))
+            // Pull packets off the comm port, sleeping for up to 20ms until each one arrives
+            while (OrionCommReceiveTimeout(&PktIn, 20000))
             {
                 GeolocateTelemetryCore_t Geo;
 
@@ -42,13 +42,10 @@ int main(int argc, char **argv)
                 {
                     // Print the current path segment information
                     printf("Path segment: from point %2d to point %2d (%3.0f%%), stare time = %.1f\r", Geo.pathFrom, Geo.pathTo, Geo.pathProgress * 100.0f, Geo.stareTime);
+                    fflush(stdout);
                 }
 
             }
-
-            // Give the rest of the system 20ms to work
-            fflush(stdout);
-            usleep(20000);
         }
     }
     // Path.numPoints is zero for some reason
@@ -0,0 +1,513 @@
+#include "OrionPublicPacket.h"
+#include "OrionCommEventLoop.h"
+#include "earthposition.h"
+#include "mathutilities.h"
+#include "Constants.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Maximum number of clients connected at once
+#define MAX_CLIENTS 1024
+
+// How often to look for new clients and discovery requests, in microseconds
+#define SERVICE_PERIOD_US 10000
+
+// Everything the simulated gimbal knows about itself
+typedef struct
+{
+    // Address to serve on, and the UDP discovery and TCP listening sockets
+    struct in_addr Address;
+    int UdpHandle;
+    int TcpHandle;
+
+    // Discovery socket shared with other simulators for broadcast requests, or -1
+    int BroadcastHandle;
+
+    // Connected clients
+    OrionConn_t *pClients[MAX_CLIENTS];
+    int ClientCount;
+
+    // Telemetry rates in Hz, and when the simulation started
+    double Rates[4];
+    double StartTime;
+
+    // Running totals for the status line
+    UInt32 PacketsOut;
+    UInt32 PacketsIn;
+} Simulator_t;
+
+// Telemetry streams, indexing Simulator_t.Rates
+enum
+{
+    STREAM_GEOLOCATE,
+    STREAM_GPS,
+    STREAM_PERFORMANCE,
+    STREAM_DIAGNOSTICS,
+    NUM_STREAMS
+};
+
+// A few helper functions, etc.
+static void KillProcess(const char *pMessage, int Value);
+static void ProcessArgs(int argc, char **argv, Simulator_t *pSim);
+static BOOL OpenSockets(Simulator_t *pSim);
+static void ServiceSockets(void *pContext);
+static void AnswerDiscovery(Simulator_t *pSim, int Handle);
+static void SendStream(Simulator_t *pSim, int Stream, OrionConn_t *pConn);
+static void SendGeolocate(void *pContext);
+static void SendGps(void *pContext);
+static void SendPerformance(void *pContext);
+static void SendDiagnostics(void *pContext);
+static void MakeVersion(OrionPkt_t *pPkt);
+static void MakeStream(Simulator_t *pSim, int Stream, OrionPkt_t *pPkt);
+static void Broadcast(Simulator_t *pSim, const OrionPkt_t *pPkt);
+static void HandlePacket(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext);
+static void HandleClose(OrionConn_t *pConn, void *pContext);
+static void PrintStatus(void *pContext);
+static void HandleSignal(int Signal);
+static double GetTime(void);
+
+// The event loop, which the signal handlers need to get at
+static OrionEventLoop_t *pLoop = NULL;
+
+// Set by SIGUSR1 to drop every client, for testing reconnects
+static volatile sig_atomic_t DropClients = 0;
+
+int main(int argc, char **argv)
+{
+    static const OrionTimerHandler_t Senders[NUM_STREAMS] = { SendGeolocate, SendGps, SendPerformance, SendDiagnostics };
+    Simulator_t Sim;
+    int i;
+
+    // Process the command line arguments
+    ProcessArgs(argc, argv, &Sim);
+
+    // Writes to clients that just hung up shouldn't kill us, and Ctrl-C should shut down cleanly
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    signal(SIGUSR1, HandleSignal);
+
+    // Set up the event loop and the discovery and server sockets
+    if ((pLoop = OrionEventLoopCreate()) == NULL)
+        KillProcess("Failed to create event loop", -1);
+    if (OpenSockets(&Sim) == FALSE)
+        KillProcess("Failed to open sockets", -1);
+
+    // Every client gets the same handlers
+    OrionEventLoopSetDefaultHandler(pLoop, HandlePacket, &Sim);
+    OrionEventLoopSetCloseHandler(pLoop, HandleClose, &Sim);
+
+    // Poll for new clients, print the status once a second and start each telemetry stream
+    OrionEventLoopAddTimer(pLoop, SERVICE_PERIOD_US, ServiceSockets, &Sim);
+    OrionEventLoopAddTimer(pLoop, 1000000, PrintStatus, &Sim);
+    for (i = 0; i < NUM_STREAMS; i++)
+    {
+        if (Sim.Rates[i] > 0)
+            OrionEventLoopAddTimer(pLoop, (UInt32)(1e6 / Sim.Rates[i]), Senders[i], &Sim);
+    }
+
+    printf("Simulating a gimbal on %s: telemetry %.0f Hz, GPS %.0f Hz, performance %.0f Hz, diagnostics %.0f Hz\n",
+           inet_ntoa(Sim.Address), Sim.Rates[STREAM_GEOLOCATE], Sim.Rates[STREAM_GPS], Sim.Rates[STREAM_PERFORMANCE], Sim.Rates[STREAM_DIAGNOSTICS]);
+    fflush(stdout);
+
+    // Run until we're told to stop
+    OrionEventLoopRun(pLoop);
+
+    // Hang up on everyone and shut down
+    for (i = 0; i < Sim.ClientCount; i++)
+        OrionConnClose(Sim.pClients[i]);
+    OrionEventLoopDestroy(pLoop);
+    close(Sim.UdpHandle);
+    if (Sim.BroadcastHandle >= 0)
+        close(Sim.BroadcastHandle);
+    close(Sim.TcpHandle);
+
+    printf("\n");
+    return 0;
+
+}// main
+
+// Open the UDP discovery and TCP server sockets on the chosen address
+static BOOL OpenSockets(Simulator_t *pSim)
+{
+    struct sockaddr_in Local;
+    int Reuse = 1;
+
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family = AF_INET;
+    Local.sin_addr = pSim->Address;
+
+    // Discovery requests come in on the port the SDK broadcasts to
+    pSim->UdpHandle = socket(AF_INET, SOCK_DGRAM, 0);
+    Local.sin_port = htons(UDP_OUT_PORT);
+    setsockopt(pSim->UdpHandle, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+    if ((pSim->UdpHandle < 0) || (bind(pSim->UdpHandle, (struct sockaddr *)&Local, sizeof(Local)) != 0))
+    {
+        perror("UDP bind");
+        return FALSE;
+    }
+
+    // Clients connect to the TCP port once they've found us
+    pSim->TcpHandle = socket(AF_INET, SOCK_STREAM, 0);
+    Local.sin_port = htons(TCP_PORT);
+    setsockopt(pSim->TcpHandle, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+    if ((pSim->TcpHandle < 0) || (bind(pSim->TcpHandle, (struct sockaddr *)&Local, sizeof(Local)) != 0) || (listen(pSim->TcpHandle, SOMAXCONN) != 0))
+    {
+        perror("TCP bind");
+        return FALSE;
+    }
+
+    // A socket bound to one address never sees broadcasts, so simulators on specific addresses
+    //  also share a wildcard socket; the kernel hands each broadcast to every socket sharing it
+    pSim->BroadcastHandle = -1;
+    if (pSim->Address.s_addr != htonl(INADDR_ANY))
+    {
+        pSim->BroadcastHandle = socket(AF_INET, SOCK_DGRAM, 0);
+        Local.sin_addr.s_addr = htonl(INADDR_ANY);
+        Local.sin_port = htons(UDP_OUT_PORT);
+        setsockopt(pSim->BroadcastHandle, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+        if ((pSim->BroadcastHandle < 0) || (bind(pSim->BroadcastHandle, (struct sockaddr *)&Local, sizeof(Local)) != 0))
+        {
+            perror("UDP broadcast bind");
+            return FALSE;
+        }
+        fcntl(pSim->BroadcastHandle, F_SETFL, O_NONBLOCK);
+    }
+
+    // These all get polled from a timer, so none of them can block
+    fcntl(pSim->UdpHandle, F_SETFL, O_NONBLOCK);
+    fcntl(pSim->TcpHandle, F_SETFL, O_NONBLOCK);
+
+    return TRUE;
+
+}// OpenSockets
+
+// Timer handler: answer discovery requests, accept new clients and drop clients if asked to
+static void ServiceSockets(void *pContext)
+{
+    Simulator_t *pSim = (Simulator_t *)pContext;
+    int Handle;
+
+    // Answer discovery requests, whether they were sent to us or broadcast
+    AnswerDiscovery(pSim, pSim->UdpHandle);
+    if (pSim->BroadcastHandle >= 0)
+        AnswerDiscovery(pSim, pSim->BroadcastHandle);
+
+    // Pick up any new clients
+    while ((Handle = accept(pSim->TcpHandle, NULL, NULL)) >= 0)
+    {
+        OrionConn_t *pConn;
+
+        // Turn away clients we don't have room for
+        if (pSim->ClientCount >= MAX_CLIENTS)
+        {
+            close(Handle);
+            continue;
+        }
+
+        // Wrap the socket in a connection and start servicing it
+        pConn = OrionConnOpenHandle(Handle);
+        if ((pConn != NULL) && OrionEventLoopAddConn(pLoop, pConn))
+            pSim->pClients[pSim->ClientCount++] = pConn;
+        else
+            OrionConnClose(pConn);
+    }
+
+    // SIGUSR1 hangs up on everyone so they have to reconnect
+    if (DropClients)
+    {
+        DropClients = 0;
+        while (pSim->ClientCount > 0)
+        {
+            OrionConn_t *pConn = pSim->pClients[--pSim->ClientCount];
+            OrionEventLoopRemoveConn(pLoop, pConn);
+            OrionConnClose(pConn);
+        }
+    }
+
+}// ServiceSockets
+
+// Reply to each discovery datagram waiting on a socket with our version, which is all the SDK
+//  needs to find us. Replies always go out from our own address so the client knows where we are.
+static void AnswerDiscovery(Simulator_t *pSim, int Handle)
+{
+    struct sockaddr_in From;
+    socklen_t Size = sizeof(From);
+    UInt8 Buffer[256];
+    OrionPkt_t Pkt;
+
+    while (recvfrom(Handle, Buffer, sizeof(Buffer), 0, (struct sockaddr *)&From, &Size) >= 0)
+    {
+        MakeVersion(&Pkt);
+        sendto(pSim->UdpHandle, &Pkt, Pkt.Length + ORION_PKT_OVERHEAD, 0, (struct sockaddr *)&From, Size);
+        Size = sizeof(From);
+    }
+
+}// AnswerDiscovery
+
+// Timer handlers for each telemetry stream
+static void SendGeolocate(void *pContext)    { SendStream((Simulator_t *)pContext, STREAM_GEOLOCATE, NULL); }
+static void SendGps(void *pContext)          { SendStream((Simulator_t *)pContext, STREAM_GPS, NULL); }
+static void SendPerformance(void *pContext)  { SendStream((Simulator_t *)pContext, STREAM_PERFORMANCE, NULL); }
+static void SendDiagnostics(void *pContext)  { SendStream((Simulator_t *)pContext, STREAM_DIAGNOSTICS, NULL); }
+
+// Build the current packet for a stream and send it to one client, or everyone if pConn is NULL
+static void SendStream(Simulator_t *pSim, int Stream, OrionConn_t *pConn)
+{
+    OrionPkt_t Pkt;
+
+    MakeStream(pSim, Stream, &Pkt);
+
+    if (pConn != NULL)
+    {
+        OrionConnSend(pConn, &Pkt);
+        pSim->PacketsOut++;
+    }
+    else
+        Broadcast(pSim, &Pkt);
+
+}// SendStream
+
+// Fill out the telemetry for one stream at the current point in the simulation
+static void MakeStream(Simulator_t *pSim, int Stream, OrionPkt_t *pPkt)
+{
+    double Time = GetTime() - pSim->StartTime;
+    double Lla[NLLA] = { deg2rad(45.7), deg2rad(-121.5), 1000.0 };
+
+    switch (Stream)
+    {
+    default:
+    case STREAM_GEOLOCATE:
+    {
+        GeolocateTelemetryCore_t Geo;
+
+        // Sit still, pan slowly around and look down 30 degrees
+        memset(&Geo, 0, sizeof(Geo));
+        Geo.systemTime = (uint32_t)(Time * 1000.0);
+        Geo.posLat = Lla[LAT];
+        Geo.posLon = Lla[LON];
+        Geo.posAlt = Lla[ALT];
+        Geo.gimbalQuat[0] = 1.0f;
+        Geo.insQuat[0] = 1.0f;
+        Geo.pan = (float)subtractAngles(deg2rad(10.0) * Time, 0);
+        Geo.tilt = (float)deg2rad(-30.0);
+        Geo.hfov = (float)deg2rad(20.0);
+        Geo.vfov = (float)deg2rad(15.0);
+        Geo.pixelWidth = 1280;
+        Geo.pixelHeight = 720;
+        Geo.mode = ORION_MODE_RATE;
+        encodeGeolocateTelemetryCorePacketStructure(pPkt, &Geo);
+        break;
+    }
+
+    case STREAM_GPS:
+    {
+        GpsData_t Gps;
+
+        // A solid 3D fix at the same place the gimbal thinks it is
+        memset(&Gps, 0, sizeof(Gps));
+        Gps.FixType = 3;
+        Gps.FixState = 1;
+        Gps.TrackedSats = 12;
+        Gps.PDOP = 1.2f;
+        Gps.Latitude = Lla[LAT];
+        Gps.Longitude = Lla[LON];
+        Gps.Altitude = Lla[ALT];
+        Gps.Hacc = 1.5f;
+        Gps.Vacc = 3.0f;
+        Gps.ITOW = (uint32_t)(Time * 1000.0);
+        Gps.valid3DFix = 1;
+        encodeGpsDataPacketStructure(pPkt, &Gps);
+        break;
+    }
+
+    case STREAM_PERFORMANCE:
+    {
+        OrionPerformance_t Perf;
+
+        // Small, steady stabilization errors
+        memset(&Perf, 0, sizeof(Perf));
+        Perf.RmsQuad[0] = Perf.RmsQuad[1] = 1e-5f;
+        Perf.RmsDir[0] = Perf.RmsDir[1] = 1e-5f;
+        Perf.Iout[0] = Perf.Iout[1] = 0.1f;
+        encodeOrionPerformancePacketStructure(pPkt, &Perf);
+        break;
+    }
+
+    case STREAM_DIAGNOSTICS:
+    {
+        OrionDiagnostics_t Diag;
+
+        // Healthy rails and warm boards
+        memset(&Diag, 0, sizeof(Diag));
+        Diag.Voltage24 = 24.0f;
+        Diag.Voltage12 = 12.0f;
+        Diag.Voltage3v3 = 3.3f;
+        Diag.Current24 = 1.5f;
+        Diag.CrownTemp = 40.0f;
+        Diag.GyroTemp = 45.0f;
+        encodeOrionDiagnosticsPacketStructure(pPkt, &Diag);
+        break;
+    }
+    }
+
+}// MakeStream
+
+// Build the version packet used to answer discovery and version requests
+static void MakeVersion(OrionPkt_t *pPkt)
+{
+    OrionCrownVersion_t Version;
+
+    memset(&Version, 0, sizeof(Version));
+    strcpy(Version.Version, "SIM-1.0");
+    strcpy(Version.PartNumber, "Simulator");
+    encodeOrionCrownVersionPacketStructure(pPkt, &Version);
+
+}// MakeVersion
+
+// Send a packet to every connected client
+static void Broadcast(Simulator_t *pSim, const OrionPkt_t *pPkt)
+{
+    int i;
+
+    for (i = 0; i < pSim->ClientCount; i++)
+        OrionConnSend(pSim->pClients[i], pPkt);
+
+    pSim->PacketsOut += pSim->ClientCount;
+
+}// Broadcast
+
+// Event loop handler: acknowledge incoming packets the way the gimbal does
+static void HandlePacket(OrionConn_t *pConn, const OrionPkt_t *pPkt, void *pContext)
+{
+    Simulator_t *pSim = (Simulator_t *)pContext;
+    OrionPkt_t Pkt;
+    int i;
+
+    pSim->PacketsIn++;
+
+    // Packets with data are commands or settings, which the gimbal echoes back once applied
+    if (pPkt->Length > 0)
+    {
+        memcpy(&Pkt, pPkt, pPkt->Length + ORION_PKT_OVERHEAD);
+        OrionConnSend(pConn, &Pkt);
+        pSim->PacketsOut++;
+        return;
+    }
+
+    // Empty packets are requests: answer the ones we know how to
+    if (pPkt->ID == ORION_PKT_CROWN_VERSION)
+    {
+        MakeVersion(&Pkt);
+        OrionConnSend(pConn, &Pkt);
+        pSim->PacketsOut++;
+    }
+    else
+    {
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            MakeStream(pSim, i, &Pkt);
+            if (Pkt.ID == pPkt->ID)
+            {
+                OrionConnSend(pConn, &Pkt);
+                pSim->PacketsOut++;
+                break;
+            }
+        }
+    }
+
+}// HandlePacket
+
+// Event loop close handler: forget about clients that hang up
+static void HandleClose(OrionConn_t *pConn, void *pContext)
+{
+    Simulator_t *pSim = (Simulator_t *)pContext;
+    int i;
+
+    // Find the client and fill its slot with the last one in the list
+    for (i = 0; i < pSim->ClientCount; i++)
+    {
+        if (pSim->pClients[i] == pConn)
+        {
+            pSim->pClients[i] = pSim->pClients[--pSim->ClientCount];
+            break;
+        }
+    }
+
+    OrionConnClose(pConn);
+
+}// HandleClose
+
+// Timer handler: print a status line once a second
+static void PrintStatus(void *pContext)
+{
+    Simulator_t *pSim = (Simulator_t *)pContext;
+
+    printf("Clients: %4d, packets out: %8u/s, packets in: %6u/s\r", pSim->ClientCount, pSim->PacketsOut, pSim->PacketsIn);
+    fflush(stdout);
+
+    pSim->PacketsOut = pSim->PacketsIn = 0;
+
+}// PrintStatus
+
+// Signal handler: stop the loop on SIGINT or SIGTERM, drop clients on SIGUSR1
+static void HandleSignal(int Signal)
+{
+    if (Signal == SIGUSR1)
+        DropClients = 1;
+    else
+        OrionEventLoopStop(pLoop);
+
+}// HandleSignal
+
+// Monotonic time in seconds
+static double GetTime(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return Now.tv_sec + Now.tv_nsec * 1e-9;
+
+}// GetTime
+
+// This function just shuts things down consistently with a nice message for the user
+static void KillProcess(const char *pMessage, int Value)
+{
+    // Print out the error message that got us here
+    printf("%s\n", pMessage);
+    fflush(stdout);
+
+    // Finally exit with the proper return value
+    exit(Value);
+
+}// KillProcess
+
+static void ProcessArgs(int argc, char **argv, Simulator_t *pSim)
+{
+    static const double DefaultRates[NUM_STREAMS] = { 10.0, 5.0, 10.0, 1.0 };
+    int i;
+
+    // Start from scratch, serving on every interface at the default rates
+    memset(pSim, 0, sizeof(*pSim));
+    pSim->Address.s_addr = htonl(INADDR_ANY);
+    memcpy(pSim->Rates, DefaultRates, sizeof(DefaultRates));
+    pSim->StartTime = GetTime();
+
+    // The first argument, if there is one, is the address to serve on
+    if ((argc >= 2) && (inet_pton(AF_INET, argv[1], &pSim->Address) != 1))
+        KillProcess("USAGE: Simulator [address] [telemetry Hz] [GPS Hz] [performance Hz] [diagnostics Hz]", -1);
+
+    // The rest are the telemetry rates, in order
+    for (i = 0; (i < NUM_STREAMS) && (i + 2 < argc); i++)
+        pSim->Rates[i] = atof(argv[i + 2]);
+
+}// ProcessArgs
@@ -0,0 +1,246 @@
+#include "ClockSync.h"
+
+#include <math.h>
+#include <string.h>
+
+//! Largest backward step in systemTime that isn't taken to mean the gimbal rebooted, in milliseconds
+#define CLOCK_SYNC_MAX_BACKSTEP 1000
+
+static void restartClockSync(ClockSync_t *pSync, UInt32 SystemTimeMs, UInt64 HostTimeUs);
+static void addClockSyncBlock(ClockSync_t *pSync, const ClockSyncPoint_t *pPoint);
+static void fitClockSync(ClockSync_t *pSync);
+
+
+/*!
+ * Reset a clock estimator to know nothing
+ * \param pSync is the estimator to reset
+ */
+void InitClockSync(ClockSync_t *pSync)
+{
+    memset(pSync, 0, sizeof(ClockSync_t));
+    pSync->Slope = 1.0;
+
+}// InitClockSync
+
+
+/*!
+ * Add a gimbal systemTime and the host time its packet arrived at to a clock
+ * estimator. Call this for every packet that carries a systemTime, such as
+ * GEOLOCATE_TELEMETRY, with the packet's arrival time.
+ * \param pSync is the estimator to update
+ * \param SystemTimeMs is the gimbal's systemTime from the packet, in milliseconds
+ * \param HostTimeUs is the host time the packet arrived at, in microseconds
+ * \return TRUE if the estimator can convert times
+ */
+BOOL UpdateClockSync(ClockSync_t *pSync, UInt32 SystemTimeMs, UInt64 HostTimeUs)
+{
+    ClockSyncPoint_t Point;
+    double Score;
+    SInt32 Delta;
+
+    // The first sample sets the base that everything else is measured from
+    if (pSync->Samples++ == 0)
+        restartClockSync(pSync, SystemTimeMs, HostTimeUs);
+    // If the gimbal's clock went backwards it rebooted, so start over
+    else if ((SInt32)(SystemTimeMs - pSync->LastMs) < -CLOCK_SYNC_MAX_BACKSTEP)
+    {
+        pSync->Resets++;
+        restartClockSync(pSync, SystemTimeMs, HostTimeUs);
+    }
+
+    // Unwrap systemTime to 64 bits, remembering the latest time seen
+    Delta = (SInt32)(SystemTimeMs - pSync->LastMs);
+    Point.GimbalUs = (double)(pSync->LastExtMs + Delta - pSync->BaseMs) * 1000.0;
+    Point.HostUs = (double)(SInt64)(HostTimeUs - pSync->BaseHostUs);
+    if (Delta > 0)
+    {
+        pSync->LastMs = SystemTimeMs;
+        pSync->LastExtMs += Delta;
+    }
+
+    // Once the block is over, its earliest sample goes into the fit and this one starts the next block
+    if ((pSync->BlockCount > 0) && (pSync->LastExtMs >= pSync->BlockEndMs))
+    {
+        pSync->BlockCount = 0;
+        addClockSyncBlock(pSync, &pSync->BlockBest);
+    }
+
+    if (pSync->BlockCount == 0)
+        pSync->BlockEndMs = pSync->LastExtMs + CLOCK_SYNC_BLOCK;
+
+    // Latency only ever makes a packet late, so keep the earliest sample of the block against the current fit
+    Score = Point.HostUs - pSync->Slope * Point.GimbalUs;
+    if ((pSync->BlockCount++ == 0) || (Score < pSync->BlockScore))
+    {
+        pSync->BlockBest = Point;
+        pSync->BlockScore = Score;
+    }
+
+    return pSync->Valid;
+
+}// UpdateClockSync
+
+
+/*!
+ * Convert a gimbal systemTime to the host clock
+ * \param pSync is the estimator to use
+ * \param SystemTimeMs is the gimbal's systemTime, in milliseconds
+ * \return the matching host time in microseconds, or 0 if the estimator isn't valid yet
+ */
+UInt64 OrionTimeToHost(const ClockSync_t *pSync, UInt32 SystemTimeMs)
+{
+    SInt64 ExtMs = pSync->LastExtMs + (SInt32)(SystemTimeMs - pSync->LastMs);
+    double HostUs;
+
+    if (pSync->Valid == FALSE)
+        return 0;
+
+    // Put the time on the fitted line, relative to the base
+    HostUs = pSync->Offset + pSync->Slope * (double)(ExtMs - pSync->BaseMs) * 1000.0;
+    return (UInt64)((SInt64)pSync->BaseHostUs + (SInt64)floor(HostUs + 0.5));
+
+}// OrionTimeToHost
+
+
+/*!
+ * Convert a host time to the gimbal's systemTime
+ * \param pSync is the estimator to use
+ * \param HostTimeUs is the host time, in microseconds
+ * \return the matching gimbal systemTime in milliseconds, or 0 if the estimator isn't valid yet
+ */
+UInt32 HostToOrionTime(const ClockSync_t *pSync, UInt64 HostTimeUs)
+{
+    double GimbalUs;
+
+    if (pSync->Valid == FALSE)
+        return 0;
+
+    // Invert the fitted line, then round to the nearest millisecond
+    GimbalUs = ((double)(SInt64)(HostTimeUs - pSync->BaseHostUs) - pSync->Offset) / pSync->Slope;
+    return (UInt32)(pSync->BaseMs + (SInt64)floor(GimbalUs / 1000.0 + 0.5));
+
+}// HostToOrionTime
+
+
+/*!
+ * Throw away everything the estimator knows and start again from one sample
+ * \param pSync is the estimator to restart
+ * \param SystemTimeMs is the gimbal's systemTime that becomes the base
+ * \param HostTimeUs is the host time that becomes the base
+ */
+static void restartClockSync(ClockSync_t *pSync, UInt32 SystemTimeMs, UInt64 HostTimeUs)
+{
+    // Everything is measured relative to this sample from now on
+    pSync->BaseMs = pSync->LastExtMs = SystemTimeMs;
+    pSync->LastMs = SystemTimeMs;
+    pSync->BaseHostUs = HostTimeUs;
+
+    // No fit, no blocks, and no drift until there's enough data to say otherwise
+    pSync->Valid = FALSE;
+    pSync->Offset = 0;
+    pSync->Slope = 1.0;
+    pSync->DriftPpm = 0;
+    pSync->ResidualUs = 0;
+    pSync->BlockCount = 0;
+    pSync->Head = pSync->Count = 0;
+    pSync->RunOfOutliers = 0;
+
+}// restartClockSync
+
+
+/*!
+ * Add one block minimum to the sliding window and refit, unless it's an outlier
+ * \param pSync is the estimator to update
+ * \param pPoint is the earliest sample of the block
+ */
+static void addClockSyncBlock(ClockSync_t *pSync, const ClockSyncPoint_t *pPoint)
+{
+    // Compare the new point to the line through the window
+    if (pSync->Count > 0)
+    {
+        double Error = pPoint->HostUs - (pSync->Offset + pSync->Slope * pPoint->GimbalUs);
+        double Gate = 5 * pSync->ResidualUs;
+
+        if (Gate < CLOCK_SYNC_MIN_GATE)
+            Gate = CLOCK_SYNC_MIN_GATE;
+
+        // Far from the line: either a block where every packet was held up, or the clock jumped
+        if (fabs(Error) > Gate)
+        {
+            pSync->Outliers++;
+
+            // A few in a row means the old line is no good any more
+            if (++pSync->RunOfOutliers < CLOCK_SYNC_MAX_OUTLIERS)
+                return;
+
+            pSync->Resets++;
+            pSync->Head = pSync->Count = 0;
+        }
+
+        pSync->RunOfOutliers = 0;
+    }
+
+    // Put the point into the window, pushing out the oldest one once it's full
+    pSync->Points[pSync->Head] = *pPoint;
+    pSync->Head = (pSync->Head + 1) % CLOCK_SYNC_WINDOW;
+    if (pSync->Count < CLOCK_SYNC_WINDOW)
+        pSync->Count++;
+
+    fitClockSync(pSync);
+    pSync->Valid = TRUE;
+
+}// addClockSyncBlock
+
+
+/*!
+ * Fit a least squares line through the block minima in the window
+ * \param pSync is the estimator to fit
+ */
+static void fitClockSync(ClockSync_t *pSync)
+{
+    double MeanX = 0, MeanY = 0, Sxx = 0, Sxy = 0, Residual = 0;
+    UInt32 i;
+
+    // Center the points first, which keeps the sums well conditioned however long we've been running
+    for (i = 0; i < pSync->Count; i++)
+    {
+        MeanX += pSync->Points[i].GimbalUs;
+        MeanY += pSync->Points[i].HostUs;
+    }
+
+    MeanX /= pSync->Count;
+    MeanY /= pSync->Count;
+
+    for (i = 0; i < pSync->Count; i++)
+    {
+        double dX = pSync->Points[i].GimbalUs - MeanX;
+
+        Sxx += dX * dX;
+        Sxy += dX * (pSync->Points[i].HostUs - MeanY);
+    }
+
+    // Only estimate drift once the window spans enough time to measure it, and keep it believable
+    pSync->Slope = 1.0;
+    if ((pSync->Count >= CLOCK_SYNC_MIN_FIT) && (Sxx > 0))
+    {
+        double Drift = Sxy / Sxx - 1.0;
+
+        if (Drift > CLOCK_SYNC_MAX_DRIFT * 1e-6)
+            Drift = CLOCK_SYNC_MAX_DRIFT * 1e-6;
+        else if (Drift < -CLOCK_SYNC_MAX_DRIFT * 1e-6)
+            Drift = -CLOCK_SYNC_MAX_DRIFT * 1e-6;
+
+        pSync->Slope = 1.0 + Drift;
+    }
+
+    // The line goes through the middle of the points
+    pSync->Offset = MeanY - pSync->Slope * MeanX;
+    pSync->DriftPpm = (pSync->Slope - 1.0) * 1e6;
+
+    // Average distance of the points from the line, which sets how far out an outlier has to be
+    for (i = 0; i < pSync->Count; i++)
+        Residual += fabs(pSync->Points[i].HostUs - (pSync->Offset + pSync->Slope * pSync->Points[i].GimbalUs));
+
+    pSync->ResidualUs = Residual / pSync->Count;
+
+}// fitClockSync
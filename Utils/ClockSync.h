@@ -0,0 +1,127 @@
+/*!
+ *  \file ClockSync.h
+ *  \brief Map the gimbal's clock onto the host's clock.
+ *
+ *  Telemetry from the gimbal is stamped with its systemTime, in milliseconds
+ *  since the gimbal booted. This module estimates the offset and drift
+ *  between that clock and a host clock (typically the arrival timestamps
+ *  from OrionConnGetRxTimeUs), so gimbal data can be lined up with video
+ *  frames and other sensors. Feed it one (systemTime, arrival time) pair per
+ *  packet with UpdateClockSync(), then convert times in either direction
+ *  with OrionTimeToHost() and HostToOrionTime().
+ *
+ *  Link latency only ever makes a packet late, so the samples are split into
+ *  one second blocks and only the earliest sample of each block (relative to
+ *  the current fit) is kept. A least squares line is fitted through the block
+ *  minima in a sliding window, rejecting blocks that land far from the line,
+ *  such as those where every packet was held up behind a stalled reader.
+ *  Each update costs a constant amount of work. The converted times include
+ *  the link's minimum latency, which can't be told apart from clock offset
+ *  by a one-way link. systemTime only counts whole milliseconds, so if the
+ *  gimbal's packets always go out at the same point within its millisecond
+ *  tick the conversions can be up to a millisecond late; any jitter in when
+ *  they go out lets the block minima find the start of the tick.
+ */
+
+#ifndef CLOCKSYNC_H_
+#define CLOCKSYNC_H_
+
+#include "Types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! Length of each block of samples, of which only the earliest is used, in gimbal milliseconds
+#define CLOCK_SYNC_BLOCK        1000
+
+//! Number of block minima in the sliding window the line is fitted through
+#define CLOCK_SYNC_WINDOW       64
+
+//! Number of block minima needed before the drift is estimated, rather than assumed to be zero
+#define CLOCK_SYNC_MIN_FIT      8
+
+//! Largest drift believed between the two clocks, in parts per million
+#define CLOCK_SYNC_MAX_DRIFT    500.0
+
+//! Smallest distance from the line, in microseconds, at which a block is rejected as an outlier
+#define CLOCK_SYNC_MIN_GATE     2000.0
+
+//! Number of outliers in a row that are taken to mean the gimbal's clock jumped
+#define CLOCK_SYNC_MAX_OUTLIERS 3
+
+//! One block minimum: gimbal time in microseconds and host time in microseconds, relative to the base
+typedef struct
+{
+    double GimbalUs;
+    double HostUs;
+} ClockSyncPoint_t;
+
+//! Estimator state for one gimbal's clock
+typedef struct
+{
+    //! TRUE once times can be converted
+    BOOL Valid;
+
+    //! How much faster the host clock runs than the gimbal clock, in parts per million
+    double DriftPpm;
+
+    //! Average distance of the block minima from the fitted line, in microseconds
+    double ResidualUs;
+
+    //! Number of samples fed to the estimator
+    UInt32 Samples;
+
+    //! Number of blocks rejected as outliers
+    UInt32 Outliers;
+
+    //! Number of times the estimator started over because the gimbal's clock jumped
+    UInt32 Resets;
+
+    // Data below this point are internal to the estimator
+
+    //! Gimbal time (milliseconds, unwrapped) and host time (microseconds) that the fit is relative to
+    SInt64 BaseMs;
+    UInt64 BaseHostUs;
+
+    //! The last systemTime fed in, and the same time unwrapped to 64 bits
+    UInt32 LastMs;
+    SInt64 LastExtMs;
+
+    //! Fitted line: host time = Offset + Slope * gimbal time, relative to the base
+    double Offset;
+    double Slope;
+
+    //! The block being filled: when it ends (gimbal milliseconds, unwrapped), and its earliest sample so far
+    SInt64 BlockEndMs;
+    UInt32 BlockCount;
+    double BlockScore;
+    ClockSyncPoint_t BlockBest;
+
+    //! Ring of block minima the line is fitted through
+    ClockSyncPoint_t Points[CLOCK_SYNC_WINDOW];
+    UInt32 Head;
+    UInt32 Count;
+
+    //! Number of blocks in a row that were rejected
+    UInt32 RunOfOutliers;
+
+}ClockSync_t;
+
+//! Reset a clock estimator to know nothing
+void InitClockSync(ClockSync_t *pSync);
+
+//! Add a gimbal systemTime and the host time its packet arrived at to a clock estimator
+BOOL UpdateClockSync(ClockSync_t *pSync, UInt32 SystemTimeMs, UInt64 HostTimeUs);
+
+//! Convert a gimbal systemTime to the host clock
+UInt64 OrionTimeToHost(const ClockSync_t *pSync, UInt32 SystemTimeMs);
+
+//! Convert a host time to the gimbal's systemTime
+UInt32 HostToOrionTime(const ClockSync_t *pSync, UInt64 HostTimeUs);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CLOCKSYNC_H_
@@ -22,6 +22,8 @@ typedef TrilliumPktInfo_t OrionPktInfo_t;
 // And they share the same basic parsing functions
 #define LookForOrionPacketInByte(a, b)      LookForTrilliumPacketInByte((TrilliumPkt_t *)a, ORION_SYNC, b)
 #define LookForOrionPacketInByteEx(a, b, c) LookForTrilliumPacketInByteEx((TrilliumPkt_t *)a, (TrilliumPktInfo_t *)b, ORION_SYNC, c)
+#define LookForOrionPacketsInBuffer(a, b, c, d, e) LookForTrilliumPacketsInBuffer((TrilliumPkt_t *)a, ORION_SYNC, b, c, d, e)
+#define LookForOrionPacketsInBufferEx(a, b, c, d, e, f) LookForTrilliumPacketsInBufferEx((TrilliumPkt_t *)a, ORION_SYNC, b, c, d, e, f)
 #define MakeOrionPacket(a, b, c)            MakeTrilliumPacket(a, ORION_SYNC, b, c)
 
 // Defines for backward compatibility. NOTE: THESE *WILL* BE DEPRECATED IN THE FUTURE
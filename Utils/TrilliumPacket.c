@@ -1,8 +1,32 @@
 #include "TrilliumPacket.h"
+#include <string.h>
+
+// Pick the widest vector checksum kernel this compiler is targeting
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define CHECKSUM_AVX2
+# define CHECKSUM_VECTOR_SIZE 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define CHECKSUM_SSE2
+# define CHECKSUM_VECTOR_SIZE 16
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define CHECKSUM_NEON
+# define CHECKSUM_VECTOR_SIZE 16
+#endif
+
+// Number of bytes that can be summed before the 32-bit checksum accumulators must be reduced mod 251
+#define CHECKSUM_BLOCK_MAX 4096
 
 // Running checksum calculation functions
 static void InitChecksum(UInt8 Byte, UInt16 *pA, UInt16 *pB);
 static void UpdateChecksum(UInt8 Byte, UInt16 *pA, UInt16 *pB);
+static BOOL ParseByte(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 Byte, TrilliumParseStats_t *pStats);
+
+#ifdef CHECKSUM_VECTOR_SIZE
+static void UpdateChecksumVector(const UInt8 *pData, UInt32 Chunks, UInt32 *pA, UInt32 *pB);
+#endif
 
 BOOL LookForTrilliumPacketInByteEx(TrilliumPkt_t *pPkt, TrilliumPktInfo_t *pInfo, UInt16 Sync, UInt8 Byte)
 {
@@ -75,10 +99,175 @@ BOOL LookForTrilliumPacketInByteEx(TrilliumPkt_t *pPkt, TrilliumPktInfo_t *pInfo
 
 }// LookForOrionPacketInByte
 
+/*!
+ * Scan a whole buffer of received data for packets. This produces exactly the same
+ * packets as feeding each byte to LookForTrilliumPacketInByteEx, but jumps straight
+ * to each candidate sync byte and validates complete packets in a single pass.
+ * Packets which straddle the end of the buffer are tracked in pPkt and completed
+ * by the next call.
+ * \param pPkt holds the parser state between calls; zero it before first use
+ * \param Sync is the two byte packet synchronization word
+ * \param pBuffer points to the received data
+ * \param Length is the number of bytes in pBuffer
+ * \param pCallback is called for each valid packet, may be NULL
+ * \param pContext is passed through to pCallback
+ * \return the number of bytes consumed, which is less than Length only if pCallback returned FALSE
+ */
+UInt32 LookForTrilliumPacketsInBuffer(TrilliumPkt_t *pPkt, UInt16 Sync, const UInt8 *pBuffer, UInt32 Length, TrilliumPktCallback_t pCallback, void *pContext)
+{
+    return LookForTrilliumPacketsInBufferEx(pPkt, Sync, pBuffer, Length, pCallback, pContext, NULL);
+
+}// LookForTrilliumPacketsInBuffer
+
+/*!
+ * Scan a whole buffer of received data for packets, exactly as LookForTrilliumPacketsInBuffer
+ * does, while counting the bytes and packets thrown away along the way. The counts come out
+ * the same however the data is split between calls.
+ * \param pPkt holds the parser state between calls; zero it before first use
+ * \param Sync is the two byte packet synchronization word
+ * \param pBuffer points to the received data
+ * \param Length is the number of bytes in pBuffer
+ * \param pCallback is called for each valid packet, may be NULL
+ * \param pContext is passed through to pCallback
+ * \param pStats has the parser's rejections added to it, may be NULL
+ * \return the number of bytes consumed, which is less than Length only if pCallback returned FALSE
+ */
+UInt32 LookForTrilliumPacketsInBufferEx(TrilliumPkt_t *pPkt, UInt16 Sync, const UInt8 *pBuffer, UInt32 Length, TrilliumPktCallback_t pCallback, void *pContext, TrilliumParseStats_t *pStats)
+{
+    UInt32 i = 0;
+
+    // If there's no parser state or data, we can't do this
+    if ((pPkt == NULL) || (pBuffer == NULL))
+        return 0;
+
+    // Keep going until we run out of data
+    while (i < Length)
+    {
+        const UInt8 *pStart;
+        UInt32 Remaining, Size;
+        UInt16 A = 1, B = 0;
+
+        // If a packet is already in progress, finish it up one byte at a time
+        if (pPkt->Info.State != 0)
+        {
+            // If this byte completes the packet, hand it to the user
+            if (ParseByte(pPkt, Sync, pBuffer[i++], pStats))
+            {
+                // Stop early if the user asks us to
+                if ((pCallback != NULL) && (pCallback(pPkt, pContext) == FALSE))
+                    break;
+            }
+
+            // Move on to the next byte
+            continue;
+        }
+
+        // Skip ahead to the next candidate for the first sync byte
+        pStart = (const UInt8 *)memchr(&pBuffer[i], (UInt8)(Sync >> 8), Length - i);
+
+        // If there isn't one, the rest of the buffer is junk
+        if (pStart == NULL)
+        {
+            if (pStats != NULL)
+                pStats->Discarded += Length - i;
+
+            return Length;
+        }
+
+        // Anything we skipped over is junk too
+        if (pStats != NULL)
+            pStats->Discarded += (UInt32)(pStart - &pBuffer[i]);
+
+        // Figure out where we are and how much data we have left to work with
+        i = (UInt32)(pStart - pBuffer);
+        Remaining = Length - i;
+
+        // If the header runs off the end of the buffer, let the state machine carry it over
+        if (Remaining < TRILLIUM_PKT_HEADER_SIZE)
+        {
+            ParseByte(pPkt, Sync, pBuffer[i++], pStats);
+            continue;
+        }
+
+        // Second sync byte mismatch: the state machine drops both bytes
+        if (pStart[1] != (UInt8)(Sync & 0xFF))
+        {
+            if (pStats != NULL)
+                pStats->Discarded += 2;
+
+            i += 2;
+            continue;
+        }
+
+        // Oversized length: the state machine drops the whole header
+        if (pStart[3] > TRILLIUM_PKT_MAX_SIZE)
+        {
+            if (pStats != NULL)
+            {
+                pStats->Discarded += TRILLIUM_PKT_HEADER_SIZE;
+                pStats->OversizeRejects++;
+            }
+
+            i += TRILLIUM_PKT_HEADER_SIZE;
+            continue;
+        }
+
+        // Total size of this packet on the wire
+        Size = pStart[3] + TRILLIUM_PKT_OVERHEAD;
+
+        // If the packet runs off the end of the buffer, let the state machine carry it over
+        if (Remaining < Size)
+        {
+            ParseByte(pPkt, Sync, pBuffer[i++], pStats);
+            continue;
+        }
+
+        // Run the checksum over the header and data in one go
+        UpdateTrilliumChecksum(pStart, Size - 2, &A, &B);
+
+        // First checksum byte mismatch: the state machine resyncs on the byte after it
+        if ((A & 0xFF) != pStart[Size - 2])
+        {
+            if (pStats != NULL)
+            {
+                pStats->Discarded += Size - 1;
+                pStats->ChecksumFailures++;
+            }
+
+            i += Size - 1;
+            continue;
+        }
+
+        // Either way this packet has been consumed
+        i += Size;
+
+        // If the second checksum byte doesn't check out, the whole packet is dropped
+        if ((B & 0xFF) != pStart[Size - 1])
+        {
+            if (pStats != NULL)
+            {
+                pStats->Discarded += Size;
+                pStats->ChecksumFailures++;
+            }
+        }
+        // Otherwise hand the packet over in place
+        else if (pCallback != NULL)
+        {
+            // Stop early if the user asks us to
+            if (pCallback((const TrilliumPkt_t *)pStart, pContext) == FALSE)
+                break;
+        }
+    }
+
+    // Tell the caller how much of the buffer we chewed through
+    return i;
+
+}// LookForTrilliumPacketsInBufferEx
+
 BOOL MakeTrilliumPacket(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 ID, UInt16 Length)
 {
     // Get a byte pointer to the start of the packet structure
-    UInt8 *pData = (UInt8 *)pPkt, i;
+    UInt8 *pData = (UInt8 *)pPkt;
 
     // If this is an invalid data length, return FALSE immediately
     if (Length > TRILLIUM_PKT_MAX_SIZE)
@@ -92,9 +281,8 @@ BOOL MakeTrilliumPacket(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 ID, UInt16 Lengt
     pPkt->Info.Check0 = 1;
     pPkt->Info.Check1 = 0;
 
-    // Roll each byte into the running checksum
-    for (i = 0; i < Length + TRILLIUM_PKT_HEADER_SIZE; i++)
-        UpdateChecksum(pData[i], &pPkt->Info.Check0, &pPkt->Info.Check1);
+    // Roll the header and data into the running checksum
+    UpdateTrilliumChecksum(pData, Length + TRILLIUM_PKT_HEADER_SIZE, &pPkt->Info.Check0, &pPkt->Info.Check1);
 
     // Negate the checksum and paste its bytes onto the end of the data payload
     pPkt->Data[Length++] = (UInt8)(pPkt->Info.Check0 & 0xFF);
@@ -105,6 +293,30 @@ BOOL MakeTrilliumPacket(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 ID, UInt16 Lengt
 
 }// MakeOrionPacket
 
+// Feed one byte to the state machine, counting whatever it throws away if it resets
+static BOOL ParseByte(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 Byte, TrilliumParseStats_t *pStats)
+{
+    UInt16 State = pPkt->Info.State;
+
+    // A finished packet, or one still in progress, has nothing to count
+    if (LookForTrilliumPacketInByte(pPkt, Sync, Byte))
+        return TRUE;
+    else if ((pStats == NULL) || (pPkt->Info.State != 0))
+        return FALSE;
+
+    // Otherwise the state machine threw away this byte and every byte of the packet before it
+    pStats->Discarded += State + 1;
+
+    // The fourth byte is the length, and any byte after the header that fails is a checksum byte
+    if (State == TRILLIUM_PKT_HEADER_SIZE - 1)
+        pStats->OversizeRejects++;
+    else if (State >= TRILLIUM_PKT_HEADER_SIZE)
+        pStats->ChecksumFailures++;
+
+    return FALSE;
+
+}// ParseByte
+
 static void InitChecksum(UInt8 Byte, UInt16 *pA, UInt16 *pB)
 {
     // For the first iteration, both checksum bytes should be equal
@@ -119,3 +331,164 @@ static void UpdateChecksum(UInt8 Byte, UInt16 *pA, UInt16 *pB)
     *pB = (*pB + *pA) % 251;
 
 }// UpdateChecksum
+
+/*!
+ * Roll a block of bytes into a running Fletcher-251 checksum. This gives the same
+ * result as updating the checksum one byte at a time, but only reduces modulo 251
+ * once every CHECKSUM_BLOCK_MAX bytes and uses a vector kernel where available.
+ * \param pData points to the bytes to checksum
+ * \param Length is the number of bytes in pData
+ * \param pA is the first running checksum value, updated in place
+ * \param pB is the second running checksum value, updated in place
+ */
+void UpdateTrilliumChecksum(const UInt8 *pData, UInt32 Length, UInt16 *pA, UInt16 *pB)
+{
+    // Start from reduced values so the accumulators can't overflow
+    UInt32 A = *pA % 251, B = *pB % 251;
+
+    // Work through the data one block at a time
+    while (Length > 0)
+    {
+        UInt32 Block = (Length < CHECKSUM_BLOCK_MAX) ? Length : CHECKSUM_BLOCK_MAX;
+
+        // Take this block off the total now
+        Length -= Block;
+
+#ifdef CHECKSUM_VECTOR_SIZE
+        // Let the vector kernel handle as many whole chunks as it can
+        if (Block >= CHECKSUM_VECTOR_SIZE)
+        {
+            UInt32 Chunks = Block / CHECKSUM_VECTOR_SIZE;
+
+            UpdateChecksumVector(pData, Chunks, &A, &B);
+            pData += Chunks * CHECKSUM_VECTOR_SIZE;
+            Block -= Chunks * CHECKSUM_VECTOR_SIZE;
+        }
+#endif // CHECKSUM_VECTOR_SIZE
+
+        // Pick up any leftover bytes without reducing
+        while (Block--)
+        {
+            A += *pData++;
+            B += A;
+        }
+
+        // Now bring both sums back into range
+        A %= 251;
+        B %= 251;
+    }
+
+    // Hand the results back
+    *pA = (UInt16)A;
+    *pB = (UInt16)B;
+
+}// UpdateTrilliumChecksum
+
+#ifdef CHECKSUM_VECTOR_SIZE
+/*!
+ * Vector checksum kernel. For each chunk of N bytes b[0..N-1], B gains N times the
+ * starting value of A plus the sum of (N - j) * b[j], and A gains the sum of b[j].
+ * The lanes accumulate the byte sums (S), the sums of S before each chunk (PS) and
+ * the weighted byte sums (W), which are only added across lanes at the very end.
+ * \param pData points to the bytes to checksum
+ * \param Chunks is the number of CHECKSUM_VECTOR_SIZE byte chunks in pData
+ * \param pA is the first, unreduced, running checksum value
+ * \param pB is the second, unreduced, running checksum value
+ */
+static void UpdateChecksumVector(const UInt8 *pData, UInt32 Chunks, UInt32 *pA, UInt32 *pB)
+{
+    UInt32 i, S, PS, W;
+
+#if defined(CHECKSUM_AVX2)
+    const __m256i Weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1);
+    const __m256i Ones = _mm256_set1_epi16(1);
+    const __m256i Zero = _mm256_setzero_si256();
+    __m256i vS = Zero, vPS = Zero, vW = Zero;
+    __m128i Sum[3];
+
+    for (i = 0; i < Chunks; i++, pData += CHECKSUM_VECTOR_SIZE)
+    {
+        __m256i Bytes = _mm256_loadu_si256((const __m256i *)pData);
+
+        // Accumulate the running sums, then the byte sum and weighted byte sum of this chunk
+        vPS = _mm256_add_epi32(vPS, vS);
+        vS = _mm256_add_epi32(vS, _mm256_sad_epu8(Bytes, Zero));
+        vW = _mm256_add_epi32(vW, _mm256_madd_epi16(_mm256_maddubs_epi16(Bytes, Weights), Ones));
+    }
+
+    // Fold the upper and lower halves of each accumulator together
+    Sum[0] = _mm_add_epi32(_mm256_castsi256_si128(vS), _mm256_extracti128_si256(vS, 1));
+    Sum[1] = _mm_add_epi32(_mm256_castsi256_si128(vPS), _mm256_extracti128_si256(vPS, 1));
+    Sum[2] = _mm_add_epi32(_mm256_castsi256_si128(vW), _mm256_extracti128_si256(vW, 1));
+#elif defined(CHECKSUM_SSE2)
+    const __m128i WeightsLo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i WeightsHi = _mm_setr_epi16( 8,  7,  6,  5,  4,  3,  2, 1);
+    const __m128i Zero = _mm_setzero_si128();
+    __m128i vS = Zero, vPS = Zero, vW = Zero;
+    __m128i Sum[3];
+
+    for (i = 0; i < Chunks; i++, pData += CHECKSUM_VECTOR_SIZE)
+    {
+        __m128i Bytes = _mm_loadu_si128((const __m128i *)pData);
+
+        // Accumulate the running sums, then the byte sum and weighted byte sum of this chunk
+        vPS = _mm_add_epi32(vPS, vS);
+        vS = _mm_add_epi32(vS, _mm_sad_epu8(Bytes, Zero));
+        vW = _mm_add_epi32(vW, _mm_madd_epi16(_mm_unpacklo_epi8(Bytes, Zero), WeightsLo));
+        vW = _mm_add_epi32(vW, _mm_madd_epi16(_mm_unpackhi_epi8(Bytes, Zero), WeightsHi));
+    }
+
+    Sum[0] = vS;
+    Sum[1] = vPS;
+    Sum[2] = vW;
+#elif defined(CHECKSUM_NEON)
+    static const uint8_t WeightData[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    const uint8x8_t WeightsLo = vld1_u8(&WeightData[0]), WeightsHi = vld1_u8(&WeightData[8]);
+    uint32x4_t vS = vdupq_n_u32(0), vPS = vS, vW = vS;
+    uint32x2_t Sum[3];
+
+    for (i = 0; i < Chunks; i++, pData += CHECKSUM_VECTOR_SIZE)
+    {
+        uint8x16_t Bytes = vld1q_u8(pData);
+
+        // Accumulate the running sums, then the byte sum and weighted byte sum of this chunk
+        vPS = vaddq_u32(vPS, vS);
+        vS = vpadalq_u16(vS, vpaddlq_u8(Bytes));
+        vW = vpadalq_u16(vW, vmull_u8(vget_low_u8(Bytes), WeightsLo));
+        vW = vpadalq_u16(vW, vmull_u8(vget_high_u8(Bytes), WeightsHi));
+    }
+
+    // Fold the upper and lower halves of each accumulator together
+    Sum[0] = vadd_u32(vget_low_u32(vS), vget_high_u32(vS));
+    Sum[1] = vadd_u32(vget_low_u32(vPS), vget_high_u32(vPS));
+    Sum[2] = vadd_u32(vget_low_u32(vW), vget_high_u32(vW));
+#endif
+
+    // Add across the remaining lanes of each accumulator
+    for (i = 0; i < 3; i++)
+    {
+#if defined(CHECKSUM_NEON)
+        Sum[i] = vpadd_u32(Sum[i], Sum[i]);
+#else
+        Sum[i] = _mm_add_epi32(Sum[i], _mm_shuffle_epi32(Sum[i], _MM_SHUFFLE(1, 0, 3, 2)));
+        Sum[i] = _mm_add_epi32(Sum[i], _mm_shuffle_epi32(Sum[i], _MM_SHUFFLE(2, 3, 0, 1)));
+#endif
+    }
+
+#if defined(CHECKSUM_NEON)
+    S = vget_lane_u32(Sum[0], 0);
+    PS = vget_lane_u32(Sum[1], 0);
+    W = vget_lane_u32(Sum[2], 0);
+#else
+    S = (UInt32)_mm_cvtsi128_si32(Sum[0]);
+    PS = (UInt32)_mm_cvtsi128_si32(Sum[1]);
+    W = (UInt32)_mm_cvtsi128_si32(Sum[2]);
+#endif
+
+    // Roll the lane totals into the running checksum
+    *pB += CHECKSUM_VECTOR_SIZE * (Chunks * *pA + PS) + W;
+    *pA += S;
+
+}// UpdateChecksumVector
+#endif // CHECKSUM_VECTOR_SIZE
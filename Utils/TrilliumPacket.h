@@ -27,6 +27,19 @@ typedef struct
     TrilliumPktInfo_t Info;
 } TrilliumPkt_t;
 
+// Bytes and packets the buffer parser threw away while looking for valid packets
+typedef struct
+{
+    UInt32 Discarded;           // Bytes dropped while resynchronizing, including those of rejected packets
+    UInt32 ChecksumFailures;    // Complete packets dropped because their checksum didn't match
+    UInt32 OversizeRejects;     // Headers dropped because their length was over TRILLIUM_PKT_MAX_SIZE
+} TrilliumParseStats_t;
+
+// Called by LookForTrilliumPacketsInBuffer for each valid packet. The packet may point directly
+//  into the caller's buffer and is only valid for the duration of the call; its Info member must
+//  not be used. Return FALSE to stop scanning the buffer after this packet.
+typedef BOOL (*TrilliumPktCallback_t)(const TrilliumPkt_t *pPkt, void *pContext);
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -34,8 +47,13 @@ extern "C" {
 BOOL LookForTrilliumPacketInByteEx(TrilliumPkt_t *pPkt, TrilliumPktInfo_t *pInfo, UInt16 Sync, UInt8 Byte);
 #define LookForTrilliumPacketInByte(pPkt, Sync, Byte) LookForTrilliumPacketInByteEx(pPkt, &(pPkt)->Info, Sync, Byte)
 
+UInt32 LookForTrilliumPacketsInBuffer(TrilliumPkt_t *pPkt, UInt16 Sync, const UInt8 *pBuffer, UInt32 Length, TrilliumPktCallback_t pCallback, void *pContext);
+UInt32 LookForTrilliumPacketsInBufferEx(TrilliumPkt_t *pPkt, UInt16 Sync, const UInt8 *pBuffer, UInt32 Length, TrilliumPktCallback_t pCallback, void *pContext, TrilliumParseStats_t *pStats);
+
 BOOL MakeTrilliumPacket(TrilliumPkt_t *pPkt, UInt16 Sync, UInt8 Type, UInt16 Length);
 
+void UpdateTrilliumChecksum(const UInt8 *pData, UInt32 Length, UInt16 *pA, UInt16 *pB);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -10,7 +10,8 @@ TARGET = OrionUtils
 TEMPLATE = lib
 CONFIG += staticlib
 
-SOURCES += dcm.c \
+SOURCES += ClockSync.c \
+    dcm.c \
     earthposition.c \
     earthrotation.c \
     GpsDataReceive.c \
@@ -22,7 +23,8 @@ SOURCES += dcm.c \
     TrilliumPacket.c \
     WGS84.c
 
-HEADERS += dcm.h \
+HEADERS += ClockSync.h \
+    dcm.h \
     earthposition.h \
     earthrotation.h \
     GpsDataReceive.h \